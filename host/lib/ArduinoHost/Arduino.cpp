@@ -0,0 +1,417 @@
+// Arduino core classes and helpers for the host build
+#include <stdio.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <deque>
+#include <random>
+#include <string>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#include "Arduino.h"
+#include "ArduinoHost.h"
+
+// --- String ------------------------------------------------------------
+
+String::String(int value) : _s(std::to_string(value)) {}
+String::String(unsigned int value) : _s(std::to_string(value)) {}
+String::String(long value) : _s(std::to_string(value)) {}
+String::String(unsigned long value) : _s(std::to_string(value)) {}
+
+String::String(double value, unsigned int decimals)
+{
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", (int)decimals, value);
+    _s = buffer;
+}
+
+bool String::endsWith(const String& suffix) const
+{
+    return _s.length() >= suffix._s.length()
+           && _s.compare(_s.length() - suffix._s.length(), suffix._s.length(), suffix._s) == 0;
+}
+
+int String::indexOf(char c, unsigned int from) const
+{
+    size_t at = _s.find(c, from);
+    return at == std::string::npos ? -1 : (int)at;
+}
+
+int String::indexOf(const String& s, unsigned int from) const
+{
+    size_t at = _s.find(s._s, from);
+    return at == std::string::npos ? -1 : (int)at;
+}
+
+String String::substring(unsigned int from, unsigned int to) const
+{
+    if (from > to)
+    {
+        unsigned int t = from;
+        from = to;
+        to = t;
+    }
+    if (from >= _s.length()) return String();
+    return String(_s.substr(from, to - from));
+}
+
+void String::trim()
+{
+    size_t begin = 0;
+    while (begin < _s.length() && isspace((unsigned char)_s[begin])) begin++;
+    size_t end = _s.length();
+    while (end > begin && isspace((unsigned char)_s[end - 1])) end--;
+    _s = _s.substr(begin, end - begin);
+}
+
+void String::toLowerCase()
+{
+    for (size_t i = 0; i < _s.length(); i++) _s[i] = (char)tolower((unsigned char)_s[i]);
+}
+
+void String::toUpperCase()
+{
+    for (size_t i = 0; i < _s.length(); i++) _s[i] = (char)toupper((unsigned char)_s[i]);
+}
+
+long String::toInt() const
+{
+    return strtol(_s.c_str(), nullptr, 10);
+}
+
+float String::toFloat() const
+{
+    return (float)strtod(_s.c_str(), nullptr);
+}
+
+double String::toDouble() const
+{
+    return strtod(_s.c_str(), nullptr);
+}
+
+String operator+(const String& a, const String& b)
+{
+    String s(a);
+    s += b;
+    return s;
+}
+
+String operator+(const String& a, const char* b)
+{
+    String s(a);
+    s += b;
+    return s;
+}
+
+// --- Print / Stream ----------------------------------------------------
+
+size_t Print::write(const uint8_t* buffer, size_t size)
+{
+    size_t n = 0;
+    while (size-- > 0) n += write(*buffer++);
+    return n;
+}
+
+size_t Print::printf(const char* format, ...)
+{
+    char small[128];
+    va_list args;
+    va_start(args, format);
+    va_list copy;
+    va_copy(copy, args);
+    int length = vsnprintf(small, sizeof(small), format, copy);
+    va_end(copy);
+    if (length < 0)
+    {
+        va_end(args);
+        return 0;
+    }
+    size_t n;
+    if ((size_t)length < sizeof(small))
+    {
+        n = write((const uint8_t*)small, length);
+    }
+    else
+    {
+        std::string big(length + 1, '\0');
+        vsnprintf(&big[0], big.size(), format, args);
+        n = write((const uint8_t*)big.data(), length);
+    }
+    va_end(args);
+    return n;
+}
+
+static size_t printNumber(Print& p, unsigned long long value, int base, bool negative)
+{
+    if (base < 2) base = 10;
+    char buffer[66];
+    char* s = buffer + sizeof(buffer) - 1;
+    *s = '\0';
+    do
+    {
+        int digit = (int)(value % base);
+        *--s = (char)(digit < 10 ? '0' + digit : 'A' + digit - 10);
+        value /= base;
+    } while (value != 0);
+    if (negative) *--s = '-';
+    return p.write(s);
+}
+
+size_t Print::print(long value, int base)
+{
+    return print((long long)value, base);
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+    return printNumber(*this, value, base, false);
+}
+
+size_t Print::print(long long value, int base)
+{
+    if (base == 10 && value < 0) return printNumber(*this, 0ULL - (unsigned long long)value, 10, true);
+    return printNumber(*this, (unsigned long long)value, base, false);
+}
+
+size_t Print::print(unsigned long long value, int base)
+{
+    return printNumber(*this, value, base, false);
+}
+
+size_t Print::print(double value, int digits)
+{
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+    return write(buffer);
+}
+
+size_t Stream::readBytes(uint8_t* buffer, size_t length)
+{
+    size_t n = 0;
+    while (n < length && available() > 0)
+    {
+        int c = read();
+        if (c < 0) break;
+        buffer[n++] = (uint8_t)c;
+    }
+    return n;
+}
+
+// --- IPAddress ---------------------------------------------------------
+
+bool IPAddress::fromString(const char* address)
+{
+    unsigned int a, b, c, d;
+    char tail;
+    if (address == nullptr || sscanf(address, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) != 4) return false;
+    if (a > 255 || b > 255 || c > 255 || d > 255) return false;
+    *this = IPAddress(a, b, c, d);
+    return true;
+}
+
+String IPAddress::toString() const
+{
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+    return String(buffer);
+}
+
+size_t IPAddress::printTo(Print& p) const
+{
+    return p.print(toString());
+}
+
+// --- Serial ------------------------------------------------------------
+
+namespace
+{
+    struct Console
+    {
+        std::function<void(const char*, size_t)> out;
+        std::deque<char> in;
+    };
+
+    Console& console()
+    {
+        static Console* c = new Console();
+        return *c;
+    }
+}
+
+HardwareSerial Serial;
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size)
+{
+    Console& c = console();
+    if (c.out) c.out((const char*)buffer, size);
+    else fwrite(buffer, 1, size, stdout);
+    return size;
+}
+
+void HardwareSerial::flush()
+{
+    if (!console().out) fflush(stdout);
+}
+
+int HardwareSerial::available()
+{
+    return (int)console().in.size();
+}
+
+int HardwareSerial::read()
+{
+    Console& c = console();
+    if (c.in.empty()) return -1;
+    char ch = c.in.front();
+    c.in.pop_front();
+    return (uint8_t)ch;
+}
+
+int HardwareSerial::peek()
+{
+    Console& c = console();
+    return c.in.empty() ? -1 : (uint8_t)c.in.front();
+}
+
+void host::serialInput(const char* text)
+{
+    Console& c = console();
+    while (*text != '\0') c.in.push_back(*text++);
+}
+
+void host::setSerialOutput(std::function<void(const char* data, size_t length)> out)
+{
+    console().out = out;
+}
+
+// --- ESP ---------------------------------------------------------------
+
+EspClass ESP;
+
+namespace
+{
+    const uint32_t HEAP_SIZE = 320 * 1024;  // ESP32-C3 data RAM left to the application, roughly
+    uint64_t efuseMac = 0x0000a1b2c3d4e5f6ULL;
+    uint32_t minFreeHeap = HEAP_SIZE;
+    uint32_t cpuMhz = 160;
+
+    uint32_t heapUsed()
+    {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+        return (uint32_t)mallinfo2().uordblks;
+#else
+        return 0;
+#endif
+    }
+}
+
+uint32_t EspClass::getHeapSize()
+{
+    return HEAP_SIZE;
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+    uint32_t used = heapUsed();
+    uint32_t free = used < HEAP_SIZE ? HEAP_SIZE - used : 0;
+    if (free < minFreeHeap) minFreeHeap = free;
+    return free;
+}
+
+uint32_t EspClass::getMinFreeHeap()
+{
+    getFreeHeap();
+    return minFreeHeap;
+}
+
+uint32_t EspClass::getMaxAllocHeap()
+{
+    return getFreeHeap();
+}
+
+uint64_t EspClass::getEfuseMac()
+{
+    return efuseMac;
+}
+
+uint32_t EspClass::getCpuFreqMHz()
+{
+    return cpuMhz;
+}
+
+void EspClass::restart()
+{
+    fflush(stdout);
+    fprintf(stderr, "host: ESP.restart()\n");
+    exit(0);
+}
+
+void host::setEfuseMac(uint64_t mac)
+{
+    efuseMac = mac;
+}
+
+uint32_t getCpuFrequencyMhz()
+{
+    return cpuMhz;
+}
+
+bool setCpuFrequencyMhz(uint32_t mhz)
+{
+    cpuMhz = mhz;
+    return true;
+}
+
+// --- helpers -----------------------------------------------------------
+
+namespace
+{
+    std::mt19937& randomEngine()
+    {
+        static std::mt19937* engine = new std::mt19937(5489u);
+        return *engine;
+    }
+}
+
+long random(long howBig)
+{
+    if (howBig <= 0) return 0;
+    return (long)(randomEngine()() % (unsigned long)howBig);
+}
+
+long random(long howSmall, long howBig)
+{
+    if (howSmall >= howBig) return howSmall;
+    return howSmall + random(howBig - howSmall);
+}
+
+void randomSeed(unsigned long seed)
+{
+    if (seed != 0) randomEngine().seed((std::mt19937::result_type)seed);
+}
+
+#ifdef ARDUINO_HOST_STRLCPY
+extern "C" size_t strlcpy(char* dst, const char* src, size_t size)
+{
+    size_t length = strlen(src);
+    if (size > 0)
+    {
+        size_t n = length < size - 1 ? length : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return length;
+}
+
+extern "C" size_t strlcat(char* dst, const char* src, size_t size)
+{
+    size_t used = strnlen(dst, size);
+    if (used == size) return size + strlen(src);
+    return used + strlcpy(dst + used, src, size - used);
+}
+#endif
@@ -0,0 +1,103 @@
+#ifndef ARDUINO_HOST_H
+#define ARDUINO_HOST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+// Controls for the host build of the firmware (the [env:native] and [env:sim]
+// PlatformIO environments). The firmware runs unmodified against the Arduino
+// and ESP-IDF headers in this library; the tests and the simulator drive it
+// from here.
+//
+// Time is virtual. Each FreeRTOS task is a thread, but only one runs at a
+// time and the scheduler switches at the firmware's own scheduling points
+// (delay(), vTaskDelay(), ulTaskNotifyTake()). When every task is blocked
+// the clock jumps to the next deadline, firing the timer, RMT and scheduled
+// host events due on the way, so an hour of firmware runs in well under a
+// second and the same inputs always give the same run.
+namespace host
+{
+    // Virtual microseconds since boot (esp_timer_get_time())
+    int64_t now();
+
+    // Runs the firmware tasks until the virtual clock reaches now() + us.
+    // Called from the test (or simulator) thread, which counts as loopTask.
+    void run(int64_t us);
+
+    // With countHostTime(true) the host time spent running firmware code is
+    // added to the virtual clock, so the firmware's own timing metrics
+    // (stage durations, CPU per frame) measure this machine. Off by default.
+    void countHostTime(bool enable);
+
+    // Paces the virtual clock against the wall clock: 1.0 is real time,
+    // 1000.0 is a thousand times faster, 0 (the default) runs unpaced
+    void setSpeed(double speed);
+
+    // Sets the wall clock (time(), gettimeofday()) to usSinceEpoch now
+    void setEpochUs(int64_t usSinceEpoch);
+
+    // Calls fn at virtual time atUs, from whichever task is running then;
+    // returns an id for cancel()
+    uint32_t at(int64_t atUs, std::function<void()> fn);
+    void cancel(uint32_t id);
+
+    // GPIO. Listeners see every level change, whether from digitalWrite(),
+    // gpio_ll_set_level(), RMT playback or drivePin(). pinWrites() counts
+    // the CPU writes to a pin and pinToggles() the level changes.
+    typedef std::function<void(uint8_t pin, int level, int64_t atUs)> PinListener;
+    void onPinChange(PinListener listener);
+    void drivePin(uint8_t pin, int level); // an external signal; fires interrupts
+    int pinLevel(uint8_t pin);
+    uint32_t pinWrites(uint8_t pin);
+    uint32_t pinToggles(uint8_t pin);
+    void resetPinCounts();
+
+    // Console. Output goes to stdout unless redirected.
+    void serialInput(const char* text);
+    void setSerialOutput(std::function<void(const char* data, size_t length)> out);
+
+    // Chip identity (ESP.getEfuseMac())
+    void setEfuseMac(uint64_t mac);
+
+    // Network. The station connects instantly when enabled; addHost() maps a
+    // name for WiFi.hostByName() and MDNS.queryHost() ("grid.local" is
+    // queried as "grid").
+    void setWifiConnected(bool connected);
+    void addHost(const char* name, uint32_t ip);
+
+    // UDP (WiFiUDP) between the sockets of this process: each delivery
+    // arrives latencyUs after endPacket() and lossPercent of them are
+    // dropped at random (seeded, so runs repeat). Instant and lossless by
+    // default.
+    void setUdpLink(uint32_t latencyUs, uint8_t lossPercent);
+
+    // WebSocket servers inside the process, for the WebSocketsClient of the
+    // firmware. A client connects at its loop() while a server listens on
+    // its ip:port and is dropped when the server closes. Frames sent to it
+    // are queued and handed over at its next loop(); its own text frames go
+    // to onText, with its id to answer it alone. Pings are answered.
+    typedef std::function<void(uint32_t client, const char* text, size_t length)> WebSocketHandler;
+    void listenWebSocket(uint32_t ip, uint16_t port, WebSocketHandler onText = nullptr);
+    void closeWebSocket(uint32_t ip, uint16_t port);
+    // Returns the number of clients the frame was queued for
+    size_t webSocketSend(uint32_t ip, uint16_t port, const char* text, size_t length);
+    bool webSocketSendTo(uint32_t client, const char* text, size_t length);
+
+    // Real sockets, for the tools and tests of the host and to run the
+    // firmware against servers outside the process (tools/gridfreq_server.py).
+    // With useHostSockets(true), before setup(), a WebSocketsClient whose
+    // target has no server in the process connects to it over TCP, and each
+    // WebServer and WiFiServer listens on 127.0.0.1 at its port + portOffset
+    // (80 -> 8080). Accepted WiFiServer connections get the send buffer of
+    // lwIP, so a slow reader stalls the server's writes as soon as on the
+    // device. Pair it with setSpeed(1.0) when the peers keep the wall clock.
+    void useHostSockets(bool enable, uint16_t portOffset = 8000);
+
+    // Storage. LittleFS lives under dir (a fresh temporary directory by
+    // default); NVS is in memory.
+    void setDataDir(const char* dir);
+    void eraseNvs();
+}
+
+#endif
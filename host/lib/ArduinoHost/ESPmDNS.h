@@ -0,0 +1,22 @@
+#ifndef ESPMDNS_H
+#define ESPMDNS_H
+
+#include "Arduino.h"
+#include "IPAddress.h"
+
+esp_err_t mdns_init();
+void mdns_free();
+
+// Names resolve through host::addHost(); a miss waits out the timeout like
+// an unanswered query
+class MDNSResponder
+{
+public:
+    bool begin(const char* hostName);
+    void end() {}
+    IPAddress queryHost(const char* host, uint32_t timeoutMs = 2000);
+};
+
+extern MDNSResponder MDNS;
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef ESP_H
+#define ESP_H
+
+#include <stdint.h>
+
+// Chip information. The heap figures are the host heap in use taken from a
+// budget the size of the ESP32-C3 heap, so leaks and growth show up in the
+// firmware heap metrics.
+class EspClass
+{
+public:
+    uint32_t getHeapSize();
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getMaxAllocHeap();
+    uint64_t getEfuseMac();
+    const char* getChipModel() { return "ESP32-C3 (host)"; }
+    uint32_t getCpuFreqMHz();
+    void restart();
+};
+
+extern EspClass ESP;
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef FS_H
+#define FS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include "Stream.h"
+
+namespace fs
+{
+    class FileImpl;
+    typedef std::shared_ptr<FileImpl> FileImplPtr;
+
+    enum SeekMode
+    {
+        SeekSet = 0,
+        SeekCur = 1,
+        SeekEnd = 2
+    };
+
+    // A file on the host filesystem (see host::setDataDir())
+    class File : public Stream
+    {
+    public:
+        File(FileImplPtr impl = FileImplPtr()) : _impl(impl) {}
+
+        size_t write(uint8_t c) override;
+        size_t write(const uint8_t* buffer, size_t size) override;
+        using Print::write;
+        void flush() override;
+
+        int available() override;
+        int read() override;
+        int peek() override;
+        size_t read(uint8_t* buffer, size_t size);
+
+        bool seek(uint32_t pos, SeekMode mode = SeekSet);
+        size_t position() const;
+        size_t size() const;
+        void close();
+        operator bool() const { return _impl != nullptr; }
+        const char* path() const;
+
+    private:
+        FileImplPtr _impl;
+    };
+
+    class FS
+    {
+    public:
+        explicit FS(const char* mountPoint) : _mountPoint(mountPoint) {}
+
+        File open(const char* path, const char* mode = "r", bool create = false);
+        bool exists(const char* path);
+        bool remove(const char* path);
+        bool rename(const char* from, const char* to);
+        bool mkdir(const char* path);
+        bool rmdir(const char* path);
+
+    protected:
+        const char* _mountPoint;
+    };
+}
+
+using fs::FS;
+using fs::File;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+
+#endif
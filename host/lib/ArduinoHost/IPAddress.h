@@ -0,0 +1,31 @@
+#ifndef IPADDRESS_H
+#define IPADDRESS_H
+
+#include <stdint.h>
+#include "Printable.h"
+#include "WString.h"
+
+// IPv4 address, stored in network order like lwIP (the first octet in the
+// lowest byte), so the uint32_t conversion is an s_addr
+class IPAddress : public Printable
+{
+public:
+    IPAddress() : _address(0) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+        : _address((uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24)) {}
+    IPAddress(uint32_t address) : _address(address) {}
+
+    operator uint32_t() const { return _address; }
+    bool operator==(const IPAddress& other) const { return _address == other._address; }
+    bool operator!=(const IPAddress& other) const { return _address != other._address; }
+    uint8_t operator[](int index) const { return (uint8_t)(_address >> (8 * index)); }
+
+    bool fromString(const char* address);
+    String toString() const;
+    size_t printTo(Print& p) const override;
+
+private:
+    uint32_t _address;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef PREFERENCES_H
+#define PREFERENCES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "nvs.h"
+
+// Key-value namespace on top of nvs.h, as in the Arduino core
+class Preferences
+{
+public:
+    ~Preferences() { end(); }
+
+    bool begin(const char* name, bool readOnly = false);
+    void end();
+    bool clear();
+    bool remove(const char* key);
+
+    size_t putUChar(const char* key, uint8_t value);
+    size_t putUShort(const char* key, uint16_t value);
+    size_t putUInt(const char* key, uint32_t value);
+    size_t putString(const char* key, const char* value);
+    size_t putBytes(const char* key, const void* value, size_t length);
+
+    uint8_t getUChar(const char* key, uint8_t defaultValue = 0);
+    uint16_t getUShort(const char* key, uint16_t defaultValue = 0);
+    uint32_t getUInt(const char* key, uint32_t defaultValue = 0);
+    size_t getString(const char* key, char* value, size_t maxLength);
+    size_t getBytesLength(const char* key);
+    size_t getBytes(const char* key, void* buffer, size_t maxLength);
+
+private:
+    nvs_handle_t _handle = 0;
+    bool _started = false;
+    bool _readOnly = false;
+};
+
+#endif
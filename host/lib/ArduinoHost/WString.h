@@ -0,0 +1,59 @@
+#ifndef WSTRING_H
+#define WSTRING_H
+
+#include <stddef.h>
+#include <string>
+
+// Subset of the Arduino String, on std::string
+class String
+{
+public:
+    String(const char* s = "") : _s(s != nullptr ? s : "") {}
+    String(const char* s, size_t length) : _s(s, length) {}
+    String(const std::string& s) : _s(s) {}
+    explicit String(char c) : _s(1, c) {}
+    explicit String(int value);
+    explicit String(unsigned int value);
+    explicit String(long value);
+    explicit String(unsigned long value);
+    explicit String(double value, unsigned int decimals = 2);
+
+    const char* c_str() const { return _s.c_str(); }
+    size_t length() const { return _s.length(); }
+    bool isEmpty() const { return _s.empty(); }
+    char operator[](size_t index) const { return index < _s.length() ? _s[index] : '\0'; }
+
+    bool equals(const String& other) const { return _s == other._s; }
+    bool operator==(const String& other) const { return _s == other._s; }
+    bool operator==(const char* other) const { return _s == (other != nullptr ? other : ""); }
+    bool operator!=(const String& other) const { return !(*this == other); }
+    bool operator!=(const char* other) const { return !(*this == other); }
+
+    String& operator+=(const String& other) { _s += other._s; return *this; }
+    String& operator+=(const char* other) { if (other != nullptr) _s += other; return *this; }
+    String& operator+=(char c) { _s += c; return *this; }
+    bool concat(const char* other) { *this += other; return true; }
+    bool concat(char c) { *this += c; return true; }
+
+    bool startsWith(const String& prefix) const { return _s.compare(0, prefix._s.length(), prefix._s) == 0; }
+    bool endsWith(const String& suffix) const;
+    int indexOf(char c, unsigned int from = 0) const;
+    int indexOf(const String& s, unsigned int from = 0) const;
+    String substring(unsigned int from) const { return from < _s.length() ? String(_s.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const;
+    void trim();
+    void toLowerCase();
+    void toUpperCase();
+
+    long toInt() const;
+    float toFloat() const;
+    double toDouble() const;
+
+private:
+    std::string _s;
+};
+
+String operator+(const String& a, const String& b);
+String operator+(const String& a, const char* b);
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef WEBSERVER_H
+#define WEBSERVER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+
+typedef enum
+{
+    HTTP_ANY,
+    HTTP_GET,
+    HTTP_HEAD,
+    HTTP_POST,
+    HTTP_PUT,
+    HTTP_PATCH,
+    HTTP_DELETE,
+    HTTP_OPTIONS
+} HTTPMethod;
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define CONTENT_LENGTH_NOT_SET ((size_t)-2)
+
+// HTTP server with the ESP32 WebServer's handler API. Handlers and the
+// request they see (method, arguments) are real. With
+// host::useHostSockets() it listens on the loopback and handleClient()
+// answers a pending request, one per call, closing the connection after
+// it; otherwise it never finds a request and responses go nowhere.
+class WebServer
+{
+public:
+    typedef std::function<void(void)> THandlerFunction;
+
+    explicit WebServer(int port = 80) : _port(port) {}
+    ~WebServer() { stop(); }
+
+    void begin();
+    void stop();
+    void handleClient();
+
+    void on(const char* uri, THandlerFunction handler) { on(uri, HTTP_ANY, handler); }
+    void on(const char* uri, HTTPMethod method, THandlerFunction handler);
+    void onNotFound(THandlerFunction handler) { _notFound = handler; }
+
+    HTTPMethod method() const { return _method; }
+    String uri() const { return String(_uri); }
+    int args() const { return (int)_args.size(); }
+    String arg(int i) const;
+    String arg(const char* name) const;
+    String argName(int i) const;
+    bool hasArg(const char* name) const;
+
+    void sendHeader(const char* name, const char* value, bool first = false);
+    void setContentLength(size_t length) { _contentLength = length; }
+    void send(int code, const char* contentType = nullptr, const char* content = "");
+    void send(int code, const char* contentType, const String& content) { send(code, contentType, content.c_str()); }
+    void send_P(int code, PGM_P contentType, PGM_P content) { send(code, contentType, content); }
+    void sendContent(const char* content, size_t length);
+    void sendContent(const String& content) { sendContent(content.c_str(), content.length()); }
+
+private:
+    struct Route
+    {
+        std::string uri;
+        HTTPMethod method;
+        THandlerFunction handler;
+    };
+    struct Arg
+    {
+        std::string name;
+        std::string value;
+    };
+
+    WebServer(const WebServer&);
+    WebServer& operator=(const WebServer&);
+    bool readRequest(int fd);
+    void addArgs(const std::string& query);
+    void write(const char* data, size_t length);
+
+    int _port;
+    bool _started = false;
+    std::vector<Route> _routes;
+    THandlerFunction _notFound;
+    HTTPMethod _method = HTTP_GET;
+    std::string _uri;
+    std::vector<Arg> _args;
+    size_t _contentLength = CONTENT_LENGTH_NOT_SET;
+    int _listenFd = -1;
+    int _clientFd = -1;        // the request being answered
+    std::string _headers;      // of the next response
+    bool _chunked = false;     // response of unknown length, not finished
+};
+
+#endif
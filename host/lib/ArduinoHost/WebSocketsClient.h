@@ -0,0 +1,86 @@
+#ifndef WEBSOCKETS_CLIENT_H
+#define WEBSOCKETS_CLIENT_H
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <utility>
+#include "Arduino.h"
+
+typedef enum
+{
+    WStype_ERROR,
+    WStype_DISCONNECTED,
+    WStype_CONNECTED,
+    WStype_TEXT,
+    WStype_BIN,
+    WStype_FRAGMENT_TEXT_START,
+    WStype_FRAGMENT_BIN_START,
+    WStype_FRAGMENT,
+    WStype_FRAGMENT_FIN,
+    WStype_PING,
+    WStype_PONG
+} WStype_t;
+
+// WebSocket client with the links2004 WebSockets API. It reaches the
+// servers of the process (host::listenWebSocket()): loop() connects while
+// one listens on the target, every reconnect interval otherwise, and
+// passes the queued frames and pongs to the event handler. With
+// host::useHostSockets() a target without a server in the process is
+// reached over TCP instead, with the client side of RFC 6455 (handshake,
+// masked frames, pings, fragments, the 15 KB frame limit of the ESP32
+// build). Without either the client stays disconnected.
+class WebSocketsClient
+{
+public:
+    typedef std::function<void(WStype_t type, uint8_t* payload, size_t length)> WebSocketClientEvent;
+
+    WebSocketsClient();
+    ~WebSocketsClient();
+
+    void begin(const char* host, uint16_t port, const char* url = "/", const char* protocol = "arduino");
+    void begin(IPAddress host, uint16_t port, const char* url = "/", const char* protocol = "arduino");
+    void onEvent(WebSocketClientEvent event) { _event = event; }
+    void setReconnectInterval(unsigned long ms) { _reconnectIntervalMs = ms; }
+    void disconnect();
+    void loop();
+
+    bool sendTXT(const char* payload, size_t length = 0);
+    bool sendTXT(const String& payload) { return sendTXT(payload.c_str(), payload.length()); }
+    bool sendPing(const char* payload = nullptr, size_t length = 0);
+    bool isConnected() const { return _connected; }
+
+    // Host side, see host::webSocketSendTo()
+    uint32_t id() const { return _id; }
+    bool serves(std::pair<uint32_t, uint16_t> server) const;
+    void deliver(const char* text, size_t length);
+    void drop();
+
+private:
+    WebSocketsClient(const WebSocketsClient&);
+    WebSocketsClient& operator=(const WebSocketsClient&);
+
+    // TCP connection of host::useHostSockets()
+    bool openSocket(IPAddress ip);
+    void receive();
+    void handleFrames();
+    void handleFrame(bool fin, uint8_t opcode, std::string& payload);
+    bool sendFrame(uint8_t opcode, const char* payload, size_t length);
+
+    uint32_t _id;
+    WebSocketClientEvent _event;
+    std::string _host;
+    uint16_t _port = 0;
+    std::string _url;
+    unsigned long _reconnectIntervalMs = 500;
+    bool _begun = false;
+    bool _connected = false;
+    bool _attempted = false;
+    unsigned long _lastAttemptMs = 0;
+    uint32_t _pongsDue = 0;
+    std::deque<std::string> _inbox;
+    int _fd = -1;
+    std::string _received;     // bytes of the frames not complete yet
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef WIFI_H
+#define WIFI_H
+
+#include "Arduino.h"
+#include "IPAddress.h"
+#include "WiFiClient.h"
+#include "WiFiServer.h"
+#include "WiFiUdp.h"
+
+typedef enum
+{
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3
+} wifi_mode_t;
+
+typedef enum
+{
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+// Station and soft AP. The station "connects" as soon as begin() is called
+// with an SSID while host::setWifiConnected(true) (the default) holds.
+class WiFiClass
+{
+public:
+    bool mode(wifi_mode_t mode) { _mode = mode; return true; }
+    wifi_mode_t getMode() const { return _mode; }
+    wl_status_t begin(const char* ssid, const char* password = nullptr);
+    bool disconnect(bool wifiOff = false);
+    wl_status_t status();
+    bool setSleep(bool enable) { _sleep = enable; return true; }
+    bool getSleep() const { return _sleep; }
+
+    IPAddress localIP();
+    bool softAP(const char* ssid, const char* password = nullptr, int channel = 1, int hidden = 0, int maxConnections = 4);
+    bool softAPConfig(IPAddress localIp, IPAddress gateway, IPAddress subnet);
+    IPAddress softAPIP() { return _apIp; }
+
+    // 1 when found (host::addHost()), 0 otherwise
+    int hostByName(const char* name, IPAddress& result);
+
+private:
+    wifi_mode_t _mode = WIFI_OFF;
+    bool _begun = false;
+    bool _sleep = false;
+    IPAddress _apIp = IPAddress(192, 168, 4, 1);
+};
+
+extern WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef WIFI_CLIENT_H
+#define WIFI_CLIENT_H
+
+#include <memory>
+#include "Arduino.h"
+
+class WiFiClientSocket;
+
+// TCP connection, shared between copies like the Arduino core's (the socket
+// closes with the last copy or stop())
+class WiFiClient : public Stream
+{
+public:
+    WiFiClient() {}
+    explicit WiFiClient(int fd);
+
+    int connect(IPAddress ip, uint16_t port);
+    uint8_t connected();
+    void stop();
+    int fd() const;
+    operator bool() { return connected(); }
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+
+    int available() override;
+    int read() override;
+    int read(uint8_t* buffer, size_t size);
+    int peek() override;
+    void setNoDelay(bool noDelay);
+
+    IPAddress remoteIP() const;
+    uint16_t remotePort() const;
+
+private:
+    std::shared_ptr<WiFiClientSocket> _socket;
+};
+
+#endif
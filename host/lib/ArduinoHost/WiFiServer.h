@@ -0,0 +1,30 @@
+#ifndef WIFI_SERVER_H
+#define WIFI_SERVER_H
+
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+// TCP listener. With host::useHostSockets() it listens on the loopback and
+// available() accepts the pending connections, one per call; otherwise
+// nothing connects and it always returns an unconnected client.
+class WiFiServer
+{
+public:
+    WiFiServer(uint16_t port = 80, uint8_t maxClients = 4) : _port(port), _maxClients(maxClients) {}
+
+    void begin(uint16_t port = 0);
+    void end();
+    void setNoDelay(bool noDelay) { _noDelay = noDelay; }
+    WiFiClient available();
+    WiFiClient accept() { return available(); }
+    operator bool() { return _listening; }
+
+private:
+    uint16_t _port;
+    uint8_t _maxClients;
+    bool _noDelay = false;
+    bool _listening = false;
+    int _listenFd = -1;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef WIFI_UDP_H
+#define WIFI_UDP_H
+
+#include <deque>
+#include <vector>
+#include "Arduino.h"
+
+// UDP socket on a loopback network between the sockets of the process
+// (see host::setUdpLink()): a packet is received by every open socket
+// bound to its destination port, for a multicast group only by the
+// sockets that joined it, the sender included (multicast loopback).
+class WiFiUDP : public Stream
+{
+public:
+    WiFiUDP() {}
+    ~WiFiUDP() { stop(); }
+
+    uint8_t begin(uint16_t port);
+    uint8_t beginMulticast(IPAddress group, uint16_t port);
+    void stop();
+
+    int beginPacket(IPAddress ip, uint16_t port);
+    int beginMulticastPacket();
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    int endPacket();
+
+    int parsePacket();
+    int available() override;
+    int read() override;
+    int read(uint8_t* buffer, size_t length);
+    int read(char* buffer, size_t length) { return read((uint8_t*)buffer, length); }
+    int peek() override;
+    IPAddress remoteIP() const { return _remoteIp; }
+    uint16_t remotePort() const { return _remotePort; }
+
+private:
+    struct Packet
+    {
+        int64_t atUs;
+        std::vector<uint8_t> data;
+        IPAddress from;
+        uint16_t fromPort;
+    };
+
+    WiFiUDP(const WiFiUDP&);
+    WiFiUDP& operator=(const WiFiUDP&);
+
+    void open(IPAddress group, uint16_t port);
+    static std::vector<WiFiUDP*>& sockets();
+
+    bool _open = false;
+    IPAddress _group;
+    uint16_t _port = 0;
+    IPAddress _destIp;
+    uint16_t _destPort = 0;
+    std::vector<uint8_t> _tx;
+    std::deque<Packet> _inbox;
+    std::vector<uint8_t> _rx;
+    size_t _rxPos = 0;
+    IPAddress _remoteIp;
+    uint16_t _remotePort = 0;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef DRIVER_RMT_H
+#define DRIVER_RMT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "hal/gpio_types.h"
+#include "soc/soc_caps.h"
+
+// RMT transmitter. The items are copied to a per channel memory and played
+// from there one by one on the virtual clock, each item read when the
+// player reaches it: like the peripheral, an item rewritten during the
+// transmission is played as rewritten if the player has not passed it.
+// Level changes are driven on the attached pin (see ArduinoHost.h).
+typedef enum { RMT_CHANNEL_0, RMT_CHANNEL_1, RMT_CHANNEL_2, RMT_CHANNEL_3, RMT_CHANNEL_MAX } rmt_channel_t;
+typedef enum { RMT_MODE_TX, RMT_MODE_RX, RMT_MODE_MAX } rmt_mode_t;
+typedef enum { RMT_IDLE_LEVEL_LOW, RMT_IDLE_LEVEL_HIGH } rmt_idle_level_t;
+typedef enum { RMT_CARRIER_LEVEL_LOW, RMT_CARRIER_LEVEL_HIGH } rmt_carrier_level_t;
+
+typedef struct
+{
+    union
+    {
+        struct
+        {
+            uint32_t duration0 : 15;
+            uint32_t level0 : 1;
+            uint32_t duration1 : 15;
+            uint32_t level1 : 1;
+        };
+        uint32_t val;
+    };
+} rmt_item32_t;
+
+typedef struct
+{
+    uint32_t carrier_freq_hz;
+    rmt_carrier_level_t carrier_level;
+    rmt_idle_level_t idle_level;
+    uint8_t carrier_duty_percent;
+    uint32_t loop_count;
+    bool carrier_en;
+    bool loop_en;
+    bool idle_output_en;
+} rmt_tx_config_t;
+
+typedef struct
+{
+    rmt_mode_t rmt_mode;
+    rmt_channel_t channel;
+    gpio_num_t gpio_num;
+    uint8_t clk_div;
+    uint8_t mem_block_num;
+    uint32_t flags;
+    rmt_tx_config_t tx_config;
+} rmt_config_t;
+
+static inline rmt_config_t rmtDefaultConfigTx(gpio_num_t gpio, rmt_channel_t channel)
+{
+    rmt_config_t config = {};
+    config.rmt_mode = RMT_MODE_TX;
+    config.channel = channel;
+    config.gpio_num = gpio;
+    config.clk_div = 80;
+    config.mem_block_num = 1;
+    config.tx_config.carrier_freq_hz = 38000;
+    config.tx_config.carrier_duty_percent = 33;
+    config.tx_config.idle_output_en = true;
+    return config;
+}
+
+#define RMT_DEFAULT_CONFIG_TX(gpio, channel_id) rmtDefaultConfigTx(gpio, channel_id)
+
+typedef void (*rmt_tx_end_fn_t)(rmt_channel_t channel, void* arg);
+
+typedef struct
+{
+    rmt_tx_end_fn_t function;
+    void* arg;
+} rmt_tx_end_callback_t;
+
+esp_err_t rmt_config(const rmt_config_t* config);
+esp_err_t rmt_driver_install(rmt_channel_t channel, size_t rxBufferSize, int intrAllocFlags);
+esp_err_t rmt_driver_uninstall(rmt_channel_t channel);
+rmt_tx_end_callback_t rmt_register_tx_end_callback(rmt_tx_end_fn_t function, void* arg);
+esp_err_t rmt_set_gpio(rmt_channel_t channel, rmt_mode_t mode, gpio_num_t gpio, bool invertSignal);
+esp_err_t rmt_fill_tx_items(rmt_channel_t channel, const rmt_item32_t* items, uint16_t count, uint16_t offset);
+esp_err_t rmt_tx_start(rmt_channel_t channel, bool resetMemory);
+esp_err_t rmt_tx_stop(rmt_channel_t channel);
+
+#endif
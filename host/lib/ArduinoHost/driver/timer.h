@@ -0,0 +1,48 @@
+#ifndef DRIVER_TIMER_H
+#define DRIVER_TIMER_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_intr_alloc.h"
+#include "soc/soc_caps.h"
+
+// General purpose timers: the alarm is an event on the virtual clock at
+// divider / 80 MHz per tick, the ISR runs at the alarm time
+typedef enum { TIMER_GROUP_0, TIMER_GROUP_1, TIMER_GROUP_MAX } timer_group_t;
+typedef enum { TIMER_0, TIMER_1, TIMER_MAX } timer_idx_t;
+typedef enum { TIMER_COUNT_DOWN, TIMER_COUNT_UP } timer_count_dir_t;
+typedef enum { TIMER_PAUSE, TIMER_START } timer_start_t;
+typedef enum { TIMER_ALARM_DIS, TIMER_ALARM_EN } timer_alarm_t;
+typedef enum { TIMER_AUTORELOAD_DIS, TIMER_AUTORELOAD_EN } timer_autoreload_t;
+typedef enum { TIMER_INTR_LEVEL } timer_intr_mode_t;
+typedef enum { TIMER_SRC_CLK_APB } timer_src_clk_t;
+
+typedef struct
+{
+    timer_alarm_t alarm_en;
+    timer_start_t counter_en;
+    timer_intr_mode_t intr_type;
+    timer_count_dir_t counter_dir;
+    timer_autoreload_t auto_reload;
+    uint32_t divider;
+    timer_src_clk_t clk_src;
+} timer_config_t;
+
+// Returns true if a higher priority task was woken
+typedef bool (*timer_isr_t)(void* arg);
+
+esp_err_t timer_init(timer_group_t group, timer_idx_t index, const timer_config_t* config);
+esp_err_t timer_deinit(timer_group_t group, timer_idx_t index);
+esp_err_t timer_isr_callback_add(timer_group_t group, timer_idx_t index, timer_isr_t isr, void* arg, int intrAllocFlags);
+esp_err_t timer_isr_callback_remove(timer_group_t group, timer_idx_t index);
+esp_err_t timer_set_counter_value(timer_group_t group, timer_idx_t index, uint64_t value);
+esp_err_t timer_get_counter_value(timer_group_t group, timer_idx_t index, uint64_t* value);
+esp_err_t timer_set_alarm_value(timer_group_t group, timer_idx_t index, uint64_t value);
+esp_err_t timer_set_alarm(timer_group_t group, timer_idx_t index, timer_alarm_t enable);
+esp_err_t timer_start(timer_group_t group, timer_idx_t index);
+esp_err_t timer_pause(timer_group_t group, timer_idx_t index);
+
+void timer_group_set_counter_enable_in_isr(timer_group_t group, timer_idx_t index, timer_start_t enable);
+void timer_group_set_alarm_value_in_isr(timer_group_t group, timer_idx_t index, uint64_t value);
+
+#endif
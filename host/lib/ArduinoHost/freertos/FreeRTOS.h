@@ -0,0 +1,38 @@
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void* parameters);
+
+#define configTICK_RATE_HZ      1000
+#define portTICK_PERIOD_MS      (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(ms) * configTICK_RATE_HZ / 1000)
+#define portMAX_DELAY           ((TickType_t)0xffffffffUL)
+
+#define pdFALSE                 0
+#define pdTRUE                  1
+#define pdFAIL                  0
+#define pdPASS                  1
+
+// A single task runs at a time and events only run where it waits (see
+// ArduinoHost.h), so nothing can interleave with a critical section
+typedef struct
+{
+    uint32_t owner;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    { 0 }
+
+static inline void portENTER_CRITICAL(portMUX_TYPE* mux) { (void)mux; }
+static inline void portEXIT_CRITICAL(portMUX_TYPE* mux) { (void)mux; }
+static inline void portENTER_CRITICAL_ISR(portMUX_TYPE* mux) { (void)mux; }
+static inline void portEXIT_CRITICAL_ISR(portMUX_TYPE* mux) { (void)mux; }
+
+#define portYIELD_FROM_ISR(woken)   ((void)(woken))
+
+#endif
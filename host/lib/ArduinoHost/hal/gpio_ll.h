@@ -0,0 +1,19 @@
+#ifndef HAL_GPIO_LL_H
+#define HAL_GPIO_LL_H
+
+#include <stdint.h>
+#include "hal/gpio_types.h"
+
+// Register level pin access. The "register" is the host pin state, so
+// listeners and counters see these writes like digitalWrite() ones.
+typedef struct
+{
+    uint32_t reserved;
+} gpio_dev_t;
+
+extern gpio_dev_t GPIO;
+
+void gpio_ll_set_level(gpio_dev_t* hw, gpio_num_t gpio_num, uint32_t level);
+int gpio_ll_get_level(gpio_dev_t* hw, gpio_num_t gpio_num);
+
+#endif
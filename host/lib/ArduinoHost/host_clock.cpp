@@ -0,0 +1,552 @@
+// Virtual clock, cooperative FreeRTOS scheduler, timed events, esp_timer and
+// the wall clock for the host build (see ArduinoHost.h)
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "ArduinoHost.h"
+#include "host_internal.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+namespace
+{
+    typedef std::chrono::steady_clock Steady;
+
+    struct Task
+    {
+        std::string name;
+        TaskFunction_t code = nullptr;
+        void* parameters = nullptr;
+        std::condition_variable wake;
+        int64_t wakeAt = 0;         // runnable from then on; -1 waits for a notification only
+        bool waitsNotify = false;
+        uint32_t notified = 0;
+        bool finished = false;
+    };
+
+    // Only the task holding the baton (running) runs and touches this state;
+    // the mutex orders the hand-overs
+    class Scheduler
+    {
+    public:
+        std::mutex mutex;
+        std::vector<Task*> tasks;
+        Task* running = nullptr;
+
+        int64_t base = 0;               // virtual time at mark
+        Steady::time_point mark;        // host time since which running code counts, with countHostTime
+        bool countHost = false;
+        double speed = 0;
+        Steady::time_point paceReal;
+        int64_t paceVirtual = 0;
+
+        std::map<std::pair<int64_t, uint32_t>, std::function<void()>> events;
+        std::map<uint32_t, int64_t> eventTimes;
+        uint32_t nextEventId = 1;
+
+        int64_t now()
+        {
+            if (!countHost) return base;
+            return base + std::chrono::duration_cast<std::chrono::microseconds>(Steady::now() - mark).count();
+        }
+
+        // Folds the host time run so far into base
+        void commit()
+        {
+            if (!countHost) return;
+            Steady::time_point t = Steady::now();
+            base += std::chrono::duration_cast<std::chrono::microseconds>(t - mark).count();
+            mark = t;
+        }
+
+        void resume()
+        {
+            mark = Steady::now();
+        }
+
+        Task* self();
+        void fireDue(int64_t until);
+        void advanceTo(int64_t t);
+        bool runnable(const Task* task) const;
+        void block();
+        Task* create(const char* name, TaskFunction_t code, void* parameters);
+    };
+
+    Scheduler& scheduler()
+    {
+        static Scheduler* s = new Scheduler(); // never destroyed, task threads outlive main()
+        return *s;
+    }
+
+    thread_local Task* currentTask = nullptr;
+
+    Task* Scheduler::self()
+    {
+        if (currentTask != nullptr) return currentTask;
+        // the first thread to call in (the test or the simulator) is loopTask
+        std::lock_guard<std::mutex> lock(mutex);
+        if (running != nullptr)
+        {
+            fprintf(stderr, "host: call from a thread that is not a task\n");
+            abort();
+        }
+        Task* task = new Task();
+        task->name = "loopTask";
+        tasks.push_back(task);
+        running = task;
+        currentTask = task;
+        resume();
+        return task;
+    }
+
+    void Scheduler::fireDue(int64_t until)
+    {
+        while (!events.empty() && events.begin()->first.first <= until)
+        {
+            std::pair<int64_t, uint32_t> key = events.begin()->first;
+            std::function<void()> fn = std::move(events.begin()->second);
+            events.erase(events.begin());
+            eventTimes.erase(key.second);
+            if (key.first > base) base = key.first;
+            fn();
+        }
+    }
+
+    void Scheduler::advanceTo(int64_t t)
+    {
+        if (t <= base) return;
+        if (speed > 0)
+        {
+            int64_t realUs = (int64_t)((t - paceVirtual) / speed);
+            std::this_thread::sleep_until(paceReal + std::chrono::microseconds(realUs));
+        }
+        base = t;
+        resume();
+    }
+
+    bool Scheduler::runnable(const Task* task) const
+    {
+        if (task->finished) return false;
+        if (task->waitsNotify && task->notified > 0) return true;
+        return task->wakeAt >= 0 && task->wakeAt <= base;
+    }
+
+    // The running task gives up the baton after setting what it waits for,
+    // and returns once that has happened and the baton is back
+    void Scheduler::block()
+    {
+        Task* me = self();
+        commit();
+        for (;;)
+        {
+            fireDue(base);
+
+            // round robin, the caller last
+            size_t at = 0;
+            while (tasks[at] != me) at++;
+            Task* next = nullptr;
+            for (size_t i = 1; i <= tasks.size() && next == nullptr; i++)
+            {
+                Task* t = tasks[(at + i) % tasks.size()];
+                if (runnable(t)) next = t;
+            }
+            if (next != nullptr)
+            {
+                if (next != me)
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    running = next;
+                    next->wake.notify_one();
+                    me->wake.wait(lock, [&] { return running == me; });
+                }
+                resume();
+                if (!runnable(me)) continue; // woken for a task that has since finished
+                return;
+            }
+
+            // everything waits: jump to the next deadline
+            int64_t t = INT64_MAX;
+            if (!events.empty()) t = events.begin()->first.first;
+            for (size_t i = 0; i < tasks.size(); i++)
+            {
+                if (!tasks[i]->finished && tasks[i]->wakeAt >= 0 && tasks[i]->wakeAt < t) t = tasks[i]->wakeAt;
+            }
+            if (t == INT64_MAX)
+            {
+                fprintf(stderr, "host: every task waits for a notification, nothing is scheduled\n");
+                abort();
+            }
+            advanceTo(t);
+        }
+    }
+
+    void taskEntry(Task* task)
+    {
+        Scheduler& s = scheduler();
+        currentTask = task;
+        {
+            std::unique_lock<std::mutex> lock(s.mutex);
+            task->wake.wait(lock, [&] { return s.running == task; });
+        }
+        s.resume();
+        task->code(task->parameters);
+        // returning from a task function is an error in FreeRTOS, treat it as
+        // vTaskDelete(NULL)
+        vTaskDelete(nullptr);
+    }
+
+    Task* Scheduler::create(const char* name, TaskFunction_t code, void* parameters)
+    {
+        self(); // the creator is a task
+        Task* task = new Task();
+        task->name = name != nullptr ? name : "";
+        task->code = code;
+        task->parameters = parameters;
+        task->wakeAt = base;
+        tasks.push_back(task);
+        std::thread(taskEntry, task).detach();
+        return task;
+    }
+}
+
+// --- host control ------------------------------------------------------
+
+int64_t host::now()
+{
+    return scheduler().now();
+}
+
+void host::run(int64_t us)
+{
+    Scheduler& s = scheduler();
+    Task* me = s.self();
+    me->wakeAt = s.now() + us;
+    s.block();
+}
+
+void host::countHostTime(bool enable)
+{
+    Scheduler& s = scheduler();
+    s.commit();
+    s.countHost = enable;
+    s.resume();
+}
+
+void host::setSpeed(double speed)
+{
+    Scheduler& s = scheduler();
+    s.speed = speed;
+    s.paceReal = Steady::now();
+    s.paceVirtual = s.now();
+}
+
+uint32_t host::at(int64_t atUs, std::function<void()> fn)
+{
+    Scheduler& s = scheduler();
+    uint32_t id = s.nextEventId++;
+    s.events[std::make_pair(atUs, id)] = std::move(fn);
+    s.eventTimes[id] = atUs;
+    return id;
+}
+
+void host::cancel(uint32_t id)
+{
+    Scheduler& s = scheduler();
+    std::map<uint32_t, int64_t>::iterator it = s.eventTimes.find(id);
+    if (it == s.eventTimes.end()) return;
+    s.events.erase(std::make_pair(it->second, id));
+    s.eventTimes.erase(it);
+}
+
+void host::detail::spin(int64_t us)
+{
+    Scheduler& s = scheduler();
+    s.commit();
+    int64_t until = s.base + us;
+    s.fireDue(until);
+    if (until > s.base) s.base = until;
+    s.resume();
+}
+
+// --- Arduino timing ----------------------------------------------------
+
+unsigned long millis()
+{
+    return (unsigned long)(host::now() / 1000);
+}
+
+unsigned long micros()
+{
+    return (unsigned long)host::now();
+}
+
+void delay(uint32_t ms)
+{
+    vTaskDelay(ms / portTICK_PERIOD_MS);
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    host::detail::spin(us);
+}
+
+void yield()
+{
+    vTaskDelay(0);
+}
+
+// --- FreeRTOS ----------------------------------------------------------
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char* name, uint32_t stackDepth, void* parameters,
+                       UBaseType_t priority, TaskHandle_t* created)
+{
+    (void)stackDepth;
+    (void)priority;
+    Task* task = scheduler().create(name, code, parameters);
+    if (created != nullptr) *created = task;
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char* name, uint32_t stackDepth, void* parameters,
+                                   UBaseType_t priority, TaskHandle_t* created, BaseType_t core)
+{
+    (void)core;
+    return xTaskCreate(code, name, stackDepth, parameters, priority, created);
+}
+
+void vTaskDelete(TaskHandle_t handle)
+{
+    Scheduler& s = scheduler();
+    Task* task = handle != nullptr ? (Task*)handle : s.self();
+    task->finished = true;
+    if (task != s.self()) return;
+    s.block(); // never returns: a finished task is not runnable
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    Scheduler& s = scheduler();
+    Task* me = s.self();
+    me->wakeAt = s.now() + (int64_t)ticks * (1000000 / configTICK_RATE_HZ);
+    s.block();
+}
+
+TickType_t xTaskGetTickCount()
+{
+    return (TickType_t)(host::now() / (1000000 / configTICK_RATE_HZ));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    return scheduler().self();
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait)
+{
+    Scheduler& s = scheduler();
+    Task* me = s.self();
+    if (me->notified == 0 && ticksToWait != 0)
+    {
+        me->waitsNotify = true;
+        me->wakeAt = ticksToWait == portMAX_DELAY ? -1
+                                                  : s.now() + (int64_t)ticksToWait * (1000000 / configTICK_RATE_HZ);
+        s.block();
+        me->waitsNotify = false;
+    }
+    me->wakeAt = 0;
+    uint32_t value = me->notified;
+    if (value > 0) me->notified = clearOnExit ? 0 : value - 1;
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle)
+{
+    ((Task*)handle)->notified++;
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t handle, BaseType_t* higherPriorityTaskWoken)
+{
+    ((Task*)handle)->notified++;
+    if (higherPriorityTaskWoken != nullptr) *higherPriorityTaskWoken = pdFALSE;
+}
+
+// --- esp_timer ---------------------------------------------------------
+
+struct esp_timer
+{
+    esp_timer_cb_t callback;
+    void* arg;
+    uint64_t periodUs;
+    int64_t dueAt;
+    uint32_t event;     // 0 while stopped
+};
+
+static void timerFire(esp_timer* timer)
+{
+    timer->event = 0;
+    if (timer->periodUs != 0)
+    {
+        // the next period counts from this alarm, not from when it ran
+        timer->dueAt += timer->periodUs;
+        timer->event = host::at(timer->dueAt, [timer] { timerFire(timer); });
+    }
+    timer->callback(timer->arg);
+}
+
+static esp_err_t timerStart(esp_timer_handle_t timer, uint64_t timeoutUs, uint64_t periodUs)
+{
+    if (timer == nullptr) return ESP_ERR_INVALID_ARG;
+    if (timer->event != 0) return ESP_ERR_INVALID_STATE;
+    timer->periodUs = periodUs;
+    timer->dueAt = host::now() + (int64_t)timeoutUs;
+    timer->event = host::at(timer->dueAt, [timer] { timerFire(timer); });
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle)
+{
+    if (args == nullptr || args->callback == nullptr || handle == nullptr) return ESP_ERR_INVALID_ARG;
+    esp_timer* timer = new esp_timer();
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    timer->periodUs = 0;
+    timer->dueAt = 0;
+    timer->event = 0;
+    *handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs)
+{
+    return timerStart(timer, timeoutUs, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodUs)
+{
+    return timerStart(timer, periodUs, periodUs);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (timer == nullptr) return ESP_ERR_INVALID_ARG;
+    if (timer->event == 0) return ESP_ERR_INVALID_STATE;
+    host::cancel(timer->event);
+    timer->event = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if (timer == nullptr) return ESP_ERR_INVALID_ARG;
+    if (timer->event != 0) return ESP_ERR_INVALID_STATE;
+    delete timer;
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    return timer != nullptr && timer->event != 0;
+}
+
+int64_t esp_timer_get_time()
+{
+    return host::now();
+}
+
+// --- wall clock --------------------------------------------------------
+//
+// The firmware's time(), gettimeofday(), settimeofday() and adjtime() are
+// redirected here by the linker (-Wl,--wrap=...). adjtime() slews like
+// ESP-IDF's, by at most 1/64 of the elapsed time.
+
+namespace
+{
+    struct WallClock
+    {
+        int64_t epochUs = 0;    // wall time at virtualMark
+        int64_t virtualMark = 0;
+        int64_t pendingUs = 0;  // adjtime() correction still to apply
+
+        void settle()
+        {
+            int64_t now = host::now();
+            int64_t elapsed = now - virtualMark;
+            int64_t step = elapsed / 64;
+            int64_t correction = pendingUs > step ? step : (pendingUs < -step ? -step : pendingUs);
+            epochUs += elapsed + correction;
+            pendingUs -= correction;
+            virtualMark = now;
+        }
+    };
+
+    WallClock& wallClock()
+    {
+        static WallClock* w = new WallClock();
+        return *w;
+    }
+}
+
+int64_t host::detail::wallUs()
+{
+    WallClock& w = wallClock();
+    w.settle();
+    return w.epochUs;
+}
+
+void host::setEpochUs(int64_t usSinceEpoch)
+{
+    WallClock& w = wallClock();
+    w.settle();
+    w.epochUs = usSinceEpoch;
+    w.pendingUs = 0;
+}
+
+extern "C" time_t __wrap_time(time_t* t)
+{
+    time_t now = (time_t)(host::detail::wallUs() / 1000000);
+    if (t != nullptr) *t = now;
+    return now;
+}
+
+extern "C" int __wrap_gettimeofday(struct timeval* tv, void* tz)
+{
+    (void)tz;
+    if (tv != nullptr)
+    {
+        int64_t us = host::detail::wallUs();
+        tv->tv_sec = (time_t)(us / 1000000);
+        tv->tv_usec = (suseconds_t)(us % 1000000);
+    }
+    return 0;
+}
+
+extern "C" int __wrap_settimeofday(const struct timeval* tv, const struct timezone* tz)
+{
+    (void)tz;
+    if (tv != nullptr) host::setEpochUs((int64_t)tv->tv_sec * 1000000 + tv->tv_usec);
+    return 0;
+}
+
+extern "C" int __wrap_adjtime(const struct timeval* delta, struct timeval* olddelta)
+{
+    WallClock& w = wallClock();
+    w.settle();
+    if (olddelta != nullptr)
+    {
+        olddelta->tv_sec = (time_t)(w.pendingUs / 1000000);
+        olddelta->tv_usec = (suseconds_t)(w.pendingUs % 1000000);
+    }
+    if (delta != nullptr) w.pendingUs = (int64_t)delta->tv_sec * 1000000 + delta->tv_usec;
+    return 0;
+}
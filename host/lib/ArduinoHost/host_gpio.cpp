@@ -0,0 +1,466 @@
+// Pins, pin interrupts, general purpose timers and the RMT transmitter on
+// the virtual clock (see ArduinoHost.h)
+#include <vector>
+#include "Arduino.h"
+#include "ArduinoHost.h"
+#include "host_internal.h"
+#include "hal/gpio_ll.h"
+#include "driver/timer.h"
+#include "driver/rmt.h"
+
+namespace
+{
+    struct Pin
+    {
+        int level = 0;
+        uint8_t mode = INPUT;
+        uint32_t writes = 0;
+        uint32_t toggles = 0;
+        void (*isr)(void) = nullptr;
+        int isrMode = 0;
+    };
+
+    struct Pins
+    {
+        Pin pins[SOC_GPIO_PIN_COUNT];
+        std::vector<host::PinListener> listeners;
+    };
+
+    Pins& pins()
+    {
+        static Pins* p = new Pins();
+        return *p;
+    }
+
+    // Sets a level, returns true if it changed
+    bool setLevel(uint8_t pin, int level)
+    {
+        Pins& p = pins();
+        Pin& state = p.pins[pin];
+        if (state.level == level) return false;
+        state.level = level;
+        state.toggles++;
+        int64_t now = host::now();
+        for (size_t i = 0; i < p.listeners.size(); i++) p.listeners[i](pin, level, now);
+        return true;
+    }
+}
+
+gpio_dev_t GPIO;
+
+void host::detail::writePin(uint8_t pin, int level, bool cpu)
+{
+    if (pin >= SOC_GPIO_PIN_COUNT) return;
+    if (cpu) pins().pins[pin].writes++;
+    setLevel(pin, level != 0 ? HIGH : LOW);
+}
+
+void host::onPinChange(PinListener listener)
+{
+    pins().listeners.push_back(listener);
+}
+
+void host::drivePin(uint8_t pin, int level)
+{
+    if (pin >= SOC_GPIO_PIN_COUNT) return;
+    level = level != 0 ? HIGH : LOW;
+    if (!setLevel(pin, level)) return;
+    Pin& state = pins().pins[pin];
+    if (state.isr == nullptr) return;
+    if (state.isrMode == CHANGE || (state.isrMode == RISING && level == HIGH) || (state.isrMode == FALLING && level == LOW))
+    {
+        state.isr();
+    }
+}
+
+int host::pinLevel(uint8_t pin)
+{
+    return pin < SOC_GPIO_PIN_COUNT ? pins().pins[pin].level : LOW;
+}
+
+uint32_t host::pinWrites(uint8_t pin)
+{
+    return pin < SOC_GPIO_PIN_COUNT ? pins().pins[pin].writes : 0;
+}
+
+uint32_t host::pinToggles(uint8_t pin)
+{
+    return pin < SOC_GPIO_PIN_COUNT ? pins().pins[pin].toggles : 0;
+}
+
+void host::resetPinCounts()
+{
+    for (int i = 0; i < SOC_GPIO_PIN_COUNT; i++)
+    {
+        pins().pins[i].writes = 0;
+        pins().pins[i].toggles = 0;
+    }
+}
+
+// --- Arduino pins ------------------------------------------------------
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    if (pin >= SOC_GPIO_PIN_COUNT) return;
+    pins().pins[pin].mode = mode;
+    if ((mode & PULLUP) != 0) setLevel(pin, HIGH);
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    host::detail::writePin(pin, val, true);
+}
+
+int digitalRead(uint8_t pin)
+{
+    return host::pinLevel(pin);
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode)
+{
+    if (pin >= SOC_GPIO_PIN_COUNT) return;
+    pins().pins[pin].isr = isr;
+    pins().pins[pin].isrMode = mode;
+}
+
+void detachInterrupt(uint8_t pin)
+{
+    if (pin >= SOC_GPIO_PIN_COUNT) return;
+    pins().pins[pin].isr = nullptr;
+}
+
+void gpio_ll_set_level(gpio_dev_t* hw, gpio_num_t gpio_num, uint32_t level)
+{
+    (void)hw;
+    host::detail::writePin((uint8_t)gpio_num, (int)level, true);
+}
+
+int gpio_ll_get_level(gpio_dev_t* hw, gpio_num_t gpio_num)
+{
+    (void)hw;
+    return host::pinLevel((uint8_t)gpio_num);
+}
+
+// --- general purpose timers ----------------------------------------------
+
+namespace
+{
+    struct HwTimer
+    {
+        bool initialized = false;
+        bool autoReload = false;
+        bool alarmEnabled = false;
+        bool running = false;
+        double tickUs = 1.0;
+        uint64_t counterAtStart = 0;    // counter value at startAt
+        int64_t startAt = 0;
+        uint64_t alarm = 0;
+        uint64_t load = 0;              // reload value (the last counter value set)
+        timer_isr_t isr = nullptr;
+        void* arg = nullptr;
+        uint32_t event = 0;
+    };
+
+    HwTimer hwTimers[TIMER_GROUP_MAX][TIMER_MAX];
+
+    HwTimer* hwTimer(timer_group_t group, timer_idx_t index)
+    {
+        if (group < 0 || group >= TIMER_GROUP_MAX || index < 0 || index >= TIMER_MAX) return nullptr;
+        return &hwTimers[group][index];
+    }
+
+    uint64_t counterNow(const HwTimer& t)
+    {
+        if (!t.running) return t.counterAtStart;
+        return t.counterAtStart + (uint64_t)((host::now() - t.startAt) / t.tickUs);
+    }
+
+    // Freezes the counter at its current value
+    void hold(HwTimer& t)
+    {
+        t.counterAtStart = counterNow(t);
+        t.startAt = host::now();
+    }
+
+    void hwAlarm(HwTimer* t);
+
+    void schedule(HwTimer& t)
+    {
+        if (t.event != 0) host::cancel(t.event);
+        t.event = 0;
+        if (!t.running || !t.alarmEnabled || t.isr == nullptr) return;
+        uint64_t ticks = t.alarm > t.counterAtStart ? t.alarm - t.counterAtStart : 0;
+        int64_t at = t.startAt + (int64_t)(ticks * t.tickUs);
+        t.event = host::at(at, [&t] { hwAlarm(&t); });
+    }
+
+    void hwAlarm(HwTimer* t)
+    {
+        t->event = 0;
+        // the alarm time, whatever the host took to get here
+        t->startAt = t->startAt + (int64_t)((t->alarm > t->counterAtStart ? t->alarm - t->counterAtStart : 0) * t->tickUs);
+        t->counterAtStart = t->autoReload ? t->load : t->alarm;
+        t->isr(t->arg);
+        // the driver's ISR wrapper enables the alarm again after the callback
+        if (t->autoReload) schedule(*t);
+    }
+}
+
+esp_err_t timer_init(timer_group_t group, timer_idx_t index, const timer_config_t* config)
+{
+    HwTimer* t = hwTimer(group, index);
+    if (t == nullptr || config == nullptr || config->divider < 2) return ESP_ERR_INVALID_ARG;
+    *t = HwTimer();
+    t->initialized = true;
+    t->autoReload = config->auto_reload == TIMER_AUTORELOAD_EN;
+    t->alarmEnabled = config->alarm_en == TIMER_ALARM_EN;
+    t->tickUs = config->divider / 80.0;
+    t->startAt = host::now();
+    t->running = config->counter_en == TIMER_START;
+    return ESP_OK;
+}
+
+esp_err_t timer_deinit(timer_group_t group, timer_idx_t index)
+{
+    HwTimer* t = hwTimer(group, index);
+    if (t == nullptr || !t->initialized) return ESP_ERR_INVALID_STATE;
+    if (t->event != 0) host::cancel(t->event);
+    *t = HwTimer();
+    return ESP_OK;
+}
+
+esp_err_t timer_isr_callback_add(timer_group_t group, timer_idx_t index, timer_isr_t isr, void* arg, int intrAllocFlags)
+{
+    (void)intrAllocFlags;
+    HwTimer* t = hwTimer(group, index);
+    if (t == nullptr || !t->initialized) return ESP_ERR_INVALID_STATE;
+    t->isr = isr;
+    t->arg = arg;
+    schedule(*t);
+    return ESP_OK;
+}
+
+esp_err_t timer_isr_callback_remove(timer_group_t group, timer_idx_t index)
+{
+    HwTimer* t = hwTimer(group, index);
+    if (t == nullptr || !t->initialized) return ESP_ERR_INVALID_STATE;
+    t->isr = nullptr;
+    schedule(*t);
+    return ESP_OK;
+}
+
+esp_err_t timer_set_counter_value(timer_group_t group, timer_idx_t index, uint64_t value)
+{
+    HwTimer* t = hwTimer(group, index);
+    if (t == nullptr || !t->initialized) return ESP_ERR_INVALID_STATE;
+    t->counterAtStart = value;
+    t->load = value;
+    t->startAt = host::now();
+    schedule(*t);
+    return ESP_OK;
+}
+
+esp_err_t timer_get_counter_value(timer_group_t group, timer_idx_t index, uint64_t* value)
+{
+    HwTimer* t = hwTimer(group, index);
+    if (t == nullptr || !t->initialized || value == nullptr) return ESP_ERR_INVALID_ARG;
+    *value = counterNow(*t);
+    return ESP_OK;
+}
+
+esp_err_t timer_set_alarm_value(timer_group_t group, timer_idx_t index, uint64_t value)
+{
+    HwTimer* t = hwTimer(group, index);
+    if (t == nullptr || !t->initialized) return ESP_ERR_INVALID_STATE;
+    hold(*t);
+    t->alarm = value;
+    schedule(*t);
+    return ESP_OK;
+}
+
+esp_err_t timer_set_alarm(timer_group_t group, timer_idx_t index, timer_alarm_t enable)
+{
+    HwTimer* t = hwTimer(group, index);
+    if (t == nullptr || !t->initialized) return ESP_ERR_INVALID_STATE;
+    hold(*t);
+    t->alarmEnabled = enable == TIMER_ALARM_EN;
+    schedule(*t);
+    return ESP_OK;
+}
+
+esp_err_t timer_start(timer_group_t group, timer_idx_t index)
+{
+    HwTimer* t = hwTimer(group, index);
+    if (t == nullptr || !t->initialized) return ESP_ERR_INVALID_STATE;
+    hold(*t);
+    t->running = true;
+    schedule(*t);
+    return ESP_OK;
+}
+
+esp_err_t timer_pause(timer_group_t group, timer_idx_t index)
+{
+    HwTimer* t = hwTimer(group, index);
+    if (t == nullptr || !t->initialized) return ESP_ERR_INVALID_STATE;
+    hold(*t);
+    t->running = false;
+    schedule(*t);
+    return ESP_OK;
+}
+
+void timer_group_set_counter_enable_in_isr(timer_group_t group, timer_idx_t index, timer_start_t enable)
+{
+    HwTimer* t = hwTimer(group, index);
+    if (t == nullptr) return;
+    // inside the ISR the counter is where the alarm left it
+    t->running = enable == TIMER_START;
+    if (t->event != 0) host::cancel(t->event);
+    t->event = 0;
+}
+
+void timer_group_set_alarm_value_in_isr(timer_group_t group, timer_idx_t index, uint64_t value)
+{
+    HwTimer* t = hwTimer(group, index);
+    if (t == nullptr) return;
+    t->alarm = value;
+}
+
+// --- RMT ---------------------------------------------------------------
+
+namespace
+{
+    struct RmtChannel
+    {
+        bool configured = false;
+        bool installed = false;
+        int gpio = -1;
+        double tickUs = 1.0;
+        int idleLevel = LOW;
+        rmt_item32_t memory[SOC_RMT_MEM_WORDS_PER_CHANNEL];
+        bool playing = false;
+        int index = 0;
+        int64_t nextAt = 0;
+        uint32_t event = 0;
+    };
+
+    RmtChannel rmtChannels[RMT_CHANNEL_MAX];
+    rmt_tx_end_callback_t rmtTxEnd = { nullptr, nullptr };
+
+    void rmtDrive(RmtChannel& c, int level)
+    {
+        if (c.gpio >= 0) host::detail::writePin((uint8_t)c.gpio, level, false);
+    }
+
+    void rmtEnd(rmt_channel_t channel)
+    {
+        RmtChannel& c = rmtChannels[channel];
+        c.playing = false;
+        c.event = 0;
+        rmtDrive(c, c.idleLevel);
+        if (rmtTxEnd.function != nullptr) rmtTxEnd.function(channel, rmtTxEnd.arg);
+    }
+
+    // Plays half an item: the level0 part (second false) or the level1 part
+    void rmtStep(rmt_channel_t channel, bool second)
+    {
+        RmtChannel& c = rmtChannels[channel];
+        c.event = 0;
+        if (c.index >= SOC_RMT_MEM_WORDS_PER_CHANNEL) return rmtEnd(channel);
+        const rmt_item32_t& item = c.memory[c.index];   // read as the player reaches it
+        uint32_t duration = second ? item.duration1 : item.duration0;
+        if (duration == 0) return rmtEnd(channel);
+        rmtDrive(c, second ? item.level1 : item.level0);
+        if (second) c.index++;
+        c.nextAt += (int64_t)(duration * c.tickUs);
+        c.event = host::at(c.nextAt, [channel, second] { rmtStep(channel, !second); });
+    }
+
+    RmtChannel* rmtChannel(rmt_channel_t channel)
+    {
+        return channel >= 0 && channel < RMT_CHANNEL_MAX ? &rmtChannels[channel] : nullptr;
+    }
+}
+
+esp_err_t rmt_config(const rmt_config_t* config)
+{
+    if (config == nullptr || config->rmt_mode != RMT_MODE_TX) return ESP_ERR_INVALID_ARG;
+    RmtChannel* c = rmtChannel(config->channel);
+    if (c == nullptr || config->clk_div == 0) return ESP_ERR_INVALID_ARG;
+    c->configured = true;
+    c->gpio = config->gpio_num;
+    c->tickUs = config->clk_div / 80.0;
+    c->idleLevel = config->tx_config.idle_level == RMT_IDLE_LEVEL_HIGH ? HIGH : LOW;
+    return ESP_OK;
+}
+
+esp_err_t rmt_driver_install(rmt_channel_t channel, size_t rxBufferSize, int intrAllocFlags)
+{
+    (void)rxBufferSize;
+    (void)intrAllocFlags;
+    RmtChannel* c = rmtChannel(channel);
+    if (c == nullptr || !c->configured) return ESP_ERR_INVALID_ARG;
+    if (c->installed) return ESP_ERR_INVALID_STATE;
+    c->installed = true;
+    return ESP_OK;
+}
+
+esp_err_t rmt_driver_uninstall(rmt_channel_t channel)
+{
+    RmtChannel* c = rmtChannel(channel);
+    if (c == nullptr || !c->installed) return ESP_ERR_INVALID_STATE;
+    rmt_tx_stop(channel);
+    c->installed = false;
+    return ESP_OK;
+}
+
+rmt_tx_end_callback_t rmt_register_tx_end_callback(rmt_tx_end_fn_t function, void* arg)
+{
+    rmt_tx_end_callback_t previous = rmtTxEnd;
+    rmtTxEnd.function = function;
+    rmtTxEnd.arg = arg;
+    return previous;
+}
+
+esp_err_t rmt_set_gpio(rmt_channel_t channel, rmt_mode_t mode, gpio_num_t gpio, bool invertSignal)
+{
+    (void)invertSignal;
+    RmtChannel* c = rmtChannel(channel);
+    if (c == nullptr || mode != RMT_MODE_TX) return ESP_ERR_INVALID_ARG;
+    c->gpio = gpio;
+    return ESP_OK;
+}
+
+esp_err_t rmt_fill_tx_items(rmt_channel_t channel, const rmt_item32_t* items, uint16_t count, uint16_t offset)
+{
+    RmtChannel* c = rmtChannel(channel);
+    if (c == nullptr || !c->installed || items == nullptr || count == 0) return ESP_ERR_INVALID_ARG;
+    if (offset + count > SOC_RMT_MEM_WORDS_PER_CHANNEL) return ESP_ERR_INVALID_ARG;
+    for (uint16_t i = 0; i < count; i++) c->memory[offset + i] = items[i];
+    return ESP_OK;
+}
+
+esp_err_t rmt_tx_start(rmt_channel_t channel, bool resetMemory)
+{
+    RmtChannel* c = rmtChannel(channel);
+    if (c == nullptr || !c->installed) return ESP_ERR_INVALID_STATE;
+    if (c->event != 0) host::cancel(c->event);
+    if (resetMemory) c->index = 0;
+    c->playing = true;
+    c->nextAt = host::now();
+    // the first level goes out now, the rest (and the end callback) from
+    // the peripheral's own time line
+    c->event = host::at(c->nextAt, [channel] { rmtStep(channel, false); });
+    return ESP_OK;
+}
+
+esp_err_t rmt_tx_stop(rmt_channel_t channel)
+{
+    RmtChannel* c = rmtChannel(channel);
+    if (c == nullptr || !c->installed) return ESP_ERR_INVALID_STATE;
+    if (c->event != 0) host::cancel(c->event);
+    c->event = 0;
+    c->playing = false;
+    c->index = 0;
+    rmtDrive(*c, c->idleLevel);
+    return ESP_OK;
+}
@@ -0,0 +1,25 @@
+#ifndef HOST_INTERNAL_H
+#define HOST_INTERNAL_H
+
+#include <stdint.h>
+#include <functional>
+
+// Shared between the translation units of the host library
+namespace host
+{
+    namespace detail
+    {
+        // Advances the clock by us inside the running task, firing the
+        // events due on the way (busy waits, delayMicroseconds())
+        void spin(int64_t us);
+
+        // Marks a CPU write (digitalWrite(), gpio_ll_set_level()) or a
+        // peripheral drive (RMT) of a pin
+        void writePin(uint8_t pin, int level, bool cpu);
+
+        // Wall clock in microseconds since the epoch
+        int64_t wallUs();
+    }
+}
+
+#endif
@@ -0,0 +1,1113 @@
+// WiFi, name resolution and the network classes for the host build
+#include <poll.h>
+#include <map>
+#include <random>
+#include <string>
+#include "Arduino.h"
+#include "ArduinoHost.h"
+#include "WiFi.h"
+#include "WiFiUdp.h"
+#include "ESPmDNS.h"
+#include "WebServer.h"
+#include "WebSocketsClient.h"
+#include "lwip/sockets.h"
+#include "lwip/dns.h"
+
+// --- WiFi --------------------------------------------------------------
+
+namespace
+{
+    struct Network
+    {
+        bool wifiUp = true;
+        std::map<std::string, uint32_t> hosts;
+        bool hostSockets = false;
+        uint16_t portOffset = 8000;
+    };
+
+    Network& network()
+    {
+        static Network* n = new Network();
+        return *n;
+    }
+
+    bool lookup(const char* name, IPAddress& result)
+    {
+        if (name == nullptr) return false;
+        if (result.fromString(name)) return true;
+        Network& n = network();
+        std::map<std::string, uint32_t>::const_iterator it = n.hosts.find(name);
+        if (it == n.hosts.end()) return false;
+        result = IPAddress(it->second);
+        return true;
+    }
+}
+
+WiFiClass WiFi;
+MDNSResponder MDNS;
+
+void host::useHostSockets(bool enable, uint16_t portOffset)
+{
+    network().hostSockets = enable;
+    network().portOffset = portOffset;
+}
+
+void host::setWifiConnected(bool connected)
+{
+    network().wifiUp = connected;
+}
+
+void host::addHost(const char* name, uint32_t ip)
+{
+    network().hosts[name] = ip;
+}
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* password)
+{
+    (void)password;
+    _begun = ssid != nullptr && ssid[0] != '\0';
+    if ((_mode & WIFI_STA) == 0) _mode = (wifi_mode_t)(_mode | WIFI_STA);
+    return status();
+}
+
+bool WiFiClass::disconnect(bool wifiOff)
+{
+    _begun = false;
+    if (wifiOff) _mode = WIFI_OFF;
+    return true;
+}
+
+wl_status_t WiFiClass::status()
+{
+    if (!_begun) return WL_DISCONNECTED;
+    return network().wifiUp ? WL_CONNECTED : WL_NO_SSID_AVAIL;
+}
+
+IPAddress WiFiClass::localIP()
+{
+    return status() == WL_CONNECTED ? IPAddress(127, 0, 0, 1) : IPAddress();
+}
+
+bool WiFiClass::softAP(const char* ssid, const char* password, int channel, int hidden, int maxConnections)
+{
+    (void)password;
+    (void)channel;
+    (void)hidden;
+    (void)maxConnections;
+    if (ssid == nullptr || ssid[0] == '\0') return false;
+    _mode = (wifi_mode_t)(_mode | WIFI_AP);
+    return true;
+}
+
+bool WiFiClass::softAPConfig(IPAddress localIp, IPAddress gateway, IPAddress subnet)
+{
+    (void)gateway;
+    (void)subnet;
+    _apIp = localIp;
+    return true;
+}
+
+int WiFiClass::hostByName(const char* name, IPAddress& result)
+{
+    if (status() != WL_CONNECTED) return 0;
+    return lookup(name, result) ? 1 : 0;
+}
+
+err_t dns_gethostbyname_addrtype(const char* hostname, ip_addr_t* addr, dns_found_callback found,
+                                 void* callback_arg, uint8_t dns_addrtype)
+{
+    (void)found;
+    (void)callback_arg;
+    (void)dns_addrtype;
+    IPAddress ip;
+    if (!network().wifiUp || !lookup(hostname, ip)) return ERR_VAL;
+    addr->u_addr.ip4.addr = (uint32_t)ip;
+    addr->type = IPADDR_TYPE_V4;
+    return ERR_OK;
+}
+
+esp_err_t mdns_init()
+{
+    return ESP_OK;
+}
+
+void mdns_free()
+{
+}
+
+bool MDNSResponder::begin(const char* hostName)
+{
+    (void)hostName;
+    return true;
+}
+
+IPAddress MDNSResponder::queryHost(const char* host, uint32_t timeoutMs)
+{
+    IPAddress ip;
+    std::string name = host != nullptr ? host : "";
+    if (lookup(name.c_str(), ip) || lookup((name + ".local").c_str(), ip)) return ip;
+    delay(timeoutMs); // nobody answers
+    return IPAddress();
+}
+
+// --- WiFiClient --------------------------------------------------------
+
+class WiFiClientSocket
+{
+public:
+    explicit WiFiClientSocket(int fd) : fd(fd) {}
+    ~WiFiClientSocket() { close(); }
+    void close()
+    {
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+
+    int fd;
+};
+
+WiFiClient::WiFiClient(int fd) : _socket(fd >= 0 ? std::make_shared<WiFiClientSocket>(fd) : nullptr)
+{
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port)
+{
+    stop();
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return 0;
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = (uint32_t)ip;
+    if (::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        ::close(fd);
+        return 0;
+    }
+    _socket = std::make_shared<WiFiClientSocket>(fd);
+    return 1;
+}
+
+uint8_t WiFiClient::connected()
+{
+    if (!_socket || _socket->fd < 0) return 0;
+    char c;
+    int n = recv(_socket->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+    {
+        _socket->close();
+        return 0;
+    }
+    return 1;
+}
+
+void WiFiClient::stop()
+{
+    if (_socket) _socket->close();
+    _socket.reset();
+}
+
+int WiFiClient::fd() const
+{
+    return _socket ? _socket->fd : -1;
+}
+
+size_t WiFiClient::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t WiFiClient::write(const uint8_t* buffer, size_t size)
+{
+    if (fd() < 0) return 0;
+    ssize_t n = ::send(fd(), buffer, size, MSG_NOSIGNAL);
+    return n < 0 ? 0 : (size_t)n;
+}
+
+int WiFiClient::available()
+{
+    if (fd() < 0) return 0;
+    uint8_t buffer[256];
+    ssize_t n = recv(fd(), buffer, sizeof(buffer), MSG_PEEK | MSG_DONTWAIT);
+    return n < 0 ? 0 : (int)n;
+}
+
+int WiFiClient::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t* buffer, size_t size)
+{
+    if (fd() < 0) return -1;
+    ssize_t n = recv(fd(), buffer, size, MSG_DONTWAIT);
+    return n < 0 ? -1 : (int)n;
+}
+
+int WiFiClient::peek()
+{
+    if (fd() < 0) return -1;
+    uint8_t c;
+    return recv(fd(), &c, 1, MSG_PEEK | MSG_DONTWAIT) == 1 ? c : -1;
+}
+
+void WiFiClient::setNoDelay(bool noDelay)
+{
+    if (fd() < 0) return;
+    int flag = noDelay ? 1 : 0;
+    setsockopt(fd(), IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+}
+
+IPAddress WiFiClient::remoteIP() const
+{
+    struct sockaddr_in addr = {};
+    socklen_t length = sizeof(addr);
+    if (fd() < 0 || getpeername(fd(), (struct sockaddr*)&addr, &length) != 0) return IPAddress();
+    return IPAddress(addr.sin_addr.s_addr);
+}
+
+uint16_t WiFiClient::remotePort() const
+{
+    struct sockaddr_in addr = {};
+    socklen_t length = sizeof(addr);
+    if (fd() < 0 || getpeername(fd(), (struct sockaddr*)&addr, &length) != 0) return 0;
+    return ntohs(addr.sin_port);
+}
+
+// --- WiFiServer --------------------------------------------------------
+
+// lwIP's default TCP send buffer (CONFIG_LWIP_TCP_SND_BUF_DEFAULT)
+static const int lwipSendBuffer = 5744;
+
+void WiFiServer::begin(uint16_t port)
+{
+    if (port != 0) _port = port;
+    _listening = true;
+    if (!network().hostSockets || _listenFd >= 0) return;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return;
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)(_port + network().portOffset));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, _maxClients) != 0)
+    {
+        fprintf(stderr, "WiFiServer: port %d: %s\n", _port + network().portOffset, strerror(errno));
+        ::close(fd);
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    _listenFd = fd;
+}
+
+void WiFiServer::end()
+{
+    _listening = false;
+    if (_listenFd >= 0) ::close(_listenFd);
+    _listenFd = -1;
+}
+
+WiFiClient WiFiServer::available()
+{
+    if (!_listening || _listenFd < 0) return WiFiClient();
+    int fd = ::accept(_listenFd, nullptr, nullptr);
+    if (fd < 0) return WiFiClient();
+    // a slow reader fills the window as soon as it would on the device
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &lwipSendBuffer, sizeof(lwipSendBuffer));
+    if (_noDelay)
+    {
+        int flag = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    }
+    return WiFiClient(fd);
+}
+
+// --- WiFiUDP -----------------------------------------------------------
+
+namespace
+{
+    struct UdpLink
+    {
+        uint32_t latencyUs = 0;
+        uint8_t lossPercent = 0;
+        std::mt19937 rng;
+        uint16_t nextEphemeralPort = 49152;
+    };
+
+    UdpLink& udpLink()
+    {
+        static UdpLink* l = new UdpLink();
+        return *l;
+    }
+
+    bool isMulticast(IPAddress ip)
+    {
+        return ip[0] >= 224 && ip[0] <= 239;
+    }
+}
+
+void host::setUdpLink(uint32_t latencyUs, uint8_t lossPercent)
+{
+    udpLink().latencyUs = latencyUs;
+    udpLink().lossPercent = lossPercent;
+}
+
+std::vector<WiFiUDP*>& WiFiUDP::sockets()
+{
+    static std::vector<WiFiUDP*>* s = new std::vector<WiFiUDP*>();
+    return *s;
+}
+
+void WiFiUDP::open(IPAddress group, uint16_t port)
+{
+    stop();
+    _open = true;
+    _port = port;
+    _group = group;
+    sockets().push_back(this);
+}
+
+uint8_t WiFiUDP::begin(uint16_t port)
+{
+    open(IPAddress(), port);
+    return 1;
+}
+
+uint8_t WiFiUDP::beginMulticast(IPAddress group, uint16_t port)
+{
+    open(group, port);
+    return 1;
+}
+
+void WiFiUDP::stop()
+{
+    std::vector<WiFiUDP*>& all = sockets();
+    for (size_t i = 0; i < all.size(); i++)
+    {
+        if (all[i] == this)
+        {
+            all.erase(all.begin() + i);
+            break;
+        }
+    }
+    _open = false;
+    _tx.clear();
+    _inbox.clear();
+    _rx.clear();
+    _rxPos = 0;
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+    _destIp = ip;
+    _destPort = port;
+    _tx.clear();
+    return _open ? 1 : 0;
+}
+
+int WiFiUDP::beginMulticastPacket()
+{
+    return beginPacket(_group, _port);
+}
+
+size_t WiFiUDP::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t WiFiUDP::write(const uint8_t* buffer, size_t size)
+{
+    _tx.insert(_tx.end(), buffer, buffer + size);
+    return size;
+}
+
+int WiFiUDP::endPacket()
+{
+    if (!_open)
+    {
+        _tx.clear();
+        return 0;
+    }
+    UdpLink& link = udpLink();
+    if (_port == 0) _port = link.nextEphemeralPort++;
+    Packet packet = { host::now() + link.latencyUs, _tx, WiFi.localIP(), _port };
+    bool multicast = isMulticast(_destIp);
+    std::vector<WiFiUDP*>& all = sockets();
+    for (size_t i = 0; i < all.size(); i++)
+    {
+        WiFiUDP* to = all[i];
+        if (to->_port != _destPort || (multicast && to->_group != _destIp)) continue;
+        if (link.lossPercent != 0 && link.rng() % 100 < link.lossPercent) continue;
+        to->_inbox.push_back(packet);
+    }
+    _tx.clear();
+    return 1;
+}
+
+int WiFiUDP::parsePacket()
+{
+    _rx.clear();
+    _rxPos = 0;
+    if (_inbox.empty() || _inbox.front().atUs > host::now()) return 0;
+    Packet& packet = _inbox.front();
+    _rx.swap(packet.data);
+    _remoteIp = packet.from;
+    _remotePort = packet.fromPort;
+    _inbox.pop_front();
+    return (int)_rx.size();
+}
+
+int WiFiUDP::available()
+{
+    return (int)(_rx.size() - _rxPos);
+}
+
+int WiFiUDP::read()
+{
+    return _rxPos < _rx.size() ? _rx[_rxPos++] : -1;
+}
+
+int WiFiUDP::read(uint8_t* buffer, size_t length)
+{
+    size_t n = _rx.size() - _rxPos;
+    if (n > length) n = length;
+    memcpy(buffer, _rx.data() + _rxPos, n);
+    _rxPos += n;
+    return (int)n;
+}
+
+int WiFiUDP::peek()
+{
+    return _rxPos < _rx.size() ? _rx[_rxPos] : -1;
+}
+
+// --- WebServer ---------------------------------------------------------
+
+namespace
+{
+    // Reads from a blocking socket until the peer has sent what is needed,
+    // waiting timeoutMs at most for each part
+    bool receiveMore(int fd, std::string& data, int timeoutMs)
+    {
+        struct pollfd p = { fd, POLLIN, 0 };
+        if (poll(&p, 1, timeoutMs) <= 0) return false;
+        char buffer[1024];
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) return false;
+        data.append(buffer, (size_t)n);
+        return true;
+    }
+
+    std::string urlDecode(const std::string& text)
+    {
+        std::string decoded;
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            if (text[i] == '+') decoded += ' ';
+            else if (text[i] == '%' && i + 2 < text.size() && isxdigit((unsigned char)text[i + 1]) &&
+                     isxdigit((unsigned char)text[i + 2]))
+            {
+                decoded += (char)strtol(text.substr(i + 1, 2).c_str(), nullptr, 16);
+                i += 2;
+            }
+            else decoded += text[i];
+        }
+        return decoded;
+    }
+
+    const char* reason(int code)
+    {
+        switch (code)
+        {
+        case 200: return "OK";
+        case 204: return "No Content";
+        case 302: return "Found";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default: return "";
+        }
+    }
+}
+
+void WebServer::begin()
+{
+    _started = true;
+    if (!network().hostSockets || _listenFd >= 0) return;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return;
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)(_port + network().portOffset));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0)
+    {
+        fprintf(stderr, "WebServer: port %d: %s\n", _port + network().portOffset, strerror(errno));
+        ::close(fd);
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    _listenFd = fd;
+}
+
+void WebServer::stop()
+{
+    _started = false;
+    if (_listenFd >= 0) ::close(_listenFd);
+    _listenFd = -1;
+}
+
+void WebServer::handleClient()
+{
+    if (!_started || _listenFd < 0) return;
+    int fd = accept(_listenFd, nullptr, nullptr);
+    if (fd < 0) return;
+    if (readRequest(fd))
+    {
+        _clientFd = fd;
+        _headers.clear();
+        _contentLength = CONTENT_LENGTH_NOT_SET;
+        _chunked = false;
+        THandlerFunction handler = _notFound;
+        for (size_t i = 0; i < _routes.size(); i++)
+        {
+            if (_routes[i].uri == _uri && (_routes[i].method == HTTP_ANY || _routes[i].method == _method))
+            {
+                handler = _routes[i].handler;
+                break;
+            }
+        }
+        if (handler) handler();
+        else send(404, "text/plain", "Not found");
+        if (_chunked) sendContent("", 0);
+        _clientFd = -1;
+    }
+    ::close(fd);
+}
+
+// Request line, headers and a form body, into _method, _uri and _args
+bool WebServer::readRequest(int fd)
+{
+    std::string request;
+    size_t end;
+    while ((end = request.find("\r\n\r\n")) == std::string::npos)
+    {
+        if (request.size() > 8192 || !receiveMore(fd, request, 1000)) return false;
+    }
+    char method[16];
+    char target[1024];
+    if (sscanf(request.c_str(), "%15s %1023s", method, target) != 2) return false;
+    static const char* const methods[] = { "", "GET", "HEAD", "POST", "PUT", "PATCH", "DELETE", "OPTIONS" };
+    _method = HTTP_GET;
+    for (size_t i = 1; i < sizeof(methods) / sizeof(methods[0]); i++)
+    {
+        if (strcmp(method, methods[i]) == 0) _method = (HTTPMethod)i;
+    }
+    _args.clear();
+    std::string path = target;
+    size_t query = path.find('?');
+    _uri = urlDecode(path.substr(0, query));
+    if (query != std::string::npos) addArgs(path.substr(query + 1));
+
+    size_t length = 0;
+    const char* header = strcasestr(request.c_str(), "\r\nContent-Length:");
+    if (header != nullptr && header < request.c_str() + end) length = strtoul(header + 17, nullptr, 10);
+    std::string body = request.substr(end + 4);
+    while (body.size() < length)
+    {
+        if (!receiveMore(fd, body, 1000)) return false;
+    }
+    if (length > 0) addArgs(body.substr(0, length));
+    return true;
+}
+
+void WebServer::addArgs(const std::string& query)
+{
+    size_t start = 0;
+    while (start < query.size())
+    {
+        size_t end = query.find('&', start);
+        if (end == std::string::npos) end = query.size();
+        std::string pair = query.substr(start, end - start);
+        size_t equals = pair.find('=');
+        Arg arg = { urlDecode(pair.substr(0, equals)), equals == std::string::npos ? "" : urlDecode(pair.substr(equals + 1)) };
+        if (!arg.name.empty()) _args.push_back(arg);
+        start = end + 1;
+    }
+}
+
+void WebServer::write(const char* data, size_t length)
+{
+    while (_clientFd >= 0 && length > 0)
+    {
+        ssize_t n = ::send(_clientFd, data, length, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            _clientFd = -1; // the peer went away, the handler finishes unheard
+            return;
+        }
+        data += n;
+        length -= (size_t)n;
+    }
+}
+
+void WebServer::on(const char* uri, HTTPMethod method, THandlerFunction handler)
+{
+    Route route = { uri, method, handler };
+    _routes.push_back(route);
+}
+
+String WebServer::arg(int i) const
+{
+    return i >= 0 && i < (int)_args.size() ? String(_args[i].value) : String();
+}
+
+String WebServer::arg(const char* name) const
+{
+    for (size_t i = 0; i < _args.size(); i++)
+    {
+        if (_args[i].name == name) return String(_args[i].value);
+    }
+    return String();
+}
+
+String WebServer::argName(int i) const
+{
+    return i >= 0 && i < (int)_args.size() ? String(_args[i].name) : String();
+}
+
+bool WebServer::hasArg(const char* name) const
+{
+    for (size_t i = 0; i < _args.size(); i++)
+    {
+        if (_args[i].name == name) return true;
+    }
+    return false;
+}
+
+void WebServer::sendHeader(const char* name, const char* value, bool first)
+{
+    std::string line = std::string(name) + ": " + value + "\r\n";
+    _headers = first ? line + _headers : _headers + line;
+}
+
+// Headers, then the content; CONTENT_LENGTH_UNKNOWN sends it chunked, the
+// handler ending with sendContent("") like on the device
+void WebServer::send(int code, const char* contentType, const char* content)
+{
+    if (content == nullptr) content = "";
+    std::string head = "HTTP/1.1 " + std::to_string(code) + " " + reason(code) + "\r\n";
+    if (contentType != nullptr) head += std::string("Content-Type: ") + contentType + "\r\n";
+    head += _headers;
+    _chunked = _contentLength == CONTENT_LENGTH_UNKNOWN;
+    if (_chunked) head += "Transfer-Encoding: chunked\r\n";
+    else
+    {
+        size_t length = _contentLength == CONTENT_LENGTH_NOT_SET ? strlen(content) : _contentLength;
+        head += "Content-Length: " + std::to_string(length) + "\r\n";
+    }
+    head += "Connection: close\r\n\r\n";
+    write(head.data(), head.size());
+    _headers.clear();
+    _contentLength = CONTENT_LENGTH_NOT_SET;
+    if (*content != '\0') sendContent(content, strlen(content));
+}
+
+void WebServer::sendContent(const char* content, size_t length)
+{
+    if (!_chunked)
+    {
+        write(content, length);
+        return;
+    }
+    char size[16];
+    snprintf(size, sizeof(size), "%zx\r\n", length);
+    write(size, strlen(size));
+    write(content, length);
+    write("\r\n", 2);
+    if (length == 0) _chunked = false; // the last chunk
+}
+
+// --- WebSocketsClient --------------------------------------------------
+
+namespace
+{
+    struct WebSocketServers
+    {
+        std::map<std::pair<uint32_t, uint16_t>, host::WebSocketHandler> listening;
+        std::vector<WebSocketsClient*> clients;
+        uint32_t nextClientId = 1;
+    };
+
+    WebSocketServers& webSocketServers()
+    {
+        static WebSocketServers* w = new WebSocketServers();
+        return *w;
+    }
+
+    std::pair<uint32_t, uint16_t> serverKey(IPAddress ip, uint16_t port)
+    {
+        return std::make_pair((uint32_t)ip, port);
+    }
+}
+
+void host::listenWebSocket(uint32_t ip, uint16_t port, WebSocketHandler onText)
+{
+    webSocketServers().listening[std::make_pair(ip, port)] = onText;
+}
+
+void host::closeWebSocket(uint32_t ip, uint16_t port)
+{
+    WebSocketServers& w = webSocketServers();
+    w.listening.erase(std::make_pair(ip, port));
+    // the clients see the connection drop at their next loop()
+}
+
+size_t host::webSocketSend(uint32_t ip, uint16_t port, const char* text, size_t length)
+{
+    size_t sent = 0;
+    std::vector<WebSocketsClient*>& clients = webSocketServers().clients;
+    for (size_t i = 0; i < clients.size(); i++)
+    {
+        if (clients[i]->isConnected() && clients[i]->serves(std::make_pair(ip, port)))
+        {
+            clients[i]->deliver(text, length);
+            sent++;
+        }
+    }
+    return sent;
+}
+
+bool host::webSocketSendTo(uint32_t client, const char* text, size_t length)
+{
+    std::vector<WebSocketsClient*>& clients = webSocketServers().clients;
+    for (size_t i = 0; i < clients.size(); i++)
+    {
+        if (clients[i]->id() != client) continue;
+        if (!clients[i]->isConnected()) return false;
+        clients[i]->deliver(text, length);
+        return true;
+    }
+    return false;
+}
+
+WebSocketsClient::WebSocketsClient() : _id(webSocketServers().nextClientId++)
+{
+    webSocketServers().clients.push_back(this);
+}
+
+WebSocketsClient::~WebSocketsClient()
+{
+    std::vector<WebSocketsClient*>& clients = webSocketServers().clients;
+    for (size_t i = 0; i < clients.size(); i++)
+    {
+        if (clients[i] == this)
+        {
+            clients.erase(clients.begin() + i);
+            break;
+        }
+    }
+}
+
+void WebSocketsClient::begin(const char* host, uint16_t port, const char* url, const char* protocol)
+{
+    (void)protocol;
+    drop();
+    _host = host != nullptr ? host : "";
+    _port = port;
+    _url = url != nullptr ? url : "/";
+    _begun = true;
+    _attempted = false;
+}
+
+void WebSocketsClient::begin(IPAddress host, uint16_t port, const char* url, const char* protocol)
+{
+    begin(host.toString().c_str(), port, url, protocol);
+}
+
+bool WebSocketsClient::serves(std::pair<uint32_t, uint16_t> server) const
+{
+    IPAddress ip;
+    return lookup(_host.c_str(), ip) && serverKey(ip, _port) == server;
+}
+
+void WebSocketsClient::deliver(const char* text, size_t length)
+{
+    _inbox.push_back(std::string(text, length));
+}
+
+void WebSocketsClient::drop()
+{
+    if (_fd >= 0) ::close(_fd);
+    _fd = -1;
+    _received.clear();
+    _inbox.clear();
+    _pongsDue = 0;
+    bool was = _connected;
+    _connected = false;
+    if (was && _event) _event(WStype_DISCONNECTED, nullptr, 0);
+}
+
+void WebSocketsClient::disconnect()
+{
+    if (_fd >= 0) sendFrame(0x8, "\x03\xe8", 2); // 1000, normal closure
+    drop();
+    _attempted = true;
+    _lastAttemptMs = millis();
+}
+
+void WebSocketsClient::loop()
+{
+    if (!_begun) return;
+    IPAddress ip;
+    WebSocketServers& w = webSocketServers();
+    bool resolved = network().wifiUp && lookup(_host.c_str(), ip);
+    bool listening = resolved && w.listening.count(serverKey(ip, _port)) != 0;
+    if (_connected && (_fd >= 0 ? !network().wifiUp : !listening))
+    {
+        drop();
+        _attempted = true;
+        _lastAttemptMs = millis();
+    }
+    if (!_connected)
+    {
+        if (_attempted && millis() - _lastAttemptMs < _reconnectIntervalMs) return;
+        _attempted = true;
+        _lastAttemptMs = millis();
+        if (!listening && !(resolved && network().hostSockets && openSocket(ip))) return;
+        _connected = true;
+        if (_event) _event(WStype_CONNECTED, (uint8_t*)&_url[0], _url.size());
+    }
+    if (_fd >= 0)
+    {
+        receive();
+        return;
+    }
+    for (; _connected && _pongsDue > 0; _pongsDue--)
+    {
+        if (_event) _event(WStype_PONG, nullptr, 0);
+    }
+    // frames queued by the server so far, new ones wait for the next loop()
+    size_t count = _inbox.size();
+    for (size_t i = 0; i < count && _connected && !_inbox.empty(); i++)
+    {
+        std::string text;
+        text.swap(_inbox.front());
+        _inbox.pop_front();
+        if (_event) _event(WStype_TEXT, (uint8_t*)&text[0], text.size());
+    }
+}
+
+bool WebSocketsClient::sendTXT(const char* payload, size_t length)
+{
+    if (!_connected) return false;
+    if (length == 0 && payload != nullptr) length = strlen(payload);
+    if (_fd >= 0) return sendFrame(0x1, payload, length);
+    IPAddress ip;
+    WebSocketServers& w = webSocketServers();
+    std::map<std::pair<uint32_t, uint16_t>, host::WebSocketHandler>::const_iterator it;
+    if (!lookup(_host.c_str(), ip) || (it = w.listening.find(serverKey(ip, _port))) == w.listening.end()) return false;
+    host::WebSocketHandler onText = it->second; // the server may close from its handler
+    if (onText) onText(_id, payload, length);
+    return true;
+}
+
+bool WebSocketsClient::sendPing(const char* payload, size_t length)
+{
+    if (!_connected) return false;
+    if (_fd >= 0) return sendFrame(0x9, payload, payload != nullptr ? length : 0);
+    _pongsDue++;
+    return true;
+}
+
+// Connects and upgrades, blocking like the library's connect() does
+bool WebSocketsClient::openSocket(IPAddress ip)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(_port);
+    addr.sin_addr.s_addr = (uint32_t)ip;
+    std::string response;
+    size_t end = std::string::npos;
+    if (::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0)
+    {
+        int flag = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+        std::string request = "GET " + _url + " HTTP/1.1\r\nHost: " + _host + ":" + std::to_string(_port) +
+                              "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                              "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+        if (::send(fd, request.data(), request.size(), MSG_NOSIGNAL) == (ssize_t)request.size())
+        {
+            while ((end = response.find("\r\n\r\n")) == std::string::npos && response.size() < 4096 &&
+                   receiveMore(fd, response, 5000))
+            {
+            }
+        }
+    }
+    if (end == std::string::npos || response.compare(0, 12, "HTTP/1.1 101") != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    _fd = fd;
+    _received = response.substr(end + 4); // frames right behind the upgrade
+    return true;
+}
+
+// Reads what has arrived, a buffer at a time, handling each complete frame
+void WebSocketsClient::receive()
+{
+    char buffer[4096];
+    if (!_received.empty()) handleFrames(); // right behind the upgrade
+    while (_fd >= 0)
+    {
+        ssize_t n = recv(_fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n <= 0)
+        {
+            drop(); // closed by the server, or reset
+            _attempted = true;
+            _lastAttemptMs = millis();
+            return;
+        }
+        _received.append(buffer, (size_t)n);
+        handleFrames();
+    }
+}
+
+// Complete frames of _received; a frame over the limit is refused on its
+// header, before its payload is buffered
+void WebSocketsClient::handleFrames()
+{
+    // WEBSOCKETS_MAX_DATA_SIZE of the ESP32 build: the library closes with
+    // 1009 (message too big)
+    const uint64_t maxFrameBytes = 15 * 1024;
+    size_t pos = 0;
+    while (_connected && _fd >= 0)
+    {
+        size_t available = _received.size() - pos;
+        const uint8_t* p = (const uint8_t*)_received.data() + pos;
+        if (available < 2) break;
+        uint64_t length = p[1] & 0x7f;
+        size_t header = 2;
+        if (length == 126)
+        {
+            if (available < 4) break;
+            length = ((uint64_t)p[2] << 8) | p[3];
+            header = 4;
+        }
+        else if (length == 127)
+        {
+            if (available < 10) break;
+            length = 0;
+            for (int i = 0; i < 8; i++) length = (length << 8) | p[2 + i];
+            header = 10;
+        }
+        bool masked = (p[1] & 0x80) != 0;
+        if (masked) header += 4;
+        if (length > maxFrameBytes)
+        {
+            sendFrame(0x8, "\x03\xf1", 2);
+            drop();
+            _attempted = true;
+            _lastAttemptMs = millis();
+            return;
+        }
+        if (available < header + length) break;
+        std::string payload = _received.substr(pos + header, (size_t)length);
+        if (masked)
+        {
+            for (size_t i = 0; i < payload.size(); i++) payload[i] ^= p[header - 4 + i % 4];
+        }
+        bool fin = (p[0] & 0x80) != 0;
+        uint8_t opcode = p[0] & 0x0f;
+        pos += header + (size_t)length;
+        handleFrame(fin, opcode, payload);
+    }
+    if (_fd >= 0) _received.erase(0, pos);
+}
+
+void WebSocketsClient::handleFrame(bool fin, uint8_t opcode, std::string& payload)
+{
+    uint8_t* data = (uint8_t*)&payload[0];
+    switch (opcode)
+    {
+    case 0x0:
+        if (_event) _event(fin ? WStype_FRAGMENT_FIN : WStype_FRAGMENT, data, payload.size());
+        break;
+    case 0x1:
+        if (_event) _event(fin ? WStype_TEXT : WStype_FRAGMENT_TEXT_START, data, payload.size());
+        break;
+    case 0x2:
+        if (_event) _event(fin ? WStype_BIN : WStype_FRAGMENT_BIN_START, data, payload.size());
+        break;
+    case 0x8:
+        sendFrame(0x8, payload.data(), payload.size() < 2 ? payload.size() : 2);
+        drop();
+        _attempted = true;
+        _lastAttemptMs = millis();
+        break;
+    case 0x9:
+        sendFrame(0xa, payload.data(), payload.size());
+        if (_event) _event(WStype_PING, data, payload.size());
+        break;
+    case 0xa:
+        if (_event) _event(WStype_PONG, data, payload.size());
+        break;
+    default:
+        break;
+    }
+}
+
+// A masked client frame, written whole
+bool WebSocketsClient::sendFrame(uint8_t opcode, const char* payload, size_t length)
+{
+    static std::minstd_rand maskKeys(1);
+    uint8_t header[14];
+    size_t size = 0;
+    header[size++] = (uint8_t)(0x80 | opcode);
+    if (length < 126) header[size++] = (uint8_t)(0x80 | length);
+    else if (length < 65536)
+    {
+        header[size++] = 0x80 | 126;
+        header[size++] = (uint8_t)(length >> 8);
+        header[size++] = (uint8_t)length;
+    }
+    else
+    {
+        header[size++] = 0x80 | 127;
+        for (int i = 7; i >= 0; i--) header[size++] = (uint8_t)((uint64_t)length >> (8 * i));
+    }
+    uint32_t key = (uint32_t)maskKeys();
+    uint8_t* mask = header + size;
+    memcpy(mask, &key, 4);
+    size += 4;
+    std::string frame((const char*)header, size);
+    frame.append(payload != nullptr ? payload : "", payload != nullptr ? length : 0);
+    for (size_t i = 0; i < frame.size() - size; i++) frame[size + i] ^= (char)mask[i % 4];
+    const char* data = frame.data();
+    size_t left = frame.size();
+    while (left > 0)
+    {
+        ssize_t n = ::send(_fd, data, left, MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            struct pollfd p = { _fd, POLLOUT, 0 };
+            if (poll(&p, 1, 1000) > 0) continue;
+        }
+        if (n <= 0) return false;
+        data += n;
+        left -= (size_t)n;
+    }
+    return true;
+}
@@ -0,0 +1,500 @@
+// NVS, Preferences and LittleFS for the host build
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include "ArduinoHost.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "Preferences.h"
+#include "FS.h"
+#include "LittleFS.h"
+
+// --- NVS ---------------------------------------------------------------
+
+namespace
+{
+    enum NvsType
+    {
+        NVS_U8,
+        NVS_U16,
+        NVS_U32,
+        NVS_STR,
+        NVS_BLOB
+    };
+
+    struct NvsEntry
+    {
+        NvsType type;
+        std::vector<uint8_t> data;
+    };
+
+    typedef std::map<std::string, NvsEntry> NvsNamespace;
+
+    struct NvsHandle
+    {
+        std::string name;
+        bool readOnly;
+    };
+
+    struct Nvs
+    {
+        std::map<std::string, NvsNamespace> namespaces;
+        std::map<nvs_handle_t, NvsHandle> handles;
+        nvs_handle_t nextHandle = 1;
+    };
+
+    Nvs& nvs()
+    {
+        static Nvs* n = new Nvs();
+        return *n;
+    }
+
+    NvsHandle* nvsHandle(nvs_handle_t handle)
+    {
+        std::map<nvs_handle_t, NvsHandle>::iterator it = nvs().handles.find(handle);
+        return it == nvs().handles.end() ? nullptr : &it->second;
+    }
+
+    esp_err_t nvsSet(nvs_handle_t handle, const char* key, NvsType type, const void* value, size_t length)
+    {
+        NvsHandle* h = nvsHandle(handle);
+        if (h == nullptr) return ESP_ERR_NVS_INVALID_HANDLE;
+        if (h->readOnly) return ESP_ERR_NVS_READ_ONLY;
+        if (key == nullptr || strlen(key) > 15) return ESP_ERR_INVALID_ARG;
+        NvsEntry& entry = nvs().namespaces[h->name][key];
+        entry.type = type;
+        entry.data.assign((const uint8_t*)value, (const uint8_t*)value + length);
+        return ESP_OK;
+    }
+
+    const NvsEntry* nvsFind(nvs_handle_t handle, const char* key, NvsType type, esp_err_t* err)
+    {
+        NvsHandle* h = nvsHandle(handle);
+        if (h == nullptr)
+        {
+            *err = ESP_ERR_NVS_INVALID_HANDLE;
+            return nullptr;
+        }
+        NvsNamespace& ns = nvs().namespaces[h->name];
+        NvsNamespace::const_iterator it = ns.find(key);
+        // the type is part of the key, as in the NVS library
+        if (it == ns.end() || it->second.type != type)
+        {
+            *err = ESP_ERR_NVS_NOT_FOUND;
+            return nullptr;
+        }
+        *err = ESP_OK;
+        return &it->second;
+    }
+
+    esp_err_t nvsGetInt(nvs_handle_t handle, const char* key, NvsType type, void* value, size_t size)
+    {
+        esp_err_t err;
+        const NvsEntry* entry = nvsFind(handle, key, type, &err);
+        if (entry == nullptr) return err;
+        memcpy(value, entry->data.data(), size);
+        return ESP_OK;
+    }
+
+    esp_err_t nvsGetBytes(nvs_handle_t handle, const char* key, NvsType type, void* value, size_t* length)
+    {
+        if (length == nullptr) return ESP_ERR_INVALID_ARG;
+        esp_err_t err;
+        const NvsEntry* entry = nvsFind(handle, key, type, &err);
+        if (entry == nullptr) return err;
+        if (value == nullptr)
+        {
+            *length = entry->data.size();
+            return ESP_OK;
+        }
+        if (*length < entry->data.size())
+        {
+            *length = entry->data.size();
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        }
+        memcpy(value, entry->data.data(), entry->data.size());
+        *length = entry->data.size();
+        return ESP_OK;
+    }
+}
+
+esp_err_t nvs_flash_init()
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase()
+{
+    nvs().namespaces.clear();
+    return ESP_OK;
+}
+
+void host::eraseNvs()
+{
+    nvs_flash_erase();
+}
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t mode, nvs_handle_t* handle)
+{
+    if (name == nullptr || handle == nullptr || strlen(name) > 15) return ESP_ERR_INVALID_ARG;
+    Nvs& n = nvs();
+    if (mode == NVS_READONLY && n.namespaces.find(name) == n.namespaces.end()) return ESP_ERR_NVS_NOT_FOUND;
+    n.namespaces[name];
+    *handle = n.nextHandle++;
+    NvsHandle h = { name, mode == NVS_READONLY };
+    n.handles[*handle] = h;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    nvs().handles.erase(handle);
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return nvsHandle(handle) != nullptr ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key)
+{
+    NvsHandle* h = nvsHandle(handle);
+    if (h == nullptr) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (h->readOnly) return ESP_ERR_NVS_READ_ONLY;
+    return nvs().namespaces[h->name].erase(key) > 0 ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle)
+{
+    NvsHandle* h = nvsHandle(handle);
+    if (h == nullptr) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (h->readOnly) return ESP_ERR_NVS_READ_ONLY;
+    nvs().namespaces[h->name].clear();
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char* key, uint8_t value)
+{
+    return nvsSet(handle, key, NVS_U8, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_u16(nvs_handle_t handle, const char* key, uint16_t value)
+{
+    return nvsSet(handle, key, NVS_U16, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char* key, uint32_t value)
+{
+    return nvsSet(handle, key, NVS_U32, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char* key, const char* value)
+{
+    if (value == nullptr) return ESP_ERR_INVALID_ARG;
+    return nvsSet(handle, key, NVS_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value, size_t length)
+{
+    return nvsSet(handle, key, NVS_BLOB, value, length);
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char* key, uint8_t* value)
+{
+    return nvsGetInt(handle, key, NVS_U8, value, sizeof(*value));
+}
+
+esp_err_t nvs_get_u16(nvs_handle_t handle, const char* key, uint16_t* value)
+{
+    return nvsGetInt(handle, key, NVS_U16, value, sizeof(*value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char* key, uint32_t* value)
+{
+    return nvsGetInt(handle, key, NVS_U32, value, sizeof(*value));
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char* key, char* value, size_t* length)
+{
+    return nvsGetBytes(handle, key, NVS_STR, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* value, size_t* length)
+{
+    return nvsGetBytes(handle, key, NVS_BLOB, value, length);
+}
+
+// --- Preferences -------------------------------------------------------
+
+bool Preferences::begin(const char* name, bool readOnly)
+{
+    if (_started) return false;
+    _readOnly = readOnly;
+    _started = nvs_open(name, readOnly ? NVS_READONLY : NVS_READWRITE, &_handle) == ESP_OK;
+    return _started;
+}
+
+void Preferences::end()
+{
+    if (!_started) return;
+    nvs_close(_handle);
+    _started = false;
+}
+
+bool Preferences::clear()
+{
+    return _started && !_readOnly && nvs_erase_all(_handle) == ESP_OK;
+}
+
+bool Preferences::remove(const char* key)
+{
+    return _started && !_readOnly && nvs_erase_key(_handle, key) == ESP_OK;
+}
+
+size_t Preferences::putUChar(const char* key, uint8_t value)
+{
+    return _started && nvs_set_u8(_handle, key, value) == ESP_OK ? sizeof(value) : 0;
+}
+
+size_t Preferences::putUShort(const char* key, uint16_t value)
+{
+    return _started && nvs_set_u16(_handle, key, value) == ESP_OK ? sizeof(value) : 0;
+}
+
+size_t Preferences::putUInt(const char* key, uint32_t value)
+{
+    return _started && nvs_set_u32(_handle, key, value) == ESP_OK ? sizeof(value) : 0;
+}
+
+size_t Preferences::putString(const char* key, const char* value)
+{
+    return _started && nvs_set_str(_handle, key, value) == ESP_OK ? strlen(value) : 0;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t length)
+{
+    return _started && nvs_set_blob(_handle, key, value, length) == ESP_OK ? length : 0;
+}
+
+uint8_t Preferences::getUChar(const char* key, uint8_t defaultValue)
+{
+    uint8_t value = defaultValue;
+    if (_started) nvs_get_u8(_handle, key, &value);
+    return value;
+}
+
+uint16_t Preferences::getUShort(const char* key, uint16_t defaultValue)
+{
+    uint16_t value = defaultValue;
+    if (_started) nvs_get_u16(_handle, key, &value);
+    return value;
+}
+
+uint32_t Preferences::getUInt(const char* key, uint32_t defaultValue)
+{
+    uint32_t value = defaultValue;
+    if (_started) nvs_get_u32(_handle, key, &value);
+    return value;
+}
+
+size_t Preferences::getString(const char* key, char* value, size_t maxLength)
+{
+    size_t length = maxLength;
+    if (!_started || value == nullptr || nvs_get_str(_handle, key, value, &length) != ESP_OK) return 0;
+    return length;
+}
+
+size_t Preferences::getBytesLength(const char* key)
+{
+    size_t length = 0;
+    if (!_started || nvs_get_blob(_handle, key, nullptr, &length) != ESP_OK) return 0;
+    return length;
+}
+
+size_t Preferences::getBytes(const char* key, void* buffer, size_t maxLength)
+{
+    size_t length = maxLength;
+    if (!_started || buffer == nullptr || nvs_get_blob(_handle, key, buffer, &length) != ESP_OK) return 0;
+    return length;
+}
+
+// --- LittleFS ----------------------------------------------------------
+
+namespace
+{
+    std::string& dataDir()
+    {
+        static std::string* dir = new std::string();
+        if (dir->empty())
+        {
+            char pattern[] = "/tmp/arduino-host-XXXXXX";
+            const char* made = mkdtemp(pattern);
+            *dir = made != nullptr ? made : ".";
+        }
+        return *dir;
+    }
+
+    std::string hostPath(const char* path)
+    {
+        std::string p = path != nullptr ? path : "";
+        if (p.empty() || p[0] != '/') p = "/" + p;
+        return dataDir() + p;
+    }
+}
+
+void host::setDataDir(const char* dir)
+{
+    ::mkdir(dir, 0755);
+    dataDir() = dir;
+}
+
+namespace fs
+{
+    class FileImpl
+    {
+    public:
+        FileImpl(FILE* f, const char* path) : file(f), name(path) {}
+        ~FileImpl() { close(); }
+        void close()
+        {
+            if (file != nullptr) fclose(file);
+            file = nullptr;
+        }
+
+        FILE* file;
+        std::string name;
+    };
+}
+
+fs::LittleFSFS LittleFS;
+
+size_t fs::File::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t fs::File::write(const uint8_t* buffer, size_t size)
+{
+    if (!_impl || _impl->file == nullptr) return 0;
+    return fwrite(buffer, 1, size, _impl->file);
+}
+
+void fs::File::flush()
+{
+    if (_impl && _impl->file != nullptr) fflush(_impl->file);
+}
+
+int fs::File::available()
+{
+    if (!_impl || _impl->file == nullptr) return 0;
+    return (int)(size() - position());
+}
+
+int fs::File::read()
+{
+    if (!_impl || _impl->file == nullptr) return -1;
+    int c = fgetc(_impl->file);
+    return c == EOF ? -1 : c;
+}
+
+int fs::File::peek()
+{
+    int c = read();
+    if (c >= 0) ungetc(c, _impl->file);
+    return c;
+}
+
+size_t fs::File::read(uint8_t* buffer, size_t size)
+{
+    if (!_impl || _impl->file == nullptr) return 0;
+    return fread(buffer, 1, size, _impl->file);
+}
+
+bool fs::File::seek(uint32_t pos, SeekMode mode)
+{
+    if (!_impl || _impl->file == nullptr) return false;
+    int whence = mode == SeekCur ? SEEK_CUR : (mode == SeekEnd ? SEEK_END : SEEK_SET);
+    return fseek(_impl->file, (long)pos, whence) == 0;
+}
+
+size_t fs::File::position() const
+{
+    if (!_impl || _impl->file == nullptr) return 0;
+    long at = ftell(_impl->file);
+    return at < 0 ? 0 : (size_t)at;
+}
+
+size_t fs::File::size() const
+{
+    if (!_impl || _impl->file == nullptr) return 0;
+    fflush(_impl->file);
+    struct stat st;
+    if (fstat(fileno(_impl->file), &st) != 0) return 0;
+    return (size_t)st.st_size;
+}
+
+void fs::File::close()
+{
+    if (_impl) _impl->close();
+    _impl.reset();
+}
+
+const char* fs::File::path() const
+{
+    return _impl ? _impl->name.c_str() : nullptr;
+}
+
+fs::File fs::FS::open(const char* path, const char* mode, bool create)
+{
+    (void)create;
+    std::string p = hostPath(path);
+    struct stat st;
+    if (stat(p.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) return File();
+    std::string m = mode != nullptr ? mode : "r";
+    if (m.find('b') == std::string::npos) m += "b";
+    FILE* f = fopen(p.c_str(), m.c_str());
+    if (f == nullptr) return File();
+    return File(std::make_shared<FileImpl>(f, path));
+}
+
+bool fs::FS::exists(const char* path)
+{
+    struct stat st;
+    return stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool fs::FS::remove(const char* path)
+{
+    return ::unlink(hostPath(path).c_str()) == 0;
+}
+
+bool fs::FS::rename(const char* from, const char* to)
+{
+    return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+bool fs::FS::mkdir(const char* path)
+{
+    return ::mkdir(hostPath(path).c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+bool fs::FS::rmdir(const char* path)
+{
+    return ::rmdir(hostPath(path).c_str()) == 0;
+}
+
+bool fs::LittleFSFS::begin(bool formatOnFail, const char* basePath, uint8_t maxOpenFiles, const char* partitionLabel)
+{
+    (void)formatOnFail;
+    (void)basePath;
+    (void)maxOpenFiles;
+    (void)partitionLabel;
+    struct stat st;
+    return stat(dataDir().c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
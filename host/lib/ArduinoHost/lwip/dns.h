@@ -0,0 +1,29 @@
+#ifndef LWIP_DNS_H
+#define LWIP_DNS_H
+
+#include <stdint.h>
+
+// lwIP's DNS client over the name table of the host network (host::addHost):
+// a known name or an address literal answers at once (ERR_OK), anything
+// else fails (ERR_VAL), the callback is never called
+
+typedef int8_t err_t;
+enum { ERR_OK = 0, ERR_INPROGRESS = -5, ERR_VAL = -6, ERR_ARG = -16 };
+
+enum { IPADDR_TYPE_V4 = 0 };
+struct ip4_addr { uint32_t addr; };
+typedef struct ip_addr
+{
+    union { struct ip4_addr ip4; } u_addr;
+    uint8_t type;
+} ip_addr_t;
+#define ip_2_ip4(ipaddr) (&((ipaddr)->u_addr.ip4))
+
+enum { LWIP_DNS_ADDRTYPE_IPV4 = 0 };
+
+typedef void (*dns_found_callback)(const char* name, const ip_addr_t* ipaddr, void* callback_arg);
+
+err_t dns_gethostbyname_addrtype(const char* hostname, ip_addr_t* addr, dns_found_callback found,
+                                 void* callback_arg, uint8_t dns_addrtype);
+
+#endif
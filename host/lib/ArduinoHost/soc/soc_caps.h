@@ -0,0 +1,12 @@
+#ifndef SOC_CAPS_H
+#define SOC_CAPS_H
+
+// ESP32-C3
+#define SOC_TIMER_GROUPS                    2
+#define SOC_TIMER_GROUP_TIMERS_PER_GROUP    1
+#define SOC_RMT_CHANNELS_PER_GROUP          4
+#define SOC_RMT_TX_CANDIDATES_PER_GROUP     2
+#define SOC_RMT_MEM_WORDS_PER_CHANNEL       48
+#define SOC_GPIO_PIN_COUNT                  22
+
+#endif
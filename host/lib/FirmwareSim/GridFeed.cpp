@@ -0,0 +1,76 @@
+#include "GridFeed.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <ArduinoHost.h>
+
+GridFeed::GridFeed(uint32_t ip, uint16_t port) : _ip(ip), _port(port)
+{
+}
+
+void GridFeed::listen()
+{
+    host::listenWebSocket(_ip, _port, [this](uint32_t client, const char* text, size_t length) {
+        onText(client, text, length);
+    });
+    _up = true;
+}
+
+void GridFeed::play(const std::vector<Sample>& samples)
+{
+    _samples = samples;
+    _next = 0;
+    listen();
+    if (!_samples.empty()) host::at(_samples[0].atUs, [this] { publishNext(); });
+}
+
+void GridFeed::outage(int64_t durationUs)
+{
+    host::closeWebSocket(_ip, _port);
+    _up = false;
+    host::at(host::now() + durationUs, [this] { listen(); });
+}
+
+void GridFeed::publishNext()
+{
+    const Sample& s = _samples[_next++];
+    if (_up)
+    {
+        char text[64];
+        int length = snprintf(text, sizeof(text), "{\"time_stamp\": %llu, \"frequency\": %.3f}",
+                              (unsigned long long)s.timeStamp, s.frequency);
+        _messagesSent += host::webSocketSend(_ip, _port, text, (size_t)length) > 0 ? 1 : 0;
+    }
+    if (_next < _samples.size()) host::at(_samples[_next].atUs, [this] { publishNext(); });
+}
+
+// {"backfill_since":<time_stamp>,"max":<samples per message>}, anything
+// else (the "Connected" greeting) is ignored
+void GridFeed::onText(uint32_t client, const char* text, size_t length)
+{
+    std::string request(text, length);
+    unsigned long long since = 0;
+    unsigned int chunk = 32;
+    if (sscanf(request.c_str(), "{\"backfill_since\":%llu,\"max\":%u}", &since, &chunk) < 1) return;
+    if (chunk == 0) chunk = 1;
+    _backfillRequests++;
+
+    size_t first = 0;
+    while (first < _next && _samples[first].timeStamp <= since) first++;
+    // one message at least, an empty one if nothing was missed
+    for (size_t i = first; i == first || i < _next; i += chunk)
+    {
+        std::string message = "{\"backfill\":[";
+        size_t end = i + chunk < _next ? i + chunk : _next;
+        for (size_t j = i; j < end; j++)
+        {
+            char item[48];
+            snprintf(item, sizeof(item), "%s[%llu,%.3f]", j == i ? "" : ",",
+                     (unsigned long long)_samples[j].timeStamp, _samples[j].frequency);
+            message += item;
+        }
+        message += end < _next ? "],\"more\":true}" : "],\"more\":false}";
+        host::webSocketSendTo(client, message.data(), message.size());
+        _backfilled += (uint32_t)(end - i);
+    }
+}
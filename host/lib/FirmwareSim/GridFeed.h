@@ -0,0 +1,58 @@
+#ifndef GRID_FEED_H
+#define GRID_FEED_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// GridFreqMonitor stand-in on the in-process WebSockets of the host build
+// (host::listenWebSocket()), the counterpart of tools/gridfreq_server.py:
+// publishes a series of samples, each at its own virtual time, as
+// {"time_stamp", "frequency"} messages to the connected clients, and
+// answers the backfill requests of SourceSelector from what it published.
+class GridFeed
+{
+public:
+    struct Sample
+    {
+        int64_t atUs;           // virtual time it is published at
+        uint64_t timeStamp;     // as sent, seconds or milliseconds
+        float frequency;
+    };
+
+    GridFeed(uint32_t ip, uint16_t port);
+
+    // Listens and publishes the samples at their time, in order
+    void play(const std::vector<Sample>& samples);
+
+    // Closes the server for durationUs: the clients drop, the samples keep
+    // coming and are backfilled on request once it listens again
+    void outage(int64_t durationUs);
+
+    bool up() const { return _up; }
+    bool done() const { return _next >= _samples.size(); }
+
+    // Last sample published, nullptr before the first one
+    const Sample* latest() const { return _next > 0 ? &_samples[_next - 1] : nullptr; }
+
+    uint32_t published() const { return (uint32_t)_next; }
+    uint32_t messagesSent() const { return _messagesSent; }    // per client
+    uint32_t backfillRequests() const { return _backfillRequests; }
+    uint32_t backfilled() const { return _backfilled; }         // samples sent in answers
+
+private:
+    void listen();
+    void publishNext();
+    void onText(uint32_t client, const char* text, size_t length);
+
+    uint32_t _ip;
+    uint16_t _port;
+    std::vector<Sample> _samples;
+    size_t _next = 0;
+    bool _up = false;
+    uint32_t _messagesSent = 0;
+    uint32_t _backfillRequests = 0;
+    uint32_t _backfilled = 0;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#include "HcmsPanel.h"
+#include <Arduino.h>
+#include <ArduinoHost.h>
+#include "HCMS39xx.h"
+
+HcmsPanel::HcmsPanel(uint8_t numChars, uint8_t dataPin, uint8_t rsPin, uint8_t clkPin, uint8_t cePin, uint8_t blankPin)
+    : _dataPin(dataPin), _rsPin(rsPin), _clkPin(clkPin), _cePin(cePin), _blankPin(blankPin),
+      _columns(numChars * COLUMNS_PER_CHAR, 0)
+{
+}
+
+void HcmsPanel::attach()
+{
+    host::onPinChange([this](uint8_t pin, int level, int64_t atUs) { pinChanged(pin, level, atUs); });
+}
+
+void HcmsPanel::pinChanged(uint8_t pin, int level, int64_t atUs)
+{
+    if (pin == _cePin)
+    {
+        if (level == LOW)
+        {
+            _shifting = true;
+            _control = host::pinLevel(_rsPin) == HIGH;
+            _shifted.clear();
+            _byte = 0;
+            _bits = 0;
+        }
+        else if (_shifting)
+        {
+            _shifting = false;
+            latch(atUs);
+        }
+    }
+    else if (pin == _clkPin && level == HIGH && _shifting)
+    {
+        // data is sampled on the rising edge, msb first
+        _byte = (uint8_t)((_byte << 1) | (host::pinLevel(_dataPin) == HIGH ? 1 : 0));
+        if (++_bits == 8)
+        {
+            _shifted.push_back(_byte);
+            _byte = 0;
+            _bits = 0;
+        }
+    }
+}
+
+void HcmsPanel::latch(int64_t atUs)
+{
+    if (_control)
+    {
+        // control word 0 (bit 7 clear): brightness and sleep, the same on
+        // every device in simultaneous mode; word 1 only sets modes
+        for (size_t i = 0; i < _shifted.size(); i++)
+        {
+            if ((_shifted[i] & 0x80) != 0) continue;
+            _brightness = _shifted[i] & 0x0F;
+            _awake = (_shifted[i] & 0x40) != 0;
+        }
+        return;
+    }
+
+    // the dot registers of the chain are one shift register: each byte
+    // enters on the right and pushes the others left
+    size_t n = _shifted.size() < _columns.size() ? _shifted.size() : _columns.size();
+    _columns.erase(_columns.begin(), _columns.begin() + n);
+    _columns.insert(_columns.end(), _shifted.end() - n, _shifted.end());
+    _frames++;
+    _lastFrameUs = atUs;
+}
+
+bool HcmsPanel::lit() const
+{
+    return _awake && (_blankPin == HCMS39xx::NO_PIN || host::pinLevel(_blankPin) == LOW);
+}
+
+std::string HcmsPanel::text() const
+{
+    std::string s;
+    for (size_t pos = 0; pos + COLUMNS_PER_CHAR <= _columns.size(); pos += COLUMNS_PER_CHAR)
+    {
+        char found = '?';
+        for (int c = ' '; c <= '~' && found == '?'; c++)
+        {
+            bool match = true;
+            for (uint8_t col = 0; col < COLUMNS_PER_CHAR && match; col++)
+            {
+                match = HCMS39xx::glyphColumn((char)c, col) == _columns[pos + col];
+            }
+            if (match) found = (char)c;
+        }
+        s += found;
+    }
+    return s;
+}
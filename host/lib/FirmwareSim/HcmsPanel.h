@@ -0,0 +1,52 @@
+#ifndef HCMS_PANEL_H
+#define HCMS_PANEL_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// A chain of HCMS-39xx displays on the host's GPIO. It decodes what the
+// firmware shifts in, latched by CE: dot data into the columns lit, control
+// word 0 into the brightness and sleep state. The text is read back from
+// the columns with the font of the HCMS39xx library.
+class HcmsPanel
+{
+public:
+    enum { COLUMNS_PER_CHAR = 5 };
+
+    HcmsPanel(uint8_t numChars, uint8_t dataPin, uint8_t rsPin, uint8_t clkPin, uint8_t cePin, uint8_t blankPin);
+
+    // Starts watching the pins (host::onPinChange()), before the firmware begins
+    void attach();
+
+    // Column 0 is the leftmost one, bit 0 the top row
+    const std::vector<uint8_t>& columns() const { return _columns; }
+
+    // One character per 5 columns, '?' where the columns are not a glyph
+    std::string text() const;
+
+    // Awake and not blanked
+    bool lit() const;
+    uint8_t brightness() const { return _brightness; }
+
+    uint32_t frames() const { return _frames; }       // dot data latched
+    int64_t lastFrameUs() const { return _lastFrameUs; }
+
+private:
+    void pinChanged(uint8_t pin, int level, int64_t atUs);
+    void latch(int64_t atUs);
+
+    uint8_t _dataPin, _rsPin, _clkPin, _cePin, _blankPin;
+    std::vector<uint8_t> _columns;
+    bool _control = false;          // RS high at CE low: a control word is shifted
+    bool _shifting = false;
+    std::vector<uint8_t> _shifted;  // bytes of the transfer in progress
+    uint8_t _byte = 0;
+    uint8_t _bits = 0;
+    bool _awake = false;
+    uint8_t _brightness = 0;
+    uint32_t _frames = 0;
+    int64_t _lastFrameUs = 0;
+};
+
+#endif
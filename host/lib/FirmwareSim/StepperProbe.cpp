@@ -0,0 +1,30 @@
+#include "StepperProbe.h"
+#include <Arduino.h>
+#include <ArduinoHost.h>
+
+StepperProbe::StepperProbe(uint8_t stepPin, uint8_t dirPin, unsigned int steps)
+    : _stepPin(stepPin), _dirPin(dirPin), _max(steps - 1)
+{
+}
+
+void StepperProbe::attach()
+{
+    host::onPinChange([this](uint8_t pin, int level, int64_t atUs) { pinChanged(pin, level, atUs); });
+}
+
+void StepperProbe::pinChanged(uint8_t pin, int level, int64_t atUs)
+{
+    if (pin != _stepPin || level != HIGH) return;
+    _steps++;
+    _lastStepUs = atUs;
+    if (host::pinLevel(_dirPin) == LOW)
+    {
+        if (_position < _max) _position++;
+        else _stalls++;
+    }
+    else
+    {
+        if (_position > 0) _position--;
+        else _stalls++;
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef STEPPER_PROBE_H
+#define STEPPER_PROBE_H
+
+#include <stdint.h>
+
+// Needle of a stepper driver with step and direction inputs (the X12.017
+// of SwitecX12) on the host's GPIO. Every rising edge of the step pin is a
+// step, clockwise while the direction pin is low; the needle stops at both
+// ends of its travel, like on the mechanical stops.
+class StepperProbe
+{
+public:
+    StepperProbe(uint8_t stepPin, uint8_t dirPin, unsigned int steps);
+
+    // Starts watching the pins (host::onPinChange()), before the firmware begins
+    void attach();
+
+    unsigned int position() const { return _position; }
+    uint32_t steps() const { return _steps; }
+    uint32_t stalls() const { return _stalls; }     // steps against a stop
+    int64_t lastStepUs() const { return _lastStepUs; }
+
+private:
+    void pinChanged(uint8_t pin, int level, int64_t atUs);
+
+    uint8_t _stepPin, _dirPin;
+    unsigned int _max;
+    unsigned int _position = 0;
+    uint32_t _steps = 0;
+    uint32_t _stalls = 0;
+    int64_t _lastStepUs = 0;
+};
+
+#endif
@@ -0,0 +1,480 @@
+// Whole firmware simulator (pio run -e sim, then .pio/build/sim/program).
+// Runs main.cpp unmodified, setup() and loop(), on the virtual clock of the
+// host build, fed a frequency trace by a GridFreqMonitor stand-in over the
+// in-process WebSockets. The needle (X12.017 on D4/D5) and the HCMS-3907
+// chain are modelled from the pins, so what is checked is what the device
+// would show. A week of grid data runs in minutes at --speed 1000, faster
+// unpaced.
+//
+// Usage: program [--trace trace.bin|samples.csv] [--hours N] [--speed 1000]
+//                [--every 60] [--out run.csv] [--outage DOWN/EVERY]
+//                [--host-time] [--log firmware.log] [--seed 1]
+//        program --live SECONDS [--log firmware.log]
+//
+// --trace     a trace downloaded from the device (http://<device>/trace) or
+//             a CSV of time_stamp,frequency[,received epoch ms] lines;
+//             without it a synthetic grid of --hours (24) is generated
+// --speed     virtual seconds per real second, 0 runs as fast as it can
+// --every     seconds of virtual time between the rows of --out
+// --out       CSV rows: epoch ms, grid Hz, needle step, needle Hz, error
+//             mHz, displayed text
+// --outage    closes the stand-in for DOWN seconds every EVERY seconds
+// --host-time counts the host time spent in the firmware on the virtual
+//             clock, so the firmware's timing histograms measure this
+//             machine (the run is then no longer repeatable)
+// --live      runs in real time against a server outside the process,
+//             tools/gridfreq_server.py on this machine, over real sockets,
+//             with /metrics on http://127.0.0.1:8080/metrics (token sim,
+//             ELECTIME_TOKEN=sim for the tools); host time
+//             counted, so the ingest metrics give the CPU per frame here;
+//             the backup source of [env:sim] is 127.0.0.2 (--backup of the
+//             stand-in, for --switch)
+#include <Arduino.h>
+#include <ArduinoHost.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "GridFeed.h"
+#include "HcmsPanel.h"
+#include "StepperProbe.h"
+#include "Metrics.h"
+#include "grid_profile.h"
+#include "trace_recorder.h"
+#include "nvs.h"
+
+void setup();
+void loop();
+
+namespace
+{
+    struct Options
+    {
+        const char* trace = nullptr;
+        double hours = 24;
+        double speed = 1000;
+        double everySec = 60;
+        const char* out = nullptr;
+        const char* log = nullptr;
+        double outageDownSec = 0;
+        double outageEverySec = 0;
+        bool hostTime = false;
+        unsigned seed = 1;
+        double liveSec = 0;
+    };
+
+    // A sample of the trace: when it reached the device, what it carried
+    struct TraceSample
+    {
+        uint64_t receivedMs;
+        uint64_t timeStamp;
+        float frequency;
+    };
+
+    const uint32_t serverIp = 0x0100007f;    // 127.0.0.1, "electime"
+    const uint32_t backupIp = 0x0200007f;    // 127.0.0.2, BACKUP_SERVER of [env:sim]
+    const uint16_t serverPort = 8765;
+    const int64_t bootLeadUs = 10000000;     // boot this long before the first sample
+    const unsigned int gaugeSteps = 315 * 12;
+
+    void usage()
+    {
+        fprintf(stderr, "usage: program [--trace trace.bin|samples.csv] [--hours N] [--speed 1000] [--every 60]\n"
+                        "               [--out run.csv] [--outage DOWN/EVERY] [--host-time] [--log firmware.log] [--seed 1]\n"
+                        "       program --live SECONDS [--log firmware.log]\n");
+        exit(2);
+    }
+
+    Options parse(int argc, char** argv)
+    {
+        Options o;
+        for (int i = 1; i < argc; i++)
+        {
+            const char* a = argv[i];
+            const char* v = i + 1 < argc ? argv[i + 1] : nullptr;
+            if (strcmp(a, "--host-time") == 0)
+            {
+                o.hostTime = true;
+                continue;
+            }
+            if (v == nullptr) usage();
+            i++;
+            if (strcmp(a, "--trace") == 0) o.trace = v;
+            else if (strcmp(a, "--hours") == 0) o.hours = atof(v);
+            else if (strcmp(a, "--speed") == 0) o.speed = atof(v);
+            else if (strcmp(a, "--every") == 0) o.everySec = atof(v);
+            else if (strcmp(a, "--out") == 0) o.out = v;
+            else if (strcmp(a, "--log") == 0) o.log = v;
+            else if (strcmp(a, "--seed") == 0) o.seed = (unsigned)atoi(v);
+            else if (strcmp(a, "--live") == 0) o.liveSec = atof(v);
+            else if (strcmp(a, "--outage") == 0)
+            {
+                if (sscanf(v, "%lf/%lf", &o.outageDownSec, &o.outageEverySec) != 2) usage();
+            }
+            else usage();
+        }
+        return o;
+    }
+
+    // Time stamps are seconds, or milliseconds at higher rates
+    uint64_t stampMs(uint64_t timeStamp)
+    {
+        return timeStamp < 100000000000ULL ? timeStamp * 1000 : timeStamp;
+    }
+
+    // Pages of TraceRecorder, as served by /trace
+    bool loadTraceBin(FILE* f, std::vector<TraceSample>& samples)
+    {
+        TraceRecorder::Page page;
+        while (fread(page.data, 1, TraceRecorder::PAGE_SIZE, f) == TraceRecorder::PAGE_SIZE)
+        {
+            if (page.data[0] != TraceRecorder::PAGE_MAGIC) continue;
+            TraceSample s;
+            s.receivedMs = TraceRecorder::readLe(page.data + 4, 8);
+            s.timeStamp = TraceRecorder::readLe(page.data + 12, 8);
+            int32_t milliHz = (int32_t)TraceRecorder::readLe(page.data + 20, 4);
+            s.frequency = milliHz / 1000.0f;
+            samples.push_back(s);
+            size_t pos = TraceRecorder::HEADER_SIZE;
+            for (uint8_t r = 0; r < page.data[1]; r++)
+            {
+                int64_t d[3];
+                bool complete = true;
+                for (int i = 0; i < 3 && complete; i++)
+                {
+                    size_t n = TraceRecorder::readVarint(page.data + pos, TraceRecorder::PAGE_SIZE - pos, d[i]);
+                    complete = n != 0;
+                    pos += n;
+                }
+                if (!complete) break; // corrupted page, skip the rest of it
+                s.receivedMs += d[0];
+                s.timeStamp += d[1];
+                milliHz += (int32_t)d[2];
+                s.frequency = milliHz / 1000.0f;
+                samples.push_back(s);
+            }
+        }
+        return !samples.empty();
+    }
+
+    // time_stamp,frequency[,received epoch ms], '#' comments
+    bool loadCsv(FILE* f, std::vector<TraceSample>& samples)
+    {
+        char line[128];
+        while (fgets(line, sizeof(line), f) != nullptr)
+        {
+            unsigned long long timeStamp = 0;
+            unsigned long long receivedMs = 0;
+            float frequency = 0;
+            int n = sscanf(line, "%llu,%f,%llu", &timeStamp, &frequency, &receivedMs);
+            if (line[0] == '#' || n < 2) continue;
+            TraceSample s;
+            s.timeStamp = timeStamp;
+            s.frequency = frequency;
+            s.receivedMs = n == 3 ? receivedMs : stampMs(timeStamp) + 300; // a typical network delay
+            samples.push_back(s);
+        }
+        return !samples.empty();
+    }
+
+    bool loadTrace(const char* path, std::vector<TraceSample>& samples)
+    {
+        FILE* f = fopen(path, "rb");
+        if (f == nullptr) return false;
+        int first = fgetc(f);
+        rewind(f);
+        bool ok = first == TraceRecorder::PAGE_MAGIC ? loadTraceBin(f, samples) : loadCsv(f, samples);
+        fclose(f);
+        return ok;
+    }
+
+    // The synthetic grid of tools/needle_replay.py: a slow random walk
+    // around nominal, ramps at the quarter hours, measurement noise, one
+    // sample per second and a jittered network delay
+    void synthesize(double hours, unsigned seed, std::vector<TraceSample>& samples)
+    {
+        std::mt19937 rng(seed);
+        std::normal_distribution<double> walk(0.0, 0.002);
+        std::normal_distribution<double> noise(0.0, 0.001);
+        std::uniform_int_distribution<int> delay(150, 600);
+        const uint64_t startSec = 1718064000; // 2024-06-11 00:00 UTC
+        double drift = 0.0;
+        for (uint64_t t = 0; t < (uint64_t)(hours * 3600); t++)
+        {
+            drift += walk(rng) - drift * 0.01;
+            double phase = fmod((double)t, 900.0);
+            double ramp = phase < 60.0 ? 0.02 * sin(phase / 60.0 * M_PI) : 0.0;
+            TraceSample s;
+            s.timeStamp = startSec + t;
+            s.frequency = (float)(round((ActiveGrid::nominal() + drift + ramp + noise(rng)) * 1000.0) / 1000.0);
+            s.receivedMs = (startSec + t) * 1000 + (uint64_t)delay(rng);
+            samples.push_back(s);
+        }
+    }
+
+    float stepToFrequency(unsigned int step)
+    {
+        return (float)((step - (double)ActiveGrid::stepMin()) / ActiveGrid::stepsPerHz() + ActiveGrid::minFrequency());
+    }
+
+    bool isClockText(const std::string& text)
+    {
+        return text.size() == 8 && isdigit((unsigned char)text[0]) && isdigit((unsigned char)text[1]) && text[2] == ':' &&
+               isdigit((unsigned char)text[3]) && isdigit((unsigned char)text[4]) && text[5] == ':' &&
+               isdigit((unsigned char)text[6]) && isdigit((unsigned char)text[7]);
+    }
+
+    void printHistogram(const char* name)
+    {
+        Histogram* h = Histogram::find(name);
+        if (h == nullptr || h->count() == 0) return;
+        printf("  %-24s %8u  mean %8.1f  max %8u\n", name, (unsigned)h->count(), (double)h->sum() / h->count(),
+               (unsigned)h->max());
+    }
+
+    uint32_t counter(const char* name)
+    {
+        Counter* c = Counter::find(name);
+        return c != nullptr ? c->value() : 0;
+    }
+
+    FILE* logFile = nullptr;
+
+    // Wi-Fi credentials as saved from the access point page, and the
+    // http.token that /metrics and /trace need
+    void provision()
+    {
+        nvs_handle_t handle;
+        if (nvs_open("wificre", NVS_READWRITE, &handle) == ESP_OK)
+        {
+            nvs_set_str(handle, "ssid", "sim");
+            nvs_set_str(handle, "password", "simulated");
+            nvs_commit(handle);
+            nvs_close(handle);
+        }
+        if (nvs_open("config", NVS_READWRITE, &handle) == ESP_OK)
+        {
+            nvs_set_str(handle, "http.token", "sim");
+            nvs_commit(handle);
+            nvs_close(handle);
+        }
+    }
+
+    // --live: the firmware on the wall clock, its WebSocket and HTTP server
+    // on real sockets, until the time is up
+    int runLive(const Options& options)
+    {
+        host::useHostSockets(true);
+        host::setEpochUs(std::chrono::duration_cast<std::chrono::microseconds>(
+                             std::chrono::system_clock::now().time_since_epoch()).count());
+        HcmsPanel panel(8, D10, D2, D8, D0, D3);
+        StepperProbe needle(D4, D5, gaugeSteps);
+        panel.attach();
+        needle.attach();
+        host::countHostTime(true);
+        host::setSpeed(1.0);
+        setup();
+        printf("Live for %.0f s: ws://electime:%u/ is 127.0.0.1, metrics on http://127.0.0.1:8080/metrics?token=sim\n",
+               options.liveSec, (unsigned)serverPort);
+#ifdef BACKUP_SERVER
+        printf("Backup source %s is 127.0.0.2\n", BACKUP_SERVER);
+#endif
+        fflush(stdout);
+        int64_t endUs = host::now() + (int64_t)(options.liveSec * 1e6);
+        while (host::now() < endUs) loop();
+
+        printf("Ingest: %u messages, %u bytes, %u rejected (%u malformed, %u oversized), %u duplicates, %u out of order\n",
+               counter("ingest_messages_total"), counter("ingest_bytes_total"), counter("ingest_rejected_total"),
+               counter("ingest_malformed_total"), counter("ingest_oversized_total"),
+               counter("ingest_deduplicated_total"), counter("ingest_out_of_order_total"));
+        printf("Sources: %u failovers, %u backfill requests\n", counter("source_failovers_total"),
+               counter("source_backfill_requests_total"));
+        printf("Heap: %d bytes free at least, JSON arena %d bytes at most\n",
+               Gauge::find("heap_min_free_bytes")->value(), Gauge::find("json_arena_high_water_bytes")->value());
+        printf("Needle: %u steps, display: %u frames, last \"%s\"\n", (unsigned)needle.steps(),
+               (unsigned)panel.frames(), panel.text().c_str());
+        printf("Firmware timing on this machine (us):\n");
+        printHistogram("ingest_message_us");
+        printHistogram("ingest_parse_us");
+        printHistogram("gauge_set_position_us");
+        printHistogram("display_transfer_us");
+        if (logFile != nullptr) fclose(logFile);
+        fflush(stdout);
+        return 0;
+    }
+}
+
+// The main thread is loopTask: setup(), then loop() for as long as the trace lasts
+int main(int argc, char** argv)
+{
+    Options options = parse(argc, argv);
+    logFile = options.log != nullptr ? fopen(options.log, "w") : nullptr;
+    host::setSerialOutput([](const char* data, size_t length) {
+        if (logFile != nullptr) fwrite(data, 1, length, logFile);
+    });
+    host::addHost("electime", serverIp);
+#ifdef BACKUP_SERVER
+    host::addHost(BACKUP_SERVER, backupIp); // nobody serves it in a replay
+#endif
+    provision();
+    if (options.liveSec > 0) return runLive(options);
+
+    std::vector<TraceSample> trace;
+    if (options.trace != nullptr)
+    {
+        if (!loadTrace(options.trace, trace))
+        {
+            fprintf(stderr, "%s: no samples\n", options.trace);
+            return 1;
+        }
+    }
+    else
+    {
+        synthesize(options.hours, options.seed, trace);
+    }
+
+
+    // The wall clock is kept across the reset, so the firmware shows the
+    // time at once, like after a warm boot
+    int64_t bootUs = host::now();
+    uint64_t epoch0Ms = trace[0].receivedMs;
+    host::setEpochUs((int64_t)epoch0Ms * 1000 - bootLeadUs);
+
+    std::vector<GridFeed::Sample> feedSamples;
+    feedSamples.reserve(trace.size());
+    for (size_t i = 0; i < trace.size(); i++)
+    {
+        GridFeed::Sample s;
+        s.atUs = bootUs + bootLeadUs + (int64_t)(trace[i].receivedMs - epoch0Ms) * 1000;
+        s.timeStamp = trace[i].timeStamp;
+        s.frequency = trace[i].frequency;
+        feedSamples.push_back(s);
+    }
+    int64_t endUs = feedSamples.back().atUs + 5000000;
+
+    GridFeed feed(serverIp, serverPort);
+    HcmsPanel panel(8, D10, D2, D8, D0, D3);    // HCMS39xx display(8, D10, D2, D8, D0, D3)
+    StepperProbe needle(D4, D5, gaugeSteps);   // gaugeFreqMeter.begin(D4, D5, D1)
+    panel.attach();
+    needle.attach();
+    feed.play(feedSamples);
+    if (options.outageEverySec > 0)
+    {
+        int64_t every = (int64_t)(options.outageEverySec * 1e6);
+        int64_t down = (int64_t)(options.outageDownSec * 1e6);
+        for (int64_t t = bootUs + bootLeadUs + every; t < endUs; t += every)
+        {
+            host::at(t, [&feed, down] { feed.outage(down); });
+        }
+    }
+
+    FILE* out = options.out != nullptr ? fopen(options.out, "w") : nullptr;
+    if (out != nullptr) fprintf(out, "epoch_ms,grid_hz,needle_step,needle_hz,error_mhz,display\n");
+
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point wall0 = Clock::now();
+    host::countHostTime(options.hostTime);
+    setup();
+    host::setSpeed(options.speed);
+
+    // Needle against the grid, sampled at every loop() once the first
+    // sample has been applied
+    double errorSquares = 0;
+    double errorMax = 0;
+    uint64_t errorCount = 0;
+    uint64_t within10 = 0;
+    // Display: text changes and the longest time without one
+    std::string text = panel.text();
+    uint32_t textChanges = 0;
+    uint32_t notClock = 0;
+    int64_t lastChangeUs = host::now();
+    int64_t longestUs = 0;
+    // Needle motion after each sample: from its publication to the last step before the next one
+    uint32_t published = 0;
+    int64_t publishedAtUs = 0;
+    double motionSum = 0;
+    int64_t motionMax = 0;
+    uint32_t motions = 0;
+    int64_t nextRowUs = bootUs + bootLeadUs;
+    int64_t everyUs = (int64_t)(options.everySec * 1e6);
+
+    while (host::now() < endUs)
+    {
+        loop();
+        int64_t now = host::now();
+
+        if (feed.published() != published)
+        {
+            if (published > 0 && needle.lastStepUs() > publishedAtUs)
+            {
+                int64_t motion = needle.lastStepUs() - publishedAtUs;
+                motionSum += (double)motion;
+                if (motion > motionMax) motionMax = motion;
+                motions++;
+            }
+            published = feed.published();
+            publishedAtUs = feed.latest()->atUs;
+        }
+
+        std::string shown = panel.text();
+        if (shown != text)
+        {
+            text = shown;
+            textChanges++;
+            if (now - lastChangeUs > longestUs && textChanges > 1) longestUs = now - lastChangeUs;
+            lastChangeUs = now;
+            if (!isClockText(text)) notClock++;
+        }
+
+        const GridFeed::Sample* grid = feed.latest();
+        if (grid == nullptr) continue;
+        float needleHz = stepToFrequency(needle.position());
+        double errorMilliHz = ((double)needleHz - grid->frequency) * 1000.0;
+        if (now > feedSamples[0].atUs + 10000000)
+        {
+            errorSquares += errorMilliHz * errorMilliHz;
+            if (fabs(errorMilliHz) > errorMax) errorMax = fabs(errorMilliHz);
+            if (fabs(errorMilliHz) <= 10.0) within10++;
+            errorCount++;
+        }
+        if (out != nullptr && now >= nextRowUs)
+        {
+            nextRowUs += everyUs;
+            fprintf(out, "%llu,%.3f,%u,%.4f,%.1f,%s\n",
+                    (unsigned long long)(epoch0Ms + (now - bootUs - bootLeadUs) / 1000), grid->frequency,
+                    needle.position(), needleHz, errorMilliHz, text.c_str());
+        }
+    }
+    double wallSec = std::chrono::duration<double>(Clock::now() - wall0).count();
+    double virtualSec = (host::now() - bootUs) / 1e6;
+    if (out != nullptr) fclose(out);
+
+    printf("Replayed %u samples, %.1f h of virtual time in %.1f s (%.0fx real time)\n",
+           (unsigned)trace.size(), virtualSec / 3600, wallSec, virtualSec / wallSec);
+    printf("Server: %u messages sent, %u backfill requests, %u samples backfilled\n",
+           (unsigned)feed.messagesSent(), (unsigned)feed.backfillRequests(), (unsigned)feed.backfilled());
+    printf("Needle: %u steps, %u against a stop (the reset at boot runs into it), error %.2f mHz RMS, %.1f mHz max, %.1f %% of the time within 10 mHz\n",
+           (unsigned)needle.steps(), (unsigned)needle.stalls(), errorCount ? sqrt(errorSquares / errorCount) : 0.0,
+           errorMax, errorCount ? 100.0 * within10 / errorCount : 0.0);
+    printf("Needle motion per sample: %.0f ms mean, %.0f ms max\n", motions ? motionSum / motions / 1000 : 0.0,
+           motionMax / 1000.0);
+    printf("Display: %u frames, %u text changes (%u not a clock), longest unchanged %.1f s, last \"%s\"%s\n",
+           (unsigned)panel.frames(), (unsigned)textChanges, (unsigned)notClock, longestUs / 1e6, text.c_str(),
+           panel.lit() ? "" : " (dark)");
+    if (options.hostTime)
+    {
+        printf("Firmware timing on this machine (us):\n");
+        printHistogram("ingest_message_us");
+        printHistogram("ingest_parse_us");
+        printHistogram("gauge_set_position_us");
+        printHistogram("display_transfer_us");
+        printHistogram("motor_advance_us");
+    }
+    if (logFile != nullptr) fclose(logFile);
+    fflush(stdout);
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include "Console.h"
+
+Console::Console(const Command* commands, size_t count)
+    : _commands(commands), _count(count)
+{
+}
+
+void Console::begin(Stream& stream)
+{
+    _stream = &stream;
+}
+
+void Console::poll()
+{
+    if (_stream == nullptr) return;
+
+    while (_stream->available() > 0)
+    {
+        feed((char)_stream->read());
+    }
+}
+
+void Console::feed(char c)
+{
+    if (c == '\n' || c == '\r')
+    {
+        if (_overflow)
+        {
+            _stream->println("Error: line too long");
+        }
+        else if (_length > 0)
+        {
+            _line[_length] = '\0';
+            execute();
+        }
+        _length = 0;
+        _overflow = false;
+        return;
+    }
+
+    if (_length < LINE_SIZE - 1)
+    {
+        _line[_length++] = c;
+    }
+    else
+    {
+        _overflow = true;
+    }
+}
+
+void Console::execute()
+{
+    char* p = _line + strspn(_line, " \t=");
+    size_t nameLength = strcspn(p, " \t=");
+    if (nameLength == 0) return;
+    const Command* command = find(p, nameLength);
+    if (command == nullptr)
+    {
+        p[nameLength] = '\0';
+        _stream->printf("Unknown command '%s', type 'help'\n", p);
+        return;
+    }
+
+    char* argv[MAX_ARGS];
+    int argc = 0;
+    while (true)
+    {
+        if (argc > 0 && argc == command->restOfLine)
+        {
+            // after one separator (spaces, '=' or both), everything as typed
+            while (*p == ' ' || *p == '\t') *p++ = '\0';
+            if (*p == '=') *p++ = '\0';
+            while (*p == ' ' || *p == '\t') *p++ = '\0';
+            if (*p != '\0') argv[argc++] = p;
+            break;
+        }
+        while (*p == ' ' || *p == '\t' || *p == '=') *p++ = '\0';
+        if (*p == '\0') break;
+        if (argc == MAX_ARGS)
+        {
+            _stream->println("Error: too many arguments");
+            return;
+        }
+        argv[argc++] = p;
+        while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '=') p++;
+    }
+    command->handler(argc, argv);
+}
+
+const Console::Command* Console::find(const char* name, size_t length) const
+{
+    for (size_t i = 0; i < _count; i++)
+    {
+        if (strncmp(name, _commands[i].name, length) == 0 && _commands[i].name[length] == '\0')
+        {
+            return &_commands[i];
+        }
+    }
+    return nullptr;
+}
+
+void Console::printHelp() const
+{
+    for (size_t i = 0; i < _count; i++)
+    {
+        _stream->printf("  %-8s %s\n", _commands[i].name, _commands[i].help);
+    }
+}
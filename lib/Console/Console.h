@@ -0,0 +1,57 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <Arduino.h>
+
+// Serial command console.
+// Input bytes are appended to a fixed line buffer (constant time per byte,
+// no heap). On end of line the buffer is split in place into arguments,
+// on spaces and '=' so "f=49.95" and "f 49.95" are equivalent, and the
+// matching entry of the command table is called. A command with restOfLine
+// set gets the rest of the line from that argument on as one argument,
+// spaces and '=' kept as typed (network names, time zones, messages).
+// Lines longer than the buffer and lines with more than MAX_ARGS arguments
+// are rejected as a whole.
+
+class Console
+{
+public:
+    typedef void (*Handler)(int argc, char* argv[]);
+
+    struct Command
+    {
+        const char* name;
+        Handler handler;
+        const char* help;
+        uint8_t restOfLine;     // > 0: argv[restOfLine] is the rest of the line as typed
+    };
+
+    enum { LINE_SIZE = 96, MAX_ARGS = 6 };
+
+    Console(const Command* commands, size_t count);
+
+    void begin(Stream& stream);
+
+    // Processes the bytes available on the stream
+    void poll();
+
+    // Lists the command table
+    void printHelp() const;
+
+    Print& out() { return *_stream; }
+
+private:
+    void feed(char c);
+    void execute();
+    const Command* find(const char* name, size_t length) const;
+
+    const Command* _commands;
+    size_t _count;
+    Stream* _stream = nullptr;
+
+    char _line[LINE_SIZE];
+    uint8_t _length = 0;
+    bool _overflow = false;
+};
+
+#endif
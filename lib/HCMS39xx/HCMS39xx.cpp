@@ -8,11 +8,16 @@
 
 #include "HCMS39xx.h"
 #include "font5x7.h"
+#include "Metrics.h"
+
+static Counter displayFrames("display_frames_total", "Dot data frames pushed to the HCMS39xx chain");
+static Counter displayBytes("display_bytes_total", "Bytes shifted out to the HCMS39xx chain");
+static Counter displayGpioWrites("display_gpio_writes_total", "GPIO writes issued for HCMS39xx transfers");
 
 HCMS39xx::HCMS39xx(uint8_t num_chars, uint8_t data_pin, uint8_t rs_pin, uint8_t clk_pin, 
                    uint8_t ce_pin, uint8_t blank_pin, uint8_t osc_select_pin) {
 
-    _num_chars      = num_chars;
+    _num_chars      = num_chars > MAX_CHARS ? MAX_CHARS : num_chars;
     _data_pin       = data_pin; 
     _clk_pin        = clk_pin; 
     _rs_pin         = rs_pin; 
@@ -46,6 +51,9 @@ void HCMS39xx::begin() {
 
     // Per datasheet, load control word 0 with desired brightness and set sleep bit HIGH (awake)
     _control_word0 = WAKEUP | DEFAULT_BRIGHTNESS | DEFAULT_CURRENT; 
+    for (i = 0; i < MAX_DEVICES; i++) {
+        _device_control_word0[i] = _control_word0;
+    }
     setupControlData();
     for (i = 0; i < _num_chars / CHARS_PER_DEVICE; i++) {
         sendByte(_control_word0);
@@ -58,17 +66,22 @@ void HCMS39xx::begin() {
 
 void HCMS39xx::print(const char* s) {
     uint8_t i; 
+    uint8_t len = 0;
+
+    while (len < _num_chars && s[len] != 0) len++; // Don't loop for more chars than defined for the display object
+
+    // The chain shifts by len characters, keep the framebuffer in step
+    shiftColumns(len * COLUMNS_PER_CHAR);
+    uint8_t* dst = _columns + (_num_chars - len) * COLUMNS_PER_CHAR;
 
     setupDotData();
-    for (i = 0; i < _num_chars; i++) { // Don't loop for more chars than defined for the display object
-        if (s[i] != 0) {
-        sendFontData(font5x7 + (uint8_t)(s[i] - _first_ascii_index) * (uint16_t)COLUMNS_PER_CHAR, COLUMNS_PER_CHAR);
-        }
-        else  { // If we find a NULL terminator, then break out of loop
-            break;
-        }
+    for (i = 0; i < len; i++) {
+        const uint8_t* glyph = font5x7 + (uint8_t)(s[i] - _first_ascii_index) * (uint16_t)COLUMNS_PER_CHAR;
+        sendFontData(glyph, COLUMNS_PER_CHAR);
+        memcpy_P(dst + i * COLUMNS_PER_CHAR, glyph, COLUMNS_PER_CHAR);
     }
     endTransmission();
+    displayFrames.inc();
 }
 
 void HCMS39xx::print(int j) {
@@ -109,51 +122,101 @@ void HCMS39xx::print(unsigned long j) {
 void HCMS39xx::printDirect(const uint8_t* s, uint8_t len) {
     uint8_t i; 
 
+    if (len > _num_chars * COLUMNS_PER_CHAR) {
+        // only the last columns stay in the chain
+        s += len - _num_chars * COLUMNS_PER_CHAR;
+        len = _num_chars * COLUMNS_PER_CHAR;
+    }
+    shiftColumns(len);
+    memcpy(_columns + _num_chars * COLUMNS_PER_CHAR - len, s, len);
+
     setupDotData();
     for (i = 0; i < len; i++) {
         sendByte(s[i]);
     }
     endTransmission();
+    displayFrames.inc();
 }
 
 void HCMS39xx::clear() {
     uint8_t i; 
 
+    memset(_columns, 0, sizeof(_columns));
+    _dirty_devices = 0;
+
     setupDotData();
     for (i = 0; i < _num_chars * COLUMNS_PER_CHAR; i++) {
         sendByte(0);
     }
     endTransmission(); 
+    displayFrames.inc();
 }
 
-void HCMS39xx::displaySleep() {
-    _control_word0 = _control_word0 & ~SLEEP_MASK; 
+void HCMS39xx::printAt(uint8_t pos, const char* s) {
+    for (; pos < _num_chars && *s != 0; pos++, s++) {
+        const uint8_t* glyph = font5x7 + (uint8_t)(*s - _first_ascii_index) * (uint16_t)COLUMNS_PER_CHAR;
+        for (uint8_t c = 0; c < COLUMNS_PER_CHAR; c++) {
+            setColumn(pos * COLUMNS_PER_CHAR + c, pgm_read_byte(&glyph[c]));
+        }
+    }
+}
 
-    setupControlData();
-    if (_control_word1 & DATA_OUT_MODE_SIMUL) {  // simultaneous mode, then only need to send once
-        sendByte(_control_word0);
+void HCMS39xx::writeColumns(uint16_t column, const uint8_t* data, uint8_t len) {
+    for (uint8_t i = 0; i < len && column + i < _num_chars * COLUMNS_PER_CHAR; i++) {
+        setColumn(column + i, data[i]);
     }
-    else { // Serial mode, then need to send for each driver chip
-        for (int i = 0; i < _num_chars / CHARS_PER_DEVICE; i++) {
-            sendByte(_control_word0); 
-        }
+}
+
+void HCMS39xx::clearRegion(uint8_t pos, uint8_t len) {
+    for (uint16_t c = pos * COLUMNS_PER_CHAR; c < (pos + len) * COLUMNS_PER_CHAR && c < _num_chars * COLUMNS_PER_CHAR; c++) {
+        setColumn(c, 0);
     }
-    endTransmission();
 }
 
-void HCMS39xx::displayWakeup() {
-    _control_word0 = _control_word0 | WAKEUP; 
+bool HCMS39xx::update() {
+    uint8_t i; 
 
-    setupControlData();
-    if (_control_word1 & DATA_OUT_MODE_SIMUL) {  // simultaneous mode, then only need to send once
-        sendByte(_control_word0);
+    if (_dirty_devices == 0) return false;
+
+    setupDotData();
+    for (i = 0; i < _num_chars * COLUMNS_PER_CHAR; i++) {
+        sendByte(_columns[i]);
     }
-    else { // Serial mode, then need to send for each driver chip
-        for (int i = 0; i < _num_chars / CHARS_PER_DEVICE; i++) {
-            sendByte(_control_word0); 
-        }
+    endTransmission(); 
+    displayFrames.inc();
+    _dirty_devices = 0;
+    return true;
+}
+
+uint8_t HCMS39xx::glyphColumn(char c, uint8_t column) {
+    uint8_t first = pgm_read_byte(&font5x7[0]);
+    uint8_t last = pgm_read_byte(&font5x7[1]);
+
+    if ((uint8_t)c < first || (uint8_t)c > last || column >= COLUMNS_PER_CHAR) return 0;
+    return pgm_read_byte(&font5x7[((uint8_t)c - first + 1) * COLUMNS_PER_CHAR + column]);
+}
+
+void HCMS39xx::setColumn(uint16_t column, uint8_t value) {
+    if (_columns[column] != value) {
+        _columns[column] = value;
+        _dirty_devices |= 1 << (column / (CHARS_PER_DEVICE * COLUMNS_PER_CHAR));
     }
-    endTransmission();
+}
+
+void HCMS39xx::shiftColumns(uint16_t count) {
+    uint16_t total = _num_chars * COLUMNS_PER_CHAR;
+
+    memmove(_columns, _columns + count, total - count);
+    // unsent changes were shifted along with the rest, resend everything
+    if (_dirty_devices != 0) _dirty_devices = (1 << numDevices()) - 1;
+}
+
+void HCMS39xx::displaySleep() {
+    setControlWord0(-1, SLEEP_MASK, SLEEP);
+}
+
+void HCMS39xx::displayWakeup() {
+    setControlWord0(-1, SLEEP_MASK, WAKEUP);
 }
 
 void HCMS39xx::displayBlank() {
@@ -169,30 +232,63 @@ void HCMS39xx::displayUnblank() {
 }
 
 void HCMS39xx::setBrightness(uint8_t value) {
-    _control_word0 = (_control_word0 & ~BRIGHTNESS_MASK) | (value & BRIGHTNESS_MASK); 
+    setControlWord0(-1, BRIGHTNESS_MASK, value);
+}
 
-    setupControlData();
-    if (_control_word1 & DATA_OUT_MODE_SIMUL) {  // simultaneous mode, then only need to send once
-        sendByte(_control_word0);
+void HCMS39xx::setBrightness(uint8_t device, uint8_t value) {
+    if (device < numDevices()) setControlWord0(device, BRIGHTNESS_MASK, value);
+}
+
+void HCMS39xx::setCurrent(DISPLAY_CURRENT value) {
+    setControlWord0(-1, PIXEL_CURRENT_MASK, value);
+}
+
+void HCMS39xx::setCurrent(uint8_t device, DISPLAY_CURRENT value) {
+    if (device < numDevices()) setControlWord0(device, PIXEL_CURRENT_MASK, value);
+}
+
+// Updates the masked bits of control word 0 for one device (all if device < 0)
+void HCMS39xx::setControlWord0(int8_t device, uint8_t mask, uint8_t value) {
+    uint8_t i; 
+
+    if (device < 0) {
+        _control_word0 = (_control_word0 & ~mask) | (value & mask); 
     }
-    else { // Serial mode, then need to send for each driver chip
-        for (int i = 0; i < _num_chars / CHARS_PER_DEVICE; i++) {
-            sendByte(_control_word0); 
+    for (i = 0; i < numDevices(); i++) {
+        if (device < 0 || device == i) {
+            _device_control_word0[i] = (_device_control_word0[i] & ~mask) | (value & mask);
         }
     }
-    endTransmission();
+    sendControlWord0();
 }
 
-void HCMS39xx::setCurrent(DISPLAY_CURRENT value) {
-    _control_word0 = (_control_word0 & ~PIXEL_CURRENT_MASK) | (value & PIXEL_CURRENT_MASK); 
+void HCMS39xx::stageControl(uint8_t device, uint8_t brightness, DISPLAY_CURRENT current, bool awake) {
+    if (device < numDevices()) {
+        _device_control_word0[device] = (awake ? WAKEUP : SLEEP) | (current & PIXEL_CURRENT_MASK) | (brightness & BRIGHTNESS_MASK);
+    }
+}
+
+void HCMS39xx::sendControlWord0() {
+    uint8_t i; 
+    bool uniform = true;
+
+    for (i = 1; i < numDevices(); i++) {
+        if (_device_control_word0[i] != _device_control_word0[0]) uniform = false;
+    }
+    if (!uniform && (_control_word1 & DATA_OUT_MODE_SIMUL)) {
+        setSerialMode();
+    }
+    else if (uniform && !(_control_word1 & DATA_OUT_MODE_SIMUL)) {  // back to one byte for the chain
+        setSimultaneousMode();
+    }
 
     setupControlData();
     if (_control_word1 & DATA_OUT_MODE_SIMUL) {  // simultaneous mode, then only need to send once
-        sendByte(_control_word0);
+        sendByte(_device_control_word0[0]);
     }
-    else { // Serial mode, then need to send for each driver chip
-        for (int i = 0; i < _num_chars / CHARS_PER_DEVICE; i++) {
-            sendByte(_control_word0); 
+    else { // Serial mode, the first word sent ends in the device farthest from DIN
+        for (i = 0; i < numDevices(); i++) {
+            sendByte(_device_control_word0[i]); 
         }
     }
     endTransmission();
@@ -261,20 +357,24 @@ void HCMS39xx::setSerialMode() {
 }
 
 void HCMS39xx::setupDotData() {
-    digitalWrite(_clk_pin, HIGH); 
-    digitalWrite(_rs_pin, LOW); 
-    digitalWrite(_ce_pin, LOW); 
+    writePin(_clk_pin, HIGH); 
+    writePin(_rs_pin, LOW); 
+    writePin(_ce_pin, LOW); 
 }
 
 void HCMS39xx::setupControlData() {
-    digitalWrite(_clk_pin, HIGH); 
-    digitalWrite(_rs_pin, HIGH); 
-    digitalWrite(_ce_pin, LOW); 
+    writePin(_clk_pin, HIGH); 
+    writePin(_rs_pin, HIGH); 
+    writePin(_ce_pin, LOW); 
 }
 
 void HCMS39xx::endTransmission() {
-    digitalWrite(_ce_pin, HIGH); 
-    digitalWrite(_clk_pin, LOW);    
+    writePin(_ce_pin, HIGH); 
+    writePin(_clk_pin, LOW);    
+    displayBytes.inc(_bytes_sent);
+    displayGpioWrites.inc(_gpio_writes);
+    _bytes_sent = 0;
+    _gpio_writes = 0;
 }
 
 void HCMS39xx::sendFontData(const uint8_t *b, uint8_t length) {
@@ -291,9 +391,10 @@ void HCMS39xx::sendByte(uint8_t b) {
     uint8_t i; 
 
     for (i = 0; i < 8; i++) {
-        digitalWrite(_clk_pin, LOW); 
-        digitalWrite(_data_pin, b & 0x80); // msb first
-        digitalWrite(_clk_pin, HIGH); 
+        writePin(_clk_pin, LOW); 
+        writePin(_data_pin, b & 0x80); // msb first
+        writePin(_clk_pin, HIGH); 
         b = b << 1; 
     }
+    _bytes_sent++;
 }
\ No newline at end of file
@@ -17,6 +17,8 @@ public:
   enum {NO_PIN = 255};
   enum {DEFAULT_BRIGHTNESS = 0x0C}; // 0x0C => HHLL -> 47% relative brightness
   enum DISPLAY_CURRENT {DEFAULT_CURRENT = 0x20, CURRENT_4_0_mA = 0x20, CURRENT_6_4_mA = 0x10, CURRENT_9_3_mA = 0x00, CURRENT_12_8_mA = 0x30}; 
+  enum {CHARS_PER_DEVICE = 4, COLUMNS_PER_CHAR = 5U};
+  enum {MAX_CHARS = 32, MAX_DEVICES = MAX_CHARS / CHARS_PER_DEVICE}; // longer chains are truncated
 
   HCMS39xx(uint8_t num_chars, uint8_t data_pin, uint8_t rs_pin, uint8_t clk_pin, 
            uint8_t ce_pin, uint8_t blank_pin = NO_PIN, uint8_t osc_select_pin = NO_PIN);
@@ -28,12 +30,39 @@ public:
   void print(unsigned long j);
   void printDirect(const uint8_t*, uint8_t len);
   void clear();
+
+  // Framebuffer API: the calls below only change the framebuffer and mark
+  // the devices whose columns changed, update() sends them.
+  // Position 0 is the leftmost character (the device farthest from DIN).
+  void printAt(uint8_t pos, const char* s);
+  void writeColumns(uint16_t column, const uint8_t* data, uint8_t len);
+  void clearRegion(uint8_t pos, uint8_t len);
+  // Sends the frame if any device is dirty, returns false if nothing was sent.
+  // The dot registers of the chain form a single shift register latched by
+  // the shared CE, so a dirty frame is always shifted in full.
+  bool update();
+  uint8_t dirtyDevices() const { return _dirty_devices; } // bit n set: device n has unsent changes
+  uint8_t numChars() const { return _num_chars; }
+  uint8_t numDevices() const { return _num_chars / CHARS_PER_DEVICE; }
+
+  // Column of a character in the built-in font (bit 0 top row, bit 6 bottom row),
+  // 0 for characters outside the font
+  static uint8_t glyphColumn(char c, uint8_t column);
+
   void displaySleep();
   void displayWakeup();
   void displayBlank();
   void displayUnblank();
   void setBrightness(uint8_t value);
   void setCurrent(DISPLAY_CURRENT value);
+  // Per device control: uniform values are sent once in simultaneous mode,
+  // different values switch the chain to serial mode (one byte per device)
+  // until they are uniform again
+  void setBrightness(uint8_t device, uint8_t value);
+  void setCurrent(uint8_t device, DISPLAY_CURRENT value);
+  // Batched control: stage the control word 0 of any devices, then send them in one transfer
+  void stageControl(uint8_t device, uint8_t brightness, DISPLAY_CURRENT current, bool awake);
+  void sendControl() { sendControlWord0(); }
   void setExtOsc();
   void setIntOsc();
   void setExternalPrescaleDiv8();
@@ -49,18 +78,27 @@ private:
   enum {CONTROL_WORD1  = 0x80}; 
   enum {EXT_PRESCALER_DIV8 = 0x02}; 
   enum {DATA_OUT_MODE_SIMUL = 0x01}; 
-  enum {CHARS_PER_DEVICE = 4, COLUMNS_PER_CHAR = 5U};
   uint8_t _num_chars; 
   uint8_t _first_ascii_index; 
   uint8_t _data_pin, _clk_pin, _rs_pin, _ce_pin, _blank_pin, _osc_select_pin; 
   uint8_t _control_word0;
+  uint8_t _device_control_word0[MAX_DEVICES];
   uint8_t _control_word1; 
+  uint16_t _bytes_sent = 0; // bytes shifted out in the current transmission
+  uint16_t _gpio_writes = 0; // pin writes in the current transmission
+  uint8_t _columns[MAX_CHARS * COLUMNS_PER_CHAR]; // framebuffer, column 0 is shifted first
+  uint8_t _dirty_devices = 0;
 
+  void setControlWord0(int8_t device, uint8_t mask, uint8_t value);
+  void sendControlWord0();
+  void shiftColumns(uint16_t count);
+  void setColumn(uint16_t column, uint8_t value);
   void setupDotData();
   void setupControlData();
   void endTransmission();
   void sendFontData(const uint8_t *b, uint8_t length);
   void sendByte(uint8_t b);   
+  inline void writePin(uint8_t pin, uint8_t value) { digitalWrite(pin, value); _gpio_writes++; }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,65 @@
+/* -----------------------------------------------------------------
+   HCMS39xx Library
+   https://github.com/Andy4495/HCMS39xx
+
+   Compile-time frames: string literals rendered into dot columns with
+   the font by the compiler, so fixed messages are pushed with a
+   single printDirect() of the columns, without per character lookups.
+
+     static constexpr HCMS39xxFrame<8> boot = HCMS39xxFrame<8>::render("- BOOT -");
+     display.printDirect(boot.columns, boot.size());
+
+   Only the rendered columns end up in flash: the glyphs come from the
+   space to 'Z' subset in font5x7frames.h, read by the compiler only.
+   Other characters do not compile.
+*/
+
+#ifndef HCMS39xxFRAME_H
+#define HCMS39xxFRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "font5x7frames.h"
+
+namespace hcms39xx_detail {
+
+template <uint16_t... I> struct Indices {};
+template <uint16_t N, uint16_t... I> struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+template <uint16_t... I> struct MakeIndices<0, I...> { typedef Indices<I...> type; };
+
+// Same result as HCMS39xx::glyphColumn(), not a constant outside the subset
+constexpr uint8_t glyphColumn(uint8_t c, uint8_t column) {
+    return (c < frameFont[0] || c > frameFont[1])
+        ? throw "character outside the frame font"
+        : frameFont[(c - frameFont[0] + 1) * 5 + column];
+}
+
+// Column of a left aligned, blank filled text
+constexpr uint8_t textColumn(const char* s, size_t len, uint16_t column) {
+    return (column / 5 < len) ? glyphColumn((uint8_t)s[column / 5], column % 5) : 0;
+}
+
+} // namespace hcms39xx_detail
+
+template <uint8_t CHARS>
+struct HCMS39xxFrame {
+  enum {COLUMNS = CHARS * 5};
+  uint8_t columns[COLUMNS];
+
+  constexpr uint8_t size() const { return COLUMNS; }
+
+  // Left aligned, blank filled, like print() of the whole display
+  template <size_t N>
+  static constexpr HCMS39xxFrame render(const char (&s)[N]) {
+    static_assert(N - 1 <= CHARS, "text longer than the frame");
+    return render(s, N - 1, typename hcms39xx_detail::MakeIndices<COLUMNS>::type());
+  }
+
+private:
+  template <uint16_t... I>
+  static constexpr HCMS39xxFrame render(const char* s, size_t len, hcms39xx_detail::Indices<I...>) {
+    return HCMS39xxFrame{{hcms39xx_detail::textColumn(s, len, I)...}};
+  }
+};
+
+#endif
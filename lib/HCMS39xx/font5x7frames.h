@@ -0,0 +1,85 @@
+/* -----------------------------------------------------------------
+   HCMS39xx Library
+   https://github.com/Andy4495/HCMS39xx
+
+   Glyph subset for HCMS39xxFrame: space to 'Z' of font5x7, the characters
+   of fixed messages. Read by the compiler only, so neither this table nor
+   font5x7 is linked in for the frames; print() keeps the full font.
+
+*/
+
+#ifndef FONT5X7FRAMES_H
+#define FONT5X7FRAMES_H
+
+#include <stdint.h>
+
+namespace hcms39xx_detail {
+
+// Same layout as font5x7: first ASCII character, last ASCII character,
+// then 5 columns per character
+constexpr uint8_t frameFont[] = {
+	0x20, 0x5A, 0x00, 0x00, 0x00, // meta-data
+	0x00, 0x00, 0x00, 0x00, 0x00, // 0x20 (space)
+	0x00, 0x5F, 0x00, 0x00, 0x00, // 0x21 !
+	0x00, 0x03, 0x00, 0x03, 0x00, // 0x22 "
+	0x14, 0x7F, 0x14, 0x7F, 0x14, // 0x23 #
+	0x24, 0x2A, 0x7F, 0x2A, 0x12, // 0x24 $
+	0x23, 0x13, 0x08, 0x64, 0x62, // 0x25 %
+	0x36, 0x49, 0x56, 0x20, 0x50, // 0x26 &
+	0x00, 0x0B, 0x07, 0x00, 0x00, // 0x27 '
+	0x00, 0x00, 0x3E, 0x41, 0x00, // 0x28 (
+	0x00, 0x41, 0x3E, 0x00, 0x00, // 0x29 )
+	0x08, 0x2A, 0x1C, 0x2A, 0x08, // 0x2A *
+	0x08, 0x08, 0x3E, 0x08, 0x08, // 0x2B +
+	0x00, 0x58, 0x38, 0x00, 0x00, // 0x2C ,
+	0x08, 0x08, 0x08, 0x08, 0x08, // 0x2D -
+	0x00, 0x30, 0x30, 0x00, 0x00, // 0x2E .
+	0x20, 0x10, 0x08, 0x04, 0x02, // 0x2F /
+	0x3E, 0x51, 0x49, 0x45, 0x3E, // 0x30 0
+	0x00, 0x42, 0x7F, 0x40, 0x00, // 0x31 1
+	0x62, 0x51, 0x49, 0x49, 0x46, // 0x32 2
+	0x22, 0x41, 0x49, 0x49, 0x36, // 0x33 3
+	0x18, 0x14, 0x12, 0x7F, 0x10, // 0x34 4
+	0x27, 0x45, 0x45, 0x45, 0x39, // 0x35 5
+	0x3C, 0x4A, 0x49, 0x49, 0x30, // 0x36 6
+	0x01, 0x71, 0x09, 0x05, 0x03, // 0x37 7
+	0x36, 0x49, 0x49, 0x49, 0x36, // 0x38 8
+	0x06, 0x49, 0x49, 0x29, 0x1E, // 0x39 9
+	0x00, 0x36, 0x36, 0x00, 0x00, // 0x3A :
+	0x00, 0x56, 0x36, 0x00, 0x00, // 0x3B ;
+	0x00, 0x08, 0x14, 0x22, 0x41, // 0x3C <
+	0x14, 0x14, 0x14, 0x14, 0x14, // 0x3D =
+	0x41, 0x22, 0x14, 0x08, 0x00, // 0x3E >
+	0x02, 0x01, 0x51, 0x09, 0x06, // 0x3F ?
+	0x3E, 0x41, 0x5D, 0x55, 0x1E, // 0x40 @
+	0x7E, 0x09, 0x09, 0x09, 0x7E, // 0x41 A
+	0x7F, 0x49, 0x49, 0x49, 0x36, // 0x42 B
+	0x3E, 0x41, 0x41, 0x41, 0x22, // 0x43 C
+	0x41, 0x7F, 0x41, 0x41, 0x3E, // 0x44 D
+	0x7F, 0x49, 0x49, 0x49, 0x41, // 0x45 E
+	0x7F, 0x09, 0x09, 0x09, 0x01, // 0x46 F
+	0x3E, 0x41, 0x41, 0x51, 0x32, // 0x47 G
+	0x7F, 0x08, 0x08, 0x08, 0x7F, // 0x48 H
+	0x00, 0x41, 0x7F, 0x41, 0x00, // 0x49 I
+	0x20, 0x40, 0x40, 0x40, 0x3F, // 0x4A J
+	0x7F, 0x08, 0x14, 0x22, 0x41, // 0x4B K
+	0x7F, 0x40, 0x40, 0x40, 0x40, // 0x4C L
+	0x7F, 0x02, 0x0C, 0x02, 0x7F, // 0x4D M
+	0x7F, 0x04, 0x08, 0x10, 0x7F, // 0x4E N
+	0x3E, 0x41, 0x41, 0x41, 0x3E, // 0x4F O
+	0x7F, 0x09, 0x09, 0x09, 0x06, // 0x50 P
+	0x3E, 0x41, 0x51, 0x21, 0x5E, // 0x51 Q
+	0x7F, 0x09, 0x19, 0x29, 0x46, // 0x52 R
+	0x26, 0x49, 0x49, 0x49, 0x32, // 0x53 S
+	0x01, 0x01, 0x7F, 0x01, 0x01, // 0x54 T
+	0x3F, 0x40, 0x40, 0x40, 0x3F, // 0x55 U
+	0x07, 0x18, 0x60, 0x18, 0x07, // 0x56 V
+	0x7F, 0x20, 0x18, 0x20, 0x7F, // 0x57 W
+	0x63, 0x14, 0x08, 0x14, 0x63, // 0x58 X
+	0x03, 0x04, 0x78, 0x04, 0x03, // 0x59 Y
+	0x61, 0x51, 0x49, 0x45, 0x43, // 0x5A Z
+};
+
+} // namespace hcms39xx_detail
+
+#endif
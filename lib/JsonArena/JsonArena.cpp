@@ -0,0 +1,70 @@
+#include "JsonArena.h"
+
+JsonArena::JsonArena(uint8_t* buffer, size_t size)
+    : _buffer(buffer), _size(size)
+{
+}
+
+void* JsonArena::allocate(size_t size)
+{
+    size_t rounded = (size + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+    if (rounded + HEADER > _size - _top)
+    {
+        _failures++;
+        return nullptr; // ArduinoJson reports NoMemory
+    }
+
+    uint8_t* block = _buffer + _top + HEADER;
+    *(size_t*)(block - HEADER) = rounded;
+    _top += rounded + HEADER;
+    if (_top > _highWater) _highWater = _top;
+    _last = block;
+    return block;
+}
+
+void JsonArena::deallocate(void* ptr)
+{
+    if (ptr != nullptr && ptr == _last)
+    {
+        _top -= blockSize(ptr) + HEADER;
+        _last = nullptr;
+    }
+}
+
+void* JsonArena::reallocate(void* ptr, size_t newSize)
+{
+    if (ptr == nullptr)
+    {
+        return allocate(newSize);
+    }
+
+    size_t oldSize = blockSize(ptr);
+    size_t rounded = (newSize + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+
+    if (ptr == _last)
+    {
+        // most recent block: grow or shrink in place
+        size_t start = (uint8_t*)ptr - _buffer;
+        if (rounded > _size - start)
+        {
+            _failures++;
+            return nullptr;
+        }
+        *(size_t*)((uint8_t*)ptr - HEADER) = rounded;
+        _top = start + rounded;
+        if (_top > _highWater) _highWater = _top;
+        return ptr;
+    }
+
+    if (rounded <= oldSize)
+    {
+        return ptr; // shrinking an older block, keep it where it is
+    }
+
+    void* block = allocate(newSize);
+    if (block != nullptr)
+    {
+        memcpy(block, ptr, oldSize);
+    }
+    return block;
+}
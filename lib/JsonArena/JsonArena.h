@@ -0,0 +1,53 @@
+#ifndef JSON_ARENA_H
+#define JSON_ARENA_H
+
+#include <ArduinoJson.h>
+
+// ArduinoJson allocator backed by a fixed buffer.
+// Allocations bump a pointer, frees are ignored except for the most recent
+// block, and reset() releases everything at once. Resetting before each
+// message keeps JSON parsing off the heap entirely, so it cannot fragment.
+// reset() must only be called when no JsonDocument uses the arena.
+
+class JsonArena : public ArduinoJson::Allocator
+{
+public:
+    JsonArena(uint8_t* buffer, size_t size);
+
+    void reset() { _top = 0; _last = nullptr; }
+
+    size_t capacity() const { return _size; }
+    size_t used() const { return _top; }
+    size_t highWater() const { return _highWater; }
+    uint32_t failures() const { return _failures; }
+
+    void* allocate(size_t size) override;
+    void deallocate(void* ptr) override;
+    void* reallocate(void* ptr, size_t newSize) override;
+
+private:
+    // Each block is preceded by its size, rounded so blocks stay 8-byte aligned
+    enum { HEADER = 8, ALIGN = 8 };
+
+    static size_t blockSize(const void* ptr) { return *(const size_t*)((const uint8_t*)ptr - HEADER); }
+
+    uint8_t* _buffer;
+    size_t _size;
+    size_t _top = 0;
+    size_t _highWater = 0;
+    uint32_t _failures = 0;
+    uint8_t* _last = nullptr; // most recent block, can grow or be freed in place
+};
+
+// Arena owning a statically sized buffer
+template <size_t N>
+class StaticJsonArena : public JsonArena
+{
+public:
+    StaticJsonArena() : JsonArena(_storage, N) {}
+
+private:
+    alignas(8) uint8_t _storage[N];
+};
+
+#endif
@@ -0,0 +1,230 @@
+#include "Logger.h"
+#include "Metrics.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+Logger logger;
+
+static Counter logRecords("log_records_total", "Log records queued");
+static Counter logDropped("log_dropped_total", "Log records dropped because the ring was full");
+
+static const char* const levelNames[] = { "none", "error", "warn", "info", "debug" };
+static const char levelLetters[] = { '-', 'E', 'W', 'I', 'D' };
+
+#define DRAIN_PERIOD_MS 20
+
+Logger::Logger()
+{
+    for (uint32_t i = 0; i < RING_SIZE; i++)
+    {
+        _slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+}
+
+void Logger::begin(Print& out, unsigned int taskPriority)
+{
+    _out = &out;
+    xTaskCreate(drainTask, "logger", 3072, this, taskPriority, nullptr);
+}
+
+uint32_t Logger::dropped() const
+{
+    return logDropped.value();
+}
+
+const char* Logger::levelName(Level level)
+{
+    return level <= LEVEL_DEBUG ? levelNames[level] : "?";
+}
+
+bool Logger::levelFromName(const char* name, Level& level)
+{
+    for (uint8_t i = 0; i <= LEVEL_DEBUG; i++)
+    {
+        if (strcmp(name, levelNames[i]) == 0)
+        {
+            level = (Level)i;
+            return true;
+        }
+    }
+    if (name[0] >= '0' && name[0] <= '0' + LEVEL_DEBUG && name[1] == '\0')
+    {
+        level = (Level)(name[0] - '0');
+        return true;
+    }
+    return false;
+}
+
+void Logger::putWords(Record& r, ArgType type, uint32_t lo, uint32_t hi, uint8_t count)
+{
+    // Arguments that do not fit are silently ignored, the formatter prints "?"
+    if (r.words + count > MAX_WORDS || r.argc >= 10) return;
+    r.arg[r.words++] = lo;
+    if (count == 2) r.arg[r.words++] = hi;
+    r.types |= (uint32_t)type << (3 * r.argc);
+    r.argc++;
+}
+
+// Bounded multi-producer ring (Vyukov): each slot carries a sequence number,
+// producers reserve a slot with a single compare-and-swap on _head.
+void Logger::push(const Record& r)
+{
+    uint32_t pos = _head.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        Slot& slot = _slots[pos & (RING_SIZE - 1)];
+        int32_t diff = (int32_t)(slot.seq.load(std::memory_order_acquire) - pos);
+        if (diff == 0)
+        {
+            if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                slot.record = r;
+                slot.seq.store(pos + 1, std::memory_order_release);
+                logRecords.inc();
+                return;
+            }
+        }
+        else if (diff < 0)
+        {
+            // ring full: drop instead of blocking the caller
+            logDropped.inc();
+            return;
+        }
+        else
+        {
+            pos = _head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool Logger::pop(Record& r)
+{
+    Slot& slot = _slots[_tail & (RING_SIZE - 1)];
+    int32_t diff = (int32_t)(slot.seq.load(std::memory_order_acquire) - (_tail + 1));
+    if (diff < 0)
+    {
+        return false; // empty, or the producer has not finished writing yet
+    }
+    r = slot.record;
+    slot.seq.store(_tail + RING_SIZE, std::memory_order_release);
+    _tail++;
+    return true;
+}
+
+// Formats one record. Each conversion of the format string is handed to
+// snprintf on its own, with the length modifier taken from the stored
+// argument type rather than from the format string.
+void Logger::write(const Record& r)
+{
+    char line[160];
+    size_t len = snprintf(line, sizeof(line), "[%8u][%c] ", (unsigned)r.millis, levelLetters[r.level <= LEVEL_DEBUG ? r.level : 0]);
+    const char* f = r.fmt;
+    uint8_t argIndex = 0;
+    uint8_t word = 0;
+
+    while (*f != '\0' && len < sizeof(line) - 2)
+    {
+        if (*f != '%')
+        {
+            line[len++] = *f++;
+            continue;
+        }
+        if (f[1] == '%')
+        {
+            line[len++] = '%';
+            f += 2;
+            continue;
+        }
+
+        // copy flags, width and precision, skip the length modifiers
+        char spec[16];
+        size_t s = 0;
+        spec[s++] = *f++;
+        while (*f != '\0' && strchr("-+ #0123456789.", *f) != nullptr && s < sizeof(spec) - 4)
+        {
+            spec[s++] = *f++;
+        }
+        while (*f != '\0' && strchr("hlLzjt", *f) != nullptr)
+        {
+            f++;
+        }
+        char conv = *f;
+        if (conv != '\0') f++;
+
+        size_t room = sizeof(line) - 1 - len;
+        if (argIndex >= r.argc)
+        {
+            line[len++] = '?';
+            continue;
+        }
+
+        ArgType type = (ArgType)((r.types >> (3 * argIndex)) & 0x07);
+        bool wide = type == ARG_INT64 || type == ARG_UINT64 || (type == ARG_STR && sizeof(const char*) == 8);
+        uint32_t lo = r.arg[word];
+        uint32_t hi = wide ? r.arg[word + 1] : 0;
+        word += wide ? 2 : 1;
+        argIndex++;
+
+        int n = 0;
+        switch (type)
+        {
+            case ARG_INT:
+            case ARG_UINT:
+                spec[s++] = strchr("diouxXc", conv) ? conv : (type == ARG_INT ? 'd' : 'u');
+                spec[s] = '\0';
+                n = (type == ARG_INT) ? snprintf(line + len, room, spec, (int)lo) : snprintf(line + len, room, spec, (unsigned int)lo);
+                break;
+            case ARG_INT64:
+            case ARG_UINT64:
+                spec[s++] = 'l';
+                spec[s++] = 'l';
+                spec[s++] = strchr("diouxX", conv) ? conv : (type == ARG_INT64 ? 'd' : 'u');
+                spec[s] = '\0';
+                n = snprintf(line + len, room, spec, (unsigned long long)(((uint64_t)hi << 32) | lo));
+                break;
+            case ARG_DOUBLE:
+            {
+                float v;
+                memcpy(&v, &lo, sizeof(v));
+                spec[s++] = strchr("eEfgG", conv) ? conv : 'f';
+                spec[s] = '\0';
+                n = snprintf(line + len, room, spec, (double)v);
+                break;
+            }
+            case ARG_STR:
+            {
+                const char* str = (const char*)(uintptr_t)(((uint64_t)hi << 32) | lo);
+                spec[s++] = 's';
+                spec[s] = '\0';
+                n = snprintf(line + len, room, spec, str ? str : "(null)");
+                break;
+            }
+        }
+        if (n > 0) len += ((size_t)n < room) ? (size_t)n : room - 1;
+    }
+    line[len++] = '\n';
+    _out->write((const uint8_t*)line, len);
+}
+
+void Logger::drainTask(void* context)
+{
+    Logger* self = (Logger*)context;
+    uint32_t reportedDrops = 0;
+    Record r;
+
+    for (;;)
+    {
+        while (self->pop(r))
+        {
+            self->write(r);
+        }
+
+        uint32_t drops = self->dropped();
+        if (drops != reportedDrops)
+        {
+            self->_out->printf("[log] %u records dropped\n", (unsigned)(drops - reportedDrops));
+            reportedDrops = drops;
+        }
+        vTaskDelay(pdMS_TO_TICKS(DRAIN_PERIOD_MS));
+    }
+}
@@ -0,0 +1,114 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Deferred logger.
+// Call sites only copy the format string pointer (the format ID) and the raw
+// argument words into a lock-free ring of fixed size records. A low priority
+// task formats and writes them to the output, so logging never waits on the
+// UART. When the ring is full the record is dropped and counted.
+//
+// String arguments are stored by pointer: only pass literals or strings with
+// static lifetime.
+
+class Logger
+{
+public:
+    enum Level : uint8_t { LEVEL_NONE = 0, LEVEL_ERROR, LEVEL_WARN, LEVEL_INFO, LEVEL_DEBUG };
+    enum { RING_SIZE = 64 };   // records, must be a power of two
+    enum { MAX_WORDS = 6 };    // raw argument words per record (64-bit values take two)
+
+    Logger();
+
+    // Starts the drain task writing formatted records to out
+    void begin(Print& out, unsigned int taskPriority = 1);
+
+    void setLevel(Level level) { _level.store(level, std::memory_order_relaxed); }
+    Level level() const { return (Level)_level.load(std::memory_order_relaxed); }
+    bool enabled(Level level) const { return level <= _level.load(std::memory_order_relaxed); }
+
+    // Records dropped because the ring was full
+    uint32_t dropped() const;
+
+    static const char* levelName(Level level);
+    static bool levelFromName(const char* name, Level& level);
+
+    template <typename... Args>
+    void log(Level level, const char* fmt, Args... args)
+    {
+        Record r;
+        r.millis = millis();
+        r.fmt = fmt;
+        r.level = level;
+        r.words = 0;
+        r.argc = 0;
+        r.types = 0;
+        pack(r, args...);
+        push(r);
+    }
+
+private:
+    enum ArgType : uint8_t { ARG_INT, ARG_UINT, ARG_INT64, ARG_UINT64, ARG_DOUBLE, ARG_STR };
+
+    struct Record
+    {
+        uint32_t millis;
+        const char* fmt;
+        uint8_t level;
+        uint8_t words;
+        uint8_t argc;
+        uint32_t types;         // 3 bits per argument
+        uint32_t arg[MAX_WORDS];
+    };
+
+    struct Slot
+    {
+        std::atomic<uint32_t> seq;
+        Record record;
+    };
+
+    static void pack(Record&) {}
+
+    template <typename T, typename... Rest>
+    static void pack(Record& r, T first, Rest... rest)
+    {
+        put(r, first);
+        pack(r, rest...);
+    }
+
+    static void putWords(Record& r, ArgType type, uint32_t lo, uint32_t hi, uint8_t count);
+    // long and pointers are 32 bits on the ESP32, 64 on the host build
+    static void put(Record& r, int v)                { putWords(r, ARG_INT, (uint32_t)v, 0, 1); }
+    static void put(Record& r, long v)               { if (sizeof(v) == 8) put(r, (long long)v); else put(r, (int)v); }
+    static void put(Record& r, unsigned int v)       { putWords(r, ARG_UINT, v, 0, 1); }
+    static void put(Record& r, unsigned long v)      { if (sizeof(v) == 8) put(r, (unsigned long long)v); else put(r, (unsigned int)v); }
+    static void put(Record& r, long long v)          { putWords(r, ARG_INT64, (uint32_t)v, (uint32_t)((uint64_t)v >> 32), 2); }
+    static void put(Record& r, unsigned long long v) { putWords(r, ARG_UINT64, (uint32_t)v, (uint32_t)(v >> 32), 2); }
+    static void put(Record& r, double v)             { float f = (float)v; uint32_t w; memcpy(&w, &f, sizeof(w)); putWords(r, ARG_DOUBLE, w, 0, 1); }
+    static void put(Record& r, const char* v)        { uint64_t p = (uintptr_t)v; putWords(r, ARG_STR, (uint32_t)p, (uint32_t)(p >> 32), sizeof(v) / 4); }
+
+    void push(const Record& r);
+    bool pop(Record& r);
+    void write(const Record& r);
+    static void drainTask(void* context);
+
+    Slot _slots[RING_SIZE];
+    std::atomic<uint32_t> _head{0};   // next slot to reserve (producers)
+    uint32_t _tail = 0;               // next slot to drain (drain task only)
+    std::atomic<uint8_t> _level{LEVEL_INFO};
+    Print* _out = nullptr;
+};
+
+extern Logger logger;
+
+#define LOG_AT(lvl, fmt, ...) \
+    do { if (logger.enabled(lvl)) logger.log(lvl, fmt, ##__VA_ARGS__); } while (0)
+
+#define LOG_E(fmt, ...) LOG_AT(Logger::LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#define LOG_W(fmt, ...) LOG_AT(Logger::LEVEL_WARN, fmt, ##__VA_ARGS__)
+#define LOG_I(fmt, ...) LOG_AT(Logger::LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define LOG_D(fmt, ...) LOG_AT(Logger::LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+
+#endif
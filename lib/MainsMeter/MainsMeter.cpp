@@ -0,0 +1,136 @@
+#include "MainsMeter.h"
+#include "Metrics.h"
+
+#define LOCK_WINDOW_UNLOCKED_PCT 10   // accepted period deviation before the first estimate
+#define LOCK_WINDOW_LOCKED_PCT   2    // accepted period deviation once an estimate exists
+
+static Counter mainsEdges("mains_edges_total", "Zero crossings captured");
+static Counter mainsEdgesDropped("mains_edges_dropped_total", "Zero crossings lost because the edge queue was full");
+static Counter mainsEdgesRejected("mains_edges_rejected_total", "Zero crossings rejected by the lock window");
+static Counter mainsResyncs("mains_resyncs_total", "Measurement restarts after a missing edge");
+static Gauge mainsFrequency("mains_frequency_mhz", "Locally measured mains frequency (mHz)");
+
+MainsFrequencyMeter* MainsFrequencyMeter::_instance = nullptr;
+
+MainsFrequencyEstimator::MainsFrequencyEstimator(uint16_t nominalHz, uint8_t cycles)
+    : _nominalPeriodUs(1000000UL / nominalHz),
+      _cycles(cycles > MAX_CYCLES ? MAX_CYCLES : (cycles == 0 ? 1 : cycles))
+{
+    reset();
+}
+
+void MainsFrequencyEstimator::reset()
+{
+    _head = 0;
+    _count = 0;
+    _sinceEstimate = _cycles - 1; // estimate as soon as the first window is full
+    _periodUs = _nominalPeriodUs;
+    _frequencyMilliHz = 0;
+}
+
+bool MainsFrequencyEstimator::addEdge(uint32_t timeUs)
+{
+    if (_count > 0)
+    {
+        uint32_t last = _edges[(_head + MAX_CYCLES) % (MAX_CYCLES + 1)];
+        uint32_t dt = timeUs - last; // wraps correctly
+        uint32_t tolerance = _periodUs * (_frequencyMilliHz ? LOCK_WINDOW_LOCKED_PCT : LOCK_WINDOW_UNLOCKED_PCT) / 100;
+
+        if (dt < _periodUs - tolerance)
+        {
+            _rejected++; // early edge: noise or harmonic, keep waiting for the real one
+            return false;
+        }
+        if (dt > _periodUs + tolerance)
+        {
+            // missed an edge (or a long glitch), start a new window from here
+            _resyncs++;
+            _count = 0;
+            _sinceEstimate = _cycles - 1;
+        }
+    }
+
+    _edges[_head] = timeUs;
+    _head = (_head + 1) % (MAX_CYCLES + 1);
+    if (_count <= _cycles) _count++;
+    if (_count <= _cycles) return false; // window not full yet
+
+    if (++_sinceEstimate < _cycles) return false;
+    _sinceEstimate = 0;
+
+    // _cycles periods between the oldest and the newest edge of the window
+    uint32_t first = _edges[(_head + MAX_CYCLES - _cycles) % (MAX_CYCLES + 1)];
+    uint32_t span = timeUs - first;
+    _frequencyMilliHz = (uint32_t)(((uint64_t)_cycles * 1000000000ULL + span / 2) / span);
+    _periodUs = (span + _cycles / 2) / _cycles;
+    return true;
+}
+
+MainsFrequencyMeter::MainsFrequencyMeter(uint16_t nominalHz, uint8_t cycles)
+    : _estimator(nominalHz, cycles)
+{
+}
+
+void MainsFrequencyMeter::begin(uint8_t pin)
+{
+    _instance = this;
+    _pin = pin;
+    _estimator.reset();
+    _queueHead.store(0);
+    _queueTail.store(0);
+    pinMode(pin, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(pin), edgeIsr, RISING);
+}
+
+void MainsFrequencyMeter::end()
+{
+    if (_pin == NO_PIN) return;
+    detachInterrupt(digitalPinToInterrupt(_pin));
+    _pin = NO_PIN;
+}
+
+void IRAM_ATTR MainsFrequencyMeter::edgeIsr()
+{
+    MainsFrequencyMeter* self = _instance;
+    uint32_t now = (uint32_t)esp_timer_get_time();
+
+    // comparator chatter around the crossing
+    if (now - self->_lastIsrUs < DEBOUNCE_US) return;
+    self->_lastIsrUs = now;
+
+    uint8_t head = self->_queueHead.load(std::memory_order_relaxed);
+    if ((uint8_t)(head - self->_queueTail.load(std::memory_order_acquire)) >= EDGE_QUEUE_SIZE)
+    {
+        mainsEdgesDropped.inc();
+        return;
+    }
+    self->_queue[head & (EDGE_QUEUE_SIZE - 1)] = now;
+    self->_queueHead.store(head + 1, std::memory_order_release);
+}
+
+bool MainsFrequencyMeter::poll(float& frequency)
+{
+    bool updated = false;
+    uint8_t tail = _queueTail.load(std::memory_order_relaxed);
+    uint8_t head = _queueHead.load(std::memory_order_acquire);
+    uint32_t rejected = _estimator.rejectedEdges();
+    uint32_t resyncs = _estimator.resyncs();
+
+    while (tail != head)
+    {
+        updated |= _estimator.addEdge(_queue[tail & (EDGE_QUEUE_SIZE - 1)]);
+        mainsEdges.inc();
+        tail++;
+    }
+    _queueTail.store(tail, std::memory_order_release);
+
+    mainsEdgesRejected.inc(_estimator.rejectedEdges() - rejected);
+    mainsResyncs.inc(_estimator.resyncs() - resyncs);
+
+    if (updated)
+    {
+        mainsFrequency.set(_estimator.frequencyMilliHz());
+        frequency = _estimator.frequencyMilliHz() / 1000.0f;
+    }
+    return updated;
+}
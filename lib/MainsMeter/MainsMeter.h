@@ -0,0 +1,81 @@
+#ifndef MAINS_METER_H
+#define MAINS_METER_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Frequency estimator working on zero crossing time stamps (microseconds).
+// Integer only. Edges are phase locked: an edge is accepted when it falls in
+// a window around one period after the previous accepted edge, earlier edges
+// (noise, harmonics, comparator chatter) are ignored and a missing edge
+// restarts the measurement. The frequency is the number of accepted cycles
+// divided by the time between the first and last edge of the window, so the
+// timing noise of the intermediate edges cancels out.
+
+class MainsFrequencyEstimator
+{
+public:
+    enum { MAX_CYCLES = 100 };
+
+    // nominalHz: 50 or 60, cycles: averaging window (<= MAX_CYCLES)
+    MainsFrequencyEstimator(uint16_t nominalHz, uint8_t cycles);
+
+    // Feeds one rising edge, returns true when a new estimate is available
+    bool addEdge(uint32_t timeUs);
+
+    // Latest estimate in millihertz, 0 until the first full window
+    uint32_t frequencyMilliHz() const { return _frequencyMilliHz; }
+
+    uint32_t rejectedEdges() const { return _rejected; }
+    uint32_t resyncs() const { return _resyncs; }
+
+    void reset();
+
+private:
+    uint32_t _nominalPeriodUs;
+    uint8_t _cycles;
+
+    uint32_t _edges[MAX_CYCLES + 1]; // accepted edges, circular
+    uint8_t _head = 0;               // next write index
+    uint8_t _count = 0;              // accepted edges since the last resync
+    uint8_t _sinceEstimate = 0;      // cycles since the last estimate
+    uint32_t _periodUs;              // expected period used for the lock window
+    uint32_t _frequencyMilliHz = 0;
+    uint32_t _rejected = 0;
+    uint32_t _resyncs = 0;
+};
+
+// Captures zero crossings from an isolated AC sense input (rising edges on a
+// GPIO) and runs the estimator outside the interrupt.
+class MainsFrequencyMeter
+{
+public:
+    enum { EDGE_QUEUE_SIZE = 32 }; // power of two
+
+    MainsFrequencyMeter(uint16_t nominalHz, uint8_t cycles);
+
+    void begin(uint8_t pin);
+    void end();
+    bool running() const { return _pin != NO_PIN; }
+
+    // Processes the queued edges, returns true and sets frequency when a new estimate is ready
+    bool poll(float& frequency);
+
+private:
+    enum { NO_PIN = 255 };
+    enum { DEBOUNCE_US = 1000 };
+
+    static void edgeIsr();
+
+    MainsFrequencyEstimator _estimator;
+    uint8_t _pin = NO_PIN;
+
+    // edge queue filled by the ISR (single producer, single consumer)
+    static MainsFrequencyMeter* _instance;
+    uint32_t _queue[EDGE_QUEUE_SIZE];
+    std::atomic<uint8_t> _queueHead{0};
+    std::atomic<uint8_t> _queueTail{0};
+    uint32_t _lastIsrUs = 0;
+};
+
+#endif
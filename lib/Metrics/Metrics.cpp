@@ -0,0 +1,75 @@
+#include "Metrics.h"
+
+// Zero-initialized before any constructor runs, so metrics defined at
+// namespace scope in other translation units can register safely.
+Metric* Metric::_head = nullptr;
+
+Metric::Metric(const char* name, const char* help, Type type)
+    : _name(name), _help(help), _type(type), _next(_head)
+{
+    _head = this;
+}
+
+Metric* Metric::find(const char* name)
+{
+    for (Metric* m = _head; m != nullptr; m = m->next())
+    {
+        if (strcmp(m->name(), name) == 0) return m;
+    }
+    return nullptr;
+}
+
+Metric* Metric::find(const char* name, Type type)
+{
+    Metric* m = find(name);
+    return (m != nullptr && m->type() == type) ? m : nullptr;
+}
+
+void Metric::writeAll(Print& out)
+{
+    for (const Metric* m = _head; m != nullptr; m = m->next())
+    {
+        m->writeTo(out);
+    }
+}
+
+void Metric::writeHeader(Print& out, const char* type) const
+{
+    out.printf("# HELP %s %s\n# TYPE %s %s\n", _name, _help, _name, type);
+}
+
+void Counter::writeTo(Print& out) const
+{
+    writeHeader(out, "counter");
+    out.printf("%s %u\n", name(), (unsigned)value());
+}
+
+void Gauge::writeTo(Print& out) const
+{
+    writeHeader(out, "gauge");
+    out.printf("%s %d\n", name(), (int)value());
+}
+
+uint32_t Histogram::count() const
+{
+    uint32_t total = 0;
+    for (int i = 0; i < BUCKETS; i++)
+    {
+        total += _buckets[i].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void Histogram::writeTo(Print& out) const
+{
+    writeHeader(out, "histogram");
+    uint32_t cumulative = 0;
+    for (int i = 0; i < BUCKETS - 1; i++)
+    {
+        cumulative += _buckets[i].load(std::memory_order_relaxed);
+        out.printf("%s_bucket{le=\"%u\"} %u\n", name(), (1U << i) - 1, (unsigned)cumulative);
+    }
+    cumulative += _buckets[BUCKETS - 1].load(std::memory_order_relaxed);
+    out.printf("%s_bucket{le=\"+Inf\"} %u\n", name(), (unsigned)cumulative);
+    out.printf("%s_sum %u\n%s_count %u\n%s_max %u\n", name(), (unsigned)sum(), name(), (unsigned)cumulative, name(), (unsigned)max());
+}
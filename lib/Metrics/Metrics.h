@@ -0,0 +1,119 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Lightweight metrics registry.
+// Metrics are statically allocated and link themselves into a global list
+// when constructed, so no heap is used and recording is a single relaxed
+// atomic operation, cheap enough for the stepper timer callback. The
+// recording calls are always inlined, so from an IRAM function they stay
+// in IRAM.
+// The whole registry can be exported in Prometheus text format.
+
+class Metric
+{
+public:
+    enum Type { COUNTER, GAUGE, HISTOGRAM };
+
+    Metric(const char* name, const char* help, Type type);
+
+    const char* name() const { return _name; }
+    const char* help() const { return _help; }
+    Type type() const { return _type; }
+    Metric* next() const { return _next; }
+
+    virtual void writeTo(Print& out) const = 0;
+
+    static Metric* first() { return _head; }
+
+    // Returns the metric registered under name, nullptr if none. The typed
+    // lookups (Counter::find(), ...) also return nullptr for another type.
+    static Metric* find(const char* name);
+    static Metric* find(const char* name, Type type);
+
+    // Writes every registered metric to out
+    static void writeAll(Print& out);
+
+protected:
+    void writeHeader(Print& out, const char* type) const;
+
+private:
+    const char* _name;
+    const char* _help;
+    Type _type;
+    Metric* _next;
+
+    static Metric* _head;
+};
+
+// Monotonic counter (events, bytes, ...)
+class Counter : public Metric
+{
+public:
+    Counter(const char* name, const char* help) : Metric(name, help, COUNTER) {}
+
+    static Counter* find(const char* name) { return static_cast<Counter*>(Metric::find(name, COUNTER)); }
+
+    __attribute__((always_inline)) inline void inc(uint32_t n = 1) { _value.fetch_add(n, std::memory_order_relaxed); }
+    uint32_t value() const { return _value.load(std::memory_order_relaxed); }
+
+    void writeTo(Print& out) const override;
+
+private:
+    std::atomic<uint32_t> _value{0};
+};
+
+// Instantaneous value (free heap, queue depth, ...)
+class Gauge : public Metric
+{
+public:
+    Gauge(const char* name, const char* help) : Metric(name, help, GAUGE) {}
+
+    static Gauge* find(const char* name) { return static_cast<Gauge*>(Metric::find(name, GAUGE)); }
+
+    __attribute__((always_inline)) inline void set(int32_t v) { _value.store(v, std::memory_order_relaxed); }
+    __attribute__((always_inline)) inline void add(int32_t n) { _value.fetch_add(n, std::memory_order_relaxed); }
+    int32_t value() const { return _value.load(std::memory_order_relaxed); }
+
+    void writeTo(Print& out) const override;
+
+private:
+    std::atomic<int32_t> _value{0};
+};
+
+// Histogram with power-of-two buckets: bucket i holds values < 2^i.
+// Recording is a count-leading-zeros and two atomic adds.
+class Histogram : public Metric
+{
+public:
+    enum { BUCKETS = 16 };
+
+    Histogram(const char* name, const char* help) : Metric(name, help, HISTOGRAM) {}
+
+    static Histogram* find(const char* name) { return static_cast<Histogram*>(Metric::find(name, HISTOGRAM)); }
+
+    __attribute__((always_inline)) inline void record(uint32_t v)
+    {
+        unsigned int i = (v == 0) ? 0 : 32 - __builtin_clz(v);
+        if (i >= BUCKETS) i = BUCKETS - 1;
+        _buckets[i].fetch_add(1, std::memory_order_relaxed);
+        _sum.fetch_add(v, std::memory_order_relaxed);
+        uint32_t m = _max.load(std::memory_order_relaxed);
+        while (v > m && !_max.compare_exchange_weak(m, v, std::memory_order_relaxed)) {}
+    }
+
+    uint32_t count() const;
+    uint32_t sum() const { return _sum.load(std::memory_order_relaxed); }
+    uint32_t max() const { return _max.load(std::memory_order_relaxed); }
+
+    void writeTo(Print& out) const override;
+
+private:
+    std::atomic<uint32_t> _buckets[BUCKETS] = {};
+    std::atomic<uint32_t> _sum{0};
+    std::atomic<uint32_t> _max{0};
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include "RmtStepTrain.h"
+#include "Metrics.h"
+
+static Counter batchesEmitted("motor_batches_total", "Step batches played by the RMT pulse train");
+
+RmtStepTrain::RmtStepTrain(uint8_t channel) : channel((rmt_channel_t)channel)
+{
+}
+
+bool RmtStepTrain::begin(uint8_t pin, Planner planner, void* context)
+{
+  this->planner = planner;
+  this->context = context;
+  if (installed) return pin == this->pin;
+
+  rmt_config_t config = RMT_DEFAULT_CONFIG_TX((gpio_num_t)pin, channel);
+  config.clk_div = 80;    // 1 tick per microsecond
+  config.mem_block_num = 1;
+  if (rmt_config(&config) != ESP_OK) return false;
+  if (rmt_driver_install(channel, 0, 0) != ESP_OK) return false;
+  // single callback for all channels, txEnd() filters on its own channel
+  rmt_register_tx_end_callback(&RmtStepTrain::txEnd, this);
+  this->pin = pin;
+  installed = true;
+  return true;
+}
+
+bool RmtStepTrain::start()
+{
+  if (!installed || isRunning) return false;
+  // the pin may have been given back to the GPIO matrix by stop()
+  rmt_set_gpio(channel, RMT_MODE_TX, (gpio_num_t)pin, false);
+  isRunning = true;
+  batch.count = 0;
+  return emitNext();
+}
+
+void RmtStepTrain::stop()
+{
+  if (!installed) return;
+  isRunning = false;
+  rmt_tx_stop(channel);
+}
+
+bool RmtStepTrain::emitNext()
+{
+  if (!isRunning || !planner(context, batch)) {
+    isRunning = false;
+    return false;
+  }
+  for (uint8_t i = 0; i < batch.count; i++) {
+    // rising edge steps, the low part lasts until the next step
+    items[i].level0 = 1;
+    items[i].duration0 = pulseMicrosec;
+    items[i].level1 = 0;
+    items[i].duration1 = batch.delayMicrosec[i] - pulseMicrosec;
+  }
+  items[batch.count].val = 0;   // end marker
+  rmt_fill_tx_items(channel, items, batch.count + 1, 0);
+  // taken before the start, so cutBatch() errs towards keeping a step
+  batchStartUs = esp_timer_get_time();
+  rmt_tx_start(channel, true);
+  batchesEmitted.inc();
+  return true;
+}
+
+bool RmtStepTrain::cutBatch(uint8_t& kept)
+{
+  if (!isRunning) return false;
+  // step i starts at the sum of the delays before it
+  int64_t horizon = esp_timer_get_time() - batchStartUs + cutMarginMicrosec;
+  int64_t stepStart = 0;
+  kept = 0;
+  while (kept < batch.count && stepStart <= horizon) {
+    stepStart += batch.delayMicrosec[kept++];
+  }
+  if (kept >= batch.count) return false;
+  // the player stops at the end marker, after the low part of step kept - 1
+  items[kept].val = 0;
+  rmt_fill_tx_items(channel, &items[kept], 1, kept);
+  batch.count = kept;
+  return true;
+}
+
+void RmtStepTrain::txEnd(rmt_channel_t channel, void* arg)
+{
+  RmtStepTrain* self = (RmtStepTrain*) arg;
+  if (self->channel != channel) return;
+  self->emitNext();
+}
@@ -0,0 +1,67 @@
+#ifndef RmtStepTrain_h
+#define RmtStepTrain_h
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <driver/rmt.h>
+
+// Steps planned ahead of time, all in the same direction
+struct StepBatch {
+  enum { MAX_STEPS = 32 };   // + end marker, fits one 48 item RMT block
+
+  uint8_t count;
+  unsigned short delayMicrosec[MAX_STEPS];  // from each step to the next
+};
+
+// Step pulse generator using an RMT channel.
+// The planner fills a batch of step delays, the batch is written to the
+// channel memory as pulses and played by the peripheral. The CPU only wakes
+// at the end of each batch (RMT interrupt) to plan and start the next one.
+// On a target change cutBatch() ends the batch in play early, so the steps
+// after it are planned again for the new target.
+class RmtStepTrain {
+  public:
+    // Fills batch, returns false when there is no step left. On entry batch
+    // holds the previous batch as played (count 0 for the first one).
+    typedef bool (*Planner)(void* context, StepBatch& batch);
+
+    RmtStepTrain(uint8_t channel);
+
+    const char* name() const { return "rmt"; }
+
+    // Installs the RMT driver on pin (once), planner supplies the batches
+    bool begin(uint8_t pin, Planner planner, void* context);
+
+    // Plans and plays batches until the planner returns false
+    bool start();
+    void stop();
+    bool running() const { return isRunning; }
+
+    // Ends the batch in play after the steps already started, or about to
+    // (kept, at least 1): the end of the last kept step starts the next
+    // batch. Returns false if there is nothing left to cut. Call with the
+    // RMT interrupt masked, the planner must then rewind to after step
+    // kept - 1.
+    bool cutBatch(uint8_t& kept);
+
+  private:
+    bool emitNext();
+    static void txEnd(rmt_channel_t channel, void* arg);
+
+    static const uint16_t pulseMicrosec = 2;
+    // a step starting within this time is kept, the RMT must not have
+    // passed the end marker written by cutBatch()
+    static const uint16_t cutMarginMicrosec = 50;
+
+    rmt_channel_t channel;
+    uint8_t pin = 0xff;
+    bool installed = false;
+    Planner planner = nullptr;
+    void* context = nullptr;
+    volatile bool isRunning = false;
+    StepBatch batch;
+    int64_t batchStartUs = 0;
+    rmt_item32_t items[StepBatch::MAX_STEPS + 1];
+};
+
+#endif
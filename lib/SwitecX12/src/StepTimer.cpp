@@ -0,0 +1,133 @@
+#include "StepTimer.h"
+
+static Histogram espJitter("motor_step_jitter_esp_us", "Step interval jitter with the esp_timer backend");
+static Histogram hwJitter("motor_step_jitter_hw_us", "Step interval jitter with the hardware timer backend");
+
+void StepTimer::start(uint32_t periodUs)
+{
+  if (isRunning) disarm();
+  period = periodUs;
+  lastFire = 0;
+  isRunning = true;
+  arm(periodUs);
+}
+
+void StepTimer::stop()
+{
+  if (!isRunning) return;
+  isRunning = false;
+  disarm();
+}
+
+uint32_t IRAM_ATTR StepTimer::fire(int64_t nowUs)
+{
+  if (!isRunning) return 0;
+  if (lastFire != 0) {
+    int64_t error = (nowUs - lastFire) - (int64_t)period;
+    jitter.record((uint32_t)(error < 0 ? -error : error));
+  }
+  lastFire = nowUs;
+  uint32_t next = callback(context);
+  period = next;
+  if (next == 0) isRunning = false;
+  return next;
+}
+
+EspStepTimer::EspStepTimer() : StepTimer(espJitter)
+{
+}
+
+bool EspStepTimer::begin(Callback callback, void* context)
+{
+  this->callback = callback;
+  this->context = context;
+  if (handle != nullptr) return true;
+
+  const esp_timer_create_args_t args = {
+    .callback = &EspStepTimer::timerCallback,
+    .arg = (void*) this,
+    .name = "switecX12"
+  };
+  return esp_timer_create(&args, &handle) == ESP_OK;
+}
+
+void EspStepTimer::arm(uint32_t periodUs)
+{
+  armedPeriod = periodUs;
+  esp_timer_start_periodic(handle, periodUs);
+}
+
+void EspStepTimer::disarm()
+{
+  esp_timer_stop(handle);
+}
+
+void EspStepTimer::timerCallback(void* arg)
+{
+  EspStepTimer* self = (EspStepTimer*) arg;
+  uint32_t next = self->fire(esp_timer_get_time());
+  if (next == 0) {
+    esp_timer_stop(self->handle);
+  } else if (next != self->armedPeriod) {
+    // a running timer cannot be restarted with a new period, stop it first
+    esp_timer_stop(self->handle);
+    self->arm(next);
+  }
+}
+
+HwStepTimer::HwStepTimer(uint8_t timerNum) : StepTimer(hwJitter),
+  group((timer_group_t)(timerNum / SOC_TIMER_GROUP_TIMERS_PER_GROUP)),
+  index((timer_idx_t)(timerNum % SOC_TIMER_GROUP_TIMERS_PER_GROUP))
+{
+}
+
+bool HwStepTimer::begin(Callback callback, void* context)
+{
+  this->callback = callback;
+  this->context = context;
+  if (installed) return true;
+
+  timer_config_t config = {};
+  config.divider = 80;    // APB clock is 80 MHz: 1 tick per microsecond
+  config.counter_dir = TIMER_COUNT_UP;
+  config.counter_en = TIMER_PAUSE;
+  config.alarm_en = TIMER_ALARM_EN;
+  config.auto_reload = TIMER_AUTORELOAD_EN;
+  config.intr_type = TIMER_INTR_LEVEL;
+  if (timer_init(group, index, &config) != ESP_OK) return false;
+  if (timer_isr_callback_add(group, index, &HwStepTimer::isr, this, ESP_INTR_FLAG_IRAM) != ESP_OK) {
+    timer_deinit(group, index);
+    return false;
+  }
+  installed = true;
+  return true;
+}
+
+void HwStepTimer::arm(uint32_t periodUs)
+{
+  armedPeriod = periodUs;
+  timer_set_counter_value(group, index, 0);
+  timer_set_alarm_value(group, index, periodUs);
+  timer_set_alarm(group, index, TIMER_ALARM_EN);
+  timer_start(group, index);
+}
+
+void HwStepTimer::disarm()
+{
+  timer_pause(group, index);
+}
+
+bool IRAM_ATTR HwStepTimer::isr(void* arg)
+{
+  HwStepTimer* self = (HwStepTimer*) arg;
+  uint32_t next = self->fire(esp_timer_get_time());
+  if (next == 0) {
+    timer_group_set_counter_enable_in_isr(self->group, self->index, TIMER_PAUSE);
+  } else if (next != self->armedPeriod) {
+    // with auto reload the counter restarted at the alarm, the new alarm
+    // value applies to the period that just began
+    timer_group_set_alarm_value_in_isr(self->group, self->index, next);
+    self->armedPeriod = next;
+  }
+  return false;   // no task woken
+}
@@ -0,0 +1,93 @@
+#ifndef StepTimer_h
+#define StepTimer_h
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <driver/timer.h>
+#include "Metrics.h"
+
+// Periodic timer backend driving SwitecX12::advance().
+// The callback returns the period to its next call, 0 stops the timer, so
+// the backends re-arm themselves without a virtual call in the interrupt.
+// Every backend records the step interval jitter (difference between the
+// measured interval and the programmed period) into its histogram.
+class StepTimer {
+  public:
+    typedef uint32_t (*Callback)(void* context);
+
+    StepTimer(Histogram& jitter) : jitter(jitter) {}
+    virtual ~StepTimer() {}
+
+    virtual const char* name() const = 0;
+
+    // Prepares the timer, callback is called with context at every period
+    virtual bool begin(Callback callback, void* context) = 0;
+
+    // Starts the timer, the first call comes after periodUs
+    void start(uint32_t periodUs);
+    void stop();
+    bool running() const { return isRunning; }
+
+  protected:
+    virtual void arm(uint32_t periodUs) = 0;
+    virtual void disarm() = 0;
+
+    // Called by the backends at every period, returns the next period
+    // (0 once stopped). In IRAM, like the callback.
+    uint32_t fire(int64_t nowUs);
+
+    Callback callback = nullptr;
+    void* context = nullptr;
+
+  private:
+    Histogram& jitter;
+    volatile bool isRunning = false;
+    volatile uint32_t period = 0;       // period of the interval in progress
+    volatile int64_t lastFire = 0;      // 0 until the first call after start()
+};
+
+// esp_timer backend: callbacks run in the esp_timer task, they can be
+// delayed by higher priority tasks (Wi-Fi, lwIP).
+class EspStepTimer : public StepTimer {
+  public:
+    EspStepTimer();
+
+    const char* name() const override { return "esp"; }
+    bool begin(Callback callback, void* context) override;
+
+  protected:
+    void arm(uint32_t periodUs) override;
+    void disarm() override;
+
+  private:
+    static void timerCallback(void* arg);
+
+    esp_timer_handle_t handle = nullptr;
+    uint32_t armedPeriod = 0;
+};
+
+// Hardware general purpose timer backend: the callback runs in the timer
+// interrupt, registered in IRAM so the steps go on while the flash cache is
+// disabled (NVS writes). The callback and everything it calls must then be
+// IRAM_ATTR and only read data in RAM.
+class HwStepTimer : public StepTimer {
+  public:
+    HwStepTimer(uint8_t timerNum);
+
+    const char* name() const override { return "hw"; }
+    bool begin(Callback callback, void* context) override;
+
+  protected:
+    void arm(uint32_t periodUs) override;
+    void disarm() override;
+
+  private:
+    static bool isr(void* arg);
+
+    timer_group_t group;
+    timer_idx_t index;
+    bool installed = false;
+    uint32_t armedPeriod = 0;
+};
+
+#endif
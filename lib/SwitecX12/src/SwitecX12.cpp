@@ -8,12 +8,14 @@
  */
 
 #include "SwitecX12.h"
+#include "Metrics.h"
+#include <hal/gpio_ll.h>
 
 // This table defines the acceleration curve.
 // 1st value is the speed step, 2nd value is delay in microseconds
 // 1st value in each row must be > 1st value in subsequent row
 // 1st value in last row should be == maxVel, must be <= maxVel
-static unsigned short defaultAccelTable[][2] = {
+static const unsigned short defaultAccelTable[][2] = {
   {   20, 4000},
   {   50, 2000},
   {  100, 1000},
@@ -26,19 +28,29 @@ const int resetStepMicrosec = 500;
 #define DEFAULT_ACCEL_TABLE_SIZE (sizeof(defaultAccelTable)/sizeof(*defaultAccelTable))
 #define TIMER_INTERVAL_USEC 5000
 
+static Counter stepsEmitted("motor_steps_total", "Steps emitted by the needle stepper");
+static Histogram advanceTime("motor_advance_us", "Time spent in SwitecX12::advance() per step");
+
+// Pin write for the step path: digitalWrite() is in flash, unusable from
+// the IRAM timer interrupt while the flash cache is disabled
+static inline void IRAM_ATTR setPin(unsigned char pin, unsigned char level)
+{
+  gpio_ll_set_level(&GPIO, (gpio_num_t)pin, level);
+}
+
 SwitecX12::SwitecX12()
 {
 }
 
-void SwitecX12::irqTimerCallback(void * context)
+uint32_t IRAM_ATTR SwitecX12::irqTimerCallback(void * context)
 {
     if(context == NULL)
     {
-        return;
+        return 0;
     }
     // 17us to execute advance();
     SwitecX12 * ptrSwitecX12 = (SwitecX12 *) context;
-    ptrSwitecX12->advance();
+    return ptrSwitecX12->advance();
     
 }
 
@@ -70,28 +82,52 @@ void SwitecX12::begin(unsigned char pinStep, unsigned char pinDir, unsigned char
   currentStep = 0;
   targetStep = 0;
 
-  accelTable = defaultAccelTable;
-  maxVel = defaultAccelTable[DEFAULT_ACCEL_TABLE_SIZE-1][0]; // last value in table.
+  setAccelTable(defaultAccelTable, DEFAULT_ACCEL_TABLE_SIZE);
 
-  const esp_timer_create_args_t periodic_timer_args = {
-    .callback = &(SwitecX12::irqTimerCallback),
-    /* name is optional, but may help identify the timer when debugging */
-    .arg = (void*) this,
-    .name = "switecX12"
-  };
-  esp_timer_create(&periodic_timer_args, &periodic_timer);
-  esp_timer_start_periodic(periodic_timer, TIMER_INTERVAL_USEC);
+  // the timer only runs while the needle moves, setPosition() starts it
+  timer->begin(&SwitecX12::irqTimerCallback, this);
+  started = true;
+}
+
+bool SwitecX12::setTimer(StepTimer& newTimer)
+{
+  if (!stopped) return false;
+  if (started && !newTimer.begin(&SwitecX12::irqTimerCallback, this)) return false;
+  stopMotion();
+  timer = &newTimer;
+  pulseTrain = nullptr;
+  return true;
+}
+
+bool SwitecX12::setPulseTrain(RmtStepTrain& train)
+{
+  if (!stopped || !started) return false;
+  if (!train.begin(pinStep, &SwitecX12::planBatch, this)) return false;
+  stopMotion();
+  pulseTrain = &train;
+  return true;
+}
+
+void SwitecX12::stopMotion()
+{
+  timer->stop();
+  if (pulseTrain != nullptr) {
+    pulseTrain->stop();
+    // give the step pin back to the GPIO matrix for stepTo()
+    pinMode(pinStep, OUTPUT);
+    digitalWrite(pinStep, LOW);
+  }
 }
 
 
 
 void SwitecX12::step(int dir)
 {
+  // starts the pulse only, the X12 steps on the rising edge
   digitalWrite(pinDir, dir > 0 ? LOW : HIGH);
   digitalWrite(pinStep, HIGH);
-  delayMicroseconds(stepPulseMicrosec);
-  digitalWrite(pinStep, LOW);
   currentStep += dir;
+  stepsEmitted.inc();
 }
 
 void SwitecX12::stepTo(int position, int delayMicrosec)
@@ -99,7 +135,7 @@ void SwitecX12::stepTo(int position, int delayMicrosec)
   int count;
   int dir;
 
-  esp_timer_stop(periodic_timer);
+  stopMotion();
   if (position > currentStep) {
     dir = 1;
     count = position - currentStep;
@@ -109,6 +145,8 @@ void SwitecX12::stepTo(int position, int delayMicrosec)
   }
   for (int i=0;i<count;i++) {
     step(dir);
+    delayMicroseconds(stepPulseMicrosec);
+    digitalWrite(pinStep, LOW);
     delayMicroseconds(delayMicrosec);
   }
 }
@@ -124,21 +162,39 @@ void SwitecX12::zero()
   targetStep = 0;
   vel = 0;
   dir = 0;
+  stopped = true; // stepTo() stopped the motion, next setPosition() restarts it
 }
 
-void SwitecX12::advance(void)
+uint32_t IRAM_ATTR SwitecX12::advance(void)
 {
+  // end the step pulse started one period ago
+  setPin(pinStep, LOW);
+
   if(stopped == true)
  {
-     return;
+     return 0;
  }
-  // detect stopped state
-  if (currentStep==targetStep && vel==0) {
+  int64_t t0 = esp_timer_get_time();
+
+  unsigned short delayMicrosec;
+  if (!planStep(delayMicrosec)) {
     stopped = true;
     dir = 0;
-    //time0 = micros();
-    esp_timer_stop(periodic_timer);
-    return;
+    return 0;
+  }
+  setPin(pinDir, dir > 0 ? LOW : HIGH);
+  setPin(pinStep, HIGH);
+  stepsEmitted.inc();
+
+  advanceTime.record((uint32_t)(esp_timer_get_time() - t0));
+  return delayMicrosec;
+}
+
+bool IRAM_ATTR SwitecX12::planStep(unsigned short& delayMicrosec)
+{
+  // detect stopped state
+  if (currentStep==targetStep && vel==0) {
+    return false;
   }
 
   // if stopped, determine direction
@@ -148,7 +204,7 @@ void SwitecX12::advance(void)
     vel = 1;
   }
 
-  step(dir);
+  currentStep += dir;
 
   // determine delta, number of steps in current direction to target.
   // may be negative if we are headed away from target
@@ -181,12 +237,50 @@ void SwitecX12::advance(void)
   // vel now defines delay
   unsigned char i = 0;
   // this is why vel must not be greater than the last vel in the table.
-  while (accelTable[i][0]<vel) {
+  while (i < accelTableSize-1 && accelTable[i][0]<vel) {
     i++;
   }
-  esp_timer_start_periodic(periodic_timer, accelTable[i][1]);
+  delayMicrosec = accelTable[i][1];
+  return true;
+}
+
+bool SwitecX12::planBatch(void * context, StepBatch& batch)
+{
+  SwitecX12 * self = (SwitecX12 *) context;
+  // the previous batch has been played, cut or not
+  stepsEmitted.inc(batch.count);
+  batch.count = 0;
+  while (batch.count < StepBatch::MAX_STEPS) {
+    // vel 0 means stopping or reversing: the dir pin must change between batches
+    if (batch.count > 0 && self->vel == 0) break;
+    if (!self->planStep(batch.delayMicrosec[batch.count])) break;
+    if (batch.count == 0) setPin(self->pinDir, self->dir > 0 ? LOW : HIGH);
+    self->batchStep[batch.count] = self->currentStep;
+    self->batchVel[batch.count] = self->vel;
+    batch.count++;
+  }
+  if (batch.count == 0) {
+    self->stopped = true;
+    self->dir = 0;
+    return false;
+  }
+  return true;
+}
+
+bool SwitecX12::setAccelTable(const unsigned short (*table)[2], unsigned int rows)
+{
+  // the timer callback walks the table, only swap it while the needle is at rest
+  if (!stopped || rows == 0 || rows > MAX_ACCEL_ROWS) return false;
+  // copied to RAM, the tables passed in are in flash
+  memcpy(accelTable, table, rows * sizeof(*table));
+  accelTableSize = rows;
+  maxVel = table[rows-1][0]; // last value in table.
+  return true;
+}
 
-  //time0 = micros();
+void SwitecX12::resetAccelTable()
+{
+  setAccelTable(defaultAccelTable, DEFAULT_ACCEL_TABLE_SIZE);
 }
 
 void SwitecX12::setPosition(unsigned int pos)
@@ -195,13 +289,30 @@ void SwitecX12::setPosition(unsigned int pos)
   //esp_timer_stop(periodic_timer);
 
   if (pos >= steps) pos = steps-1;
-  targetStep = pos;
+  if (pulseTrain != nullptr) {
+    // the batch in play was planned for the old target: cut it after the
+    // steps already started and plan the rest again from there
+    portENTER_CRITICAL(&planLock);
+    uint8_t kept;
+    if (pos != targetStep && pulseTrain->cutBatch(kept)) {
+      currentStep = batchStep[kept - 1];
+      vel = batchVel[kept - 1];
+    }
+    targetStep = pos;
+    portEXIT_CRITICAL(&planLock);
+  } else {
+    targetStep = pos;
+  }
   if (stopped)
   {
     // reset the timer to avoid possible time overflow giving spurious deltas
     stopped = false;
     vel = 0;
-    esp_timer_start_periodic(periodic_timer, TIMER_INTERVAL_USEC);
+    if (pulseTrain != nullptr) {
+      pulseTrain->start();
+    } else {
+      timer->start(TIMER_INTERVAL_USEC);
+    }
   }  
 }
 
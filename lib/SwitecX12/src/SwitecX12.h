@@ -2,11 +2,14 @@
 #define SwitecX12_h
 
 #include <Arduino.h>
-#include <esp32-hal-timer.h>
+#include <freertos/FreeRTOS.h>
+#include "StepTimer.h"
+#include "RmtStepTrain.h"
 
 
 class SwitecX12 {
   public:
+        enum { MAX_ACCEL_ROWS = 8 };
 
         SwitecX12();
 
@@ -16,6 +19,21 @@ class SwitecX12 {
 
         void zero();
         void setPosition(unsigned int pos);
+
+        // Replaces the acceleration curve, rows as in defaultAccelTable.
+        // The table is copied, at most MAX_ACCEL_ROWS rows.
+        // Only allowed while stopped, returns false otherwise.
+        bool setAccelTable(const unsigned short (*table)[2], unsigned int rows);
+        void resetAccelTable();
+        // Selects the timer backend driving the steps (esp_timer by default).
+        // Only allowed while stopped, returns false otherwise or if the
+        // backend cannot be set up.
+        bool setTimer(StepTimer& timer);
+        bool resetTimer() { return setTimer(defaultTimer); }
+        // Emits the steps as precomputed pulse batches instead of one timer
+        // callback per step. Cleared by setTimer(). Same conditions as setTimer().
+        bool setPulseTrain(RmtStepTrain& train);
+        const char* timerName() const { return pulseTrain != nullptr ? pulseTrain->name() : timer->name(); }
         bool Stopped(void) { return stopped; }
         unsigned int Steps(void) { return steps; }
 
@@ -23,16 +41,27 @@ class SwitecX12 {
 
         void stepTo(int position, int delayMicrosec);
         void step(int dir);
-        void advance();
+        // Timer callback: one step, returns the delay to the next call,
+        // 0 when the needle has stopped
+        uint32_t advance();
+        // Computes the next step of the motion: updates currentStep, vel
+        // and dir, returns the delay to the following step.
+        // Returns false when the needle has reached its target.
+        bool planStep(unsigned short& delayMicrosec);
+        // Planner of the pulse train, records the state after each step
+        // so a cut batch can be planned again from where it stops
+        static bool planBatch(void * context, StepBatch& batch);
+        void stopMotion();
         
-        static void irqTimerCallback(void * context);
+        static uint32_t irqTimerCallback(void * context);
         
         const unsigned int defaultSteps = 315 * 12;
 
         unsigned char pinStep;
         unsigned char pinDir;
         unsigned int steps;            // total steps available
-        unsigned short (*accelTable)[2]; // accel table can be modified.
+        unsigned short accelTable[MAX_ACCEL_ROWS][2]; // accel table can be modified, in RAM for the timer interrupt
+        unsigned int accelTableSize;
 
         volatile unsigned int currentStep;      // step we are currently at
         volatile unsigned int targetStep;       // target we are moving to
@@ -44,7 +73,14 @@ class SwitecX12 {
         volatile boolean stopped;               // true if stopped
 
 
-        esp_timer_handle_t periodic_timer;
+        EspStepTimer defaultTimer;
+        StepTimer* timer = &defaultTimer;
+        RmtStepTrain* pulseTrain = nullptr;
+        // state after each step of the batch in play (pulse train only)
+        unsigned short batchStep[StepBatch::MAX_STEPS];
+        unsigned short batchVel[StepBatch::MAX_STEPS];
+        portMUX_TYPE planLock = portMUX_INITIALIZER_UNLOCKED;
+        bool started = false;                   // begin() was called
 
 };
 
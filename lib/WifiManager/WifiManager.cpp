@@ -1,25 +1,32 @@
 #include "WifiManager.h"
-#include <WebServer.h>
+#include "Metrics.h"
 
 WebServer server(80);
 
+static Counter wifiReconnects("wifi_reconnects_total", "Wi-Fi reconnection attempts");
+
+static const char rootPage[] PROGMEM =
+    "<html><body><h1>Configure Wi-Fi</h1>"
+    "<form action='/set' method='POST'>"
+    "SSID: <input type='text' name='ssid'><br>"
+    "Password: <input type='password' name='password'><br>"
+    "<input type='submit' value='Submit'></form>"
+    "</body></html>";
+
 WifiManager::WifiManager(const char* apSSID, const char* apPassword)
     : apSSID(apSSID), apPassword(apPassword)
 {
 }
 
-void WifiManager::begin()
+void WifiManager::begin(const char* ssid, const char* password)
 {
     Serial.begin(115200);
     WiFi.mode(WIFI_STA);
 
-    // Load credentials from flash memory
-    preferences.begin("wificre", true);
-    networkSSID = preferences.getString("ssid", "");
-    networkPassword = preferences.getString("password", "");
-    preferences.end();
+    strlcpy(networkSSID, ssid, sizeof(networkSSID));
+    strlcpy(networkPassword, password, sizeof(networkPassword));
 
-    if (networkSSID != "" && networkPassword != "")
+    if (networkSSID[0] != '\0' && networkPassword[0] != '\0')
     {
         Serial.println("Connecting to stored Wi-Fi network...");
         connected = connectToWiFi(networkSSID, networkPassword);
@@ -36,10 +43,31 @@ void WifiManager::begin()
 
         server.on("/", std::bind(&WifiManager::handleRoot, this));
         server.on("/set", HTTP_POST, std::bind(&WifiManager::handleSet, this));
-        server.begin();
-        Serial.println("HTTP server started");
     }
 
+    // The HTTP server also serves diagnostics once connected to a network
+    server.begin();
+    Serial.println("HTTP server started");
+}
+
+void WifiManager::setCredentials(const char* ssid, const char* password)
+{
+    if (strcmp(ssid, networkSSID) == 0 && strcmp(password, networkPassword) == 0)
+    {
+        return;
+    }
+    strlcpy(networkSSID, ssid, sizeof(networkSSID));
+    strlcpy(networkPassword, password, sizeof(networkPassword));
+
+    // checkWiFiConnection() keeps retrying with the new network
+    Serial.println("Wi-Fi credentials changed, reconnecting...");
+    WiFi.disconnect();
+    WiFi.begin(networkSSID, networkPassword);
+}
+
+WebServer& WifiManager::webServer()
+{
+    return server;
 }
 
 bool WifiManager::checkWiFiConnection() 
@@ -61,43 +89,36 @@ bool WifiManager::checkWiFiConnection()
         else
         {
             Serial.println("Try to reconnect to Wi-Fi...");
-            WiFi.begin(networkSSID.c_str(), networkPassword.c_str());
+            wifiReconnects.inc();
+            WiFi.begin(networkSSID, networkPassword);
             wifiStatus = false;
         }
     }
     
-    if(connected == false)
-    {
-        // if never connected, manager the HTTP server in AP mode (for the Wi-Fi configuration)
-        server.handleClient();
-    }
+    // in AP mode the HTTP server handles the Wi-Fi configuration,
+    // once connected it serves the diagnostics endpoints
+    server.handleClient();
 
     return wifiStatus;
   }
 
 void WifiManager::handleRoot()
 {
-    String html = "<html><body><h1>Configure Wi-Fi</h1>";
-    html += "<form action='/set' method='POST'>";
-    html += "SSID: <input type='text' name='ssid'><br>";
-    html += "Password: <input type='password' name='password'><br>";
-    html += "<input type='submit' value='Submit'></form>";
-    html += "</body></html>";
-    server.send(200, "text/html", html);
+    server.send_P(200, PSTR("text/html"), rootPage);
 }
 
 void WifiManager::handleSet()
 {
     if (server.hasArg("ssid") && server.hasArg("password"))
     {
-        networkSSID = server.arg("ssid");
-        networkPassword = server.arg("password");
+        strlcpy(networkSSID, server.arg("ssid").c_str(), sizeof(networkSSID));
+        strlcpy(networkPassword, server.arg("password").c_str(), sizeof(networkPassword));
 
-        // Save credentials to flash memory
-        preferences.begin("wificre", false);
-        preferences.putString("ssid", networkSSID);
-        preferences.putString("password", networkPassword);
-        preferences.end();
+        // Stored by the application
+        if (credentialsHandler != nullptr)
+        {
+            credentialsHandler(networkSSID, networkPassword);
+        }
 
         server.send(200, "text/html", "Credentials received. Connecting to network...");
         delay(2000);
@@ -109,9 +130,49 @@ void WifiManager::handleSet()
     }
 }
 
-bool WifiManager::connectToWiFi(const String& ssid, const String& password)
+void ChunkedPrint::begin(int code, const char* contentType)
+{
+    length = 0;
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server.send(code, contentType, "");
+}
+
+void ChunkedPrint::end()
+{
+    sendBuffer();
+    server.sendContent("", 0); // last chunk
+}
+
+size_t ChunkedPrint::write(uint8_t c)
+{
+    if (length == sizeof(buffer)) sendBuffer();
+    buffer[length++] = (char)c;
+    return 1;
+}
+
+size_t ChunkedPrint::write(const uint8_t* data, size_t size)
+{
+    for (size_t done = 0; done < size; )
+    {
+        if (length == sizeof(buffer)) sendBuffer();
+        size_t n = size - done < sizeof(buffer) - length ? size - done : sizeof(buffer) - length;
+        memcpy(buffer + length, data + done, n);
+        length += n;
+        done += n;
+    }
+    return size;
+}
+
+void ChunkedPrint::sendBuffer()
+{
+    if (length == 0) return;
+    server.sendContent(buffer, length);
+    length = 0;
+}
+
+bool WifiManager::connectToWiFi(const char* ssid, const char* password)
 {
-    WiFi.begin(ssid.c_str(), password.c_str());
+    WiFi.begin(ssid, password);
     int attempt = 0;
     while (WiFi.status() != WL_CONNECTED && attempt < 20)
     {
@@ -2,32 +2,64 @@
 #define WIFIMANAGER_H
 
 #include <WiFi.h>
-#include <Preferences.h>
+#include <WebServer.h>
 
 class WifiManager
 {
 public:
+    // Called with the credentials entered on the access point page, to store them
+    typedef void (*CredentialsHandler)(const char* ssid, const char* password);
+
     WifiManager(const char* apSSID, const char* apPassword);
-    void begin();
+    // Connects with the stored credentials, or starts the access point
+    void begin(const char* ssid, const char* password);
+    void onCredentials(CredentialsHandler handler) { credentialsHandler = handler; }
+    // New credentials at run time: reconnects if they changed
+    void setCredentials(const char* ssid, const char* password);
     bool checkWiFiConnection();
 
+    // HTTP server shared with the application to register extra endpoints
+    WebServer& webServer();
+
 private:
     const char* apSSID;
     const char* apPassword;
     const IPAddress ap_local_ip = IPAddress(192, 168, 1, 1);
     const IPAddress ap_gateway = IPAddress(192, 168, 1, 1);
     const IPAddress ap_subnet = IPAddress(255, 255, 255, 0);
-    Preferences preferences;
-    String networkSSID = "";
-    String networkPassword = "";
+    CredentialsHandler credentialsHandler = nullptr;
+    char networkSSID[33] = "";     // 32 characters max (802.11)
+    char networkPassword[65] = ""; // 64 characters max (WPA2)
 
 
     void handleRoot();
     void handleSet();
-    bool connectToWiFi(const String& ssid, const String& password);
+    bool connectToWiFi(const char* ssid, const char* password);
 
     bool connected = false;
     const long checkWifiIntervalMs = 5000; // 5 seconds
 };
 
+// Print adapter streaming a response of unknown length as HTTP chunks.
+// Output is gathered in a small buffer so each chunk is one socket write.
+// begin() sends the status line and headers, end() the last chunk.
+class ChunkedPrint : public Print
+{
+public:
+    explicit ChunkedPrint(WebServer& server) : server(server) {}
+
+    void begin(int code, const char* contentType);
+    void end();
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* data, size_t size) override;
+
+private:
+    void sendBuffer();
+
+    WebServer& server;
+    char buffer[256];
+    size_t length = 0;
+};
+
 #endif
@@ -0,0 +1,46 @@
+#include "app_clock.h"
+#include <sys/time.h>
+
+AppClock appClock;
+
+uint64_t AppClock::virtualElapsedUs() const
+{
+    return (uint64_t)(esp_timer_get_time() - _originUs) * _speed;
+}
+
+unsigned long AppClock::millis() const
+{
+    if (!_virtual) return ::millis();
+    return _originMillis + (unsigned long)(virtualElapsedUs() / 1000);
+}
+
+uint64_t AppClock::epochMs() const
+{
+    if (_virtual)
+    {
+        return _startEpochMs + virtualElapsedUs() / 1000;
+    }
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+time_t AppClock::now() const
+{
+    if (!_virtual) return time(nullptr);
+    return (time_t)(epochMs() / 1000);
+}
+
+void AppClock::runVirtual(uint64_t startEpochMs, uint16_t speed)
+{
+    _originMillis = millis(); // continue from the current value so intervals stay positive
+    _originUs = esp_timer_get_time();
+    _startEpochMs = startEpochMs;
+    _speed = speed == 0 ? 1 : speed;
+    _virtual = true;
+}
+
+void AppClock::runReal()
+{
+    _virtual = false;
+}
@@ -0,0 +1,42 @@
+#ifndef APP_CLOCK_H
+#define APP_CLOCK_H
+
+#include <Arduino.h>
+#include <time.h>
+
+// Time source of the application logic (clock display, drift, sample
+// stamps, replays). It follows the system clock, or a virtual clock that
+// starts at a given date and runs N times faster than real time, so days
+// of behavior can be replayed in minutes. Network and hardware timing keep
+// using millis() directly.
+
+class AppClock
+{
+public:
+    // Monotonic milliseconds, scaled in virtual mode
+    unsigned long millis() const;
+
+    // Wall clock
+    time_t now() const;
+    uint64_t epochMs() const;
+
+    // Runs a virtual clock from start, speed times faster than real time
+    void runVirtual(uint64_t startEpochMs, uint16_t speed);
+    void runReal();
+
+    bool isVirtual() const { return _virtual; }
+    uint16_t speed() const { return _virtual ? _speed : 1; }
+
+private:
+    uint64_t virtualElapsedUs() const;
+
+    bool _virtual = false;
+    uint16_t _speed = 1;
+    uint64_t _startEpochMs = 0;
+    int64_t _originUs = 0;          // esp_timer time when the virtual clock started
+    unsigned long _originMillis = 0; // millis() value at that time
+};
+
+extern AppClock appClock;
+
+#endif
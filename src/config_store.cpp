@@ -0,0 +1,363 @@
+#include "config_store.h"
+#include <stddef.h>
+#include <stdarg.h>
+#include <nvs.h>
+#include "gauge_freq_meter.h"
+#include "Metrics.h"
+#include "Logger.h"
+
+static Gauge configLoadTime("config_load_us", "Time to read the configuration from NVS at boot");
+static Counter configCommits("config_commits_total", "Configuration commits that changed at least one field");
+static Counter configKeysWritten("config_keys_written_total", "Configuration keys written to NVS");
+
+static const char* const NAMESPACE = "config";
+static const char* const VERSION_KEY = "version";
+static const char* const LEGACY_WIFI_NAMESPACE = "wificre";   // version 0
+
+static bool validAccelProfile(const char* value)
+{
+    for (unsigned int i = 0; GaugeNeedle::accelProfileName(i) != nullptr; i++)
+    {
+        if (strcmp(value, GaugeNeedle::accelProfileName(i)) == 0) return true;
+    }
+    return false;
+}
+
+static bool notEmpty(const char* value)
+{
+    return value[0] != '\0';
+}
+
+#define CONFIG_STRING(member) ConfigStore::TYPE_STRING, offsetof(Config, member), sizeof(((Config*)0)->member), 0, 0
+#define CONFIG_NUMBER(type, member, min, max) type, offsetof(Config, member), sizeof(((Config*)0)->member), min, max
+#define CONFIG_BOOL(member) ConfigStore::TYPE_BOOL, offsetof(Config, member), sizeof(bool), 0, 1
+
+// Same order as ConfigStore::Key
+static const ConfigStore::Field fields[ConfigStore::KEY_COUNT] = {
+    { "wifi.ssid",     CONFIG_STRING(wifiSsid),     0, nullptr, "Wi-Fi network name" },
+    { "wifi.password", CONFIG_STRING(wifiPassword), ConfigStore::FLAG_SECRET, nullptr, "Wi-Fi password" },
+    { "server",        CONFIG_STRING(server),       0, notEmpty, "GridFreqMonitor mDNS name" },
+    { "port",          CONFIG_NUMBER(ConfigStore::TYPE_U16, port, 1, 65535), 0, nullptr, "GridFreqMonitor WebSocket port" },
+    { "tz",            CONFIG_STRING(timeZone),     0, notEmpty, "POSIX time zone" },
+    { "brightness",    CONFIG_NUMBER(ConfigStore::TYPE_U8, brightness, 0, 15), 0, nullptr, "display brightness 0-15" },
+    { "accel",         CONFIG_STRING(accelProfile), 0, validAccelProfile, "needle acceleration profile" },
+    { "predict",       CONFIG_BOOL(predictiveNeedle), 0, nullptr, "needle sent ahead along the trend" },
+    { "relay",         CONFIG_BOOL(lanRelay),       0, nullptr, "LAN relay election" },
+    { "power",         CONFIG_BOOL(powerSaving),    ConfigStore::FLAG_REBOOT, nullptr, "CPU frequency scaling and modem sleep" },
+    { "http.token",    CONFIG_STRING(httpToken),    ConfigStore::FLAG_SECRET, nullptr, "token for POST /config, /metrics, /trace" },
+};
+
+ConfigStore::ConfigStore(const Config& defaults) : _defaults(defaults)
+{
+    _slots[0] = defaults;
+}
+
+const ConfigStore::Field* ConfigStore::find(const char* key)
+{
+    for (uint8_t i = 0; i < KEY_COUNT; i++)
+    {
+        if (strcmp(fields[i].key, key) == 0) return &fields[i];
+    }
+    return nullptr;
+}
+
+static bool sameValue(const Config& a, const Config& b, const ConfigStore::Field& f)
+{
+    const char* pa = (const char*)&a + f.offset;
+    const char* pb = (const char*)&b + f.offset;
+    if (f.type == ConfigStore::TYPE_STRING) return strncmp(pa, pb, f.size) == 0;
+    return memcmp(pa, pb, f.size) == 0;
+}
+
+void ConfigStore::begin()
+{
+    int64_t t0 = esp_timer_get_time();
+    Config config = _defaults;
+    uint16_t version = 0;
+
+    // One pass over all keys with a single handle
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK)
+    {
+        LOG_E("Config: NVS unavailable (%d), using the defaults", err);
+        return;
+    }
+    nvs_get_u16(handle, VERSION_KEY, &version);
+    for (uint8_t i = 0; i < KEY_COUNT; i++)
+    {
+        const Field& f = fields[i];
+        char* p = (char*)&config + f.offset;
+        if (f.type == TYPE_STRING)
+        {
+            size_t len = f.size;
+            if (nvs_get_str(handle, f.key, p, &len) != ESP_OK)
+            {
+                memcpy(p, (const char*)&_defaults + f.offset, f.size); // missing or too long
+            }
+            else if (f.valid != nullptr && !f.valid(p))
+            {
+                // e.g. an acceleration profile removed from the firmware since
+                LOG_W("Config: stored %s \"%s\" is invalid, using the default", f.key, p);
+                memcpy(p, (const char*)&_defaults + f.offset, f.size);
+            }
+        }
+        else if (f.type == TYPE_U16)
+        {
+            uint16_t value;
+            if (nvs_get_u16(handle, f.key, &value) == ESP_OK && value >= f.min && value <= f.max) memcpy(p, &value, sizeof(value));
+        }
+        else
+        {
+            uint8_t value;
+            if (nvs_get_u8(handle, f.key, &value) == ESP_OK && value >= f.min && value <= f.max)
+            {
+                if (f.type == TYPE_BOOL) *(bool*)p = value != 0;
+                else *(uint8_t*)p = value;
+            }
+        }
+    }
+    nvs_close(handle);
+
+    _loadedVersion = version;
+    _slots[0] = config;
+    _active.store(0, std::memory_order_release);
+    configLoadTime.set((int32_t)(esp_timer_get_time() - t0));
+
+    if (version > VERSION)
+    {
+        LOG_W("Config: version %u written by a newer firmware, unknown keys ignored", version);
+    }
+    else if (version < VERSION)
+    {
+        migrate(version, config);
+        commit(config);
+        if (_loadedVersion == VERSION)
+        {
+            LOG_I("Config: migrated from version %u", version);
+            if (version == 0)
+            {
+                // the credentials now live in "config"
+                if (nvs_open(LEGACY_WIFI_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK)
+                {
+                    nvs_erase_all(handle);
+                    nvs_commit(handle);
+                    nvs_close(handle);
+                }
+            }
+        }
+    }
+    LOG_I("Config: version %u loaded in %d us", _loadedVersion, configLoadTime.value());
+}
+
+void ConfigStore::migrate(uint16_t from, Config& config)
+{
+    if (from < 1)
+    {
+        // Version 0: only the Wi-Fi credentials, saved by WifiManager
+        nvs_handle_t handle;
+        if (nvs_open(LEGACY_WIFI_NAMESPACE, NVS_READONLY, &handle) == ESP_OK)
+        {
+            size_t len = sizeof(config.wifiSsid);
+            if (nvs_get_str(handle, "ssid", config.wifiSsid, &len) != ESP_OK) config.wifiSsid[0] = '\0';
+            len = sizeof(config.wifiPassword);
+            if (nvs_get_str(handle, "password", config.wifiPassword, &len) != ESP_OK) config.wifiPassword[0] = '\0';
+            nvs_close(handle);
+        }
+    }
+    // Changes of later versions go here, one step per version
+}
+
+bool ConfigStore::set(Config& config, const char* key, const char* value, const char** error)
+{
+    const Field* f = find(key);
+    if (f == nullptr)
+    {
+        *error = "unknown key";
+        return false;
+    }
+    char* p = (char*)&config + f->offset;
+    if (f->type == TYPE_STRING)
+    {
+        if (strlen(value) >= f->size)
+        {
+            *error = "too long";
+            return false;
+        }
+        if (f->valid != nullptr && !f->valid(value))
+        {
+            *error = "invalid value";
+            return false;
+        }
+        strlcpy(p, value, f->size);
+    }
+    else if (f->type == TYPE_BOOL)
+    {
+        if (strcmp(value, "on") == 0 || strcmp(value, "true") == 0 || strcmp(value, "1") == 0)
+        {
+            *(bool*)p = true;
+        }
+        else if (strcmp(value, "off") == 0 || strcmp(value, "false") == 0 || strcmp(value, "0") == 0)
+        {
+            *(bool*)p = false;
+        }
+        else
+        {
+            *error = "expected on or off";
+            return false;
+        }
+    }
+    else
+    {
+        char* end;
+        unsigned long number = strtoul(value, &end, 10);
+        if (value[0] == '\0' || *end != '\0' || number < f->min || number > f->max)
+        {
+            *error = "out of range";
+            return false;
+        }
+        if (f->type == TYPE_U16)
+        {
+            uint16_t v = (uint16_t)number;
+            memcpy(p, &v, sizeof(v));
+        }
+        else
+        {
+            *(uint8_t*)p = (uint8_t)number;
+        }
+    }
+    return true;
+}
+
+uint32_t ConfigStore::commit(const Config& config)
+{
+    const Config& current = get();
+    uint32_t changed = 0;
+    for (uint8_t i = 0; i < KEY_COUNT; i++)
+    {
+        if (!sameValue(config, current, fields[i])) changed |= bit((Key)i);
+    }
+    if (changed == 0 && _loadedVersion == VERSION) return 0;
+
+    // Changed keys only, one NVS commit for the batch
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK)
+    {
+        unsigned int written = 0;
+        for (uint8_t i = 0; i < KEY_COUNT && err == ESP_OK; i++)
+        {
+            if (!(changed & bit((Key)i))) continue;
+            const Field& f = fields[i];
+            const char* p = (const char*)&config + f.offset;
+            if (f.type == TYPE_STRING) err = nvs_set_str(handle, f.key, p);
+            else if (f.type == TYPE_U16) err = nvs_set_u16(handle, f.key, *(const uint16_t*)p);
+            else if (f.type == TYPE_BOOL) err = nvs_set_u8(handle, f.key, *(const bool*)p ? 1 : 0);
+            else err = nvs_set_u8(handle, f.key, *(const uint8_t*)p);
+            written++;
+        }
+        if (err == ESP_OK && _loadedVersion < VERSION)
+        {
+            err = nvs_set_u16(handle, VERSION_KEY, VERSION);
+        }
+        if (err == ESP_OK)
+        {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+        if (err == ESP_OK) configKeysWritten.inc(written);
+    }
+    if (err != ESP_OK)
+    {
+        LOG_E("Config: commit failed (%d)", err);
+        return 0;
+    }
+    if (_loadedVersion < VERSION) _loadedVersion = VERSION;
+    if (changed == 0) return 0;
+
+    // Publish in the buffer readers do not use
+    uint8_t next = _active.load(std::memory_order_relaxed) ^ 1;
+    _slots[next] = config;
+    _active.store(next, std::memory_order_release);
+    configCommits.inc();
+
+    if (_onChange != nullptr) _onChange(_slots[next], changed);
+    return changed;
+}
+
+void ConfigStore::format(const Config& config, const Field& field, char* out, size_t len)
+{
+    const char* p = (const char*)&config + field.offset;
+    if (field.type == TYPE_STRING)
+    {
+        strlcpy(out, ((field.flags & FLAG_SECRET) && p[0] != '\0') ? "********" : p, len);
+    }
+    else if (field.type == TYPE_BOOL)
+    {
+        strlcpy(out, *(const bool*)p ? "on" : "off", len);
+    }
+    else if (field.type == TYPE_U16)
+    {
+        snprintf(out, len, "%u", *(const uint16_t*)p);
+    }
+    else
+    {
+        snprintf(out, len, "%u", *(const uint8_t*)p);
+    }
+}
+
+void ConfigStore::printStatus(Print& out) const
+{
+    const Config& config = get();
+    char value[72];
+    out.printf("Config version %u:\n", _loadedVersion);
+    for (uint8_t i = 0; i < KEY_COUNT; i++)
+    {
+        format(config, fields[i], value, sizeof(value));
+        out.printf("  %-14s %-20s %s%s\n", fields[i].key, value, fields[i].help,
+                   (fields[i].flags & FLAG_REBOOT) ? " (next start)" : "");
+    }
+}
+
+// snprintf at pos, stops adding once out is full
+static size_t appendf(char* out, size_t len, size_t pos, const char* format, ...)
+{
+    if (pos >= len) return pos;
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(out + pos, len - pos, format, args);
+    va_end(args);
+    return n > 0 ? pos + n : pos;
+}
+
+size_t ConfigStore::writeJson(char* out, size_t len) const
+{
+    const Config& config = get();
+    char value[72];
+    size_t pos = appendf(out, len, 0, "{\"version\":%u", _loadedVersion);
+    for (uint8_t i = 0; i < KEY_COUNT; i++)
+    {
+        const Field& f = fields[i];
+        format(config, f, value, sizeof(value));
+        if (f.type == TYPE_BOOL)
+        {
+            pos = appendf(out, len, pos, ",\"%s\":%s", f.key, strcmp(value, "on") == 0 ? "true" : "false");
+        }
+        else if (f.type != TYPE_STRING)
+        {
+            pos = appendf(out, len, pos, ",\"%s\":%s", f.key, value);
+        }
+        else
+        {
+            pos = appendf(out, len, pos, ",\"%s\":\"", f.key);
+            for (const char* c = value; *c != '\0' && pos + 2 < len; c++)
+            {
+                if (*c == '"' || *c == '\\') out[pos++] = '\\';
+                out[pos++] = ((uint8_t)*c < 0x20) ? '?' : *c;
+            }
+            pos = appendf(out, len, pos, "\"");
+        }
+    }
+    pos = appendf(out, len, pos, "}");
+    return pos < len ? pos : len - 1;
+}
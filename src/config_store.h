@@ -0,0 +1,106 @@
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Settings that can be edited at run time, one versioned struct
+struct Config
+{
+    char wifiSsid[33];          // 32 characters max (802.11)
+    char wifiPassword[65];      // 64 characters max (WPA2)
+    char server[32];            // GridFreqMonitor mDNS name
+    uint16_t port;              // GridFreqMonitor WebSocket port
+    char timeZone[48];          // POSIX TZ string
+    uint8_t brightness;         // display, 0-15
+    char accelProfile[12];      // needle acceleration profile
+    bool predictiveNeedle;
+    bool lanRelay;
+    bool powerSaving;
+    char httpToken[33];         // required by POST /config, empty: read only over HTTP
+};
+
+// Configuration kept in the NVS namespace "config", one key per field.
+//
+// begin() reads every key through a single NVS handle and migrates older
+// layouts (version 0: Wi-Fi credentials in the "wificre" namespace).
+// Readers get the cached copy without locks: commits fill the other of
+// two buffers and publish it atomically, a reference stays valid until
+// the next commit. Edits are made on a copy of get() and committed as a
+// batch: only the fields that changed are written, followed by one NVS
+// commit, then the change handler applies them. Fields flagged REBOOT
+// only take effect at the next start.
+//
+// Commits and change handlers run on the loop task (console, HTTP).
+
+class ConfigStore
+{
+public:
+    enum { VERSION = 1 };
+    enum Type : uint8_t { TYPE_BOOL, TYPE_U8, TYPE_U16, TYPE_STRING };
+    enum Flags : uint8_t { FLAG_SECRET = 0x01, FLAG_REBOOT = 0x02 };
+
+    // Field index, also the bit in the change masks
+    enum Key : uint8_t
+    {
+        KEY_WIFI_SSID, KEY_WIFI_PASSWORD, KEY_SERVER, KEY_PORT, KEY_TIME_ZONE,
+        KEY_BRIGHTNESS, KEY_ACCEL_PROFILE, KEY_PREDICTIVE_NEEDLE, KEY_LAN_RELAY, KEY_POWER_SAVING,
+        KEY_HTTP_TOKEN,
+        KEY_COUNT
+    };
+
+    struct Field
+    {
+        const char* key;        // NVS key (15 characters max), console and HTTP name
+        Type type;
+        uint16_t offset;
+        uint16_t size;          // string buffer size
+        uint16_t min;
+        uint16_t max;
+        uint8_t flags;
+        bool (*valid)(const char* value);   // extra check for strings, may be null
+        const char* help;
+    };
+
+    typedef void (*ChangeHandler)(const Config& config, uint32_t changed);
+
+    static uint32_t bit(Key key) { return 1UL << key; }
+
+    explicit ConfigStore(const Config& defaults);
+
+    // Loads the configuration from NVS, missing or invalid keys keep their default
+    void begin();
+
+    const Config& get() const { return _slots[_active.load(std::memory_order_acquire)]; }
+
+    void onChange(ChangeHandler handler) { _onChange = handler; }
+
+    // Parses a value into a field of config. Returns false with a reason
+    // for an unknown key or an invalid value.
+    static bool set(Config& config, const char* key, const char* value, const char** error);
+
+    // Writes the fields of config that differ from get(), publishes it and
+    // calls the change handler. Returns the changed fields (0 if none);
+    // on a storage error the cache is left unchanged and 0 is returned.
+    uint32_t commit(const Config& config);
+
+    static const Field* find(const char* key);
+
+    // Value as text, secrets masked
+    static void format(const Config& config, const Field& field, char* out, size_t len);
+
+    void printStatus(Print& out) const;
+    // JSON object of all fields, secrets masked, returns the length written
+    size_t writeJson(char* out, size_t len) const;
+
+private:
+    void migrate(uint16_t from, Config& config);
+
+    Config _defaults;
+    Config _slots[2];
+    std::atomic<uint8_t> _active{0};
+    uint16_t _loadedVersion = 0;
+    ChangeHandler _onChange = nullptr;
+};
+
+#endif
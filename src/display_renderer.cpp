@@ -0,0 +1,125 @@
+#include "display_renderer.h"
+
+void ColumnScroller::setMessage(const char* message)
+{
+    strlcpy(_message, message, sizeof(_message));
+    _length = strlen(_message);
+    _char = 0;
+    _column = 0;
+}
+
+uint8_t ColumnScroller::nextColumn(uint8_t displayColumns)
+{
+    if (_length == 0) return 0;
+
+    uint8_t column = 0;
+    if (_char < _length)
+    {
+        // the last column of each character is the spacer
+        if (_column < HCMS39xx::COLUMNS_PER_CHAR) column = HCMS39xx::glyphColumn(_message[_char], _column);
+        if (++_column > HCMS39xx::COLUMNS_PER_CHAR)
+        {
+            _column = 0;
+            _char++;
+        }
+    }
+    else if (++_column >= displayColumns)
+    {
+        _column = 0;
+        _char = 0;
+    }
+    return column;
+}
+
+Sparkline::Sparkline(float minValue, float maxValue) : _min(minValue), _max(maxValue)
+{
+}
+
+int8_t Sparkline::rowOf(float value) const
+{
+    // row 0 is the top of the display, high values are drawn high
+    float level = (value - _min) / (_max - _min);
+    if (level < 0.0f) level = 0.0f;
+    if (level > 1.0f) level = 1.0f;
+    return (ROWS - 1) - (int8_t)(level * (ROWS - 1) + 0.5f);
+}
+
+// The column of a sample, joined to the previous row so steps stay readable
+uint8_t Sparkline::join(int8_t from, int8_t row)
+{
+    int8_t top = (from < row) ? from : row;
+    int8_t bottom = (from < row) ? row : from;
+    return (uint8_t)(((1 << (bottom + 1)) - 1) & ~((1 << top) - 1));
+}
+
+uint8_t Sparkline::addSample(uint32_t timeSec, float value)
+{
+    int8_t row = rowOf(value);
+    uint8_t column = join(_count > 0 ? _rows[slot(_count - 1)] : row, row);
+
+    _ring[_head] = column;
+    _rows[_head] = row;
+    _times[_head] = timeSec;
+    _head = (_head + 1) % MAX_COLUMNS;
+    if (_count < MAX_COLUMNS) _count++;
+    return column;
+}
+
+bool Sparkline::insertSample(uint32_t timeSec, float value)
+{
+    // after the newest column older than the sample
+    uint8_t pos = _count;
+    while (pos > 0 && _times[slot(pos - 1)] >= timeSec)
+    {
+        if (_times[slot(pos - 1)] == timeSec) return false;
+        pos--;
+    }
+
+    if (_count == MAX_COLUMNS)
+    {
+        if (pos == 0) return false;
+        // the oldest column drops out, the older ones move back
+        for (uint8_t i = 1; i < pos; i++)
+        {
+            uint8_t to = slot(i - 1), from = slot(i);
+            _ring[to] = _ring[from];
+            _rows[to] = _rows[from];
+            _times[to] = _times[from];
+        }
+        pos--;
+    }
+    else
+    {
+        // the newer columns move forward
+        _head = (_head + 1) % MAX_COLUMNS;
+        _count++;
+        for (uint8_t i = _count - 1; i > pos; i--)
+        {
+            uint8_t to = slot(i), from = slot(i - 1);
+            _ring[to] = _ring[from];
+            _rows[to] = _rows[from];
+            _times[to] = _times[from];
+        }
+    }
+
+    int8_t row = rowOf(value);
+    uint8_t at = slot(pos);
+    _ring[at] = join(pos > 0 ? _rows[slot(pos - 1)] : row, row);
+    _rows[at] = row;
+    _times[at] = timeSec;
+    if (pos + 1 < _count)
+    {
+        uint8_t next = slot(pos + 1);
+        _ring[next] = join(row, _rows[next]);
+    }
+    return true;
+}
+
+bool Sparkline::contains(uint32_t timeSec) const
+{
+    for (uint8_t i = _count; i > 0 && _times[slot(i - 1)] >= timeSec; i--)
+    {
+        if (_times[slot(i - 1)] == timeSec) return true;
+    }
+    return false;
+}
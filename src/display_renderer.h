@@ -0,0 +1,88 @@
+#ifndef DISPLAY_RENDERER_H
+#define DISPLAY_RENDERER_H
+
+#include <Arduino.h>
+#include "HCMS39xx.h"
+
+// Column streaming renderers for the HCMS39xx.
+// The dot registers of the chain are a shift register: sending a single
+// column with printDirect() scrolls the whole display by one column. The
+// renderers below produce one new column per frame, so an animation step
+// costs one byte on the wire and a few instructions, whatever the width.
+
+// Scrolls a text message from right to left, one column per frame
+class ColumnScroller
+{
+public:
+    enum { MAX_LENGTH = 63 };
+
+    // Copies the message, the scroll restarts from its first column
+    void setMessage(const char* message);
+    const char* message() const { return _message; }
+
+    // Next column to shift in: 5 glyph columns and a blank spacer per
+    // character, then a blank display width so the text leaves the screen
+    uint8_t nextColumn(uint8_t displayColumns);
+
+private:
+    char _message[MAX_LENGTH + 1] = "";
+    uint8_t _length = 0;
+    uint8_t _char = 0;      // character being streamed, _length during the trailing gap
+    uint8_t _column = 0;    // column within the character (or the gap)
+};
+
+// Frequency history, one column per sample: a dot at the sample row joined
+// to the previous sample's row. Each column is derived once from the new
+// sample and the previous row and kept in a ring, so the history can be
+// redrawn without recomputing it. The time stamps are kept with the
+// columns, so backfilled samples go in at their place.
+class Sparkline
+{
+public:
+    enum { ROWS = 7, MAX_COLUMNS = HCMS39xx::MAX_CHARS * HCMS39xx::COLUMNS_PER_CHAR };
+
+    Sparkline(float minValue, float maxValue);
+
+    // Adds the newest sample and returns its column
+    uint8_t addSample(uint32_t timeSec, float value);
+
+    // Adds a backfilled sample in time stamp order, redraw with writeTo().
+    // False if it is known, or older than all the columns of a full ring.
+    bool insertSample(uint32_t timeSec, float value);
+
+    // True if the history has a sample with this time stamp
+    bool contains(uint32_t timeSec) const;
+
+    // Shifts the whole history into the display (HCMS39xx or DisplayService),
+    // oldest column first
+    template <typename Display>
+    void writeTo(Display& display) const
+    {
+        // only the last display width of the ring is visible
+        uint16_t width = display.numChars() * HCMS39xx::COLUMNS_PER_CHAR;
+        uint16_t start = (_head + MAX_COLUMNS - width) % MAX_COLUMNS;
+        uint16_t firstPart = MAX_COLUMNS - start;
+        if (firstPart > width) firstPart = width;
+        display.printDirect(_ring + start, firstPart);
+        if (firstPart < width)
+        {
+            display.printDirect(_ring, width - firstPart);
+        }
+    }
+
+private:
+    int8_t rowOf(float value) const;
+    static uint8_t join(int8_t from, int8_t row);
+    // ring index of the i-th kept column, 0 the oldest
+    uint8_t slot(uint8_t i) const { return (uint8_t)((_head + MAX_COLUMNS - _count + i) % MAX_COLUMNS); }
+
+    float _min;
+    float _max;
+    uint8_t _ring[MAX_COLUMNS] = {};
+    int8_t _rows[MAX_COLUMNS] = {};
+    uint32_t _times[MAX_COLUMNS] = {};
+    uint8_t _head = 0;          // next column to write
+    uint8_t _count = 0;         // columns kept
+};
+
+#endif
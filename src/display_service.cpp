@@ -0,0 +1,326 @@
+#include "display_service.h"
+#include <freertos/task.h>
+#include "Metrics.h"
+
+static Counter displayCommands("display_commands_total", "Commands queued to the display service");
+static Counter displayCoalesced("display_coalesced_total", "Display commands superseded or redundant, never shifted out");
+static Gauge displayLastMerged("display_coalesced_commands", "Commands merged into the last display service run");
+static Histogram displayTransferTime("display_transfer_us", "Time of one display service run (control and frame transfers)");
+
+DisplayService::DisplayService(HCMS39xx& display) : _display(display)
+{
+    for (uint8_t i = 0; i < HCMS39xx::MAX_DEVICES; i++)
+    {
+        _control.brightness[i] = HCMS39xx::DEFAULT_BRIGHTNESS;
+        _control.current[i] = HCMS39xx::DEFAULT_CURRENT;
+    }
+    _control.awake = true;
+    _control.blanked = true;
+    _sent = _control;
+}
+
+void DisplayService::begin()
+{
+    // HCMS39xx::begin() left the chain cleared, awake with the default settings, blanked
+    _controlKnown = true;
+    if (_task == nullptr)
+    {
+        xTaskCreate(serviceTask, "display", 3072, this, 1, (TaskHandle_t*)&_task);
+    }
+}
+
+void DisplayService::notify()
+{
+    displayCommands.inc();
+    if (_task != nullptr) xTaskNotifyGive((TaskHandle_t)_task);
+}
+
+void DisplayService::commitFrame()
+{
+    if (_framePending) displayCoalesced.inc();
+    _framePending = true;
+    _queued++;
+}
+
+void DisplayService::commitControl()
+{
+    if (_controlPending) displayCoalesced.inc();
+    _controlPending = true;
+    _queued++;
+}
+
+// Called with the lock held
+void DisplayService::setColumn(uint16_t column, uint8_t value)
+{
+    if (column < COLUMNS && _frame[column] != value)
+    {
+        _frame[column] = value;
+        _frameEdited = true;
+    }
+}
+
+void DisplayService::printAt(uint8_t pos, const char* s)
+{
+    portENTER_CRITICAL(&_lock);
+    for (; pos < _display.numChars() && *s != 0; pos++, s++)
+    {
+        for (uint8_t c = 0; c < HCMS39xx::COLUMNS_PER_CHAR; c++)
+        {
+            setColumn(pos * HCMS39xx::COLUMNS_PER_CHAR + c, HCMS39xx::glyphColumn(*s, c));
+        }
+    }
+    portEXIT_CRITICAL(&_lock);
+}
+
+void DisplayService::writeColumns(uint16_t column, const uint8_t* data, uint8_t len)
+{
+    uint16_t total = _display.numChars() * HCMS39xx::COLUMNS_PER_CHAR;
+    portENTER_CRITICAL(&_lock);
+    for (uint8_t i = 0; i < len && column + i < total; i++)
+    {
+        setColumn(column + i, data[i]);
+    }
+    portEXIT_CRITICAL(&_lock);
+}
+
+void DisplayService::clearRegion(uint8_t pos, uint8_t len)
+{
+    uint16_t total = _display.numChars() * HCMS39xx::COLUMNS_PER_CHAR;
+    portENTER_CRITICAL(&_lock);
+    for (uint16_t c = pos * HCMS39xx::COLUMNS_PER_CHAR; c < (pos + len) * HCMS39xx::COLUMNS_PER_CHAR && c < total; c++)
+    {
+        setColumn(c, 0);
+    }
+    portEXIT_CRITICAL(&_lock);
+}
+
+void DisplayService::update()
+{
+    portENTER_CRITICAL(&_lock);
+    bool edited = _frameEdited;
+    if (edited)
+    {
+        _frameEdited = false;
+        _fullFrame = true;
+        commitFrame();
+    }
+    portEXIT_CRITICAL(&_lock);
+    if (edited) notify();
+}
+
+void DisplayService::print(const char* s)
+{
+    uint8_t columns[COLUMNS];
+    uint8_t len = 0;
+    for (; len < _display.numChars() && s[len] != 0; len++)
+    {
+        for (uint8_t c = 0; c < HCMS39xx::COLUMNS_PER_CHAR; c++)
+        {
+            columns[len * HCMS39xx::COLUMNS_PER_CHAR + c] = HCMS39xx::glyphColumn(s[len], c);
+        }
+    }
+    printDirect(columns, len * HCMS39xx::COLUMNS_PER_CHAR);
+}
+
+void DisplayService::printDirect(const uint8_t* columns, uint8_t len)
+{
+    uint16_t total = _display.numChars() * HCMS39xx::COLUMNS_PER_CHAR;
+    if (len == 0) return;
+    if (len > total)
+    {
+        columns += len - total;
+        len = total;
+    }
+    portENTER_CRITICAL(&_lock);
+    memmove(_frame, _frame + len, total - len);
+    memcpy(_frame + total - len, columns, len);
+    _shifted = (_shifted + len > total) ? total : _shifted + len;
+    if (_frameEdited)
+    {
+        _frameEdited = false; // edits not yet committed scroll along
+        _fullFrame = true;
+    }
+    commitFrame();
+    portEXIT_CRITICAL(&_lock);
+    notify();
+}
+
+void DisplayService::clear()
+{
+    portENTER_CRITICAL(&_lock);
+    memset(_frame, 0, sizeof(_frame));
+    _frameEdited = false;
+    _fullFrame = true;
+    commitFrame();
+    portEXIT_CRITICAL(&_lock);
+    notify();
+}
+
+void DisplayService::setBrightness(uint8_t value)
+{
+    portENTER_CRITICAL(&_lock);
+    for (uint8_t i = 0; i < HCMS39xx::MAX_DEVICES; i++) _control.brightness[i] = value;
+    commitControl();
+    portEXIT_CRITICAL(&_lock);
+    notify();
+}
+
+void DisplayService::setBrightness(uint8_t device, uint8_t value)
+{
+    if (device >= _display.numDevices()) return;
+    portENTER_CRITICAL(&_lock);
+    _control.brightness[device] = value;
+    commitControl();
+    portEXIT_CRITICAL(&_lock);
+    notify();
+}
+
+void DisplayService::setCurrent(HCMS39xx::DISPLAY_CURRENT value)
+{
+    portENTER_CRITICAL(&_lock);
+    for (uint8_t i = 0; i < HCMS39xx::MAX_DEVICES; i++) _control.current[i] = value;
+    commitControl();
+    portEXIT_CRITICAL(&_lock);
+    notify();
+}
+
+void DisplayService::setCurrent(uint8_t device, HCMS39xx::DISPLAY_CURRENT value)
+{
+    if (device >= _display.numDevices()) return;
+    portENTER_CRITICAL(&_lock);
+    _control.current[device] = value;
+    commitControl();
+    portEXIT_CRITICAL(&_lock);
+    notify();
+}
+
+void DisplayService::sleep()
+{
+    portENTER_CRITICAL(&_lock);
+    _control.awake = false;
+    commitControl();
+    portEXIT_CRITICAL(&_lock);
+    notify();
+}
+
+void DisplayService::wakeup()
+{
+    portENTER_CRITICAL(&_lock);
+    _control.awake = true;
+    commitControl();
+    portEXIT_CRITICAL(&_lock);
+    notify();
+}
+
+void DisplayService::blank(bool on)
+{
+    portENTER_CRITICAL(&_lock);
+    _control.blanked = on;
+    commitControl();
+    portEXIT_CRITICAL(&_lock);
+    notify();
+}
+
+void DisplayService::suspend()
+{
+    _suspend.store(true);
+    while (_busy.load())
+    {
+        delay(1);
+    }
+}
+
+void DisplayService::resume()
+{
+    portENTER_CRITICAL(&_lock);
+    _fullFrame = true;
+    _framePending = true;
+    _controlPending = true;
+    portEXIT_CRITICAL(&_lock);
+    _controlKnown = false; // the task is stopped, resend every control word
+    _suspend.store(false);
+    notify();
+}
+
+void DisplayService::service()
+{
+    _busy.store(true);
+    if (_suspend.load())
+    {
+        _busy.store(false);
+        return;
+    }
+
+    uint8_t frame[COLUMNS];
+    uint16_t total = _display.numChars() * HCMS39xx::COLUMNS_PER_CHAR;
+
+    portENTER_CRITICAL(&_lock);
+    bool framePending = _framePending;
+    bool fullFrame = _fullFrame;
+    uint16_t shifted = _shifted;
+    bool controlPending = _controlPending;
+    Control control = _control;
+    memcpy(frame, _frame, total);
+    displayLastMerged.set(_queued);
+    _framePending = false;
+    _fullFrame = false;
+    _shifted = 0;
+    _controlPending = false;
+    _queued = 0;
+    portEXIT_CRITICAL(&_lock);
+
+    int64_t t0 = esp_timer_get_time();
+    if (controlPending)
+    {
+        bool changed = false;
+        for (uint8_t i = 0; i < _display.numDevices(); i++)
+        {
+            if (!_controlKnown || control.brightness[i] != _sent.brightness[i]
+                || control.current[i] != _sent.current[i] || control.awake != _sent.awake)
+            {
+                _display.stageControl(i, control.brightness[i], control.current[i], control.awake);
+                changed = true;
+            }
+        }
+        if (changed) _display.sendControl();
+        if (!_controlKnown || control.blanked != _sent.blanked)
+        {
+            if (control.blanked) _display.displayBlank();
+            else _display.displayUnblank();
+            changed = true;
+        }
+        if (!changed) displayCoalesced.inc(); // already in the chain
+        _sent = control;
+        _controlKnown = true;
+    }
+    if (framePending)
+    {
+        if (!fullFrame && shifted > 0 && shifted < total)
+        {
+            _display.printDirect(frame + total - shifted, shifted); // scrolled only
+        }
+        else
+        {
+            _display.writeColumns(0, frame, total);
+            if (!_display.update()) displayCoalesced.inc(); // same frame as the chain
+        }
+    }
+    displayTransferTime.record((uint32_t)(esp_timer_get_time() - t0));
+    _busy.store(false);
+}
+
+void DisplayService::serviceTask(void* context)
+{
+    DisplayService* self = (DisplayService*)context;
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        self->service();
+    }
+}
+
+void DisplayService::printStatus(Print& out) const
+{
+    out.printf("Display service: %u commands, %u coalesced, last run merged %d\n",
+               (unsigned)displayCommands.value(), (unsigned)displayCoalesced.value(), (int)displayLastMerged.value());
+}
@@ -0,0 +1,95 @@
+#ifndef DISPLAY_SERVICE_H
+#define DISPLAY_SERVICE_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include "HCMS39xx.h"
+
+// Owns the HCMS39xx from a low priority task, so bit-banged transfers
+// never run on the caller's thread.
+//
+// Callers only edit the wanted state under a spinlock and wake the task:
+// the frame (columns) and the per device control settings. The task sends
+// the latest state when it runs, so frames superseded before that and
+// control settings equal to what the chain already has are never shifted
+// out (counted as coalesced). When the frame only scrolled since the last
+// transfer, just the new columns are shifted in.
+
+class DisplayService
+{
+public:
+    enum { COLUMNS = HCMS39xx::MAX_CHARS * HCMS39xx::COLUMNS_PER_CHAR };
+
+    DisplayService(HCMS39xx& display);
+
+    // Takes over the display (after HCMS39xx::begin()) and starts the task
+    void begin();
+
+    // Frame edits, sent by update()
+    void printAt(uint8_t pos, const char* s);
+    void writeColumns(uint16_t column, const uint8_t* data, uint8_t len);
+    void clearRegion(uint8_t pos, uint8_t len);
+    void update();
+
+    // Immediate frame commands, same meaning as the HCMS39xx calls
+    void print(const char* s);                          // whole display, left aligned, blank filled
+    void printDirect(const uint8_t* columns, uint8_t len); // scrolls the columns in from the right
+    void clear();
+
+    // Control commands
+    void setBrightness(uint8_t value);
+    void setBrightness(uint8_t device, uint8_t value);
+    void setCurrent(HCMS39xx::DISPLAY_CURRENT value);
+    void setCurrent(uint8_t device, HCMS39xx::DISPLAY_CURRENT value);
+    void sleep();
+    void wakeup();
+    void blank(bool on);
+
+    // Stops the task between transfers so the driver can be used directly
+    // (benchmarks); resume() resends the whole state.
+    void suspend();
+    void resume();
+
+    uint8_t numChars() const { return _display.numChars(); }
+    void printStatus(Print& out) const;
+
+private:
+    struct Control
+    {
+        uint8_t brightness[HCMS39xx::MAX_DEVICES];
+        HCMS39xx::DISPLAY_CURRENT current[HCMS39xx::MAX_DEVICES];
+        bool awake;
+        bool blanked;
+    };
+
+    void setColumn(uint16_t column, uint8_t value);
+    void commitFrame();     // called with the lock held
+    void commitControl();   // called with the lock held
+    void notify();
+    void service();
+    static void serviceTask(void* context);
+
+    HCMS39xx& _display;
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+    void* _task = nullptr;
+
+    // Wanted state, written by the callers under _lock
+    uint8_t _frame[COLUMNS] = {};
+    bool _frameEdited = false;      // edits since the last update()
+    bool _framePending = false;     // committed, not taken by the task yet
+    uint16_t _shifted = 0;          // columns scrolled in since the last transfer
+    bool _fullFrame = false;        // other changes since the last transfer
+    Control _control;
+    bool _controlPending = false;
+    uint8_t _queued = 0;            // commands since the task last ran
+
+    // Chain state, task only
+    Control _sent;
+    bool _controlKnown = false;
+
+    std::atomic<bool> _suspend{false};
+    std::atomic<bool> _busy{false};
+};
+
+#endif
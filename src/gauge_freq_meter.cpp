@@ -1,16 +1,57 @@
 #include "gauge_freq_meter.h"
+#include "Logger.h"
+#include "Metrics.h"
 
-#define STEP_FREQ_MIN    49.80f  
-#define STEP_FREQ_MAX    50.20f
-#define STEP_SETP_MIN    207
-#define STEP_STEP_MAX    3432
+// Alternative acceleration curves, same layout as the SwitecX12 default table
+static const unsigned short gentleAccelTable[][2] = {
+  {   20, 6000},
+  {   50, 3000},
+  {  100, 1500},
+  {  150, 1000},
+  {  200, 800}
+};
 
-GaugeFreqMeter::GaugeFreqMeter()
+static const unsigned short fastAccelTable[][2] = {
+  {   20, 3000},
+  {   50, 1500},
+  {  100, 800},
+  {  200, 500},
+  {  400, 350}
+};
+
+// Generated by tools/accel_tuner.py --margin 2.0
+static const unsigned short tunedAccelTable[][2] = {
+  {    2, 1500},
+  {    3, 866},
+  {    6, 750},
+  {   11, 567},
+  {   20, 433},
+  {   36, 328}
+};
+
+struct AccelProfile
+{
+    const char* name;
+    const unsigned short (*table)[2];
+    unsigned int rows;
+};
+
+static const AccelProfile accelProfiles[] = {
+    { "default", nullptr, 0 },
+    { "gentle",  gentleAccelTable, sizeof(gentleAccelTable) / sizeof(*gentleAccelTable) },
+    { "fast",    fastAccelTable,   sizeof(fastAccelTable) / sizeof(*fastAccelTable) },
+    { "tuned",   tunedAccelTable,  sizeof(tunedAccelTable) / sizeof(*tunedAccelTable) },
+};
+#define ACCEL_PROFILE_COUNT (sizeof(accelProfiles) / sizeof(*accelProfiles))
+
+static Histogram gaugeSetPositionTime("gauge_set_position_us", "Time spent in GaugeNeedle::setPosition()");
+
+GaugeNeedle::GaugeNeedle()
 {
 
 }
 
-void GaugeFreqMeter::begin(    const unsigned char pinStep,
+void GaugeNeedle::begin(    const unsigned char pinStep,
                                 const unsigned char pinDir,
                                 const unsigned char pinReset )
 {
@@ -18,27 +59,67 @@ void GaugeFreqMeter::begin(    const unsigned char pinStep,
 }
 
 
-void GaugeFreqMeter::reset(void)
+void GaugeNeedle::reset(void)
 {
+    if (_onMotion != nullptr) _onMotion();
     _gauge.zero();
 }
 
-void GaugeFreqMeter::setPosition(const float freq)
+void GaugeNeedle::moveTo(unsigned int posStep)
+{
+    int64_t t0 = esp_timer_get_time();
+    LOG_D("new pos:%u", posStep);
+    if (_onMotion != nullptr) _onMotion();
+    _gauge.setPosition(posStep);
+    gaugeSetPositionTime.record((uint32_t)(esp_timer_get_time() - t0));
+}
+
+void GaugeNeedle::setStep(const unsigned int posStep)
+{
+    if (_onMotion != nullptr) _onMotion();
+    _gauge.setPosition(posStep);
+}
+
+bool GaugeNeedle::setAccelProfile(const char* name)
 {
-    if(freq != _currentFreq)
+    for (unsigned int i = 0; i < ACCEL_PROFILE_COUNT; i++)
     {
-        _currentFreq = freq;
-        unsigned int pos = (unsigned int)(((double)freq - (double)STEP_FREQ_MIN) * ((double)STEP_STEP_MAX - (double)STEP_SETP_MIN) / ((double)STEP_FREQ_MAX - (double)STEP_FREQ_MIN) + (double)STEP_SETP_MIN);
-        if (pos < STEP_SETP_MIN) pos = STEP_SETP_MIN;
-        if (pos > STEP_STEP_MAX) pos = STEP_STEP_MAX;
-        Serial.print("new pos:");
-        Serial.println(pos);
-        _gauge.setPosition(pos);
+        if (strcmp(name, accelProfiles[i].name) == 0)
+        {
+            if (!_gauge.Stopped()) return false;
+            if (accelProfiles[i].table == nullptr)
+            {
+                _gauge.resetAccelTable();
+            }
+            else
+            {
+                _gauge.setAccelTable(accelProfiles[i].table, accelProfiles[i].rows);
+            }
+            _accelProfile = accelProfiles[i].name;
+            return true;
+        }
     }
-    _currentFreq = freq;
+    return false;
 }
 
-void GaugeFreqMeter::setStep(const unsigned int posStep)
+bool GaugeNeedle::setStepTimer(const char* name)
 {
-    _gauge.setPosition(posStep);
+    if (strcmp(name, "esp") == 0)
+    {
+        return _gauge.resetTimer();
+    }
+    if (strcmp(name, "hw") == 0)
+    {
+        return _gauge.setTimer(_hwTimer);
+    }
+    if (strcmp(name, "rmt") == 0)
+    {
+        return _gauge.setPulseTrain(_rmtTrain);
+    }
+    return false;
+}
+
+const char* GaugeNeedle::accelProfileName(unsigned int index)
+{
+    return index < ACCEL_PROFILE_COUNT ? accelProfiles[index].name : nullptr;
 }
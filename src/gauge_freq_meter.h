@@ -2,13 +2,19 @@
 #define GAUGE_FREQ_METER_H
 
 #include "SwitecX12.h"
+#include "grid_profile.h"
 
-class GaugeFreqMeter
+// Needle driver, independent of the grid: calibration, raw steps,
+// acceleration profiles and step timer backends
+class GaugeNeedle
 {
 
     public:
 
-        GaugeFreqMeter();
+        // Called before every motion starts, e.g. to raise the clock
+        typedef void (*MotionHandler)();
+
+        GaugeNeedle();
 
         void begin( const unsigned char pinStep,
                     const unsigned char pinDir,
@@ -16,14 +22,65 @@ class GaugeFreqMeter
 
         void reset(void);
 
-        void setPosition(const float freq);
-
         void setStep(const unsigned int posStep);
 
+        // Selects one of the named acceleration profiles ("default", "gentle", "fast")
+        // Returns false if the name is unknown or the needle is moving
+        bool setAccelProfile(const char* name);
+        const char* accelProfile() const { return _accelProfile; }
+        static const char* accelProfileName(unsigned int index);
+
+        // Selects the step timer backend: "esp" (esp_timer task), "hw"
+        // (hardware timer interrupt) or "rmt" (pulse batches played by the
+        // RMT peripheral). Returns false if the name is unknown,
+        // the needle is moving or the timer cannot be set up
+        bool setStepTimer(const char* name);
+        const char* stepTimer() const { return _gauge.timerName(); }
+
         bool stopped() { return _gauge.Stopped(); }
 
+        void onMotion(MotionHandler handler) { _onMotion = handler; }
+
+    protected:
+        // Moves the needle to a step, timed in gauge_set_position_us
+        void moveTo(unsigned int posStep);
+
     private:
         SwitecX12   _gauge;
+        HwStepTimer _hwTimer{0};
+        RmtStepTrain _rmtTrain{0};
+        const char* _accelProfile = "default";
+        MotionHandler _onMotion = nullptr;
+};
+
+// Frequency gauge for a grid profile, the mapping folds at compile time
+template <typename Grid>
+class GaugeFreqMeter : public GaugeNeedle
+{
+    static_assert(Grid::maxFrequency() > Grid::minFrequency() && Grid::stepMax() > Grid::stepMin(), "empty dial range");
+
+    public:
+
+        void setPosition(const float freq)
+        {
+            if (freq != _currentFreq)
+            {
+                _currentFreq = freq;
+                moveTo(frequencyToStep(freq));
+            }
+        }
+
+        // Maps a frequency to a needle step, clamped to the dial
+        static unsigned int frequencyToStep(const float freq)
+        {
+            double pos = ((double)freq - Grid::minFrequency()) * Grid::stepsPerHz() + Grid::stepMin();
+            // clamp before the conversion, a negative value would wrap around
+            if (pos < Grid::stepMin()) pos = Grid::stepMin();
+            if (pos > Grid::stepMax()) pos = Grid::stepMax();
+            return (unsigned int)pos;
+        }
+
+    private:
         float  _currentFreq = 0.0f; // Current frequency
 };
 
@@ -0,0 +1,40 @@
+#ifndef GRID_PROFILE_H
+#define GRID_PROFILE_H
+
+// Compile-time description of the mains grid the unit is deployed on.
+// Everything is constexpr so the frequency mapping and the drift
+// calculation fold to constants, there is no runtime branch on the grid.
+// Select the profile with -DGRID_PROFILE=50 (default) or 60.
+
+template <unsigned int NominalHz, unsigned int BandMilliHz, unsigned int StepMin, unsigned int StepMax>
+struct GridProfile
+{
+    static constexpr unsigned int nominalHz() { return NominalHz; }
+    static constexpr float nominal() { return (float)NominalHz; }
+
+    // Dial range, nominal +/- band
+    static constexpr float minFrequency() { return NominalHz - BandMilliHz / 1000.0f; }
+    static constexpr float maxFrequency() { return NominalHz + BandMilliHz / 1000.0f; }
+
+    // Needle steps at both ends of the dial
+    static constexpr unsigned int stepMin() { return StepMin; }
+    static constexpr unsigned int stepMax() { return StepMax; }
+    static constexpr double stepsPerHz() { return (StepMax - StepMin) * 1000.0 / (2.0 * BandMilliHz); }
+};
+
+typedef GridProfile<50, 200, 207, 3432> Grid50Hz;
+typedef GridProfile<60, 200, 207, 3432> Grid60Hz;
+
+#ifndef GRID_PROFILE
+#define GRID_PROFILE 50
+#endif
+
+#if GRID_PROFILE == 50
+typedef Grid50Hz ActiveGrid;
+#elif GRID_PROFILE == 60
+typedef Grid60Hz ActiveGrid;
+#else
+#error "GRID_PROFILE must be 50 or 60"
+#endif
+
+#endif
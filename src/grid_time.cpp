@@ -0,0 +1,121 @@
+#include "grid_time.h"
+#include "Metrics.h"
+#include "Logger.h"
+
+static Gauge gridTimeDeviation("grid_time_deviation_ms", "Grid time deviation integrated over the applied samples");
+static Counter gridTimeGaps("grid_time_gaps_total", "Sample gaps detected in the grid time integral");
+static Counter gridTimeUnfilled("grid_time_unfilled_seconds_total", "Gap time closed without backfill (frequency held)");
+static Counter gridTimeBackfilled("grid_time_backfilled_samples_total", "Backfilled samples integrated");
+static Histogram gridTimeRecovery("grid_time_backfill_ms", "Time from gap detection to the end of its backfill");
+
+GridTimeIntegral::GridTimeIntegral(float nominalHz) : _nominal(nominalHz)
+{
+}
+
+// Unix time stamps below 10^11 are in seconds (until the year 5138)
+uint64_t GridTimeIntegral::toMs(uint64_t timeStamp)
+{
+    return timeStamp < 100000000000ULL ? timeStamp * 1000 : timeStamp;
+}
+
+void GridTimeIntegral::integrate(float frequency, uint64_t fromMs, uint64_t toMs)
+{
+    _deviationSec += ((double)frequency / _nominal - 1.0) * (double)(toMs - fromMs) / 1000.0;
+    gridTimeDeviation.set((int32_t)(_deviationSec * 1000.0));
+}
+
+void GridTimeIntegral::add(uint64_t timeStamp, float frequency)
+{
+    uint64_t ms = toMs(timeStamp);
+    if (_lastMs != 0 && ms <= _lastMs) return;
+
+    if (gapOpen() && ms - _gapEndMs > BACKFILL_WAIT_MS)
+    {
+        LOG_W("Grid time: no backfill for the gap, holding %.3f Hz", _fillFrequency);
+        closeGap(false);
+    }
+
+    if (_lastMs != 0 && ms - _lastMs > GAP_MS)
+    {
+        if (gapOpen()) closeGap(false); // a second gap before the first was backfilled
+        LOG_W("Grid time: %llu ms without samples", (unsigned long long)(ms - _lastMs));
+        gridTimeGaps.inc();
+        _fillMs = _lastMs;
+        _fillFrequency = _lastFrequency;
+        _gapEndMs = ms;
+        _filled = 0;
+        _gapOpenedMs = millis();
+    }
+    else if (_lastMs != 0)
+    {
+        integrate(_lastFrequency, _lastMs, ms);
+    }
+    _lastMs = ms;
+    _lastTimeStamp = timeStamp;
+    _lastFrequency = frequency;
+}
+
+void GridTimeIntegral::restore(const State& state)
+{
+    _deviationSec = state.deviationSec;
+    _lastTimeStamp = state.lastTimeStamp;
+    _lastMs = toMs(state.lastTimeStamp);
+    _lastFrequency = state.lastFrequency;
+    _gapEndMs = 0;
+    gridTimeDeviation.set((int32_t)(_deviationSec * 1000.0));
+}
+
+bool GridTimeIntegral::fill(uint64_t timeStamp, float frequency)
+{
+    uint64_t ms = toMs(timeStamp);
+    if (ms > _lastMs)
+    {
+        add(timeStamp, frequency); // answered before the first live sample after the reconnect
+    }
+    else if (gapOpen() && ms > _fillMs && ms < _gapEndMs)
+    {
+        integrate(_fillFrequency, _fillMs, ms);
+        _fillMs = ms;
+        _fillFrequency = frequency;
+        _filled++;
+    }
+    else
+    {
+        return false;
+    }
+    gridTimeBackfilled.inc();
+    return true;
+}
+
+void GridTimeIntegral::endFill()
+{
+    if (gapOpen())
+    {
+        closeGap(_filled > 0);
+    }
+}
+
+void GridTimeIntegral::closeGap(bool filled)
+{
+    integrate(_fillFrequency, _fillMs, _gapEndMs);
+    if (filled)
+    {
+        gridTimeRecovery.record(millis() - _gapOpenedMs);
+        LOG_I("Grid time: gap backfilled with %u samples", _filled);
+    }
+    else
+    {
+        gridTimeUnfilled.inc((uint32_t)((_gapEndMs - _fillMs) / 1000));
+    }
+    _gapEndMs = 0;
+}
+
+void GridTimeIntegral::printStatus(Print& out) const
+{
+    out.printf("Grid time deviation: %+.3f s\n", _deviationSec);
+    if (gapOpen())
+    {
+        out.printf("  gap of %llu ms waiting for backfill, %u samples filled\n",
+                   (unsigned long long)(_gapEndMs - _fillMs), _filled);
+    }
+}
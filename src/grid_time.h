@@ -0,0 +1,69 @@
+#ifndef GRID_TIME_H
+#define GRID_TIME_H
+
+#include <Arduino.h>
+
+// Grid time deviation: the integral of (f / nominal - 1) over the applied
+// samples, each frequency held until the next time stamp. This is how far a
+// synchronous clock on the grid runs ahead of real time.
+//
+// Two consecutive samples more than GAP_MS apart open a gap, which is left
+// out of the integral until the missed samples are backfilled (fill(), then
+// endFill()). A gap that is never backfilled is closed after BACKFILL_WAIT_MS
+// with the frequency held from its start, and counted as unfilled.
+// Time stamps in seconds or milliseconds are both accepted.
+
+class GridTimeIntegral
+{
+public:
+    enum : uint32_t { GAP_MS = 10000, BACKFILL_WAIT_MS = 60000 };
+
+    // What survives a reset, see TimeKeeper
+    struct State
+    {
+        double deviationSec;
+        uint64_t lastTimeStamp;     // as received, 0 if no sample yet
+        float lastFrequency;
+    };
+
+    GridTimeIntegral(float nominalHz);
+
+    // Live sample, older time stamps are ignored
+    void add(uint64_t timeStamp, float frequency);
+
+    // Backfilled sample, ascending order. Returns true if it was integrated:
+    // inside the open gap, or newer than the live samples. False if known.
+    bool fill(uint64_t timeStamp, float frequency);
+    // End of a backfill: integrates the rest of the gap and closes it,
+    // counted as unfilled if the batch had no sample inside
+    void endFill();
+
+    State state() const { return { _deviationSec, _lastTimeStamp, _lastFrequency }; }
+    // Continues from a saved state, the time until the next sample becomes a gap
+    void restore(const State& state);
+
+    bool gapOpen() const { return _gapEndMs != 0; }
+    double deviationSeconds() const { return _deviationSec; }
+    void printStatus(Print& out) const;
+
+    // time_stamp in ms, whether the source sends seconds or ms
+    static uint64_t toMs(uint64_t timeStamp);
+
+private:
+    void integrate(float frequency, uint64_t fromMs, uint64_t toMs);
+    void closeGap(bool filled);
+
+    float _nominal;
+    double _deviationSec = 0.0;
+    uint64_t _lastMs = 0;           // newest live sample, 0 before the first one
+    uint64_t _lastTimeStamp = 0;    // same, as received
+    float _lastFrequency = 0.0f;
+
+    uint64_t _gapEndMs = 0;         // 0 if no gap is open
+    uint64_t _fillMs = 0;           // integrated up to here inside the gap
+    float _fillFrequency = 0.0f;    // frequency held from _fillMs
+    uint16_t _filled = 0;           // samples backfilled into the open gap
+    unsigned long _gapOpenedMs = 0; // millis() when the gap was detected
+};
+
+#endif
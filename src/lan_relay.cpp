@@ -0,0 +1,256 @@
+#include "lan_relay.h"
+#include "Metrics.h"
+#include "Logger.h"
+
+#define HEARTBEAT_INTERVAL_MS  1000
+#define RELAY_TIMEOUT_MS       3500    // about three lost heartbeats
+#define ELECTION_JITTER_MS     1000    // spreads the candidates of a simultaneous timeout
+#define CLAIM_INTERVAL_MS      250
+#define CLAIM_PERIOD_MS        1500    // unchallenged this long: candidate becomes relay
+#define SEQ_RESTART_WINDOW     1000    // a larger backward jump is a restarted relay
+
+// Frame, little endian: 'E' 'R' version type | sender id | seq | time stamp (8) | frequency mHz
+static const uint8_t frameMagic0 = 'E';
+static const uint8_t frameMagic1 = 'R';
+static const uint8_t frameVersion = 1;
+
+static Gauge relayRole("relay_role", "LAN relay role (0 off, 1 listener, 2 candidate, 3 relay)");
+static Counter relayFramesSent("relay_frames_sent_total", "LAN relay frames sent");
+static Counter relayFramesReceived("relay_frames_received_total", "LAN relay samples received");
+static Counter relaySampleGaps("relay_sample_gaps_total", "Samples missed by this listener (sequence gaps)");
+static Counter relayElections("relay_elections_total", "Elections started by this unit");
+
+LanRelay lanRelay(IPAddress(239, 255, 50, 50), 5050);
+
+static void putU32(uint8_t* p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint32_t getU32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+LanRelay::LanRelay(IPAddress group, uint16_t port) : _group(group), _port(port), _id(0)
+{
+}
+
+const char* LanRelay::roleName(Role role)
+{
+    switch (role)
+    {
+        case ROLE_LISTENER:  return "listener";
+        case ROLE_CANDIDATE: return "candidate";
+        case ROLE_RELAY:     return "relay";
+        default:             return "off";
+    }
+}
+
+void LanRelay::begin(SampleHandler onSample, RoleHandler onRole)
+{
+    if (_role != ROLE_OFF) return;
+
+    _id = (uint32_t)ESP.getEfuseMac();
+    _onSample = onSample;
+    _onRole = onRole;
+    if (!_udp.beginMulticast(_group, _port))
+    {
+        LOG_E("LAN relay: cannot join %s:%u", _group.toString().c_str(), _port);
+        return;
+    }
+    _relayId = 0;
+    _haveSeq = false;
+    setRole(ROLE_LISTENER, millis());
+}
+
+void LanRelay::end()
+{
+    if (_role == ROLE_OFF) return;
+    _udp.stop();
+    setRole(ROLE_OFF, millis());
+}
+
+void LanRelay::setRole(Role role, unsigned long now)
+{
+    if (role == _role) return;
+    LOG_I("LAN relay: %s -> %s", roleName(_role), roleName(role));
+    _role = role;
+    _roleSinceMs = now;
+    _lastSendMs = 0;
+    if (role == ROLE_LISTENER)
+    {
+        _lastRelayMs = now;
+        _electionDelayMs = RELAY_TIMEOUT_MS + (unsigned long)random(ELECTION_JITTER_MS);
+    }
+    relayRole.set(role);
+    if (_onRole != nullptr) _onRole(role);
+}
+
+void LanRelay::send(FrameType type, uint64_t timeStamp, uint32_t milliHz)
+{
+    uint8_t frame[FRAME_SIZE];
+    frame[0] = frameMagic0;
+    frame[1] = frameMagic1;
+    frame[2] = frameVersion;
+    frame[3] = type;
+    putU32(frame + 4, _id);
+    putU32(frame + 8, _seq);
+    putU32(frame + 12, (uint32_t)timeStamp);
+    putU32(frame + 16, (uint32_t)(timeStamp >> 32));
+    putU32(frame + 20, milliHz);
+
+    _udp.beginMulticastPacket();
+    _udp.write(frame, sizeof(frame));
+    if (_udp.endPacket())
+    {
+        relayFramesSent.inc();
+    }
+}
+
+void LanRelay::broadcast(uint64_t timeStamp, float frequency)
+{
+    if (_role != ROLE_RELAY) return;
+    _seq++;
+    send(FRAME_SAMPLE, timeStamp, (uint32_t)(frequency * 1000.0f + 0.5f));
+}
+
+void LanRelay::loop()
+{
+    if (_role == ROLE_OFF) return;
+
+    unsigned long now = millis();
+    uint8_t frame[FRAME_SIZE];
+    while (_udp.parsePacket() > 0)
+    {
+        if (_udp.read(frame, sizeof(frame)) == FRAME_SIZE)
+        {
+            receive(frame, now);
+        }
+        if (_role == ROLE_OFF) return; // stopped from a handler
+    }
+
+    switch (_role)
+    {
+        case ROLE_LISTENER:
+            if (now - _lastRelayMs > _electionDelayMs)
+            {
+                LOG_W("LAN relay: no relay for %lu ms, standing for election", now - _lastRelayMs);
+                relayElections.inc();
+                _relayId = 0;
+                setRole(ROLE_CANDIDATE, now);
+            }
+            break;
+
+        case ROLE_CANDIDATE:
+            if (now - _roleSinceMs > CLAIM_PERIOD_MS)
+            {
+                setRole(ROLE_RELAY, now);
+            }
+            else if (_lastSendMs == 0 || now - _lastSendMs >= CLAIM_INTERVAL_MS)
+            {
+                _lastSendMs = now;
+                send(FRAME_CLAIM, 0, 0);
+            }
+            break;
+
+        case ROLE_RELAY:
+            if (_lastSendMs == 0 || now - _lastSendMs >= HEARTBEAT_INTERVAL_MS)
+            {
+                _lastSendMs = now;
+                send(FRAME_HEARTBEAT, 0, 0);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+void LanRelay::receive(const uint8_t* frame, unsigned long now)
+{
+    if (frame[0] != frameMagic0 || frame[1] != frameMagic1 || frame[2] != frameVersion) return;
+
+    FrameType type = (FrameType)frame[3];
+    uint32_t sender = getU32(frame + 4);
+    uint32_t seq = getU32(frame + 8);
+    if (sender == _id) return; // own frame looped back
+
+    if (type == FRAME_CLAIM)
+    {
+        if (_role == ROLE_RELAY)
+        {
+            _lastSendMs = 0; // answer at once so the candidate backs off
+        }
+        else if (_role == ROLE_CANDIDATE && sender < _id)
+        {
+            setRole(ROLE_LISTENER, now);
+        }
+        return;
+    }
+    if (type == FRAME_SAMPLE || type == FRAME_HEARTBEAT)
+    {
+        onRelayFrame(type, sender, seq, frame, now);
+    }
+}
+
+void LanRelay::onRelayFrame(FrameType type, uint32_t sender, uint32_t seq, const uint8_t* frame, unsigned long now)
+{
+    if (_role == ROLE_RELAY)
+    {
+        if (sender > _id) return; // the other relay steps down when it hears us
+        LOG_W("LAN relay: relay %08x has priority, stepping down", (unsigned)sender);
+        setRole(ROLE_LISTENER, now);
+    }
+    else if (_role == ROLE_CANDIDATE)
+    {
+        setRole(ROLE_LISTENER, now);
+    }
+
+    // Follow the lowest relay while two are briefly active, or any relay once ours is silent
+    if (sender != _relayId)
+    {
+        if (_relayId != 0 && sender > _relayId && now - _lastRelayMs <= RELAY_TIMEOUT_MS) return;
+        LOG_I("LAN relay: following %08x", (unsigned)sender);
+        _relayId = sender;
+        _haveSeq = false;
+    }
+    _lastRelayMs = now;
+
+    // A sample is expected at _lastSeq + 1, a heartbeat repeats the last sample sent
+    uint32_t expected = (type == FRAME_SAMPLE) ? _lastSeq + 1 : _lastSeq;
+    if (_haveSeq && (int32_t)(seq - expected) < 0)
+    {
+        if ((int32_t)(expected - seq) <= SEQ_RESTART_WINDOW) return; // duplicate or reordered
+        _haveSeq = false; // relay restarted
+    }
+    if (_haveSeq && seq != expected)
+    {
+        LOG_W("LAN relay: %u samples missed", (unsigned)(seq - expected));
+        relaySampleGaps.inc(seq - expected);
+    }
+    _haveSeq = true;
+    _lastSeq = seq;
+
+    if (type == FRAME_SAMPLE)
+    {
+        relayFramesReceived.inc();
+        uint64_t timeStamp = (uint64_t)getU32(frame + 12) | ((uint64_t)getU32(frame + 16) << 32);
+        if (_onSample != nullptr) _onSample(timeStamp, getU32(frame + 20) / 1000.0f);
+    }
+}
+
+void LanRelay::printStatus(Print& out) const
+{
+    out.printf("LAN relay %s:%u, node %08x, role %s for %lu s\n", _group.toString().c_str(), _port,
+               (unsigned)_id, roleName(_role), (millis() - _roleSinceMs) / 1000);
+    if (_role == ROLE_RELAY)
+    {
+        out.printf("  samples sent: %u\n", (unsigned)_seq);
+    }
+    else if (_role != ROLE_OFF && _relayId != 0)
+    {
+        out.printf("  following %08x, last frame %lu ms ago, seq %u\n", (unsigned)_relayId,
+                   millis() - _lastRelayMs, (unsigned)_lastSeq);
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef LAN_RELAY_H
+#define LAN_RELAY_H
+
+#include <Arduino.h>
+#include <WiFiUdp.h>
+
+// Shares one upstream subscription between the units of a LAN.
+// The elected relay keeps its GridFreqMonitor connections and rebroadcasts
+// every applied sample as a 24 byte UDP multicast frame, the other units
+// stay off the servers and apply the frames they receive. The relay sends
+// a heartbeat every second; when it is silent for RELAY_TIMEOUT_MS the
+// listeners hold an election (lowest node id wins) and the winner opens
+// the upstream connections. Listeners count sequence gaps.
+
+class LanRelay
+{
+public:
+    enum Role : uint8_t { ROLE_OFF, ROLE_LISTENER, ROLE_CANDIDATE, ROLE_RELAY };
+
+    typedef void (*SampleHandler)(uint64_t timeStamp, float frequency);
+    typedef void (*RoleHandler)(Role role);
+
+    LanRelay(IPAddress group, uint16_t port);
+
+    // Joins the multicast group as a listener, role changes are passed to onRole
+    void begin(SampleHandler onSample, RoleHandler onRole);
+    // Leaves the group, role becomes ROLE_OFF
+    void end();
+
+    // Receives frames, runs the election and sends the heartbeats
+    void loop();
+
+    // Relay only: rebroadcasts a sample applied from upstream
+    void broadcast(uint64_t timeStamp, float frequency);
+
+    Role role() const { return _role; }
+    bool enabled() const { return _role != ROLE_OFF; }
+    static const char* roleName(Role role);
+    void printStatus(Print& out) const;
+
+private:
+    enum FrameType : uint8_t { FRAME_SAMPLE = 1, FRAME_HEARTBEAT = 2, FRAME_CLAIM = 3 };
+    enum { FRAME_SIZE = 24 };
+
+    void send(FrameType type, uint64_t timeStamp, uint32_t milliHz);
+    void receive(const uint8_t* frame, unsigned long now);
+    void onRelayFrame(FrameType type, uint32_t sender, uint32_t seq, const uint8_t* frame, unsigned long now);
+    void setRole(Role role, unsigned long now);
+
+    WiFiUDP _udp;
+    IPAddress _group;
+    uint16_t _port;
+    uint32_t _id;                       // low bits of the MAC, election order
+    Role _role = ROLE_OFF;
+    SampleHandler _onSample = nullptr;
+    RoleHandler _onRole = nullptr;
+    uint32_t _seq = 0;                  // last sample sent (relay)
+    uint32_t _relayId = 0;              // relay followed (listener), 0 if none
+    uint32_t _lastSeq = 0;              // last sample sequence received from it
+    bool _haveSeq = false;
+    unsigned long _lastRelayMs = 0;     // last frame from the followed relay
+    unsigned long _roleSinceMs = 0;
+    unsigned long _lastSendMs = 0;      // last heartbeat or claim
+    unsigned long _electionDelayMs = 0; // randomized silence before standing
+};
+
+extern LanRelay lanRelay;
+
+#endif
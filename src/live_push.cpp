@@ -0,0 +1,269 @@
+#include "live_push.h"
+#include "Metrics.h"
+#include "Logger.h"
+#include <lwip/sockets.h>
+#include <stdarg.h>
+
+static Gauge liveClients("live_clients", "Connected live push (SSE) subscribers");
+static Counter liveFrames("live_frames_total", "Live push frames published");
+static Counter liveFramesDropped("live_frames_dropped_total", "Frames dropped from full subscriber queues");
+static Counter livePoolExhausted("live_pool_exhausted_total", "Frames not published because the frame pool was empty");
+static Counter liveBytes("live_bytes_total", "Bytes written to live push subscribers");
+
+static const char sseHeaders[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "Connection: keep-alive\r\n\r\n"
+    "retry: 2000\n\n";
+
+static const unsigned long requestTimeoutMs = 2000;
+static const unsigned long stallTimeoutMs = 10000;
+
+LivePushServer livePush(81);
+
+LivePushServer::LivePushServer(uint16_t port) : _server(port, MAX_CLIENTS)
+{
+    for (int i = 0; i < FRAME_POOL; i++)
+    {
+        _frames[i].refs = 0;
+    }
+}
+
+void LivePushServer::begin()
+{
+    _server.begin();
+    _server.setNoDelay(true);
+}
+
+uint8_t LivePushServer::clients() const
+{
+    uint8_t n = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+        if (_clients[i].state != CLIENT_FREE) n++;
+    }
+    return n;
+}
+
+bool LivePushServer::publish(const char* event, const char* fmt, ...)
+{
+    if (clients() == 0) return true;
+
+    Frame* frame = allocFrame();
+    if (frame == nullptr)
+    {
+        livePoolExhausted.inc();
+        return false;
+    }
+
+    // SSE framing: optional event line, one data line, blank line.
+    // snprintf returns the length it wanted, so stop at the first part
+    // that did not fit, before the next one would start past the end.
+    int n = 0;
+    if (event != nullptr)
+    {
+        n = snprintf(frame->data, FRAME_SIZE, "event: %s\n", event);
+    }
+    if (n >= 0 && n < FRAME_SIZE)
+    {
+        n += snprintf(frame->data + n, FRAME_SIZE - n, "data: ");
+    }
+    if (n >= 0 && n < FRAME_SIZE)
+    {
+        va_list args;
+        va_start(args, fmt);
+        int length = vsnprintf(frame->data + n, FRAME_SIZE - n, fmt, args);
+        va_end(args);
+        n = length < 0 ? length : n + length;
+    }
+    if (n >= 0 && n < FRAME_SIZE)
+    {
+        n += snprintf(frame->data + n, FRAME_SIZE - n, "\n\n");
+    }
+    if (n < 0 || n >= FRAME_SIZE)
+    {
+        LOG_W("live frame too long (%d bytes)", n);
+        return false;   // refs still 0, the frame stays free
+    }
+    frame->length = n;
+    liveFrames.inc();
+
+    for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+        if (_clients[i].state == CLIENT_STREAMING || _clients[i].state == CLIENT_HEADERS)
+        {
+            enqueue(_clients[i], frame);
+        }
+    }
+    return true;
+}
+
+void LivePushServer::loop()
+{
+    accept();
+    for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+        if (_clients[i].state != CLIENT_FREE)
+        {
+            service(_clients[i]);
+        }
+    }
+}
+
+LivePushServer::Frame* LivePushServer::allocFrame()
+{
+    for (int i = 0; i < FRAME_POOL; i++)
+    {
+        if (_frames[i].refs == 0) return &_frames[i];
+    }
+    return nullptr;
+}
+
+void LivePushServer::release(Frame* frame)
+{
+    if (frame->refs > 0) frame->refs--;
+}
+
+void LivePushServer::enqueue(Client& client, Frame* frame)
+{
+    if (client.count == QUEUE_DEPTH)
+    {
+        // drop the oldest frame not being written, a partly sent one must complete
+        uint8_t victim = (client.offset > 0 && client.state == CLIENT_STREAMING) ? 1 : 0;
+        uint8_t index = (client.head + victim) % QUEUE_DEPTH;
+        release(client.queue[index]);
+        for (uint8_t i = victim; i + 1 < client.count; i++)
+        {
+            client.queue[(client.head + i) % QUEUE_DEPTH] = client.queue[(client.head + i + 1) % QUEUE_DEPTH];
+        }
+        client.count--;
+        client.dropped++;
+        liveFramesDropped.inc();
+    }
+    frame->refs++;
+    client.queue[(client.head + client.count) % QUEUE_DEPTH] = frame;
+    client.count++;
+}
+
+void LivePushServer::accept()
+{
+    WiFiClient socket = _server.available();
+    if (!socket) return;
+
+    for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+        Client& client = _clients[i];
+        if (client.state == CLIENT_FREE)
+        {
+            client.socket = socket;
+            client.state = CLIENT_REQUEST;
+            client.head = 0;
+            client.count = 0;
+            client.offset = 0;
+            client.requestMatch = 0;
+            client.dropped = 0;
+            client.lastProgressMs = millis();
+            liveClients.set(clients());
+            return;
+        }
+    }
+    socket.stop(); // full
+}
+
+void LivePushServer::service(Client& client)
+{
+    if (!client.socket.connected())
+    {
+        close(client);
+        return;
+    }
+
+    // The request itself is not interpreted: wait for the blank line ending
+    // it, then stream. Later input from the client is discarded.
+    while (client.socket.available() > 0)
+    {
+        char c = client.socket.read();
+        if (client.state != CLIENT_REQUEST) continue;
+        static const char endOfRequest[] = "\r\n\r\n";
+        client.requestMatch = (c == endOfRequest[client.requestMatch]) ? client.requestMatch + 1 : (c == '\r' ? 1 : 0);
+        if (client.requestMatch == 4)
+        {
+            client.state = CLIENT_HEADERS;
+            client.offset = 0;
+        }
+    }
+
+    if (client.state == CLIENT_REQUEST)
+    {
+        if (millis() - client.lastProgressMs > requestTimeoutMs) close(client);
+        return;
+    }
+
+    if (client.state == CLIENT_HEADERS)
+    {
+        if (!sendPending(client, sseHeaders, sizeof(sseHeaders) - 1)) return;
+        client.state = CLIENT_STREAMING;
+    }
+
+    while (client.count > 0)
+    {
+        Frame* frame = client.queue[client.head];
+        if (!sendPending(client, frame->data, frame->length)) break;
+        release(frame);
+        client.head = (client.head + 1) % QUEUE_DEPTH;
+        client.count--;
+    }
+
+    if (client.count > 0 && millis() - client.lastProgressMs > stallTimeoutMs)
+    {
+        LOG_I("live client stalled, closing");
+        close(client);
+    }
+}
+
+// Writes what the socket accepts without blocking, returns true once the
+// whole buffer is sent (offset is then reset for the next one)
+bool LivePushServer::sendPending(Client& client, const char* data, uint16_t length)
+{
+    while (client.offset < length)
+    {
+        int sent = ::send(client.socket.fd(), data + client.offset, length - client.offset, MSG_DONTWAIT);
+        if (sent <= 0)
+        {
+            if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) close(client);
+            return false;
+        }
+        client.offset += sent;
+        client.lastProgressMs = millis();
+        liveBytes.inc(sent);
+    }
+    client.offset = 0;
+    return true;
+}
+
+void LivePushServer::close(Client& client)
+{
+    if (client.state == CLIENT_FREE) return;
+    while (client.count > 0)
+    {
+        release(client.queue[client.head]);
+        client.head = (client.head + 1) % QUEUE_DEPTH;
+        client.count--;
+    }
+    client.socket.stop();
+    client.state = CLIENT_FREE;
+    liveClients.set(clients());
+}
+
+void LivePushServer::printStatus(Print& out) const
+{
+    out.printf("Live push: %u clients\n", (unsigned)clients());
+    for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+        const Client& client = _clients[i];
+        if (client.state == CLIENT_FREE) continue;
+        out.printf("  %u: queued %u, dropped %u\n", (unsigned)i, (unsigned)client.count, (unsigned)client.dropped);
+    }
+}
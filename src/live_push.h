@@ -0,0 +1,77 @@
+#ifndef LIVE_PUSH_H
+#define LIVE_PUSH_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+// Server-Sent Events endpoint for LAN dashboards (http://<device-ip>:81/).
+// Each published event is encoded once into a reference counted frame from
+// a fixed pool; every subscriber queues a pointer to it. Sockets are written
+// without blocking from loop(), a slow reader only grows its own bounded
+// queue, and when that is full its oldest unsent frame is dropped. So
+// publishing costs one encode plus one pointer per client and never waits
+// on the network.
+//
+// The number of clients is also limited by the lwIP socket count of the
+// framework (CONFIG_LWIP_MAX_SOCKETS), shared with the other connections.
+
+class LivePushServer
+{
+public:
+    enum { MAX_CLIENTS = 8, QUEUE_DEPTH = 8, FRAME_SIZE = 192 };
+    enum { FRAME_POOL = QUEUE_DEPTH + MAX_CLIENTS + 1 }; // each client may pin one partly sent frame
+
+    LivePushServer(uint16_t port);
+
+    void begin();
+
+    // Accepts subscribers and writes their queues, never blocks
+    void loop();
+
+    // Encodes an event once and queues it for every subscriber.
+    // event may be nullptr for the default "message" type.
+    // Returns false if the frame did not fit or the pool was exhausted.
+    bool publish(const char* event, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+
+    uint8_t clients() const;
+    void printStatus(Print& out) const;
+
+private:
+    struct Frame
+    {
+        uint8_t refs;       // queues holding the frame, free when 0
+        uint16_t length;
+        char data[FRAME_SIZE];
+    };
+
+    enum ClientState : uint8_t { CLIENT_FREE, CLIENT_REQUEST, CLIENT_HEADERS, CLIENT_STREAMING };
+
+    struct Client
+    {
+        WiFiClient socket;
+        ClientState state = CLIENT_FREE;
+        Frame* queue[QUEUE_DEPTH];
+        uint8_t head = 0;           // oldest queued frame
+        uint8_t count = 0;
+        uint16_t offset = 0;        // bytes of the oldest frame (or headers) already sent
+        uint8_t requestMatch = 0;   // progress through the blank line ending the request
+        unsigned long lastProgressMs = 0;
+        uint32_t dropped = 0;
+    };
+
+    Frame* allocFrame();
+    void release(Frame* frame);
+    void enqueue(Client& client, Frame* frame);
+    void accept();
+    void service(Client& client);
+    bool sendPending(Client& client, const char* data, uint16_t length);
+    void close(Client& client);
+
+    WiFiServer _server;
+    Client _clients[MAX_CLIENTS];
+    Frame _frames[FRAME_POOL];
+};
+
+extern LivePushServer livePush;
+
+#endif
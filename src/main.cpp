@@ -1,11 +1,29 @@
 #include "WifiManager.h"
 #include "HardwareSerial.h"
 #include <Arduino.h>
-#include <WebSocketsClient.h>
 #include <ESPmDNS.h>
 #include <ArduinoJson.h>
 #include "HCMS39xx.h"
+#include "HCMS39xxFrame.h"
 #include "gauge_freq_meter.h"
+#include "Metrics.h"
+#include "Logger.h"
+#include "Console.h"
+#include "JsonArena.h"
+#include "source_selector.h"
+#include "MainsMeter.h"
+#include "app_clock.h"
+#include "trace_recorder.h"
+#include "display_renderer.h"
+#include "live_push.h"
+#include "lan_relay.h"
+#include "grid_time.h"
+#include "time_keeper.h"
+#include "power_governor.h"
+#include "display_service.h"
+#include "needle_predictor.h"
+#include "config_store.h"
+#include <LittleFS.h>
 #include <time.h>
 
 // --------------------- CONFIGURATION ---------------------
@@ -13,81 +31,307 @@
 const char* apSSID = "ElecTime";
 const char* apPassword = "12345678";
 
-// WebSocket server configuration
-const char* serverName = "electime";  // Replace with your WebSocket server name
-const int websocketPort = 8765;       // WebSocket server port
+// Defaults of the settings edited at run time ("config" on the console, /config over HTTP),
+// stored in NVS, see config_store.h
+const Config configDefaults = {
+  "", "",                         // Wi-Fi network, entered on the access point page
+  "electime", 8765,               // GridFreqMonitor mDNS name and WebSocket port
+  "CET-1CEST,M3.5.0,M10.5.0/3",   // Paris: UTC+1, daylight saving time from the last Sunday of March to the last Sunday of October
+  HCMS39xx::DEFAULT_BRIGHTNESS,
+  "default",                      // needle acceleration profile
+  true,                           // predictive needle, see needle_predictor.h
+  false,                          // LAN relay: only the elected relay connects to the servers, see lan_relay.h
+  true,                           // power saving: scale the CPU clock down and use modem sleep while idle
+  "",                             // no token: POST /config, /metrics and /trace refused
+};
 
-const float minFrequency = 49.80f; // Minimum valid frequency
-const float maxFrequency = 50.20f; // Maximum valid frequency
+// GridFreqMonitor mDNS names, the first resolved ones are connected (active + hot standby)
+char configuredServer[sizeof(Config::server)];                 // "server" setting
+const char* const serverNames[] = {
+  configuredServer,
+#ifdef BACKUP_SERVER
+  BACKUP_SERVER,                  // build flag, e.g. -DBACKUP_SERVER=\"electime-b\"
+#endif
+  // add backups here
+};
+
+// NTP servers, all queried at once, the first valid answer is used
+const char* const ntpServers[] = { "pool.ntp.org", "time.nist.gov", "time.google.com" };
+
+// Grid profile (50 or 60 Hz) selected at build time with -DGRID_PROFILE, see platformio.ini
+const float minFrequency = ActiveGrid::minFrequency(); // Minimum valid frequency
+const float maxFrequency = ActiveGrid::maxFrequency(); // Maximum valid frequency
+
+// Local measurement: isolated AC sense input (optocoupler, rising edge at each zero crossing)
+const uint8_t mainsSensePin = D7;
+const uint8_t mainsAveragingCycles = ActiveGrid::nominalHz(); // 1 s window
+
+const unsigned long scrollFramePeriodMs = 33; // one column per frame, about 30 fps
+
+const unsigned long liveStatsPeriodMs = 5000; // stats event period of the live push endpoint (port 81)
+
+// Largest WebSocket message parsed, a full backfill chunk is about 800 bytes
+const size_t maxMessageBytes = 2048;
+
+// Predictive needle: sent where the frequency will be when it gets there
+const uint32_t needleMotorLeadMs = 250;   // travel time of a typical move
+const uint32_t maxSampleAgeMs = 3000;     // older samples (clock off) are led by the travel time only
 
 // --------------------- GLOBAL VARIABLES ---------------------
 
-WebSocketsClient webSocket;
+ConfigStore configStore(configDefaults);
+
+SourceSelector sourceSelector(serverNames, sizeof(serverNames) / sizeof(*serverNames), configDefaults.port);
 
 // See https://github.com/Andy4495/HCMS39xx/blob/main/README.md#hardware-connections for wiring info
 // HCMS39xx(uint8_t num_chars, uint8_t data_pin, uint8_t rs_pin, uint8_t clk_pin, 
 //          uint8_t ce_pin, uint8_t blank_pin)
 HCMS39xx display(8, D10, D2, D8, D0, D3); // osc_select_pin tied high, not connected to microcontroller
+DisplayService displayService(display); // all display traffic after setup goes through its task
+
+// Boot screens, rendered by the compiler
+static constexpr HCMS39xxFrame<8> mdnsFrame = HCMS39xxFrame<8>::render("- MDNS -");
+static constexpr HCMS39xxFrame<8> hostFrame = HCMS39xxFrame<8>::render("- HOST -");
+static constexpr HCMS39xxFrame<8> calibFrame = HCMS39xxFrame<8>::render("-CALIB -");
+
 WifiManager wifiManager(apSSID, apPassword);
 
 // GaugeFreqMeter(uint8_t pinStep, uint8_t pinDir, uint8_t pinReset)
-GaugeFreqMeter gaugeFreqMeter;
+GaugeFreqMeter<ActiveGrid> gaugeFreqMeter;
+
+MainsFrequencyMeter mainsMeter(ActiveGrid::nominalHz(), mainsAveragingCycles);
+
+Counter messagesReceived("ingest_messages_total", "WebSocket text messages received");
+Counter messagesRejected("ingest_rejected_total", "Messages rejected (malformed, oversized or frequency out of range)");
+Counter messagesDeduplicated("ingest_deduplicated_total", "Messages ignored because the timestamp was unchanged");
+Counter messagesOutOfOrder("ingest_out_of_order_total", "Samples ignored because the timestamp was older than the last one");
+Counter messagesMalformed("ingest_malformed_total", "Messages that are not JSON or lack a valid time_stamp/frequency");
+Counter messagesOversized("ingest_oversized_total", "Messages longer than maxMessageBytes, dropped unparsed");
+Counter bytesReceived("ingest_bytes_total", "WebSocket text payload bytes received");
+Gauge heapFree("heap_free_bytes", "Free heap");
+Gauge heapMinFree("heap_min_free_bytes", "Lowest free heap since boot (watermark)");
+Gauge heapLargestBlock("heap_largest_block_bytes", "Largest allocatable heap block");
+Gauge jsonArenaHighWater("json_arena_high_water_bytes", "Peak JSON arena use for one message");
+Histogram ingestParseTime("ingest_parse_us", "Time to parse one WebSocket message");
+Histogram ingestMessageTime("ingest_message_us", "Time to handle one WebSocket message (parse and apply)");
+
+// JSON documents are parsed in a static arena reset for every message
+// (a backfill message of SourceSelector::BACKFILL_CHUNK samples is the largest)
+StaticJsonArena<4096> jsonArena;
+
+// Grid time deviation integrated over the applied and backfilled samples
+GridTimeIntegral gridTime(ActiveGrid::nominal());
+
+// Wall clock kept across resets, synced with SNTP
+TimeKeeper timeKeeper(ntpServers, sizeof(ntpServers) / sizeof(*ntpServers));
+
+// Frequency trend for the needle, alpha and beta tuned with tools/needle_replay.py
+NeedlePredictor needlePredictor(0.9f, 0.4f);
+Gauge needlePredictionOffset("needle_prediction_offset_mhz", "Needle target minus the frequency of the last sample");
+
+// Set when the needle is driven manually from the console, live samples are ignored until "resume"
+bool liveFeedPaused = false;
+
+// Where the frequency comes from: GridFreqMonitor servers or the local zero crossing input
+enum InputMode { INPUT_REMOTE, INPUT_LOCAL };
+InputMode inputMode = INPUT_REMOTE;
+
+// What the alphanumeric display shows: clock, frequency history or a scrolling message
+enum DisplayMode { DISPLAY_CLOCK, DISPLAY_SPARKLINE, DISPLAY_SCROLL };
+DisplayMode displayMode = DISPLAY_CLOCK;
+ColumnScroller scroller;
+Sparkline sparkline(minFrequency, maxFrequency);
 
 // --------------------- UTILITY FUNCTIONS ---------------------
 
-// Updates the display with the current time and frequency
-// If needFreqUpdate is true, the frequency used to correct the displayed time is updated
-// If needFreqUpdate is false, the displayed time is updated using the last known frequency
+// Updates the display with the current time, shown as a clock on the grid would show it:
+// ahead or behind by the grid time deviation integrated over the applied and backfilled
+// samples
+// If needFreqUpdate is true, frequency is the sample just applied (logged)
 // Returns the elapsed time since the last update for the display
-// The frequency is assumed to be in Hz and must be between 49.80 and 50.20 Hz
-// The drift is calculated based on the frequency and applied to the current time
 unsigned long updateDisplayWithCurrentTime(bool needFreqUpdate, float frequency) 
 {
-  static float lastFrequency = 50.0f;
-  if(needFreqUpdate) 
-  {
-    lastFrequency = frequency; // Updates the last frequency
-  }
-
-  // Calculate the drift in seconds over a year
-  float frequencyDeviation = lastFrequency - 50.0; // Difference from 50 Hz
-  int secondsPerYear = (int)(frequencyDeviation * 365.0 * 60.0 * 60.0); // Total drift in seconds over a year
-  
+  long driftSeconds = lround(gridTime.deviationSeconds());
 
-  time_t now = time(nullptr); // Get the current time
-  now += secondsPerYear; // Add the calculated drift
+  time_t now = appClock.now(); // Get the current time (virtual during replays)
+  now += driftSeconds; // Add the grid time deviation
   struct tm timeinfo;
   localtime_r(&now, &timeinfo); // Convert to local time
 
   char timeString[9]; // Format HH-MM-SS
   strftime(timeString, sizeof(timeString), "%H:%M:%S", &timeinfo);
+  if (!timeKeeper.valid() && !appClock.isVirtual())
+  {
+    strcpy(timeString, "--:--:--"); // Not synced since a power loss
+  }
   
-  Serial.print("Drift in seconds per day: ");
-  Serial.print(secondsPerYear);
-  Serial.print(" time: ");
-  Serial.println(timeString);
+  if (needFreqUpdate)
+  {
+    LOG_D("Frequency %.3f, grid time %+ld s: %02d:%02d:%02d", frequency, driftSeconds, timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
+  }
 
-  display.clear();
-  display.print(timeString); // Display the current time on the display
+  if (displayMode == DISPLAY_CLOCK)
+  {
+    displayService.printAt(0, timeString); // Display the current time on the display
+    displayService.update();
+  }
+
+  return appClock.millis(); // Return the elapsed time since the last update
+}
 
-  return millis(); // Return the elapsed time since the last update
+// How far ahead of a sample the needle is sent: its age plus the needle travel time
+uint32_t needleLeadMs(uint64_t timeStamp)
+{
+  uint32_t lead = needleMotorLeadMs;
+  if (!traceReplay.active() && timeKeeper.valid())
+  {
+    int64_t age = (int64_t)(appClock.epochMs() - GridTimeIntegral::toMs(timeStamp));
+    if (age >= 0 && age <= (int64_t)maxSampleAgeMs) lead += (uint32_t)age;
+  }
+  return lead;
+}
+
+// Moves the needle and corrects the clock with a new sample
+// Samples with an unchanged timestamp are ignored
+void applySample(uint64_t timeStamp, float frequency)
+{
+  static uint64_t lastTimestamp = 0;
+  // A late server sample would move the needle back and break the trace order. A replay
+  // starts over in the past on purpose, local samples follow the clock, even unset.
+  if (lastTimestamp != 0 && inputMode == INPUT_REMOTE && !traceReplay.active() &&
+      GridTimeIntegral::toMs(timeStamp) < GridTimeIntegral::toMs(lastTimestamp))
+  {
+    LOG_D("Timestamp %llu older than %llu, ignored", timeStamp, lastTimestamp);
+    messagesOutOfOrder.inc();
+    return;
+  }
+  if (timeStamp != lastTimestamp) 
+  {
+    lastTimestamp = timeStamp;
+    if (!traceReplay.active())
+    {
+      traceRecorder.record(appClock.epochMs(), timeStamp, frequency); // Keep the sample for later analysis
+      gridTime.add(timeStamp, frequency);
+    }
+
+    LOG_I("New Timestamp: %llu New Frequency: %.3f", lastTimestamp, frequency);
+    needlePredictor.add(GridTimeIntegral::toMs(timeStamp), frequency);
+    float target = frequency;
+    if (configStore.get().predictiveNeedle)
+    {
+      target = needlePredictor.predict(needleLeadMs(timeStamp));
+      needlePredictionOffset.set((int32_t)lroundf((target - frequency) * 1000.0f));
+    }
+    gaugeFreqMeter.setPosition(target); // Update the frequency gauge with the new value
+
+    // Encoded once and fanned out to the live push subscribers
+    livePush.publish(nullptr, "{\"time_stamp\":%llu,\"frequency\":%.3f,\"step\":%u,\"source\":%d}",
+                     (unsigned long long)timeStamp, frequency, GaugeFreqMeter<ActiveGrid>::frequencyToStep(frequency),
+                     inputMode == INPUT_LOCAL ? -1 : (int)sourceSelector.active());
+
+    uint32_t timeSec = (uint32_t)(GridTimeIntegral::toMs(timeStamp) / 1000);
+    if (!sparkline.contains(timeSec)) // unless it came in a backfill
+    {
+      uint8_t column = sparkline.addSample(timeSec, frequency);
+      if (displayMode == DISPLAY_SPARKLINE)
+      {
+        displayService.printDirect(&column, 1); // Scrolls the history by one column
+      }
+    }
+
+    updateDisplayWithCurrentTime(true, frequency); // Update the display with the new frequency
+  } 
+  else 
+  {
+    LOG_D("Timestamp unchanged, no update needed.");
+    messagesDeduplicated.inc();
+  }
+}
+
+// Applies the estimates of the local zero crossing measurement
+void pollLocalMeasurement()
+{
+  float frequency;
+  if (mainsMeter.poll(frequency))
+  {
+    if (frequency < minFrequency || frequency > maxFrequency) 
+    {
+      LOG_W("Local measurement out of range (%.3f Hz)", frequency);
+      return;
+    }
+    applySample(appClock.epochMs(), frequency); // local samples are stamped in ms
+  }
+}
+
+// Samples missed during a disconnection, sent by a source on request (see SourceSelector).
+// They go to the grid time integral and into the sparkline history at their time; the
+// needle keeps following the live samples. They stay out of the trace, which is in
+// arrival order: a replay would send the needle back to them.
+void ingestBackfill(JsonArray batch, bool more)
+{
+  int64_t t0 = esp_timer_get_time();
+  unsigned int used = 0;
+  unsigned int total = 0;
+  bool redraw = false;
+  for (JsonVariant sample : batch)
+  {
+    uint64_t timeStamp = sample[0];
+    float frequency = sample[1];
+    total++;
+    if (frequency < minFrequency || frequency > maxFrequency)
+    {
+      messagesRejected.inc();
+      continue;
+    }
+    if (gridTime.fill(timeStamp, frequency))
+    {
+      used++;
+      redraw |= sparkline.insertSample((uint32_t)(GridTimeIntegral::toMs(timeStamp) / 1000), frequency);
+    }
+  }
+  if (!more)
+  {
+    gridTime.endFill();
+  }
+  if (redraw && displayMode == DISPLAY_SPARKLINE)
+  {
+    sparkline.writeTo(displayService);
+  }
+  LOG_I("Backfill: %u of %u samples used in %lld us", used, total, (long long)(esp_timer_get_time() - t0));
 }
 
 // Fetches data from the web service and updates the frequency gauge display
 // If the timestamp has changed, updates the display with the new frequency
-void fetchWebServiceData(uint8_t * payload, size_t length)
+// Only samples from the active source are applied, see SourceSelector
+void fetchWebServiceData(uint8_t source, uint8_t * payload, size_t length)
 {
-  String message = String((char*)payload, length);
-  if (message.length() > 0) 
+  if (length > 0) 
   {
-    Serial.print("Message received via WebSocket: ");
-    Serial.println(message);
+    messagesReceived.inc();
+    bytesReceived.inc(length);
+    LOG_D("Message received via WebSocket (%u bytes)", length);
+
+    if (length > maxMessageBytes)
+    {
+      LOG_W("Message of %u bytes dropped", length);
+      messagesOversized.inc();
+      messagesRejected.inc();
+      return; // Not worth the parse time, nothing valid is that long
+    }
 
-    // Parse the received JSON
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, message);
+    // Parse the received JSON, straight from the payload into the arena
+    int64_t t0 = esp_timer_get_time();
+    jsonArena.reset();
+    JsonDocument doc(&jsonArena);
+    DeserializationError error = deserializeJson(doc, (const char*)payload, length);
+    ingestParseTime.record((uint32_t)(esp_timer_get_time() - t0));
+    jsonArenaHighWater.set(jsonArena.highWater());
 
-    if (!error) 
+    if (!error && doc["backfill"].is<JsonArray>())
+    {
+      ingestBackfill(doc["backfill"], doc["more"] | false);
+    }
+    else if (!error && doc["time_stamp"].is<uint64_t>() && doc["frequency"].is<float>())
     {
       uint64_t newTimestamp = doc["time_stamp"];
       float frequency = doc["frequency"];
@@ -95,78 +339,723 @@ void fetchWebServiceData(uint8_t * payload, size_t length)
       // Integrity check for frequency
       if (frequency < minFrequency || frequency > maxFrequency) 
       {
-        Serial.print("Error: frequency out of range (");
-        Serial.print(frequency);
-        Serial.println(" Hz)");
+        LOG_W("Error: frequency out of range (%.3f Hz)", frequency);
+        messagesRejected.inc();
         return; // Ignore the received value
       }
 
-      // Update only if the timestamp has changed
-      static uint64_t lastTimestamp = 0;
-      if (newTimestamp != lastTimestamp) 
-      {
-        lastTimestamp = newTimestamp;
-
-        Serial.print("New Timestamp: ");
-        Serial.println(lastTimestamp);
-        Serial.print("New Frequency: ");
-        Serial.println(frequency);
-        gaugeFreqMeter.setPosition(frequency); // Update the frequency gauge with the new value
-
-        updateDisplayWithCurrentTime(true, frequency); // Update the display with the new frequency
-      } 
-      else 
+      if (!sourceSelector.onSample(source, newTimestamp))
       {
-        Serial.println("Timestamp unchanged, no update needed.");
+        return; // Standby source, only used for freshness tracking
       }
+
+      lanRelay.broadcast(newTimestamp, frequency); // No-op unless this unit is the LAN relay
+      applySample(newTimestamp, frequency);
     } 
     else 
     {
-      Serial.println("Error parsing JSON from WebSocket message");
+      LOG_W("Malformed JSON message from WebSocket");
+      messagesMalformed.inc();
+      messagesRejected.inc();
     }
   }    
 }
 
-void webSocketEvent(WStype_t type, uint8_t * payload, size_t length)
+// Full clock before the needle moves, so no step is timed at the idle clock
+void needleMotion()
+{
+  powerGovernor.raise(PowerPolicy::ACTIVITY_MOTION);
+}
+
+// Activities that keep the full clock, polled from loop()
+uint8_t powerActivity()
+{
+  uint8_t activity = 0;
+  if (!gaugeFreqMeter.stopped()) activity |= PowerPolicy::ACTIVITY_MOTION;
+  if (displayMode == DISPLAY_SCROLL) activity |= PowerPolicy::ACTIVITY_DISPLAY;
+  return activity;
+}
+
+// Samples rebroadcast by the LAN relay
+void relaySample(uint64_t timeStamp, float frequency)
 {
-  switch(type)
+  if (liveFeedPaused || inputMode != INPUT_REMOTE || traceReplay.active())
+  {
+    return;
+  }
+  if (frequency < minFrequency || frequency > maxFrequency)
   {
-    case WStype_DISCONNECTED:
-      Serial.printf("[WSc] Disconnected!\n");
-      break;
-    case WStype_CONNECTED:
-      Serial.printf("[WSc] Connected to url: %s\n", payload);
+    LOG_W("Relayed frequency out of range (%.3f Hz)", frequency);
+    messagesRejected.inc();
+    return;
+  }
+  applySample(timeStamp, frequency);
+}
 
-      // Send message to server when connected
-      webSocket.sendTXT("Connected");
-      break;
-    case WStype_TEXT:
-      fetchWebServiceData(payload, length); // Fetch data from the web service and update the frequency display
-        
-      break;
-    case WStype_BIN:
-      Serial.printf("[WSc] Received binary length: %u\n", length);
-      break;
-  
-    case WStype_ERROR:	
-      Serial.println("[WSc] WebSocket error detected!");
-      break;	
-    
-    case WStype_PING:
-      Serial.println("[WSc] Ping received from server");
-      break;
-    case WStype_PONG:
-      Serial.println("[WSc] Pong received from server");
-      break;
+// True if this unit may use the GridFreqMonitor connections: no LAN relay or elected relay
+bool upstreamAllowed()
+{
+  return !lanRelay.enabled() || lanRelay.role() == LanRelay::ROLE_RELAY;
+}
+
+// Opens or closes the server connections when the LAN relay role changes
+void relayRoleChanged(LanRelay::Role role)
+{
+  if (!upstreamAllowed())
+  {
+    sourceSelector.pause();
+  }
+  else if (!liveFeedPaused && inputMode == INPUT_REMOTE)
+  {
+    sourceSelector.resume();
+  }
+}
+
+// Text messages from the GridFreqMonitor sources
+void webSocketMessage(uint8_t source, uint8_t * payload, size_t length)
+{
+  if (!liveFeedPaused)
+  {
+    int64_t t0 = esp_timer_get_time();
+    fetchWebServiceData(source, payload, length); // Fetch data from the web service and update the frequency display
+    ingestMessageTime.record((uint32_t)(esp_timer_get_time() - t0));
+  }
+}
+
+// Samples the heap state, the watermark and largest block show fragmentation over time
+void updateHeapMetrics()
+{
+  heapFree.set(ESP.getFreeHeap());
+  heapMinFree.set(ESP.getMinFreeHeap());
+  heapLargestBlock.set(ESP.getMaxAllocHeap());
+}
+
+// Compares the whole strings whatever the first difference, so the time taken does not
+// tell how much of a guess was right
+bool sameToken(const char* given, const char* expected)
+{
+  size_t givenLength = strlen(given);
+  size_t expectedLength = strlen(expected);
+  uint8_t diff = givenLength != expectedLength;
+  for (size_t i = 0; i < expectedLength; i++)
+  {
+    diff |= (uint8_t)(expected[i] ^ given[i < givenLength ? i : 0]);
+  }
+  return diff == 0;
+}
+
+// Requests that write settings or read the device state need the http.token setting (set on
+// the serial console) in a "token" field: any page a LAN user opens can send requests to the
+// device, but cannot know the token. An empty token refuses them all. Answers 403 if refused.
+bool tokenAccepted(WebServer& server)
+{
+  const char* token = configStore.get().httpToken;
+  if (token[0] == '\0' || !sameToken(server.arg("token").c_str(), token))
+  {
+    server.send(403, "application/json", "{\"error\":\"token missing or wrong, see http.token\"}");
+    return false;
+  }
+  return true;
+}
+
+// Serves all registered metrics in Prometheus text format, streamed so the
+// exposition can grow with the registry
+void handleMetrics()
+{
+  WebServer& server = wifiManager.webServer();
+  if (!tokenAccepted(server)) return;
+  ChunkedPrint out(server);
+
+  updateHeapMetrics();
+  out.begin(200, "text/plain; version=0.0.4");
+  Metric::writeAll(out);
+  out.end();
+}
+
+// Streams the recorded trace segments, oldest first
+void handleTrace()
+{
+  WebServer& server = wifiManager.webServer();
+  char path[24];
+  size_t total = 0;
+
+  if (!tokenAccepted(server)) return;
+
+  traceRecorder.sync(500); // Include the samples of the current page
+  for (uint8_t n = 0; n < TraceRecorder::SEGMENT_COUNT; n++)
+  {
+    traceRecorder.segmentPath(n, path, sizeof(path));
+    File f = LittleFS.open(path, "r");
+    if (f)
+    {
+      total += f.size();
+      f.close();
+    }
+  }
+
+  server.sendHeader("Content-Disposition", "attachment; filename=\"trace.bin\"");
+  server.setContentLength(total);
+  server.send(200, "application/octet-stream", "");
+
+  static uint8_t chunk[512];
+  for (uint8_t n = 0; n < TraceRecorder::SEGMENT_COUNT; n++)
+  {
+    traceRecorder.segmentPath(n, path, sizeof(path));
+    File f = LittleFS.open(path, "r");
+    if (!f) continue;
+    size_t len;
+    while ((len = f.read(chunk, sizeof(chunk))) > 0)
+    {
+      server.sendContent((const char*)chunk, len);
+    }
+    f.close();
+  }
+}
+
+// Applies the changed settings that take effect at once
+void configChanged(const Config& config, uint32_t changed)
+{
+  if (changed & (ConfigStore::bit(ConfigStore::KEY_WIFI_SSID) | ConfigStore::bit(ConfigStore::KEY_WIFI_PASSWORD)))
+  {
+    wifiManager.setCredentials(config.wifiSsid, config.wifiPassword);
+  }
+  if (changed & ConfigStore::bit(ConfigStore::KEY_TIME_ZONE))
+  {
+    setenv("TZ", config.timeZone, 1);
+    tzset();
+  }
+  if (changed & ConfigStore::bit(ConfigStore::KEY_BRIGHTNESS))
+  {
+    displayService.setBrightness(config.brightness);
+  }
+  if (changed & ConfigStore::bit(ConfigStore::KEY_ACCEL_PROFILE))
+  {
+    gaugeFreqMeter.setAccelProfile(config.accelProfile); // or by loop() once the needle stops
+  }
+  if (changed & ConfigStore::bit(ConfigStore::KEY_LAN_RELAY))
+  {
+    if (config.lanRelay)
+    {
+      lanRelay.begin(relaySample, relayRoleChanged);
+    }
+    else
+    {
+      lanRelay.end();
+    }
+  }
+  if (changed & (ConfigStore::bit(ConfigStore::KEY_SERVER) | ConfigStore::bit(ConfigStore::KEY_PORT)))
+  {
+    strlcpy(configuredServer, config.server, sizeof(configuredServer));
+    sourceSelector.setPort(config.port);
+    sourceSelector.reconnect(); // the backfill start is kept, the new server fills the gap
+  }
+  if (changed & ConfigStore::bit(ConfigStore::KEY_POWER_SAVING))
+  {
+    LOG_W("Config: power saving applies at the next start");
+  }
+}
+
+// Credentials entered on the access point page
+void saveWifiCredentials(const char* ssid, const char* password)
+{
+  Config config = configStore.get();
+  strlcpy(config.wifiSsid, ssid, sizeof(config.wifiSsid));
+  strlcpy(config.wifiPassword, password, sizeof(config.wifiPassword));
+  configStore.commit(config);
+}
+
+// GET: all settings as JSON (secrets masked). POST: form fields key=value, committed as one
+// batch, with the token.
+void handleConfig()
+{
+  WebServer& server = wifiManager.webServer();
+  static char body[1024];
+
+  if (server.method() == HTTP_POST)
+  {
+    if (!tokenAccepted(server)) return;
+    Config config = configStore.get();
+    for (int i = 0; i < server.args(); i++)
+    {
+      String key = server.argName(i);
+      if (key == "plain" || key == "token") continue; // raw body (fields parsed already), credential
+      const char* error;
+      if (!ConfigStore::set(config, key.c_str(), server.arg(i).c_str(), &error))
+      {
+        snprintf(body, sizeof(body), "{\"error\":\"%s: %s\"}", key.c_str(), error);
+        server.send(400, "application/json", body);
+        return;
+      }
+    }
+    configStore.commit(config);
+  }
+  configStore.writeJson(body, sizeof(body));
+  server.send(200, "application/json", body);
+}
+
+// Sets one setting from the console and commits it
+bool setConfig(const char* key, const char* value)
+{
+  Config config = configStore.get();
+  const char* error;
+  if (!ConfigStore::set(config, key, value, &error))
+  {
+    Serial.printf("%s: %s\n", key, error);
+    return false;
+  }
+  configStore.commit(config);
+  return true;
+}
+
+// --------------------- SERIAL CONSOLE ---------------------
+
+void printHelp(int argc, char* argv[]);
+
+// Stops applying live samples so a manual needle position is kept
+void pauseLiveFeed()
+{
+  if (!liveFeedPaused)
+  {
+    liveFeedPaused = true;
+    sourceSelector.pause();
+    Serial.println("Live feed paused, type 'resume' to reconnect");
+  }
+}
+
+void cmdStats(int argc, char* argv[])
+{
+  updateHeapMetrics();
+  Metric::writeAll(Serial);
+}
+
+// Value of a registered counter, 0 if unknown or not a counter
+uint32_t counterValue(const char* name)
+{
+  const Counter* c = Counter::find(name);
+  return c ? c->value() : 0;
+}
 
-    case WStype_FRAGMENT_TEXT_START:
-    case WStype_FRAGMENT_BIN_START:
-    case WStype_FRAGMENT:
-    case WStype_FRAGMENT_FIN:
-        break;
+void printBench(const char* name, int64_t elapsedUs, int iterations)
+{
+  Serial.printf("  %-22s %9.2f us/call\n", name, (double)elapsedUs / iterations);
+}
+
+// On-device micro-benchmarks of the hot paths: per call time and operation counts
+void cmdBench(int argc, char* argv[])
+{
+  static const char sample[] = "{\"time_stamp\": 1718000000, \"frequency\": 49.987}";
+  const int iterations = (argc > 1) ? atoi(argv[1]) : 100;
+  if (iterations <= 0)
+  {
+    Serial.println("Usage: bench [iterations]");
+    return;
+  }
+
+  int64_t t0 = esp_timer_get_time();
+  for (int i = 0; i < iterations; i++)
+  {
+    jsonArena.reset();
+    JsonDocument doc(&jsonArena);
+    deserializeJson(doc, sample, sizeof(sample) - 1);
+  }
+  printBench("json parse", esp_timer_get_time() - t0, iterations);
+
+  volatile unsigned int step = 0;
+  t0 = esp_timer_get_time();
+  for (int i = 0; i < iterations; i++)
+  {
+    step = GaugeFreqMeter<ActiveGrid>::frequencyToStep(minFrequency + (maxFrequency - minFrequency) * i / iterations);
+  }
+  printBench("frequency to step", esp_timer_get_time() - t0, iterations);
+  (void)step;
+
+  displayService.suspend(); // the driver is used directly below
+  uint32_t bytes0 = counterValue("display_bytes_total");
+  uint32_t gpio0 = counterValue("display_gpio_writes_total");
+  t0 = esp_timer_get_time();
+  for (int i = 0; i < iterations; i++)
+  {
+    display.print("88:88:88");
+  }
+  printBench("display print", esp_timer_get_time() - t0, iterations);
+  Serial.printf("  %-22s %9u bytes, %u gpio writes per call\n", "",
+                (unsigned)((counterValue("display_bytes_total") - bytes0) / iterations),
+                (unsigned)((counterValue("display_gpio_writes_total") - gpio0) / iterations));
+
+  t0 = esp_timer_get_time();
+  for (int i = 0; i < iterations; i++)
+  {
+    display.printDirect(calibFrame.columns, calibFrame.size()); // same bytes, no font lookups
+  }
+  printBench("display static frame", esp_timer_get_time() - t0, iterations);
+
+  static const uint8_t blankColumns[40] = {};
+  t0 = esp_timer_get_time();
+  for (int i = 0; i < iterations; i++)
+  {
+    display.printDirect(blankColumns, sizeof(blankColumns));
+  }
+  int64_t elapsed = esp_timer_get_time() - t0;
+  printBench("display printDirect", elapsed, iterations);
+  printBench("display sendByte", elapsed, iterations * (int)sizeof(blankColumns));
+
+  // Framebuffer updates: a clean frame sends nothing, a dirty one the whole chain
+  bytes0 = counterValue("display_bytes_total");
+  t0 = esp_timer_get_time();
+  for (int i = 0; i < iterations; i++)
+  {
+    display.printAt(display.numChars() - 1, (i & 1) ? "8" : "0");
+    display.update();
+  }
+  printBench("display update (1 char)", esp_timer_get_time() - t0, iterations);
+  Serial.printf("  %-22s %9u bytes per call\n", "", (unsigned)((counterValue("display_bytes_total") - bytes0) / iterations));
+  bytes0 = counterValue("display_bytes_total");
+  t0 = esp_timer_get_time();
+  for (int i = 0; i < iterations; i++)
+  {
+    display.update();
+  }
+  printBench("display update (clean)", esp_timer_get_time() - t0, iterations);
+  Serial.printf("  %-22s %9u bytes per call\n", "", (unsigned)((counterValue("display_bytes_total") - bytes0) / iterations));
+
+  // Control round trip: one device dimmed switches the chain to serial mode,
+  // restoring it switches back to simultaneous mode
+  const uint8_t brightness = configStore.get().brightness;
+  display.setBrightness(brightness);
+  bytes0 = counterValue("display_bytes_total");
+  t0 = esp_timer_get_time();
+  for (int i = 0; i < iterations; i++)
+  {
+    display.setBrightness(0, brightness ^ 1);
+    display.setBrightness(0, brightness);
+  }
+  printBench("display control trip", esp_timer_get_time() - t0, iterations);
+  Serial.printf("  %-22s %9u bytes per trip\n", "",
+                (unsigned)((counterValue("display_bytes_total") - bytes0) / iterations));
+
+  // Dirty frame cost for longer chains: a driver for a longer chain on the
+  // same pins shifts the full frame, the bytes past the real chain fall out
+  // of its far end and the resume below resends the real frame
+  for (unsigned int chars = HCMS39xx::CHARS_PER_DEVICE * 2; chars <= HCMS39xx::MAX_CHARS; chars *= 2)
+  {
+    HCMS39xx chain(chars, D10, D2, D8, D0, D3);
+    chain.clear();
+    t0 = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++)
+    {
+      uint8_t column = (i & 1) ? 0x7F : 0x00;
+      chain.writeColumns(0, &column, 1); // dirty, so every call shifts the whole chain
+      chain.update();
+    }
+    elapsed = esp_timer_get_time() - t0;
+    char name[24];
+    snprintf(name, sizeof(name), "%u char chain%s", chars, chars == display.numChars() ? " (this)" : "");
+    Serial.printf("  %-22s %9.2f us/frame, %u bytes\n", name, (double)elapsed / iterations,
+                  chars * HCMS39xx::COLUMNS_PER_CHAR);
+  }
+
+  displayService.resume(); // resends the frame and settings the bench overwrote
+  updateDisplayWithCurrentTime(false, 0.0f); // Restore the clock
+}
+
+void cmdClock(int argc, char* argv[])
+{
+  if (argc > 1 && strcmp(argv[1], "real") == 0)
+  {
+    appClock.runReal();
+  }
+  else if (argc > 1)
+  {
+    // clock <speed> [epoch seconds]: virtual clock, from now if no start is given
+    long speed = atol(argv[1]);
+    uint64_t start = (argc > 2) ? strtoull(argv[2], nullptr, 10) * 1000 : appClock.epochMs();
+    if (speed < 1 || speed > 10000)
+    {
+      Serial.println("Usage: clock [real | <speed 1..10000> [epoch]]");
+      return;
+    }
+    appClock.runVirtual(start, (uint16_t)speed);
+  }
+  Serial.printf("Clock: %s x%u, epoch %lld\n", appClock.isVirtual() ? "virtual" : "real",
+                appClock.speed(), (long long)appClock.now());
+}
+
+void cmdHeap(int argc, char* argv[])
+{
+  updateHeapMetrics();
+  int32_t freeBytes = heapFree.value();
+  int32_t largest = heapLargestBlock.value();
+  Serial.printf("Heap free: %d, min free: %d, largest block: %d, fragmentation: %d%%\n",
+                (int)freeBytes, (int)heapMinFree.value(), (int)largest,
+                freeBytes > 0 ? (int)(100 - (int64_t)largest * 100 / freeBytes) : 0);
+  Serial.printf("JSON arena: %u/%u bytes peak, %u failures\n",
+                (unsigned)jsonArena.highWater(), (unsigned)jsonArena.capacity(), (unsigned)jsonArena.failures());
+}
+
+void cmdFrequency(int argc, char* argv[])
+{
+  char* end = nullptr;
+  float freq = (argc > 1) ? strtof(argv[1], &end) : 0.0f;
+  if (argc < 2 || end == argv[1])
+  {
+    Serial.println("Usage: f <frequency>");
+    return;
+  }
+  Serial.printf("Frequency = %.3f\n", freq);
+  pauseLiveFeed();
+  gaugeFreqMeter.setPosition(freq);
+}
+
+void cmdPosition(int argc, char* argv[])
+{
+  char* end = nullptr;
+  unsigned long pos = (argc > 1) ? strtoul(argv[1], &end, 10) : 0;
+  if (argc < 2 || end == argv[1])
+  {
+    Serial.println("Usage: p <step>");
+    return;
+  }
+  Serial.printf("Position = %lu\n", pos);
+  pauseLiveFeed();
+  gaugeFreqMeter.setStep(pos);
+}
+
+void cmdCalibrate(int argc, char* argv[])
+{
+  Serial.println("Calibrating needle...");
+  gaugeFreqMeter.reset();
+  Serial.println("Done");
+}
+
+void cmdLogLevel(int argc, char* argv[])
+{
+  Logger::Level level = logger.level();
+  if (argc > 1 && !Logger::levelFromName(argv[1], level))
+  {
+    Serial.println("Usage: log <none|error|warn|info|debug>");
+    return;
+  }
+  if (argc > 1)
+  {
+    logger.setLevel(level);
+  }
+  Serial.printf("Log level: %s\n", Logger::levelName(logger.level()));
+}
+
+void cmdAccel(int argc, char* argv[])
+{
+  if (argc > 1 && !setConfig("accel", argv[1]))
+  {
+    Serial.println("Profiles:");
+    for (unsigned int i = 0; GaugeNeedle::accelProfileName(i) != nullptr; i++)
+    {
+      Serial.printf("  %s\n", GaugeNeedle::accelProfileName(i));
+    }
+    return;
+  }
+  const char* wanted = configStore.get().accelProfile;
+  bool pending = strcmp(gaugeFreqMeter.accelProfile(), wanted) != 0;
+  Serial.printf("Accel profile: %s%s%s\n", gaugeFreqMeter.accelProfile(), pending ? ", when the needle stops: " : "", pending ? wanted : "");
+}
+
+void cmdTimer(int argc, char* argv[])
+{
+  if (argc > 1 && !gaugeFreqMeter.setStepTimer(argv[1]))
+  {
+    Serial.println("Unknown timer (esp|hw|rmt), needle moving or timer unavailable");
+    return;
+  }
+  Serial.printf("Step timer: %s\n", gaugeFreqMeter.stepTimer());
+}
+
+void cmdResume(int argc, char* argv[])
+{
+  traceReplay.stop();
+  liveFeedPaused = false;
+  if (inputMode == INPUT_REMOTE && upstreamAllowed())
+  {
+    sourceSelector.resume();
+  }
+  Serial.println("Live feed resumed");
+}
+
+void cmdTrace(int argc, char* argv[])
+{
+  if (argc > 1 && strcmp(argv[1], "clear") == 0)
+  {
+    traceRecorder.clear();
+  }
+  traceRecorder.printStatus(Serial);
+}
+
+void cmdReplay(int argc, char* argv[])
+{
+  if (argc > 1 && strcmp(argv[1], "stop") == 0)
+  {
+    traceReplay.stop();
+    return;
+  }
+  long speed = (argc > 1) ? atol(argv[1]) : 1;
+  if (speed < 1 || speed > 10000)
+  {
+    Serial.println("Usage: replay [speed 1..10000 | stop]");
+    return;
+  }
+  pauseLiveFeed();
+  traceRecorder.sync(500);
+  if (!traceReplay.start(traceRecorder, (uint16_t)speed, applySample))
+  {
+    Serial.println("No trace recorded");
   }
 }
 
+void cmdInput(int argc, char* argv[])
+{
+  if (argc > 1 && strcmp(argv[1], "local") == 0 && inputMode != INPUT_LOCAL)
+  {
+    sourceSelector.pause();
+    mainsMeter.begin(mainsSensePin);
+    inputMode = INPUT_LOCAL;
+  }
+  else if (argc > 1 && strcmp(argv[1], "remote") == 0 && inputMode != INPUT_REMOTE)
+  {
+    mainsMeter.end();
+    if (!liveFeedPaused && upstreamAllowed())
+    {
+      sourceSelector.resume();
+    }
+    inputMode = INPUT_REMOTE;
+  }
+  Serial.printf("Input: %s\n", inputMode == INPUT_LOCAL ? "local" : "remote");
+}
+
+void cmdShow(int argc, char* argv[])
+{
+  if (argc > 1 && strcmp(argv[1], "clock") == 0)
+  {
+    displayMode = DISPLAY_CLOCK;
+    displayService.clear();
+    updateDisplayWithCurrentTime(false, 0.0f);
+  }
+  else if (argc > 1 && strcmp(argv[1], "spark") == 0)
+  {
+    displayMode = DISPLAY_SPARKLINE;
+    sparkline.writeTo(displayService);
+  }
+  else if (argc > 2 && strcmp(argv[1], "scroll") == 0)
+  {
+    scroller.setMessage(argv[2]); // the text as typed (restOfLine)
+    displayMode = DISPLAY_SCROLL;
+  }
+  else if (argc > 1)
+  {
+    Serial.println("Usage: show [clock | spark | scroll <text>]");
+    return;
+  }
+  Serial.printf("Display: %s\n", displayMode == DISPLAY_CLOCK ? "clock" : displayMode == DISPLAY_SPARKLINE ? "spark" : scroller.message());
+}
+
+void cmdLive(int argc, char* argv[])
+{
+  livePush.printStatus(Serial);
+}
+
+void cmdRelay(int argc, char* argv[])
+{
+  if (argc > 1 && !setConfig("relay", argv[1]))
+  {
+    Serial.println("Usage: relay [on|off]");
+    return;
+  }
+  lanRelay.printStatus(Serial);
+}
+
+void cmdGridTime(int argc, char* argv[])
+{
+  gridTime.printStatus(Serial);
+}
+
+void cmdTime(int argc, char* argv[])
+{
+  timeKeeper.printStatus(Serial);
+}
+
+void cmdPower(int argc, char* argv[])
+{
+  powerGovernor.printStatus(Serial);
+}
+
+void cmdPredict(int argc, char* argv[])
+{
+  if (argc > 1 && !setConfig("predict", argv[1]))
+  {
+    Serial.println("Usage: predict [on|off]");
+    return;
+  }
+  Serial.printf("Needle: %s, estimate %.4f Hz, trend %+.2f mHz/s, %u restarts\n",
+                configStore.get().predictiveNeedle ? "predictive" : "direct", needlePredictor.frequency(),
+                needlePredictor.trend() * 1000.0f, (unsigned)needlePredictor.resets());
+}
+
+void cmdConfig(int argc, char* argv[])
+{
+  if (argc == 2)
+  {
+    Serial.println("Usage: config [<key> <value>]");
+    return;
+  }
+  if (argc > 2)
+  {
+    if (!setConfig(argv[1], argv[2])) return; // the value as typed (restOfLine)
+  }
+  configStore.printStatus(Serial);
+}
+
+void cmdDisplay(int argc, char* argv[])
+{
+  displayService.printStatus(Serial);
+}
+
+void cmdSources(int argc, char* argv[])
+{
+  sourceSelector.printStatus(Serial);
+}
+
+const Console::Command consoleCommands[] = {
+  { "help",   printHelp,     "list commands" },
+  { "stats",  cmdStats,      "print metrics" },
+  { "heap",   cmdHeap,       "print heap watermark and fragmentation" },
+  { "bench",  cmdBench,      "bench [n]: time the parse, mapping and display hot paths" },
+  { "clock",  cmdClock,      "clock [real | <speed> [epoch]]: run the application clock virtually" },
+  { "f",      cmdFrequency,  "f <Hz>: move the needle to a frequency (pauses live feed)" },
+  { "p",      cmdPosition,   "p <step>: move the needle to a step (pauses live feed)" },
+  { "calib",  cmdCalibrate,  "recalibrate the needle zero" },
+  { "log",    cmdLogLevel,   "log [level]: show or set the log level" },
+  { "accel",  cmdAccel,      "accel [profile]: show or select the acceleration profile" },
+  { "timer",  cmdTimer,      "timer [esp|hw|rmt]: show or select the step timer backend" },
+  { "resume", cmdResume,     "resume the live WebSocket feed" },
+  { "show",   cmdShow,       "show [clock | spark | scroll <text>]: alphanumeric display content", 2 },
+  { "live",   cmdLive,       "live push (SSE) subscribers and their queues" },
+  { "relay",  cmdRelay,      "relay [on|off]: LAN relay role, one upstream connection for all units" },
+  { "gridtime", cmdGridTime, "grid time deviation integrated over the samples, pending gap" },
+  { "time",   cmdTime,       "clock source, last SNTP sync and correction" },
+  { "power",  cmdPower,      "power state, CPU clock and time per state" },
+  { "config", cmdConfig,     "config [<key> <value>]: show or change a stored setting", 2 },
+  { "predict", cmdPredict,   "predict [on|off]: needle sent ahead along the frequency trend" },
+  { "display", cmdDisplay,   "display service commands and coalesced writes" },
+  { "sources", cmdSources,   "list GridFreqMonitor sources, latency and freshness" },
+  { "trace",  cmdTrace,      "trace [clear]: recorded sample trace status" },
+  { "replay", cmdReplay,     "replay [speed | stop]: play the recorded trace (pauses live feed)" },
+  { "input",  cmdInput,      "input [remote|local]: servers or local zero crossing measurement" },
+};
+
+Console console(consoleCommands, sizeof(consoleCommands) / sizeof(*consoleCommands));
+
+void printHelp(int argc, char* argv[])
+{
+  console.printHelp();
+}
+
 // --------------------- MAIN FUNCTIONS ---------------------
 
 void setup() 
@@ -174,26 +1063,48 @@ void setup()
   
   Serial.begin(115200);
   Serial.println("Start");
+  logger.begin(Serial);
+  console.begin(Serial);
+
+  // Settings in one NVS pass, before anything uses them
+  configStore.begin();
+  const Config& config = configStore.get();
+  strlcpy(configuredServer, config.server, sizeof(configuredServer));
+  sourceSelector.setPort(config.port);
 
-  wifiManager.begin();
+  // Clock and drift state from before the reset, so the first frame is right
+  setenv("TZ", config.timeZone, 1);
+  tzset();
+  timeKeeper.begin(gridTime);
+
+  wifiManager.onCredentials(saveWifiCredentials);
+  wifiManager.begin(config.wifiSsid, config.wifiPassword);
+  wifiManager.webServer().on("/metrics", handleMetrics);
+  wifiManager.webServer().on("/config", handleConfig);
+  wifiManager.webServer().on("/trace", handleTrace);
+  traceRecorder.begin();
+  livePush.begin(); // Server-Sent Events for LAN dashboards on port 81
 
   // clear the NVS partition (and all preferences stored in it)
   //nvs_flash_erase(); // erase the NVS partition and...
   //nvs_flash_init(); // initialize the NVS partition.
 
 
-  // Configure the timezone for Paris (UTC+1 with automatic daylight saving time adjustment)
-  configTime(3600, 3600, "pool.ntp.org", "time.nist.gov", "time.google.com"); // UTC+1 offset, daylight saving enabled
+  timeKeeper.startSync(); // SNTP in the background, all servers at once
 
   gaugeFreqMeter.begin(D4, D5, D1);
+  gaugeFreqMeter.onMotion(needleMotion);
+  gaugeFreqMeter.setAccelProfile(config.accelProfile);
 
   delay(100);
 
   display.begin();
   display.clear();
-  display.displayUnblank();
+  displayService.begin();
+  displayService.setBrightness(config.brightness);
+  displayService.blank(false);
 
-  display.print("- MDNS -"); 
+  displayService.printDirect(mdnsFrame.columns, mdnsFrame.size());
   while(mdns_init()!= ESP_OK){
     delay(1000);
     Serial.println("Starting MDNS...");
@@ -201,22 +1112,29 @@ void setup()
  
   Serial.println("MDNS started");
  
-  IPAddress serverIp;
-  display.print("- HOST -"); 
-  while (serverIp.toString() == "0.0.0.0") 
+  displayService.printDirect(hostFrame.columns, hostFrame.size());
+  while (!sourceSelector.resolve()) 
   {
-    Serial.println("Resolving host...");
+    Serial.println("Resolving hosts...");
     delay(250);
-    serverIp = MDNS.queryHost(serverName);
   }
 
 
-  display.print("-CALIB -"); // Display "START" at startup
+  displayService.printDirect(calibFrame.columns, calibFrame.size());
   gaugeFreqMeter.reset(); // Reset the frequency gauge
 
-  webSocket.begin(serverIp, websocketPort, "/"); // Start the WebSocket client
-  webSocket.onEvent(webSocketEvent);
-  webSocket.setReconnectInterval(5000); // Reconnect every 5 seconds if disconnected
+  sourceSelector.resumeFrom(gridTime.state().lastTimeStamp); // Backfill what was missed during the reset
+  sourceSelector.begin(webSocketMessage); // Start the WebSocket clients
+
+  if (config.powerSaving)
+  {
+    powerGovernor.begin(true); // Light sleep only if the framework has tickless idle
+  }
+  if (config.lanRelay)
+  {
+    lanRelay.begin(relaySample, relayRoleChanged); // Starts as listener, servers closed until elected
+  }
+  configStore.onChange(configChanged); // Later edits apply live
 
 }
 
@@ -224,36 +1142,24 @@ void loop()
 {
   static unsigned long lastFetch = 0;
   static unsigned long lastDisplayUpdate = 0;
-  static String serialBuffer = "";
-
-  // Lecture des caractères reçus sur la liaison série
-  while (Serial.available()) {
-    char c = Serial.read();
-    if (c == '\n' || c == '\r') {
-      // Fin de ligne reçue, on traite la commande
-      serialBuffer.trim();
-      if (serialBuffer.startsWith("f=")) {
-        float freq = serialBuffer.substring(2).toFloat();
-        Serial.print("Commande série reçue, fréquence = ");
-        Serial.println(freq);
-        webSocket.disconnect(); // Arrêter le service WebSocket
-        gaugeFreqMeter.setPosition(freq); // Envoyer la valeur à l'aiguille
-      }
+  static unsigned long lastHeapReport = 0;
+  static unsigned long lastTraceSync = 0;
+  static unsigned long lastScrollFrame = 0;
+  static unsigned long lastLiveStats = 0;
 
-      else if (serialBuffer.startsWith("p=")) {
-        int pos = serialBuffer.substring(2).toInt();
-        Serial.print("Commande série reçue, pos = ");
-        Serial.println(pos);
-        webSocket.disconnect(); // Arrêter le service WebSocket
-        gaugeFreqMeter.setStep(pos); // Envoyer la valeur à l'aiguille
-      }  
-      serialBuffer = ""; // Réinitialiser le buffer
-    } else {
-      serialBuffer += c;
-    }
+  console.poll(); // Handle serial commands
+  livePush.loop(); // Write queued frames to the live subscribers, never blocks
+  timeKeeper.loop(); // Keep the drift state for the next reset
+  powerGovernor.update(powerActivity()); // Lower the clock once the needle and display are idle
+
+  // A new acceleration profile is taken once the needle has stopped
+  if (strcmp(gaugeFreqMeter.accelProfile(), configStore.get().accelProfile) != 0)
+  {
+    gaugeFreqMeter.setAccelProfile(configStore.get().accelProfile);
   }
 
   if (millis() - lastFetch > 500) { // Fetch data every 500ms
+    updateHeapMetrics();
     if(wifiManager.checkWiFiConnection())
     {
       //Serial.println("WiFi connected");
@@ -264,11 +1170,63 @@ void loop()
     }
   }
 
+  // Report the heap state every 10 minutes so fragmentation shows up in field logs
+  if (millis() - lastHeapReport > 600000UL)
+  {
+    lastHeapReport = millis();
+    LOG_I("Heap free: %d min free: %d largest block: %d", heapFree.value(), heapMinFree.value(), heapLargestBlock.value());
+  }
+
+  // Push the partially filled trace page to flash every 5 minutes
+  if (millis() - lastTraceSync > 300000UL)
+  {
+    lastTraceSync = millis();
+    traceRecorder.sync(0);
+  }
+
   // Update the display every second
-  if (millis() - lastDisplayUpdate > 1000) 
+  if (appClock.millis() - lastDisplayUpdate > 1000) 
   {
     lastDisplayUpdate = updateDisplayWithCurrentTime(false, 0.0f); // Update the display with the current time
   }
-  webSocket.loop(); // Handle WebSocket events
-  delay(100);
+  // Periodic stats event for the live subscribers
+  if (millis() - lastLiveStats > liveStatsPeriodMs)
+  {
+    lastLiveStats = millis();
+    livePush.publish("stats", "{\"heap_free\":%d,\"messages\":%u,\"rejected\":%u,\"motor_steps\":%u,\"live_clients\":%u}",
+                     (int)heapFree.value(), (unsigned)messagesReceived.value(), (unsigned)messagesRejected.value(),
+                     (unsigned)counterValue("motor_steps_total"), (unsigned)livePush.clients());
+  }
+
+  // Scroll the message by one column per frame
+  if (displayMode == DISPLAY_SCROLL && millis() - lastScrollFrame >= scrollFramePeriodMs)
+  {
+    lastScrollFrame = millis();
+    uint8_t column = scroller.nextColumn(displayService.numChars() * HCMS39xx::COLUMNS_PER_CHAR);
+    displayService.printDirect(&column, 1);
+  }
+
+  if (traceReplay.active())
+  {
+    if (!traceReplay.poll())
+    {
+      Serial.println("Replay done, type 'resume' to go back to live data");
+    }
+  }
+  else if (!liveFeedPaused)
+  {
+    if (inputMode == INPUT_REMOTE)
+    {
+      lanRelay.loop(); // Relay frames and election, no-op when disabled
+      if (upstreamAllowed())
+      {
+        sourceSelector.loop(); // Handle WebSocket events, failover and reconnects after a pause
+      }
+    }
+    else
+    {
+      pollLocalMeasurement();
+    }
+  }
+  delay(displayMode == DISPLAY_SCROLL ? 5 : 100); // Shorter sleep while animating
 }
\ No newline at end of file
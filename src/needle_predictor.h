@@ -0,0 +1,73 @@
+#ifndef NEEDLE_PREDICTOR_H
+#define NEEDLE_PREDICTOR_H
+
+#include <stdint.h>
+
+// Alpha-beta estimate of the frequency and its trend over the sample time
+// stamps, free of hardware calls so it can be run on the host
+// (tools/needle_replay.py mirrors it).
+//
+// predict() extrapolates the estimate by a lead time: the age of the
+// sample when it was applied plus the time the needle takes to get there,
+// so the needle is sent where the frequency will be when it arrives
+// instead of where it was. The extrapolation is capped so a noisy trend
+// cannot swing the needle past the dial movement of a real ramp.
+
+class NeedlePredictor
+{
+public:
+    enum { RESET_GAP_MS = 10000 };          // longer gaps restart the estimate
+    static constexpr float MAX_TREND_HZ_S = 0.05f;
+    static constexpr float MAX_EXTRAPOLATION_HZ = 0.03f;
+
+    NeedlePredictor(float alpha, float beta) : _alpha(alpha), _beta(beta) {}
+
+    // A new sample, time stamp in ms. Repeated or slightly out of order time
+    // stamps are ignored, a jump back (trace replay) restarts the estimate.
+    void add(uint64_t timeMs, float frequency)
+    {
+        if (_started && timeMs <= _lastMs && _lastMs - timeMs < RESET_GAP_MS) return;
+        if (!_started || timeMs <= _lastMs || timeMs - _lastMs > RESET_GAP_MS)
+        {
+            _frequency = frequency;
+            _trend = 0.0f;
+            _started = true;
+            _resets++;
+        }
+        else
+        {
+            float dt = (timeMs - _lastMs) / 1000.0f;
+            float predicted = _frequency + _trend * dt;
+            float residual = frequency - predicted;
+            _frequency = predicted + _alpha * residual;
+            _trend = clamp(_trend + _beta * residual / dt, MAX_TREND_HZ_S);
+        }
+        _lastMs = timeMs;
+    }
+
+    // Estimated frequency leadMs after the last sample
+    float predict(uint32_t leadMs) const
+    {
+        return _frequency + clamp(_trend * leadMs / 1000.0f, MAX_EXTRAPOLATION_HZ);
+    }
+
+    float frequency() const { return _frequency; }
+    float trend() const { return _trend; }          // Hz/s
+    uint32_t resets() const { return _resets; }
+
+private:
+    static float clamp(float value, float limit)
+    {
+        return value > limit ? limit : (value < -limit ? -limit : value);
+    }
+
+    float _alpha;
+    float _beta;
+    bool _started = false;
+    uint64_t _lastMs = 0;
+    float _frequency = 0.0f;
+    float _trend = 0.0f;
+    uint32_t _resets = 0;
+};
+
+#endif
@@ -0,0 +1,123 @@
+#include "power_governor.h"
+#include <WiFi.h>
+#include "Metrics.h"
+#include "Logger.h"
+#ifdef CONFIG_PM_ENABLE
+#include <esp_pm.h>
+#if CONFIG_IDF_TARGET_ESP32C3
+#include <esp32c3/pm.h>
+typedef esp_pm_config_esp32c3_t PmConfig;
+#else
+#include <esp32/pm.h>
+typedef esp_pm_config_esp32_t PmConfig;
+#endif
+#endif
+
+static Gauge powerState("power_state", "Power state (0 active, full clock; 1 idle, scaled down)");
+static Counter powerTransitions("power_transitions_total", "Power state changes");
+static Counter powerActiveTime("power_active_ms_total", "Time spent at full clock");
+static Counter powerIdleTime("power_idle_ms_total", "Time spent idle (clock scaled down, modem sleep)");
+
+// 160 MHz while active, down to the 40 MHz crystal when idle, 2 s after the last activity
+PowerGovernor powerGovernor(160, 40, 2000);
+
+PowerGovernor::PowerGovernor(uint16_t maxMhz, uint16_t minMhz, uint32_t holdMs)
+    : _policy(holdMs), _maxMhz(maxMhz), _minMhz(minMhz)
+{
+}
+
+bool PowerGovernor::begin(bool lightSleep)
+{
+    // Modem sleep is the Wi-Fi driver's own, it needs no power management
+    _modemSleep = WiFi.setSleep(true);
+#ifdef CONFIG_PM_ENABLE
+    esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "power_cpu", (esp_pm_lock_handle_t*)&_cpuLock);
+    esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "power_apb", (esp_pm_lock_handle_t*)&_apbLock);
+    esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "power_awake", (esp_pm_lock_handle_t*)&_noSleepLock);
+    apply(_policy.state()); // hold the locks before scaling is allowed
+
+    PmConfig config = {};
+    config.max_freq_mhz = _maxMhz;
+    config.min_freq_mhz = _minMhz;
+    config.light_sleep_enable = lightSleep;
+    esp_err_t err = esp_pm_configure(&config);
+    if (err != ESP_OK && lightSleep)
+    {
+        // light sleep needs tickless idle in the framework build
+        LOG_W("Light sleep unavailable (%d), frequency scaling only", err);
+        config.light_sleep_enable = false;
+        lightSleep = false;
+        err = esp_pm_configure(&config);
+    }
+    if (err != ESP_OK)
+    {
+        LOG_W("Power management unavailable (%d)", err);
+        return false;
+    }
+    _lightSleep = lightSleep;
+    _enabled = true;
+    LOG_I("Power governor: %u-%u MHz%s", _minMhz, _maxMhz, lightSleep ? ", light sleep" : "");
+    return true;
+#else
+    (void)lightSleep;
+    LOG_W("CONFIG_PM_ENABLE is off in the framework build: fixed clock, modem sleep only");
+    return false;
+#endif
+}
+
+void PowerGovernor::update(uint8_t activity)
+{
+    PowerPolicy::State before = _policy.state();
+    PowerPolicy::State state = _policy.update(activity, millis());
+    if (state != before)
+    {
+        apply(state);
+        powerTransitions.inc();
+        powerState.set(state);
+    }
+
+    // Export the accounted time as counters
+    for (uint8_t s = 0; s < PowerPolicy::STATE_COUNT; s++)
+    {
+        uint32_t total = _policy.timeInMs((PowerPolicy::State)s);
+        Counter& counter = (s == PowerPolicy::STATE_ACTIVE) ? powerActiveTime : powerIdleTime;
+        counter.inc(total - _reportedMs[s]);
+        _reportedMs[s] = total;
+    }
+}
+
+void PowerGovernor::apply(PowerPolicy::State state)
+{
+#ifdef CONFIG_PM_ENABLE
+    bool lock = (state == PowerPolicy::STATE_ACTIVE);
+    if (lock == _locked || _cpuLock == nullptr) return;
+    if (lock)
+    {
+        esp_pm_lock_acquire((esp_pm_lock_handle_t)_cpuLock);
+        esp_pm_lock_acquire((esp_pm_lock_handle_t)_apbLock);
+        esp_pm_lock_acquire((esp_pm_lock_handle_t)_noSleepLock);
+    }
+    else
+    {
+        esp_pm_lock_release((esp_pm_lock_handle_t)_noSleepLock);
+        esp_pm_lock_release((esp_pm_lock_handle_t)_apbLock);
+        esp_pm_lock_release((esp_pm_lock_handle_t)_cpuLock);
+    }
+    _locked = lock;
+#else
+    (void)state;
+#endif
+}
+
+void PowerGovernor::printStatus(Print& out) const
+{
+    uint32_t active = _policy.timeInMs(PowerPolicy::STATE_ACTIVE);
+    uint32_t idle = _policy.timeInMs(PowerPolicy::STATE_IDLE);
+    uint32_t total = active + idle;
+    out.printf("Power: %s%s, %s, CPU %u MHz\n", _enabled ? (_lightSleep ? "scaling + light sleep" : "scaling") : "fixed clock",
+               _modemSleep ? ", modem sleep" : "", _policy.state() == PowerPolicy::STATE_ACTIVE ? "active" : "idle",
+               (unsigned)getCpuFrequencyMhz());
+    out.printf("  active %lu s (%u%%), idle %lu s, %u transitions\n", (unsigned long)(active / 1000),
+               total ? (unsigned)((uint64_t)active * 100 / total) : 0, (unsigned long)(idle / 1000),
+               (unsigned)_policy.transitions());
+}
@@ -0,0 +1,59 @@
+#ifndef POWER_GOVERNOR_H
+#define POWER_GOVERNOR_H
+
+#include <Arduino.h>
+#include "power_policy.h"
+
+// Applies PowerPolicy with the ESP-IDF power management.
+//
+// Dynamic frequency scaling runs the CPU between maxMhz and minMhz. While
+// the policy is ACTIVE the governor holds locks that keep the CPU and APB
+// clocks at their maximum (the hardware timer and RMT step backends count
+// APB cycles) and forbid light sleep. Automatic light sleep is only
+// enabled when the framework is built with tickless idle. Both need
+// CONFIG_PM_ENABLE in the framework's sdkconfig; without it the clock stays
+// fixed and the governor only accounts the states. Wi-Fi modem sleep does
+// not depend on it and is always used.
+//
+// The once-a-second clock and sparkline frames do not raise the clock: the
+// display is bit-banged by the CPU and has no minimum shift rate, so at
+// the idle clock a frame only takes longer (display_transfer_us), and a
+// raise every second would never let the hold time run out. A scrolling
+// message is an activity, for its 30 frames per second.
+
+class PowerGovernor
+{
+public:
+    PowerGovernor(uint16_t maxMhz, uint16_t minMhz, uint32_t holdMs);
+
+    // Configures the power management, returns false if it is unavailable
+    bool begin(bool lightSleep);
+
+    // Before an activity starts: full clock at once
+    void raise(uint8_t activity) { update(activity); }
+
+    // Activity still going on (0 if none), from loop()
+    void update(uint8_t activity);
+
+    bool enabled() const { return _enabled; }
+    void printStatus(Print& out) const;
+
+private:
+    void apply(PowerPolicy::State state);
+
+    PowerPolicy _policy;
+    uint16_t _maxMhz;
+    uint16_t _minMhz;
+    bool _enabled = false;
+    bool _lightSleep = false;
+    bool _modemSleep = false;
+    bool _locked = false;
+    void* _cpuLock = nullptr;
+    void* _apbLock = nullptr;
+    void* _noSleepLock = nullptr;
+    uint32_t _reportedMs[PowerPolicy::STATE_COUNT] = {};
+};
+
+extern PowerGovernor powerGovernor;
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef POWER_POLICY_H
+#define POWER_POLICY_H
+
+#include <stdint.h>
+
+// Power state decision, free of hardware calls so it can be run on the host.
+//
+// Any activity switches to ACTIVE in the same call that reports it, so a
+// motion that raises the state before it starts never runs a single step
+// at the idle clock. IDLE is only entered after holdMs without activity,
+// which also keeps back to back samples from toggling the clock.
+// Time spent in each state is accounted in milliseconds.
+
+class PowerPolicy
+{
+public:
+    enum State : uint8_t { STATE_ACTIVE, STATE_IDLE, STATE_COUNT };
+    enum Activity : uint8_t { ACTIVITY_MOTION = 0x01, ACTIVITY_DISPLAY = 0x02 };
+
+    explicit PowerPolicy(uint32_t holdMs) : _holdMs(holdMs) {}
+
+    // activity: Activity bits currently going on (0 if none).
+    // Returns the state to apply now.
+    State update(uint8_t activity, uint32_t nowMs)
+    {
+        account(nowMs);
+        if (activity != 0)
+        {
+            _lastActiveMs = nowMs;
+            enter(STATE_ACTIVE);
+        }
+        else if (_state == STATE_ACTIVE && nowMs - _lastActiveMs >= _holdMs)
+        {
+            enter(STATE_IDLE);
+        }
+        return _state;
+    }
+
+    State state() const { return _state; }
+    uint32_t transitions() const { return _transitions; }
+
+    // Time spent in a state, up to the last update
+    uint32_t timeInMs(State state) const { return _timeInMs[state]; }
+
+private:
+    void account(uint32_t nowMs)
+    {
+        if (_started) _timeInMs[_state] += nowMs - _lastUpdateMs;
+        _started = true;
+        _lastUpdateMs = nowMs;
+    }
+
+    void enter(State state)
+    {
+        if (state == _state) return;
+        _state = state;
+        _transitions++;
+    }
+
+    uint32_t _holdMs;
+    State _state = STATE_ACTIVE;   // boot runs at full clock
+    bool _started = false;
+    uint32_t _lastActiveMs = 0;
+    uint32_t _lastUpdateMs = 0;
+    uint32_t _timeInMs[STATE_COUNT] = {};
+    uint32_t _transitions = 0;
+};
+
+#endif
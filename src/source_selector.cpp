@@ -0,0 +1,352 @@
+#include "source_selector.h"
+#include <ESPmDNS.h>
+#include "Logger.h"
+#include "Metrics.h"
+
+#define STALE_TIMEOUT_MS     10000   // no new time stamp for this long: source is stale
+#define RELEASE_TIMEOUT_MS   30000   // stale this long: drop it and try another source
+#define AHEAD_GRACE_MS       1500    // a standby must stay ahead this long before switching
+#define RTT_MARGIN_MS        30      // latency gain needed to switch between equally fresh sources
+#define PROBE_INTERVAL_MS    2000
+#define RESOLVE_INTERVAL_MS  30000
+#define RESOLVE_TIMEOUT_MS   300
+#define SELECT_INTERVAL_MS   250
+
+static Counter sourceFailovers("source_failovers_total", "Active source changes");
+static Counter sourceStandbySamples("source_standby_samples_total", "Samples received from standby sources");
+static Gauge sourceActive("source_active_index", "Index of the active source (-1 if none)");
+static Gauge sourceSampleAge("source_sample_age_ms", "Age of the newest sample of the active source");
+static Counter sourceBackfillRequests("source_backfill_requests_total", "Missed samples requested after a reconnect");
+static Gauge sourceActiveRtt("source_active_rtt_ms", "Round trip time to the active source");
+
+SourceSelector::SourceSelector(const char* const* names, uint8_t count, uint16_t port)
+    : _count(count > MAX_SOURCES ? MAX_SOURCES : count), _port(port)
+{
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        _sources[i].name = names[i];
+    }
+}
+
+bool SourceSelector::resolve()
+{
+    bool known = false;
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        Source& s = _sources[i];
+        if ((uint32_t)s.ip == 0)
+        {
+            s.ip = MDNS.queryHost(s.name, RESOLVE_TIMEOUT_MS);
+            if ((uint32_t)s.ip != 0)
+            {
+                LOG_I("Source %s resolved", s.name);
+            }
+        }
+        known |= (uint32_t)s.ip != 0;
+    }
+    return known;
+}
+
+void SourceSelector::begin(MessageHandler handler)
+{
+    _handler = handler;
+    // not in the constructor: a global SourceSelector can be constructed
+    // before the metrics of this file
+    sourceActive.set(-1);
+    manageConnections(millis());
+}
+
+void SourceSelector::pause()
+{
+    _paused = true;
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        if (_sources[i].inUse) release(i);
+    }
+    switchTo(-1, "paused");
+}
+
+void SourceSelector::resume()
+{
+    _paused = false;
+    manageConnections(millis());
+}
+
+void SourceSelector::reconnect()
+{
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        Source& s = _sources[i];
+        if (s.inUse) release(i);
+        s.ip = IPAddress();
+        s.lastTimeStamp = 0;
+        s.lastFreshMs = 0;
+    }
+    switchTo(-1, "reconfigured");
+    _lastResolveMs = millis() - RESOLVE_INTERVAL_MS; // resolve at the next loop()
+}
+
+void SourceSelector::connect(uint8_t index)
+{
+    Source& s = _sources[index];
+    s.client.begin(s.ip, _port, "/");
+    s.client.onEvent([this, index](WStype_t type, uint8_t* payload, size_t length) {
+        handleEvent(index, type, payload, length);
+    });
+    s.client.setReconnectInterval(5000); // Reconnect every 5 seconds if disconnected
+    s.inUse = true;
+    s.inUseSinceMs = millis();
+    s.rttMs = 0;
+    LOG_I("Source %s: connecting", s.name);
+}
+
+void SourceSelector::release(uint8_t index)
+{
+    Source& s = _sources[index];
+    s.client.disconnect();
+    s.inUse = false;
+    s.connected = false;
+}
+
+bool SourceSelector::onSample(uint8_t source, uint64_t timeStamp)
+{
+    if (source >= _count) return false;
+
+    Source& s = _sources[source];
+    if (timeStamp > s.lastTimeStamp)
+    {
+        s.lastTimeStamp = timeStamp;
+        s.lastFreshMs = millis();
+    }
+
+    if (_active < 0)
+    {
+        switchTo(source, "first sample");
+    }
+    if (source != _active)
+    {
+        sourceStandbySamples.inc();
+        return false;
+    }
+    if (timeStamp > _lastApplied) _lastApplied = timeStamp;
+    return true;
+}
+
+bool SourceSelector::isFresh(const Source& s, unsigned long now) const
+{
+    return s.connected && s.lastFreshMs != 0 && now - s.lastFreshMs < STALE_TIMEOUT_MS;
+}
+
+void SourceSelector::handleEvent(uint8_t index, WStype_t type, uint8_t* payload, size_t length)
+{
+    Source& s = _sources[index];
+    switch (type)
+    {
+        case WStype_CONNECTED:
+            LOG_I("Source %s connected", s.name);
+            s.connected = true;
+            s.client.sendTXT("Connected");
+            // Nothing fresh from another source: ask this one for what was missed
+            if (_lastApplied != 0 && (_active < 0 || _active == index || !isFresh(_sources[_active], millis())))
+            {
+                char request[64];
+                snprintf(request, sizeof(request), "{\"backfill_since\":%llu,\"max\":%u}",
+                         (unsigned long long)_lastApplied, (unsigned)BACKFILL_CHUNK);
+                s.client.sendTXT(request);
+                sourceBackfillRequests.inc();
+            }
+            break;
+        case WStype_DISCONNECTED:
+            if (s.connected) LOG_W("Source %s disconnected", s.name);
+            s.connected = false;
+            break;
+        case WStype_TEXT:
+            if (_handler != nullptr) _handler(index, payload, length);
+            break;
+        case WStype_PONG:
+            if (s.pingSentMs != 0)
+            {
+                uint16_t rtt = (uint16_t)(millis() - s.pingSentMs);
+                s.rttMs = (s.rttMs == 0) ? rtt : (uint16_t)((3 * s.rttMs + rtt) / 4);
+                s.pingSentMs = 0;
+            }
+            break;
+        case WStype_ERROR:
+            LOG_E("Source %s: WebSocket error", s.name);
+            break;
+        default:
+            break;
+    }
+}
+
+void SourceSelector::loop()
+{
+    if (_paused) return;
+
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        if (_sources[i].inUse) _sources[i].client.loop();
+    }
+    // after the client loops: the samples they delivered are stamped with
+    // millis(), an earlier now would give them a negative age
+    unsigned long now = millis();
+
+    // Latency probes
+    if (now - _lastProbeMs >= PROBE_INTERVAL_MS)
+    {
+        _lastProbeMs = now;
+        for (uint8_t i = 0; i < _count; i++)
+        {
+            Source& s = _sources[i];
+            if (s.connected && s.client.sendPing())
+            {
+                s.pingSentMs = now;
+            }
+        }
+    }
+
+    // Late resolution of the sources that were not found at boot
+    if (now - _lastResolveMs >= RESOLVE_INTERVAL_MS)
+    {
+        _lastResolveMs = now;
+        resolve();
+    }
+
+    if (now - _lastSelectMs >= SELECT_INTERVAL_MS)
+    {
+        _lastSelectMs = now;
+        selectActive(now);
+        manageConnections(now);
+    }
+
+    if (_active >= 0)
+    {
+        sourceSampleAge.set((int32_t)(now - _sources[_active].lastFreshMs));
+        sourceActiveRtt.set(_sources[_active].rttMs);
+    }
+}
+
+// Keeps the active source and the best standby connected, recycles stale ones
+void SourceSelector::manageConnections(unsigned long now)
+{
+    if (_paused) return;
+
+    uint8_t inUse = 0;
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        Source& s = _sources[i];
+        if (!s.inUse) continue;
+
+        bool stale = !isFresh(s, now) && now - s.inUseSinceMs > RELEASE_TIMEOUT_MS
+                     && (s.lastFreshMs == 0 || now - s.lastFreshMs > RELEASE_TIMEOUT_MS);
+        if (stale)
+        {
+            // connected but silent (stalled server): drop it, the round robin below reconnects
+            LOG_W("Source %s stale, recycling the connection", s.name);
+            release(i);
+            if (i == _active) switchTo(-1, "stale");
+            continue;
+        }
+        inUse++;
+    }
+
+    // Start the next resolved source, round robin so every source gets probed
+    for (uint8_t n = 0; n < _count && inUse < MAX_CONNECTIONS; n++)
+    {
+        uint8_t i = (_nextConnect + n) % _count;
+        Source& s = _sources[i];
+        if (!s.inUse && (uint32_t)s.ip != 0)
+        {
+            connect(i);
+            inUse++;
+            _nextConnect = (i + 1) % _count;
+        }
+    }
+}
+
+void SourceSelector::selectActive(unsigned long now)
+{
+    int8_t best = -1;
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        const Source& s = _sources[i];
+        if (!isFresh(s, now)) continue;
+        if (best < 0 || s.lastTimeStamp > _sources[best].lastTimeStamp
+            || (s.lastTimeStamp == _sources[best].lastTimeStamp && rtt(s) < rtt(_sources[best])))
+        {
+            best = i;
+        }
+    }
+
+    if (best < 0 || best == _active)
+    {
+        _behindSinceMs = 0;
+        if (_active >= 0 && !isFresh(_sources[_active], now) && best < 0)
+        {
+            LOG_W("Source %s: no fresh sample for %lu ms", _sources[_active].name, now - _sources[_active].lastFreshMs);
+            switchTo(-1, "watchdog");
+        }
+        return;
+    }
+
+    if (_active < 0 || !isFresh(_sources[_active], now))
+    {
+        switchTo(best, "watchdog");
+        return;
+    }
+
+    const Source& a = _sources[_active];
+    const Source& b = _sources[best];
+    if (b.lastTimeStamp > a.lastTimeStamp)
+    {
+        // the active source lags behind, give it a short grace period
+        if (_behindSinceMs == 0)
+        {
+            _behindSinceMs = now;
+        }
+        else if (now - _behindSinceMs >= AHEAD_GRACE_MS)
+        {
+            switchTo(best, "fresher data");
+        }
+    }
+    else
+    {
+        _behindSinceMs = 0;
+        if (rtt(b) + RTT_MARGIN_MS < rtt(a))
+        {
+            switchTo(best, "lower latency");
+        }
+    }
+}
+
+void SourceSelector::switchTo(int8_t index, const char* reason)
+{
+    if (index == _active) return;
+
+    if (index >= 0)
+    {
+        LOG_I("Active source: %s (%s)", _sources[index].name, reason);
+        sourceFailovers.inc();
+    }
+    else
+    {
+        LOG_W("No active source (%s)", reason);
+    }
+    _active = index;
+    _behindSinceMs = 0;
+    sourceActive.set(index);
+}
+
+void SourceSelector::printStatus(Print& out) const
+{
+    unsigned long now = millis();
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        const Source& s = _sources[i];
+        out.printf("%c %-16s %-15s %-9s rtt %4u ms  last %llu  age %lu ms\n",
+                   i == _active ? '*' : ' ', s.name, s.ip.toString().c_str(),
+                   s.connected ? "connected" : (s.inUse ? "connecting" : "idle"),
+                   s.rttMs, (unsigned long long)s.lastTimeStamp,
+                   s.lastFreshMs ? now - s.lastFreshMs : 0UL);
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef SOURCE_SELECTOR_H
+#define SOURCE_SELECTOR_H
+
+#include <Arduino.h>
+#include <WebSocketsClient.h>
+
+// Manages a list of GridFreqMonitor servers.
+// Up to MAX_CONNECTIONS sources are connected at once: the active one, whose
+// samples drive the needle, and a hot standby. Each connection is probed
+// with WebSocket pings to measure latency. The active source is replaced
+// when a standby delivers fresher time stamps, when it has the same data
+// with a clearly lower latency, or when the sample age watchdog fires.
+// When a source connects while no fresh data is flowing, it is asked for
+// the samples missed since the last applied one:
+//   -> {"backfill_since":<time_stamp>,"max":<samples per message>}
+//   <- {"backfill":[[<time_stamp>,<frequency>],...],"more":<bool>}
+// oldest first, split in messages of at most max samples.
+
+class SourceSelector
+{
+public:
+    enum { MAX_SOURCES = 4, MAX_CONNECTIONS = 2 };
+    enum { BACKFILL_CHUNK = 32 };  // samples per backfill message, sized for the JSON arena
+
+    typedef void (*MessageHandler)(uint8_t source, uint8_t* payload, size_t length);
+
+    SourceSelector(const char* const* names, uint8_t count, uint16_t port);
+
+    // Port of the servers, applies to the next connections (see reconnect())
+    void setPort(uint16_t port) { _port = port; }
+
+    // Tries to resolve the unresolved names once, returns true if at least one source is known
+    bool resolve();
+
+    // Opens the first connections, messages are passed to handler
+    void begin(MessageHandler handler);
+
+    // Services the connections, probes and watchdog
+    void loop();
+
+    // Closes all connections until resume()
+    void pause();
+    void resume();
+
+    // After a change of the names or the port: closes the connections and
+    // forgets the addresses, loop() resolves and connects again
+    void reconnect();
+
+    // Called by the ingest path for each valid sample
+    // Returns true if the sample comes from the active source and must be applied
+    bool onSample(uint8_t source, uint64_t timeStamp);
+
+    // Time stamp the next backfill starts from, e.g. the last one applied before a reset
+    void resumeFrom(uint64_t timeStamp) { _lastApplied = timeStamp; }
+
+    int8_t active() const { return _active; }
+    void printStatus(Print& out) const;
+
+private:
+    struct Source
+    {
+        const char* name;
+        IPAddress ip;
+        WebSocketsClient client;
+        bool inUse = false;              // client started
+        bool connected = false;
+        uint64_t lastTimeStamp = 0;      // newest time stamp received
+        unsigned long lastFreshMs = 0;   // when lastTimeStamp last advanced
+        unsigned long pingSentMs = 0;
+        uint16_t rttMs = 0;              // smoothed round trip time
+        unsigned long inUseSinceMs = 0;
+    };
+
+    void handleEvent(uint8_t index, WStype_t type, uint8_t* payload, size_t length);
+    void connect(uint8_t index);
+    void release(uint8_t index);
+    bool isFresh(const Source& s, unsigned long now) const;
+    static uint32_t rtt(const Source& s) { return s.rttMs != 0 ? s.rttMs : 0xFFFF; } // unmeasured sorts last
+    void manageConnections(unsigned long now);
+    void selectActive(unsigned long now);
+    void switchTo(int8_t index, const char* reason);
+
+    Source _sources[MAX_SOURCES];
+    uint8_t _count;
+    uint16_t _port;
+    MessageHandler _handler = nullptr;
+    int8_t _active = -1;
+    bool _paused = false;
+    unsigned long _behindSinceMs = 0;    // active source behind a standby since
+    unsigned long _lastProbeMs = 0;
+    unsigned long _lastResolveMs = 0;
+    unsigned long _lastSelectMs = 0;
+    uint8_t _nextConnect = 0;            // round robin start for new connections
+    uint64_t _lastApplied = 0;           // newest time stamp of the active source, backfill start
+};
+
+#endif
@@ -0,0 +1,368 @@
+#include "time_keeper.h"
+#include <WiFi.h>
+#include <Preferences.h>
+#include <lwip/sockets.h>
+#include <lwip/dns.h>
+#include <sys/time.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "Metrics.h"
+#include "Logger.h"
+
+#define MIN_VALID_EPOCH   1700000000LL   // earlier times are an unset clock
+#define NTP_PORT          123
+#define NTP_PACKET_SIZE   48
+#define NTP_UNIX_OFFSET   2208988800LL   // seconds from 1900 to 1970
+#define SYNC_TIMEOUT_MS   1500
+#define RTC_STATE_MAGIC   0x54494D45     // "TIME"
+#define SAVED_VERSION     1
+
+static Gauge timeToValid("time_to_valid_ms", "Time from boot to a valid clock");
+static Gauge timeSource("time_source", "Clock source (0 none, 1 kept across reset, 2 saved before power loss, 3 SNTP)");
+static Histogram timeCorrection("time_correction_ms", "Absolute clock corrections applied by SNTP");
+static Counter timeSteps("time_steps_total", "Clock corrections applied as a step");
+static Counter timeSlews("time_slews_total", "Clock corrections slewed with adjtime()");
+static Counter timeSyncFailures("time_sync_failures_total", "SNTP rounds without a valid answer");
+static Counter timeLookupFailures("time_lookup_failures_total", "NTP server name lookups failed or timed out");
+
+// Drift state kept across software resets
+struct RtcState
+{
+    uint32_t magic;
+    GridTimeIntegral::State drift;
+    uint32_t check;
+};
+static RTC_NOINIT_ATTR RtcState rtcState;
+
+// Saved to NVS for power losses
+struct SavedState
+{
+    uint32_t version;
+    int64_t epochSec;
+    GridTimeIntegral::State drift;
+};
+
+static uint32_t checksum(const GridTimeIntegral::State& drift)
+{
+    uint32_t sum = RTC_STATE_MAGIC;
+    const uint8_t* p = (const uint8_t*)&drift;
+    for (size_t i = 0; i < sizeof(drift); i++) sum = sum * 31 + p[i];
+    return sum;
+}
+
+static int64_t nowUs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void toNtp(int64_t unixUs, uint8_t* p)
+{
+    uint32_t sec = (uint32_t)(unixUs / 1000000 + NTP_UNIX_OFFSET);
+    uint32_t frac = (uint32_t)(((uint64_t)(unixUs % 1000000) << 32) / 1000000);
+    for (int i = 0; i < 4; i++)
+    {
+        p[i] = (uint8_t)(sec >> (24 - 8 * i));
+        p[4 + i] = (uint8_t)(frac >> (24 - 8 * i));
+    }
+}
+
+static int64_t fromNtp(const uint8_t* p)
+{
+    uint32_t sec = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    uint32_t frac = ((uint32_t)p[4] << 24) | ((uint32_t)p[5] << 16) | ((uint32_t)p[6] << 8) | p[7];
+    int64_t seconds = (int64_t)sec - NTP_UNIX_OFFSET;
+    if (sec < 0x80000000UL) seconds += 0x100000000LL; // era 1, from 2036
+    return seconds * 1000000 + (int64_t)(((uint64_t)frac * 1000000) >> 32);
+}
+
+TimeKeeper::TimeKeeper(const char* const* servers, uint8_t count)
+    : _servers(servers), _count(count > MAX_SERVERS ? MAX_SERVERS : count)
+{
+}
+
+const char* TimeKeeper::sourceName(Source source)
+{
+    switch (source)
+    {
+        case SOURCE_RTC:   return "kept across reset";
+        case SOURCE_SAVED: return "saved before power loss";
+        case SOURCE_SNTP:  return "SNTP";
+        default:           return "none";
+    }
+}
+
+TimeKeeper::Source TimeKeeper::begin(GridTimeIntegral& drift)
+{
+    _drift = &drift;
+
+    // A reset during loop() can leave a torn copy: valid magic, bad checksum
+    bool rtcRestored = rtcState.magic == RTC_STATE_MAGIC && rtcState.check == checksum(rtcState.drift);
+    if (rtcRestored)
+    {
+        drift.restore(rtcState.drift);
+    }
+
+    Preferences prefs;
+    SavedState saved;
+    bool haveSaved = prefs.begin("clock", true)
+                     && prefs.getBytes("state", &saved, sizeof(saved)) == sizeof(saved)
+                     && saved.version == SAVED_VERSION;
+    prefs.end();
+
+    if (time(nullptr) > MIN_VALID_EPOCH)
+    {
+        _source = SOURCE_RTC;
+        _valid.store(true, std::memory_order_release);
+        timeToValid.set(millis());
+    }
+    else if (haveSaved && saved.epochSec > MIN_VALID_EPOCH)
+    {
+        // Behind by the time without power: set, but not shown until synced
+        struct timeval tv = { (time_t)saved.epochSec, 0 };
+        settimeofday(&tv, nullptr);
+        _source = SOURCE_SAVED;
+    }
+    if (haveSaved && !rtcRestored)
+    {
+        drift.restore(saved.drift);
+    }
+    timeSource.set(_source);
+    LOG_I("Clock: %s", sourceName(_source));
+    return _source;
+}
+
+void TimeKeeper::startSync()
+{
+    if (_task == nullptr && _count > 0)
+    {
+        xTaskCreate(syncTask, "timesync", 3072, this, 1, (TaskHandle_t*)&_task);
+    }
+}
+
+void TimeKeeper::loop()
+{
+    if (_drift == nullptr) return;
+
+    rtcState.drift = _drift->state();
+    rtcState.check = checksum(rtcState.drift);
+    rtcState.magic = RTC_STATE_MAGIC;
+
+    if (valid() && millis() - _lastSaveMs > SAVE_PERIOD_MS)
+    {
+        _lastSaveMs = millis();
+        save();
+    }
+}
+
+void TimeKeeper::save()
+{
+    SavedState saved;
+    saved.version = SAVED_VERSION;
+    saved.epochSec = (int64_t)time(nullptr);
+    saved.drift = _drift->state();
+
+    Preferences prefs;
+    if (prefs.begin("clock", false))
+    {
+        prefs.putBytes("state", &saved, sizeof(saved));
+        prefs.end();
+    }
+}
+
+void TimeKeeper::syncTask(void* context)
+{
+    TimeKeeper* self = (TimeKeeper*)context;
+    for (;;)
+    {
+        uint32_t waitMs = RETRY_PERIOD_MS;
+        if (WiFi.status() == WL_CONNECTED)
+        {
+            if (self->syncOnce())
+            {
+                waitMs = SYNC_PERIOD_MS;
+            }
+            else
+            {
+                timeSyncFailures.inc();
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(waitMs));
+    }
+}
+
+// Runs in the lwIP task. A late answer of an earlier sync is still an address of the name.
+void TimeKeeper::lookupDone(const char* name, const ip_addr_t* ip, void* arg)
+{
+    (void)name;
+    Lookup* lookup = (Lookup*)arg;
+    if (ip != nullptr)
+    {
+        lookup->address = ip_2_ip4(ip)->addr;
+        lookup->found = true;
+    }
+    lookup->done = true;
+    xTaskNotifyGive((TaskHandle_t)lookup->owner->_task);
+}
+
+// Starts all the lookups, then waits for them together
+void TimeKeeper::resolve()
+{
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        Lookup& lookup = _lookups[i];
+        lookup.owner = this;
+        lookup.done = false;
+        lookup.found = false;
+        ip_addr_t ip;
+        err_t err = dns_gethostbyname_addrtype(_servers[i], &ip, lookupDone, &lookup, LWIP_DNS_ADDRTYPE_IPV4);
+        if (err == ERR_OK) // address literal or cached by lwIP
+        {
+            lookup.address = ip_2_ip4(&ip)->addr;
+            lookup.found = true;
+        }
+        if (err != ERR_INPROGRESS) lookup.done = true;
+    }
+
+    unsigned long start = millis();
+    for (;;)
+    {
+        uint8_t pending = 0;
+        for (uint8_t i = 0; i < _count; i++)
+        {
+            if (!_lookups[i].done) pending++;
+        }
+        unsigned long elapsed = millis() - start;
+        if (pending == 0 || elapsed >= DNS_TIMEOUT_MS) break;
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DNS_TIMEOUT_MS - elapsed));
+    }
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        if (!_lookups[i].found) timeLookupFailures.inc();
+    }
+}
+
+// Sends one request to every server and applies the first valid answer
+bool TimeKeeper::syncOnce()
+{
+    struct Request
+    {
+        struct sockaddr_in addr;
+        uint8_t transmit[8];    // echoed back by the server as the originate time
+    };
+    Request requests[MAX_SERVERS];
+    uint8_t sent = 0;
+
+    // Resolve everything first, so no answer waits in the socket while resolving
+    resolve();
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        memset(&requests[i].addr, 0, sizeof(requests[i].addr));
+        if (_lookups[i].address != 0)
+        {
+            requests[i].addr.sin_family = AF_INET;
+            requests[i].addr.sin_port = htons(NTP_PORT);
+            requests[i].addr.sin_addr.s_addr = _lookups[i].address;
+        }
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) return false;
+    struct timeval timeout = { 0, 100000 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    uint8_t packet[NTP_PACKET_SIZE];
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        if (requests[i].addr.sin_family != AF_INET) continue;
+        memset(packet, 0, sizeof(packet));
+        packet[0] = 0x23; // no leap warning, version 4, client
+        toNtp(nowUs(), packet + 40);
+        memcpy(requests[i].transmit, packet + 40, 8);
+        if (sendto(sock, packet, sizeof(packet), 0, (struct sockaddr*)&requests[i].addr, sizeof(requests[i].addr)) == sizeof(packet))
+        {
+            sent++;
+        }
+    }
+
+    bool synced = false;
+    unsigned long start = millis();
+    while (sent > 0 && !synced && millis() - start < SYNC_TIMEOUT_MS)
+    {
+        struct sockaddr_in from;
+        socklen_t fromLength = sizeof(from);
+        int n = recvfrom(sock, packet, sizeof(packet), 0, (struct sockaddr*)&from, &fromLength);
+        int64_t t4 = nowUs();
+        if (n < NTP_PACKET_SIZE) continue;
+
+        uint8_t leap = packet[0] >> 6;
+        uint8_t mode = packet[0] & 0x07;
+        uint8_t stratum = packet[1];
+        if (mode != 4 || leap == 3 || stratum == 0 || stratum > 15) continue;
+
+        for (uint8_t i = 0; i < _count; i++)
+        {
+            if (requests[i].addr.sin_family != AF_INET || requests[i].addr.sin_addr.s_addr != from.sin_addr.s_addr) continue;
+            if (memcmp(packet + 24, requests[i].transmit, 8) != 0) break; // stale or forged answer
+
+            int64_t t1 = fromNtp(requests[i].transmit);
+            int64_t t2 = fromNtp(packet + 32);
+            int64_t t3 = fromNtp(packet + 40);
+            apply(((t2 - t1) + (t3 - t4)) / 2, i);
+            synced = true;
+            break;
+        }
+    }
+    close(sock);
+    return synced;
+}
+
+void TimeKeeper::apply(int64_t offsetUs, uint8_t server)
+{
+    int64_t magnitudeUs = offsetUs < 0 ? -offsetUs : offsetUs;
+    if (!valid() || magnitudeUs > (int64_t)STEP_LIMIT_MS * 1000)
+    {
+        int64_t corrected = nowUs() + offsetUs;
+        struct timeval tv = { (time_t)(corrected / 1000000), (suseconds_t)(corrected % 1000000) };
+        settimeofday(&tv, nullptr);
+        timeSteps.inc();
+    }
+    else
+    {
+        struct timeval delta = { (time_t)(offsetUs / 1000000), (suseconds_t)(offsetUs % 1000000) };
+        adjtime(&delta, nullptr);
+        timeSlews.inc();
+    }
+
+    uint64_t magnitudeMs = (uint64_t)magnitudeUs / 1000;
+    timeCorrection.record(magnitudeMs > 0xFFFFFFFFULL ? 0xFFFFFFFFUL : (uint32_t)magnitudeMs);
+    _lastOffsetMs = (int32_t)(offsetUs / 1000);
+    _lastServer = server;
+    _lastSyncMs = millis();
+
+    if (!valid())
+    {
+        timeToValid.set(millis());
+        _valid.store(true, std::memory_order_release);
+        LOG_I("Clock valid after %lu ms (%s, offset %lld ms)", millis(), _servers[server], (long long)(offsetUs / 1000));
+    }
+    _source = SOURCE_SNTP;
+    timeSource.set(_source);
+}
+
+void TimeKeeper::printStatus(Print& out) const
+{
+    out.printf("Clock: %s, %s, valid after %d ms\n", valid() ? "valid" : "not set", sourceName(_source),
+               (int)timeToValid.value());
+    if (_lastSyncMs != 0)
+    {
+        out.printf("  last sync %lu s ago from %s, offset %d ms\n", (millis() - _lastSyncMs) / 1000,
+                   _servers[_lastServer], (int)_lastOffsetMs);
+    }
+    struct timeval pending;
+    if (adjtime(nullptr, &pending) == 0 && (pending.tv_sec != 0 || pending.tv_usec != 0))
+    {
+        out.printf("  slewing, %ld ms left\n", (long)(pending.tv_sec * 1000 + pending.tv_usec / 1000));
+    }
+}
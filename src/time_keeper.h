@@ -0,0 +1,80 @@
+#ifndef TIME_KEEPER_H
+#define TIME_KEEPER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "grid_time.h"
+
+// Keeps the wall clock and the drift state across resets and syncs it.
+//
+// The system time survives software resets in the RTC timer, so after a
+// reset the clock is right before the network is up. The grid time drift
+// state is copied to RTC memory on every loop() and to NVS every
+// SAVE_PERIOD_MS; after a power loss the last saved time is set but the
+// clock stays invalid until the first sync.
+//
+// A low priority task queries all the NTP servers at once and takes the
+// first valid answer. Their names are looked up together, at most
+// DNS_TIMEOUT_MS; a name without an answer keeps its address of the last
+// sync. Offsets up to STEP_LIMIT_MS are slewed with
+// adjtime(), larger ones (and the first sync after a power loss) step the
+// clock. Time to a valid clock and the corrections are exported as metrics.
+
+class TimeKeeper
+{
+public:
+    enum Source : uint8_t { SOURCE_NONE, SOURCE_RTC, SOURCE_SAVED, SOURCE_SNTP };
+    enum { MAX_SERVERS = 4 };
+    enum : uint32_t { STEP_LIMIT_MS = 500, SAVE_PERIOD_MS = 15 * 60 * 1000UL };
+    enum : uint32_t { SYNC_PERIOD_MS = 60 * 60 * 1000UL, RETRY_PERIOD_MS = 10000, DNS_TIMEOUT_MS = 2000 };
+
+    TimeKeeper(const char* const* servers, uint8_t count);
+
+    // Restores the clock and the drift state, call first in setup()
+    Source begin(GridTimeIntegral& drift);
+
+    // Starts the sync task, which waits for the Wi-Fi connection itself
+    void startSync();
+
+    // Copies the drift state to RTC memory, and to NVS when due
+    void loop();
+
+    // True once the clock is known: kept across a reset or synced
+    bool valid() const { return _valid.load(std::memory_order_acquire); }
+    Source source() const { return _source; }
+    static const char* sourceName(Source source);
+    void printStatus(Print& out) const;
+
+private:
+    // One NTP server name, completed by the lwIP callback
+    struct Lookup
+    {
+        TimeKeeper* owner;
+        volatile uint32_t address;  // network order, 0 until resolved once
+        volatile bool done;
+        volatile bool found;
+    };
+
+    void resolve();
+    static void lookupDone(const char* name, const struct ip_addr* ip, void* arg);
+    bool syncOnce();
+    void apply(int64_t offsetUs, uint8_t server);
+    void save();
+    static void syncTask(void* context);
+
+    const char* const* _servers;
+    uint8_t _count;
+    GridTimeIntegral* _drift = nullptr;
+    std::atomic<bool> _valid{false};
+    unsigned long _lastSaveMs = 0;
+    void* _task = nullptr;
+    Lookup _lookups[MAX_SERVERS] = {};
+
+    // Written by the sync task, only read for the status
+    volatile Source _source = SOURCE_NONE;
+    volatile unsigned long _lastSyncMs = 0;
+    volatile int32_t _lastOffsetMs = 0;
+    volatile uint8_t _lastServer = 0;
+};
+
+#endif
@@ -0,0 +1,364 @@
+#include "trace_recorder.h"
+#include <LittleFS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "app_clock.h"
+#include "Logger.h"
+#include "Metrics.h"
+
+#define TRACE_DIR       "/trace"
+#define TRACE_HEAD_FILE "/trace/head"
+
+TraceRecorder traceRecorder;
+TraceReplay traceReplay;
+
+static Counter traceSamples("trace_samples_total", "Samples recorded to the trace");
+static Counter tracePagesWritten("trace_pages_written_total", "Trace pages written to flash");
+static Counter tracePagesDropped("trace_pages_dropped_total", "Trace pages dropped because the writer was busy");
+
+static uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static size_t writeVarint(uint8_t* p, uint64_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80)
+    {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+static void writeLe(uint8_t* p, uint64_t v, uint8_t bytes)
+{
+    for (uint8_t i = 0; i < bytes; i++)
+    {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+uint64_t TraceRecorder::readLe(const uint8_t* p, uint8_t bytes)
+{
+    uint64_t v = 0;
+    for (uint8_t i = 0; i < bytes; i++)
+    {
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+size_t TraceRecorder::readVarint(const uint8_t* p, size_t len, int64_t& value)
+{
+    uint64_t v = 0;
+    size_t n = 0;
+    while (n < len && n < 10)
+    {
+        v |= (uint64_t)(p[n] & 0x7F) << (7 * n);
+        if ((p[n++] & 0x80) == 0)
+        {
+            value = (int64_t)(v >> 1) ^ -(int64_t)(v & 1); // zigzag decode
+            return n;
+        }
+    }
+    return 0; // truncated
+}
+
+bool TraceRecorder::begin()
+{
+    if (!LittleFS.begin(true)) // format on first use
+    {
+        LOG_E("Trace: LittleFS mount failed");
+        return false;
+    }
+    LittleFS.mkdir(TRACE_DIR);
+
+    // resume the segment that was being written
+    File head = LittleFS.open(TRACE_HEAD_FILE, "r");
+    if (head)
+    {
+        int index = head.read();
+        if (index >= 0) _segment = (uint8_t)index % SEGMENT_COUNT;
+        head.close();
+    }
+    char path[24];
+    snprintf(path, sizeof(path), TRACE_DIR "/%u.bin", _segment);
+    File current = LittleFS.open(path, "r");
+    if (current)
+    {
+        _segmentPages = current.size() / PAGE_SIZE;
+        current.close();
+    }
+
+    xTaskCreate(writerTask, "trace", 4096, this, 1, (TaskHandle_t*)&_task);
+    _ready = true;
+    return true;
+}
+
+void TraceRecorder::startPage(uint64_t receivedMs, uint64_t timeStamp, int32_t frequencyMilliHz)
+{
+    uint8_t* p = _pages[_active].data;
+    memset(p, 0, PAGE_SIZE);
+    p[0] = PAGE_MAGIC;
+    p[1] = 0;
+    writeLe(p + 4, receivedMs, 8);
+    writeLe(p + 12, timeStamp, 8);
+    writeLe(p + 20, (uint32_t)frequencyMilliHz, 4);
+    _fill = HEADER_SIZE;
+}
+
+void TraceRecorder::record(uint64_t receivedMs, uint64_t timeStamp, float frequency)
+{
+    if (!_ready) return;
+
+    int32_t frequencyMilliHz = (int32_t)lroundf(frequency * 1000.0f);
+    traceSamples.inc();
+
+    if (_fill == 0 || _fill + MAX_RECORD_SIZE > PAGE_SIZE)
+    {
+        if (_fill != 0) handOff();
+        startPage(receivedMs, timeStamp, frequencyMilliHz);
+    }
+    else
+    {
+        uint8_t* p = _pages[_active].data;
+        _fill += writeVarint(p + _fill, zigzag((int64_t)(receivedMs - _lastReceivedMs)));
+        _fill += writeVarint(p + _fill, zigzag((int64_t)(timeStamp - _lastTimeStamp)));
+        _fill += writeVarint(p + _fill, zigzag((int64_t)frequencyMilliHz - _lastFrequency));
+        p[1]++;
+    }
+    _lastReceivedMs = receivedMs;
+    _lastTimeStamp = timeStamp;
+    _lastFrequency = frequencyMilliHz;
+}
+
+// Gives the active page to the writer task and switches to the other one
+void TraceRecorder::handOff()
+{
+    if (_pending.load(std::memory_order_acquire))
+    {
+        tracePagesDropped.inc(); // flash is behind, lose this page rather than wait
+    }
+    else
+    {
+        _pendingIndex = _active;
+        _active ^= 1;
+        _pending.store(true, std::memory_order_release);
+        xTaskNotifyGive((TaskHandle_t)_task);
+    }
+    _fill = 0;
+}
+
+bool TraceRecorder::sync(uint32_t timeoutMs)
+{
+    if (!_ready) return false;
+
+    unsigned long start = millis();
+    while (_pending.load(std::memory_order_acquire) && millis() - start < timeoutMs)
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (_pending.load(std::memory_order_acquire))
+    {
+        return false; // writer still busy, keep filling the current page
+    }
+    if (_fill != 0)
+    {
+        handOff();
+    }
+    while (_pending.load(std::memory_order_acquire) && millis() - start < timeoutMs)
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return !_pending.load(std::memory_order_acquire);
+}
+
+void TraceRecorder::writePending()
+{
+    char path[24];
+    snprintf(path, sizeof(path), TRACE_DIR "/%u.bin", _segment);
+
+    File f = LittleFS.open(path, _segmentPages == 0 ? "w" : "a");
+    if (f)
+    {
+        f.write(_pages[_pendingIndex].data, PAGE_SIZE);
+        f.close();
+        tracePagesWritten.inc();
+    }
+    else
+    {
+        LOG_E("Trace: cannot open segment %u", _segment);
+    }
+
+    if (++_segmentPages >= SEGMENT_PAGES)
+    {
+        // segment full, move to the next one (oldest data is overwritten)
+        _segment = (_segment + 1) % SEGMENT_COUNT;
+        _segmentPages = 0;
+        File head = LittleFS.open(TRACE_HEAD_FILE, "w");
+        if (head)
+        {
+            head.write(_segment);
+            head.close();
+        }
+    }
+}
+
+void TraceRecorder::writerTask(void* context)
+{
+    TraceRecorder* self = (TraceRecorder*)context;
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (self->_pending.load(std::memory_order_acquire))
+        {
+            self->writePending();
+            self->_pending.store(false, std::memory_order_release);
+        }
+    }
+}
+
+void TraceRecorder::clear()
+{
+    sync(500);
+    char path[24];
+    for (uint8_t i = 0; i < SEGMENT_COUNT; i++)
+    {
+        snprintf(path, sizeof(path), TRACE_DIR "/%u.bin", i);
+        LittleFS.remove(path);
+    }
+    LittleFS.remove(TRACE_HEAD_FILE);
+    _segment = 0;
+    _segmentPages = 0;
+    _fill = 0;
+}
+
+void TraceRecorder::segmentPath(uint8_t n, char* path, size_t len) const
+{
+    // the segment after the one being written is the oldest
+    snprintf(path, len, TRACE_DIR "/%u.bin", (unsigned)((_segment + 1 + n) % SEGMENT_COUNT));
+}
+
+void TraceRecorder::printStatus(Print& out) const
+{
+    size_t total = 0;
+    char path[24];
+    for (uint8_t n = 0; n < SEGMENT_COUNT; n++)
+    {
+        segmentPath(n, path, sizeof(path));
+        File f = LittleFS.open(path, "r");
+        if (f)
+        {
+            total += f.size();
+            f.close();
+        }
+    }
+    out.printf("Trace: %u bytes on flash (%u max), segment %u page %u, current page %u bytes\n",
+               (unsigned)total, (unsigned)(PAGE_SIZE * SEGMENT_PAGES * SEGMENT_COUNT),
+               _segment, _segmentPages, (unsigned)_fill);
+}
+
+bool TraceReplay::start(const TraceRecorder& recorder, uint16_t speed, SampleHandler handler)
+{
+    stop();
+    _recorder = &recorder;
+    _handler = handler;
+    _segment = 0;
+    _recordsLeft = 0;
+    _replayed = 0;
+
+    _havePending = loadPage();
+    if (!_havePending)
+    {
+        return false; // empty trace
+    }
+    appClock.runVirtual(_receivedMs, speed);
+    _active = true;
+    LOG_I("Replay started at x%u", speed);
+    return true;
+}
+
+void TraceReplay::stop()
+{
+    if (_file) _file.close();
+    if (_active)
+    {
+        appClock.runReal();
+        LOG_I("Replay stopped after %u samples", (unsigned)_replayed);
+    }
+    _active = false;
+}
+
+bool TraceReplay::poll()
+{
+    if (!_active) return false;
+
+    uint64_t now = appClock.epochMs();
+    while (_havePending && _receivedMs <= now)
+    {
+        _handler(_timeStamp, _frequency / 1000.0f);
+        _replayed++;
+        _havePending = nextSample();
+    }
+    if (!_havePending)
+    {
+        stop();
+        return false;
+    }
+    return true;
+}
+
+bool TraceReplay::nextSample()
+{
+    if (_recordsLeft == 0)
+    {
+        return loadPage();
+    }
+
+    int64_t d[3];
+    for (int i = 0; i < 3; i++)
+    {
+        size_t n = TraceRecorder::readVarint(_page.data + _pos, TraceRecorder::PAGE_SIZE - _pos, d[i]);
+        if (n == 0) return loadPage(); // corrupted page, skip the rest of it
+        _pos += n;
+    }
+    _receivedMs += d[0];
+    _timeStamp += d[1];
+    _frequency += (int32_t)d[2];
+    _recordsLeft--;
+    return true;
+}
+
+// Reads the next valid page, moving through the segments oldest first
+bool TraceReplay::loadPage()
+{
+    for (;;)
+    {
+        if (!_file)
+        {
+            if (_segment >= TraceRecorder::SEGMENT_COUNT) return false;
+            char path[24];
+            _recorder->segmentPath(_segment++, path, sizeof(path));
+            if (!LittleFS.exists(path)) continue;
+            _file = LittleFS.open(path, "r");
+            if (!_file) continue;
+        }
+
+        if (_file.read(_page.data, TraceRecorder::PAGE_SIZE) != TraceRecorder::PAGE_SIZE)
+        {
+            _file.close();
+            continue;
+        }
+        if (_page.data[0] != TraceRecorder::PAGE_MAGIC) continue;
+
+        _receivedMs = TraceRecorder::readLe(_page.data + 4, 8);
+        _timeStamp = TraceRecorder::readLe(_page.data + 12, 8);
+        _frequency = (int32_t)TraceRecorder::readLe(_page.data + 20, 4);
+        _recordsLeft = _page.data[1];
+        _pos = TraceRecorder::HEADER_SIZE;
+        return true;
+    }
+}
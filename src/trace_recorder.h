@@ -0,0 +1,111 @@
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <FS.h>
+
+// Records the applied samples to a ring of segment files on LittleFS.
+//
+// Each sample is delta encoded against the previous one (receive time in
+// ms, time_stamp and frequency in mHz, as zigzag varints, ~5 bytes) into a
+// 256 byte RAM page. Full pages are handed to a low priority writer task,
+// so recording from the ingest path is a few byte stores and never waits
+// on flash. Every page starts with absolute values and decodes on its own.
+
+class TraceRecorder
+{
+public:
+    enum { PAGE_SIZE = 256, SEGMENT_PAGES = 64, SEGMENT_COUNT = 8 };
+    enum { HEADER_SIZE = 24, MAX_RECORD_SIZE = 3 * 10 };
+
+    struct Page
+    {
+        uint8_t data[PAGE_SIZE];
+    };
+
+    // Page layout: magic, record count, 2 reserved, then little endian
+    // receive epoch ms (8), time_stamp (8), frequency mHz (4), then records
+    enum { PAGE_MAGIC = 0xE7 };
+
+    bool begin();
+
+    // Appends a sample, called from the ingest path
+    void record(uint64_t receivedMs, uint64_t timeStamp, float frequency);
+
+    // Closes the current page early so it reaches flash, waits up to timeoutMs
+    // for the writer (0: hand off only if the writer is idle, do not wait)
+    bool sync(uint32_t timeoutMs);
+
+    // Removes all segments
+    void clear();
+
+    // Path of the n-th segment, oldest first (n < SEGMENT_COUNT)
+    void segmentPath(uint8_t n, char* path, size_t len) const;
+
+    void printStatus(Print& out) const;
+
+    // Helpers shared with the replay
+    static uint64_t readLe(const uint8_t* p, uint8_t bytes);
+    static size_t readVarint(const uint8_t* p, size_t len, int64_t& value);
+
+private:
+    void startPage(uint64_t receivedMs, uint64_t timeStamp, int32_t frequencyMilliHz);
+    void handOff();
+    void writePending();
+    static void writerTask(void* context);
+
+    Page _pages[2];
+    uint8_t _active = 0;             // page being filled
+    size_t _fill = 0;                // bytes used in the active page, 0 if empty
+    uint64_t _lastReceivedMs = 0;
+    uint64_t _lastTimeStamp = 0;
+    int32_t _lastFrequency = 0;
+    std::atomic<bool> _pending{false}; // a full page waits for the writer
+    uint8_t _pendingIndex = 0;
+    void* _task = nullptr;
+    bool _ready = false;
+
+    uint8_t _segment = 0;             // segment being written
+    uint16_t _segmentPages = 0;       // pages already in it
+};
+
+// Plays a stored trace through the application, at 1x or faster, using the
+// virtual application clock so the display follows the recorded time.
+class TraceReplay
+{
+public:
+    typedef void (*SampleHandler)(uint64_t timeStamp, float frequency);
+
+    bool start(const TraceRecorder& recorder, uint16_t speed, SampleHandler handler);
+    void stop();
+    bool active() const { return _active; }
+
+    // Emits the samples that are due, returns false once the trace is over
+    bool poll();
+
+private:
+    bool nextSample();
+    bool loadPage();
+
+    const TraceRecorder* _recorder = nullptr;
+    SampleHandler _handler = nullptr;
+    bool _active = false;
+    File _file;
+    uint8_t _segment = 0;             // n-th oldest segment being read
+    TraceRecorder::Page _page;
+    size_t _pos = 0;
+    uint8_t _recordsLeft = 0;
+
+    // next sample to emit
+    uint64_t _receivedMs = 0;
+    uint64_t _timeStamp = 0;
+    int32_t _frequency = 0;
+    bool _havePending = false;
+    uint32_t _replayed = 0;
+};
+
+extern TraceRecorder traceRecorder;
+extern TraceReplay traceReplay;
+
+#endif
@@ -0,0 +1,346 @@
+// Host benchmarks of the hot paths (pio test -e native -f test_bench).
+// Times are host times, useful to compare changes on one machine, not as
+// device figures; the operation counts (GPIO writes and toggles, bytes) are
+// exact. The firmware runs unmodified, setup() included, on the ArduinoHost
+// library (host/lib).
+#include <Arduino.h>
+#include <ArduinoHost.h>
+#include <unity.h>
+#include <chrono>
+#include "HCMS39xx.h"
+#include "SwitecX12.h"
+#include "gauge_freq_meter.h"
+#include "display_service.h"
+#include "Metrics.h"
+
+// from src/main.cpp
+extern HCMS39xx display;
+extern DisplayService displayService;
+extern GaugeFreqMeter<ActiveGrid> gaugeFreqMeter;
+void fetchWebServiceData(uint8_t source, uint8_t* payload, size_t length);
+uint32_t counterValue(const char* name);
+void setup();
+
+static const int ITERATIONS = 2000;
+
+// The display wiring of main.cpp: HCMS39xx display(8, D10, D2, D8, D0, D3)
+static const uint8_t displayDataPin = D10;
+static const uint8_t displayClockPin = D8;
+static const uint8_t displayEnablePin = D0;
+
+typedef std::chrono::steady_clock Clock;
+
+static double usPerCall(Clock::time_point t0, int calls)
+{
+    return std::chrono::duration<double, std::micro>(Clock::now() - t0).count() / calls;
+}
+
+static void report(const char* name, double us, const char* extra = "")
+{
+    char line[160];
+    snprintf(line, sizeof(line), "%-24s %9.3f us/call %s", name, us, extra);
+    TEST_MESSAGE(line);
+}
+
+static uint32_t counterDelta(const char* name, uint32_t before)
+{
+    return counterValue(name) - before;
+}
+
+// Step timer driven by the test: every tick() is one timer period, so
+// SwitecX12::advance() runs with nothing else around it
+static Histogram benchJitter("bench_step_jitter_us", "Step interval jitter of the bench timer");
+
+class BenchTimer : public StepTimer
+{
+public:
+    BenchTimer() : StepTimer(benchJitter) {}
+
+    const char* name() const override { return "bench"; }
+
+    bool begin(Callback callback, void* context) override
+    {
+        this->callback = callback;
+        this->context = context;
+        return true;
+    }
+
+    // Runs one period, returns the next one (0 once the needle stopped)
+    uint32_t tick()
+    {
+        _now += _period;
+        _period = fire(_now);
+        return _period;
+    }
+
+protected:
+    void arm(uint32_t periodUs) override { _period = periodUs; }
+    void disarm() override { _period = 0; }
+
+private:
+    int64_t _now = 0;
+    uint32_t _period = 0;
+};
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+// Runs the firmware until the needle stops, at most 10 s
+static bool settle()
+{
+    for (int i = 0; i < 100 && !gaugeFreqMeter.stopped(); i++) host::run(100000);
+    return gaugeFreqMeter.stopped();
+}
+
+void test_switec_advance()
+{
+    static SwitecX12 gauge;
+    static BenchTimer timer;
+    gauge.begin(11, 12, 13);
+    TEST_ASSERT_TRUE(gauge.setTimer(timer));
+
+    uint32_t steps0 = counterValue("motor_steps_total");
+    host::resetPinCounts();
+    long calls = 0;
+    Clock::time_point t0 = Clock::now();
+    for (int i = 0; i < ITERATIONS / 10; i++)
+    {
+        // full scale and back: acceleration, cruise and deceleration
+        gauge.setPosition(i % 2 == 0 ? gauge.Steps() - 1 : 0);
+        while (timer.tick() != 0) calls++;
+        calls++;
+    }
+    double us = usPerCall(t0, (int)calls);
+
+    uint32_t steps = counterDelta("motor_steps_total", steps0);
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)(ITERATIONS / 10) * (gauge.Steps() - 1), steps);
+    // a rising edge per step, the previous pulse ends at the next call
+    TEST_ASSERT_EQUAL_UINT32(2 * steps, host::pinToggles(11));
+
+    char extra[64];
+    snprintf(extra, sizeof(extra), "(%lu calls, %u steps)", calls, (unsigned)steps);
+    report("SwitecX12::advance", us, extra);
+}
+
+// The needle of main.cpp on each backend: the same steps, and on the
+// virtual clock no jitter but the microsecond rounding
+void test_step_timer_backends()
+{
+    const char* backends[] = { "esp", "hw" };
+    for (const char* backend : backends)
+    {
+        TEST_ASSERT_TRUE(settle());
+        TEST_ASSERT_TRUE(gaugeFreqMeter.setStepTimer(backend));
+        TEST_ASSERT_EQUAL_STRING(backend, gaugeFreqMeter.stepTimer());
+
+        char name[40];
+        snprintf(name, sizeof(name), "motor_step_jitter_%s_us", backend);
+        Histogram* jitter = Histogram::find(name);
+        TEST_ASSERT_NOT_NULL(jitter);
+        uint32_t intervals0 = jitter->count();
+        uint32_t steps0 = counterValue("motor_steps_total");
+        gaugeFreqMeter.setStep(GaugeFreqMeter<ActiveGrid>::frequencyToStep(ActiveGrid::maxFrequency() - 0.05f));
+        TEST_ASSERT_TRUE(settle());
+        gaugeFreqMeter.setStep(GaugeFreqMeter<ActiveGrid>::frequencyToStep(ActiveGrid::minFrequency() + 0.05f));
+        TEST_ASSERT_TRUE(settle());
+
+        uint32_t steps = counterDelta("motor_steps_total", steps0);
+        TEST_ASSERT_GREATER_THAN(0, steps);
+        // a call per step and one more that stops the timer, so one
+        // interval per step
+        TEST_ASSERT_EQUAL_UINT32(steps, jitter->count() - intervals0);
+        TEST_ASSERT_LESS_OR_EQUAL(1, jitter->max());
+
+        char line[96];
+        snprintf(line, sizeof(line), "%-3s backend: %u steps, jitter max %u us", backend, (unsigned)steps,
+                 (unsigned)jitter->max());
+        TEST_MESSAGE(line);
+    }
+    TEST_ASSERT_TRUE(gaugeFreqMeter.setStepTimer("esp"));
+}
+
+void test_display_print()
+{
+    displayService.suspend(); // the driver is used directly, as by the console bench
+    uint32_t bytes0 = counterValue("display_bytes_total");
+    uint32_t writes0 = counterValue("display_gpio_writes_total");
+    host::resetPinCounts();
+
+    Clock::time_point t0 = Clock::now();
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        display.print("88:88:88");
+    }
+    double us = usPerCall(t0, ITERATIONS);
+
+    // 8 characters of 5 columns, 3 writes per bit, 3 to set up and 2 to end
+    const uint32_t bytes = 8 * 5;
+    TEST_ASSERT_EQUAL_UINT32(ITERATIONS * bytes, counterDelta("display_bytes_total", bytes0));
+    TEST_ASSERT_EQUAL_UINT32(ITERATIONS * (bytes * 24 + 5), counterDelta("display_gpio_writes_total", writes0));
+    TEST_ASSERT_EQUAL_UINT32(ITERATIONS * (bytes * 16 + 2), host::pinWrites(displayClockPin));
+    TEST_ASSERT_EQUAL_UINT32(ITERATIONS * bytes * 8, host::pinWrites(displayDataPin));
+
+    char extra[96];
+    snprintf(extra, sizeof(extra), "(%u GPIO writes, %u clock and %u data toggles per call)",
+             (unsigned)(bytes * 24 + 5), (unsigned)(host::pinToggles(displayClockPin) / ITERATIONS),
+             (unsigned)(host::pinToggles(displayDataPin) / ITERATIONS));
+    report("HCMS39xx::print", us, extra);
+    displayService.resume();
+}
+
+// The bits shifted out, read back at the rising clock edges while enabled,
+// like the chip does
+static uint32_t shiftedBits = 0;
+static uint8_t shiftedBytes[64];
+
+static void sampleData(uint8_t pin, int level, int64_t atUs)
+{
+    (void)atUs;
+    if (pin != displayClockPin || level != HIGH || host::pinLevel(displayEnablePin) != LOW) return;
+    if (shiftedBits >= 8 * sizeof(shiftedBytes)) return;
+    uint8_t& b = shiftedBytes[shiftedBits / 8];
+    b = (uint8_t)((b << 1) | host::pinLevel(displayDataPin));
+    shiftedBits++;
+}
+
+void test_display_send_byte()
+{
+    displayService.suspend();
+    static uint8_t columns[40];
+    for (uint8_t i = 0; i < sizeof(columns); i++) columns[i] = (uint8_t)(i * 37 + 1);
+    host::resetPinCounts();
+
+    Clock::time_point t0 = Clock::now();
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        display.printDirect(columns, sizeof(columns));
+    }
+    double us = usPerCall(t0, ITERATIONS * (int)sizeof(columns));
+    uint32_t dataToggles = host::pinToggles(displayDataPin);
+
+    // the bytes arrive msb first, in order
+    static bool listening = false;
+    if (!listening) host::onPinChange(sampleData);
+    listening = true;
+    shiftedBits = 0;
+    memset(shiftedBytes, 0, sizeof(shiftedBytes));
+    display.printDirect(columns, sizeof(columns));
+    shiftedBits = 8 * sizeof(shiftedBytes); // stop sampling
+    for (uint8_t i = 0; i < sizeof(columns); i++) TEST_ASSERT_EQUAL_UINT8(columns[i], shiftedBytes[i]);
+
+    char extra[64];
+    snprintf(extra, sizeof(extra), "(24 GPIO writes, %.1f data toggles per byte)",
+             (double)dataToggles / (ITERATIONS * sizeof(columns)));
+    report("HCMS39xx::sendByte", us, extra);
+    displayService.resume();
+}
+
+void test_display_control_round_trip()
+{
+    displayService.suspend();
+    display.setBrightness(8); // uniform: simultaneous mode
+    uint32_t bytes0 = counterValue("display_bytes_total");
+
+    Clock::time_point t0 = Clock::now();
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        display.setBrightness(0, 9);
+        display.setBrightness(0, 8);
+    }
+    double us = usPerCall(t0, ITERATIONS);
+
+    // Each way: one mode switch (1 byte to serial, 1 per device back) and
+    // the control words (1 per device in serial mode, 1 in simultaneous)
+    const uint32_t devices = display.numDevices();
+    const uint32_t bytes = (1 + devices) + (devices + 1);
+    TEST_ASSERT_EQUAL_UINT32(ITERATIONS * bytes, counterDelta("display_bytes_total", bytes0));
+
+    // back in simultaneous mode: a uniform setting is one byte
+    bytes0 = counterValue("display_bytes_total");
+    display.setBrightness(8);
+    TEST_ASSERT_EQUAL_UINT32(1, counterDelta("display_bytes_total", bytes0));
+
+    char extra[64];
+    snprintf(extra, sizeof(extra), "(%u bytes per round trip)", (unsigned)bytes);
+    report("HCMS39xx control trip", us, extra);
+    displayService.resume();
+}
+
+void test_gauge_set_position()
+{
+    // from rest: starts the step timer
+    double startUs = 0;
+    for (int i = 0; i < ITERATIONS / 10; i++)
+    {
+        Clock::time_point t0 = Clock::now();
+        gaugeFreqMeter.setPosition(ActiveGrid::minFrequency() + (i % 2 == 0 ? 0.2f : 0.1f));
+        startUs += usPerCall(t0, 1);
+        TEST_ASSERT_TRUE(settle());
+    }
+    report("GaugeFreqMeter::setPosition", startUs / (ITERATIONS / 10), "(from rest)");
+
+    // while moving: a new target only
+    Clock::time_point t0 = Clock::now();
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        gaugeFreqMeter.setPosition(ActiveGrid::minFrequency() + (i % 100) * 0.01f);
+    }
+    report("GaugeFreqMeter::setPosition", usPerCall(t0, ITERATIONS), "(moving)");
+    TEST_ASSERT_TRUE(settle());
+}
+
+void test_fetch_web_service_data()
+{
+    uint32_t received0 = counterValue("ingest_messages_total");
+    uint32_t rejected0 = counterValue("ingest_rejected_total");
+    char message[96];
+    Clock::time_point t0 = Clock::now();
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        int length = snprintf(message, sizeof(message), "{\"time_stamp\": %llu, \"frequency\": %.3f}",
+                              1718000000000ULL + 1000ULL * i, ActiveGrid::nominalHz() - 0.02 + (i % 40) * 0.001);
+        fetchWebServiceData(0, (uint8_t*)message, length);
+    }
+    report("fetchWebServiceData", usPerCall(t0, ITERATIONS), "(parse and apply, one source)");
+    TEST_ASSERT_EQUAL_UINT32(ITERATIONS, counterDelta("ingest_messages_total", received0));
+    TEST_ASSERT_EQUAL_UINT32(0, counterDelta("ingest_rejected_total", rejected0));
+
+    // the rejections are counted, not applied
+    static char malformed[] = "{\"time_stamp\": 1718000000, \"frequency\":";
+    fetchWebServiceData(0, (uint8_t*)malformed, sizeof(malformed) - 1);
+    TEST_ASSERT_EQUAL_UINT32(1, counterDelta("ingest_rejected_total", rejected0));
+    host::run(1000000);
+}
+
+void test_typed_metric_lookup()
+{
+    TEST_ASSERT_NOT_NULL(Counter::find("ingest_messages_total"));
+    TEST_ASSERT_NULL(Counter::find("heap_free_bytes"));     // a gauge
+    TEST_ASSERT_NOT_NULL(Gauge::find("heap_free_bytes"));
+    TEST_ASSERT_NULL(Histogram::find("ingest_messages_total"));
+    TEST_ASSERT_EQUAL_UINT32(0, counterValue("heap_free_bytes"));
+    TEST_ASSERT_EQUAL_UINT32(0, counterValue("no_such_metric"));
+}
+
+int main(int argc, char** argv)
+{
+    host::setSerialOutput([](const char*, size_t) {});
+    host::addHost("electime", 0x0100007f); // the default server, 127.0.0.1
+    setup();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_typed_metric_lookup);
+    RUN_TEST(test_switec_advance);
+    RUN_TEST(test_step_timer_backends);
+    RUN_TEST(test_display_print);
+    RUN_TEST(test_display_send_byte);
+    RUN_TEST(test_display_control_round_trip);
+    RUN_TEST(test_gauge_set_position);
+    RUN_TEST(test_fetch_web_service_data);
+    return UNITY_END();
+}
@@ -0,0 +1,190 @@
+// Whole firmware replay (pio test -e native -f test_firmware_sim).
+// The firmware, setup() included, fed by the GridFreqMonitor stand-in over
+// the in-process WebSockets, with the needle and the display modelled from
+// the pins: what the device shows must follow the feed, and a server
+// outage must be backfilled once the source reconnects. The same models
+// run the simulator (host/sim, [env:sim]).
+#include <Arduino.h>
+#include <ArduinoHost.h>
+#include <unity.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include "GridFeed.h"
+#include "HcmsPanel.h"
+#include "StepperProbe.h"
+#include "gauge_freq_meter.h"
+#include "display_renderer.h"
+#include "Metrics.h"
+
+// from src/main.cpp
+void setup();
+void loop();
+
+static const uint32_t serverIp = 0x0100007f;
+static const uint64_t startSec = 1718064000;         // 2024-06-11 00:00 UTC
+static const int64_t firstSampleUs = 10000000;       // after setup()
+static const int samples = 1800;
+
+static std::vector<GridFeed::Sample> series;
+static GridFeed feed(serverIp, 8765);
+static HcmsPanel panel(8, D10, D2, D8, D0, D3);      // HCMS39xx display(8, D10, D2, D8, D0, D3)
+static StepperProbe needle(D4, D5, 315 * 12);        // gaugeFreqMeter.begin(D4, D5, D1)
+
+// A slow swing of +/- 50 mHz, one sample per second, 300 ms late
+static float frequencyAt(int k)
+{
+    return roundf((ActiveGrid::nominal() + 0.05f * sinf(k / 60.0f)) * 1000.0f) / 1000.0f;
+}
+
+static void runLoop(int64_t untilUs)
+{
+    while (host::now() < untilUs) loop();
+}
+
+static bool isClock(const std::string& text)
+{
+    int h, m, s;
+    char end;
+    return text.size() == 8 && sscanf(text.c_str(), "%2d:%2d:%2d%c", &h, &m, &s, &end) == 3;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_display_shows_the_clock()
+{
+    runLoop(firstSampleUs + 60000000);
+    TEST_ASSERT_TRUE(panel.lit());
+    // a new second at least every 2 s (updates 1 s apart, polled every 100 ms)
+    std::string text = panel.text();
+    int64_t changedAt = host::now();
+    int64_t longest = 0;
+    int changes = 0;
+    while (host::now() < firstSampleUs + 120000000)
+    {
+        loop();
+        if (panel.text() == text) continue;
+        text = panel.text();
+        TEST_ASSERT_TRUE_MESSAGE(isClock(text), text.c_str());
+        if (host::now() - changedAt > longest) longest = host::now() - changedAt;
+        changedAt = host::now();
+        changes++;
+    }
+    TEST_ASSERT_GREATER_OR_EQUAL(50, changes);
+    TEST_ASSERT_LESS_OR_EQUAL(2000000, longest);
+}
+
+void test_needle_follows_the_feed()
+{
+    // direct mapping: the needle goes to the frequency of each sample
+    host::serialInput("predict off\n");
+    runLoop(host::now() + 2000000);
+    int checked = 0;
+    for (int k = 0; k < 300; k++)
+    {
+        const GridFeed::Sample* latest = feed.latest();
+        TEST_ASSERT_NOT_NULL(latest);
+        // the needle has settled a second after the sample
+        int64_t settled = latest->atUs + 900000;
+        runLoop(settled);
+        if (feed.latest() != latest) continue;
+        unsigned int target = GaugeFreqMeter<ActiveGrid>::frequencyToStep(latest->frequency);
+        TEST_ASSERT_UINT32_WITHIN(1, target, needle.position());
+        checked++;
+        runLoop(latest->atUs + 1000000);
+    }
+    TEST_ASSERT_GREATER_THAN(250, checked);
+}
+
+void test_outage_backfilled()
+{
+    Counter* backfillRequests = Counter::find("source_backfill_requests_total");
+    TEST_ASSERT_NOT_NULL(backfillRequests);
+    uint32_t requests0 = backfillRequests->value();
+    uint32_t published0 = feed.published();
+    feed.outage(30000000);
+    runLoop(host::now() + 45000000);
+
+    TEST_ASSERT_TRUE(feed.up());
+    TEST_ASSERT_EQUAL_UINT32(1, backfillRequests->value() - requests0);
+    TEST_ASSERT_EQUAL_UINT32(1, feed.backfillRequests());
+    // the samples published while it was down come back in the backfill,
+    // and those until the next connection attempt, 5 s apart at most
+    TEST_ASSERT_GREATER_OR_EQUAL(30, feed.backfilled());
+    TEST_ASSERT_LESS_OR_EQUAL(36, feed.backfilled());
+    TEST_ASSERT_GREATER_OR_EQUAL(44, feed.published() - published0);
+
+    char line[96];
+    snprintf(line, sizeof(line), "outage of 30 s: %u samples backfilled, needle at step %u",
+             (unsigned)feed.backfilled(), needle.position());
+    TEST_MESSAGE(line);
+}
+
+// Collects what Sparkline::writeTo() shifts out
+struct ColumnCapture
+{
+    std::vector<uint8_t> columns;
+    uint8_t numChars() const { return 8; }
+    void printDirect(const uint8_t* data, uint8_t length) { columns.insert(columns.end(), data, data + length); }
+};
+
+void test_backfill_fills_the_sparkline()
+{
+    host::serialInput("show spark\n");
+    feed.outage(20000000);
+    runLoop(host::now() + 30000000);
+    TEST_ASSERT_TRUE(feed.up());
+
+    // between two samples, the display task has run
+    const GridFeed::Sample* latest = feed.latest();
+    runLoop(latest->atUs + 900000);
+    TEST_ASSERT_TRUE(feed.latest() == latest);
+
+    // every published sample in order: the outage is in the history, no gap
+    Sparkline expected(ActiveGrid::minFrequency(), ActiveGrid::maxFrequency());
+    for (uint32_t k = 0; k < feed.published(); k++)
+    {
+        expected.addSample((uint32_t)series[k].timeStamp, series[k].frequency);
+    }
+    ColumnCapture capture;
+    expected.writeTo(capture);
+    TEST_ASSERT_EQUAL_UINT32(capture.columns.size(), panel.columns().size());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(capture.columns.data(), panel.columns().data(), capture.columns.size());
+
+    // and the needle stayed on the live samples
+    TEST_ASSERT_UINT32_WITHIN(1, GaugeFreqMeter<ActiveGrid>::frequencyToStep(latest->frequency), needle.position());
+    host::serialInput("show clock\n");
+}
+
+int main(int argc, char** argv)
+{
+    host::setSerialOutput([](const char*, size_t) {});
+    host::addHost("electime", serverIp);
+    host::setEpochUs((int64_t)startSec * 1000000 - firstSampleUs); // kept across the reset
+
+    for (int k = 0; k < samples; k++)
+    {
+        GridFeed::Sample s;
+        s.atUs = host::now() + firstSampleUs + k * 1000000LL + 300000;
+        s.timeStamp = startSec + k;
+        s.frequency = frequencyAt(k);
+        series.push_back(s);
+    }
+    panel.attach();
+    needle.attach();
+    feed.play(series);
+    setup();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_display_shows_the_clock);
+    RUN_TEST(test_needle_follows_the_feed);
+    RUN_TEST(test_outage_backfilled);
+    RUN_TEST(test_backfill_fills_the_sparkline);
+    return UNITY_END();
+}
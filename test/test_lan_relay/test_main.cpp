@@ -0,0 +1,330 @@
+// LAN relay harness (pio test -e native -f test_lan_relay).
+// Several LanRelay instances, each standing for a unit of the LAN with its
+// own node id and loop() cadence, talk over the host's loopback UDP. An
+// upstream server publishes a sample every second; whichever units are
+// relays apply it at their next loop() and rebroadcast it, the listeners
+// apply the frames they receive. The harness measures the server load
+// (units connected upstream), the skew between the units applying the
+// same sample, the election and failover times and the samples lost.
+#include <Arduino.h>
+#include <ArduinoHost.h>
+#include <unity.h>
+#include <map>
+#include <vector>
+#include "lan_relay.h"
+#include "Metrics.h"
+
+enum { UNITS = 5 };
+
+static const int64_t loopUs = 100000;         // loop() period of main.cpp
+static const int64_t samplePeriodUs = 1000000; // GridFreqMonitor publishes every second
+static const uint64_t epochMs = 1718000000000ULL;
+
+struct Unit
+{
+    LanRelay relay{ IPAddress(239, 255, 50, 50), 5050 };
+    uint32_t id = 0;
+    bool running = false;
+    int64_t nextLoopUs = 0;
+    size_t upstreamSeen = 0;                   // upstream samples already consumed
+    std::map<uint64_t, int64_t> applied;      // sample time stamp -> when applied
+};
+
+static Unit units[UNITS];
+static std::vector<std::pair<uint64_t, int64_t> > upstream; // time stamp, published at
+static int64_t nextSampleUs = 0;
+
+// Server load: connected units integrated over time, and the worst moment
+static int64_t connectedUnitUs = 0;
+static int maxConnected = 0;
+
+template <int N>
+static void onSample(uint64_t timeStamp, float frequency)
+{
+    (void)frequency;
+    units[N].applied.insert(std::make_pair(timeStamp, host::now()));
+}
+
+static const LanRelay::SampleHandler sampleHandlers[UNITS] = { onSample<0>, onSample<1>, onSample<2>, onSample<3>, onSample<4> };
+
+static void start(int i)
+{
+    // LanRelay takes its node id from the MAC when it begins
+    host::setEfuseMac(0x24dc00000000ULL | units[i].id);
+    units[i].relay.begin(sampleHandlers[i], nullptr);
+    units[i].running = true;
+    units[i].upstreamSeen = upstream.size();
+    units[i].nextLoopUs = host::now() + loopUs;
+}
+
+static void stop(int i)
+{
+    units[i].relay.end();
+    units[i].running = false;
+}
+
+static int count(LanRelay::Role role)
+{
+    int n = 0;
+    for (int i = 0; i < UNITS; i++)
+    {
+        if (units[i].running && units[i].relay.role() == role) n++;
+    }
+    return n;
+}
+
+static int relayIndex()
+{
+    for (int i = 0; i < UNITS; i++)
+    {
+        if (units[i].running && units[i].relay.role() == LanRelay::ROLE_RELAY) return i;
+    }
+    return -1;
+}
+
+// A loop() pass of unit i: frames and election first, then the upstream
+// samples if it is connected (the WebSocket is polled in the same loop)
+static void unitLoop(Unit& unit)
+{
+    unit.relay.loop();
+    if (unit.relay.role() != LanRelay::ROLE_RELAY)
+    {
+        unit.upstreamSeen = upstream.size(); // not connected: never sees them
+        return;
+    }
+    for (; unit.upstreamSeen < upstream.size(); unit.upstreamSeen++)
+    {
+        uint64_t timeStamp = upstream[unit.upstreamSeen].first;
+        unit.applied.insert(std::make_pair(timeStamp, host::now()));
+        unit.relay.broadcast(timeStamp, 50.0f);
+    }
+}
+
+// Runs the LAN for us; until() stops early when it returns true
+template <typename Stop>
+static int64_t runFor(int64_t us, Stop until)
+{
+    int64_t end = host::now() + us;
+    while (host::now() < end)
+    {
+        int64_t next = nextSampleUs;
+        for (int i = 0; i < UNITS; i++)
+        {
+            if (units[i].running && units[i].nextLoopUs < next) next = units[i].nextLoopUs;
+        }
+        if (next > end) next = end;
+        int connected = count(LanRelay::ROLE_RELAY);
+        connectedUnitUs += connected * (next - host::now());
+        host::run(next - host::now());
+
+        if (host::now() >= nextSampleUs)
+        {
+            upstream.push_back(std::make_pair(epochMs + (uint64_t)(nextSampleUs / 1000), nextSampleUs));
+            nextSampleUs += samplePeriodUs;
+        }
+        for (int i = 0; i < UNITS; i++)
+        {
+            if (!units[i].running || units[i].nextLoopUs > host::now()) continue;
+            unitLoop(units[i]);
+            units[i].nextLoopUs += loopUs;
+        }
+        connected = count(LanRelay::ROLE_RELAY);
+        if (connected > maxConnected) maxConnected = connected;
+        if (until()) return host::now();
+    }
+    return host::now();
+}
+
+static void runFor(int64_t us)
+{
+    runFor(us, [] { return false; });
+}
+
+// Exactly one relay, everyone else listening
+static bool settled()
+{
+    int running = 0;
+    for (int i = 0; i < UNITS; i++) running += units[i].running ? 1 : 0;
+    return count(LanRelay::ROLE_RELAY) == 1 && count(LanRelay::ROLE_LISTENER) == running - 1;
+}
+
+struct Delivery
+{
+    uint32_t samples = 0;      // published while the measurement ran
+    uint32_t missed = 0;       // (unit, sample) pairs never applied
+    double meanSkewUs = 0;     // first to last unit applying a sample
+    int64_t maxSkewUs = 0;
+    int64_t maxLatencyUs = 0;  // publication to the last unit applying it
+};
+
+// Samples published in [fromUs, toUs) as applied by the running units
+static Delivery delivery(int64_t fromUs, int64_t toUs)
+{
+    Delivery d;
+    double skewSum = 0;
+    uint32_t skewCount = 0;
+    for (size_t s = 0; s < upstream.size(); s++)
+    {
+        if (upstream[s].second < fromUs || upstream[s].second >= toUs) continue;
+        d.samples++;
+        int64_t first = INT64_MAX;
+        int64_t last = INT64_MIN;
+        for (int i = 0; i < UNITS; i++)
+        {
+            if (!units[i].running) continue;
+            std::map<uint64_t, int64_t>::const_iterator it = units[i].applied.find(upstream[s].first);
+            if (it == units[i].applied.end())
+            {
+                d.missed++;
+                continue;
+            }
+            if (it->second < first) first = it->second;
+            if (it->second > last) last = it->second;
+        }
+        if (first > last) continue;
+        skewSum += (double)(last - first);
+        skewCount++;
+        if (last - first > d.maxSkewUs) d.maxSkewUs = last - first;
+        if (last - upstream[s].second > d.maxLatencyUs) d.maxLatencyUs = last - upstream[s].second;
+    }
+    d.meanSkewUs = skewCount ? skewSum / skewCount : 0;
+    return d;
+}
+
+static void report(const char* what, const Delivery& d, int64_t spanUs)
+{
+    char line[200];
+    snprintf(line, sizeof(line), "%s: %u samples, %u missed, skew %.1f ms mean %.1f ms max, latency %.1f ms max, "
+             "server load %.2f connections (max %d, %d without relay)",
+             what, (unsigned)d.samples, (unsigned)d.missed, d.meanSkewUs / 1000, d.maxSkewUs / 1000.0,
+             d.maxLatencyUs / 1000.0, (double)connectedUnitUs / spanUs, maxConnected, UNITS);
+    TEST_MESSAGE(line);
+}
+
+static void resetLoad()
+{
+    connectedUnitUs = 0;
+    maxConnected = count(LanRelay::ROLE_RELAY);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_election()
+{
+    // the units boot in a different order than their ids, 170 ms apart
+    int64_t t0 = host::now();
+    for (int i = 0; i < UNITS; i++)
+    {
+        start(i);
+        runFor(170000);
+    }
+    int64_t electedAt = runFor(15000000, settled);
+    TEST_ASSERT_TRUE(settled());
+    // nobody heard a relay: the first to time out stands, unchallenged
+    int64_t electionUs = electedAt - t0;
+    TEST_ASSERT_LESS_OR_EQUAL(3500000 + 1000000 + 1500000 + 2 * loopUs + UNITS * 170000, electionUs);
+
+    char line[96];
+    snprintf(line, sizeof(line), "election from boot: %.2f s, relay node %x",
+             electionUs / 1e6, (unsigned)units[relayIndex()].id);
+    TEST_MESSAGE(line);
+}
+
+void test_steady_state()
+{
+    Counter* gaps = Counter::find("relay_sample_gaps_total");
+    uint32_t gaps0 = gaps->value();
+    resetLoad();
+    int64_t from = host::now();
+    runFor(60000000);
+    TEST_ASSERT_TRUE(settled());
+
+    // every unit applies every sample, one connection to the server
+    Delivery d = delivery(from, host::now() - loopUs);
+    TEST_ASSERT_GREATER_OR_EQUAL(59, d.samples);
+    TEST_ASSERT_EQUAL_UINT32(0, d.missed);
+    TEST_ASSERT_EQUAL_UINT32(0, gaps->value() - gaps0);
+    TEST_ASSERT_EQUAL_INT(1, maxConnected);
+    // the relay and the listeners each apply it at their next loop()
+    TEST_ASSERT_LESS_OR_EQUAL(loopUs, d.maxSkewUs);
+    TEST_ASSERT_LESS_OR_EQUAL(2 * loopUs, d.maxLatencyUs);
+    report("steady state", d, host::now() - from);
+}
+
+void test_failover()
+{
+    int old = relayIndex();
+    TEST_ASSERT_TRUE(old >= 0);
+    resetLoad();
+    int64_t from = host::now();
+    stop(old);
+    int64_t electedAt = runFor(15000000, settled);
+    TEST_ASSERT_TRUE(settled());
+    int64_t failoverUs = electedAt - from;
+    // silence timeout with its jitter, then the claim period
+    TEST_ASSERT_LESS_OR_EQUAL(3500000 + 1000000 + 1500000 + 2 * loopUs, failoverUs);
+    TEST_ASSERT_EQUAL_INT(1, maxConnected);
+    runFor(10000000);
+    Delivery d = delivery(from, host::now() - loopUs);
+    // the samples published without a relay are lost, not more
+    TEST_ASSERT_LESS_OR_EQUAL((uint32_t)((UNITS - 1) * (failoverUs / samplePeriodUs + 1)), d.missed);
+
+    // the old relay comes back as a listener, the load stays at one connection
+    start(old);
+    runFor(10000000);
+    TEST_ASSERT_TRUE(settled());
+    TEST_ASSERT_EQUAL_INT(LanRelay::ROLE_LISTENER, units[old].relay.role());
+    TEST_ASSERT_EQUAL_INT(1, maxConnected);
+
+    char line[160];
+    snprintf(line, sizeof(line), "failover: new relay node %x after %.2f s, %u samples missed over the units",
+             (unsigned)units[relayIndex()].id, failoverUs / 1e6, (unsigned)d.missed);
+    TEST_MESSAGE(line);
+    report("failover", d, host::now() - from);
+}
+
+void test_lossy_link()
+{
+    // 10 % loss per delivery, 20 ms latency: heartbeats are lost but never
+    // three in a row often enough to start an election
+    host::setUdpLink(20000, 10);
+    Counter* gaps = Counter::find("relay_sample_gaps_total");
+    Counter* elections = Counter::find("relay_elections_total");
+    uint32_t gaps0 = gaps->value();
+    uint32_t elections0 = elections->value();
+    resetLoad();
+    int64_t from = host::now();
+    runFor(120000000);
+    host::setUdpLink(0, 0);
+
+    TEST_ASSERT_TRUE(settled());
+    TEST_ASSERT_EQUAL_UINT32(0, elections->value() - elections0);
+    Delivery d = delivery(from, host::now() - loopUs);
+    // every lost sample is seen as a sequence gap by its listener, except
+    // at the very end where no later frame has shown it yet
+    TEST_ASSERT_GREATER_THAN(0, d.missed);
+    TEST_ASSERT_UINT32_WITHIN(UNITS, d.missed, gaps->value() - gaps0);
+    TEST_ASSERT_LESS_OR_EQUAL(loopUs + 20000, d.maxSkewUs);
+    report("10 % loss, 20 ms", d, host::now() - from);
+}
+
+int main(int argc, char** argv)
+{
+    host::setSerialOutput([](const char*, size_t) {});
+    const uint32_t ids[UNITS] = { 0x30, 0x10, 0x50, 0x20, 0x40 };
+    for (int i = 0; i < UNITS; i++) units[i].id = ids[i];
+    nextSampleUs = host::now() + samplePeriodUs;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_election);
+    RUN_TEST(test_steady_state);
+    RUN_TEST(test_failover);
+    RUN_TEST(test_lossy_link);
+    return UNITY_END();
+}
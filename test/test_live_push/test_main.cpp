@@ -0,0 +1,234 @@
+// Live push load test (pio test -e native -f test_live_push).
+// The livePush server of main.cpp on the host's loopback
+// (host::useHostSockets()) with every subscriber slot taken: readers that
+// keep up must get every event in order, while stalled readers only lose
+// their own oldest frames and are closed after 10 s without progress. The
+// cost of publish() is reported, and must not depend on the slow readers.
+#include <Arduino.h>
+#include <ArduinoHost.h>
+#include <unity.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <lwip/sockets.h>
+#include "live_push.h"
+#include "Metrics.h"
+
+static const uint16_t portOffset = 18000;
+static const uint16_t port = 81;               // livePush in main.cpp
+static const int fastReaders = 6;
+static const int stalledReaders = LivePushServer::MAX_CLIENTS - fastReaders;
+static const uint32_t events = 5000;
+
+typedef std::chrono::steady_clock Clock;
+
+// A subscriber on a real socket, counting the events it decoded
+struct Reader
+{
+    int fd = -1;
+    std::string input;
+    bool headers = false;
+    uint32_t received = 0;
+    uint32_t lastSeq = 0;
+    bool inOrder = true;
+    bool closed = false;
+};
+
+static Reader readers[LivePushServer::MAX_CLIENTS];
+
+static int connectReader(int receiveBuffer)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    TEST_ASSERT_TRUE(fd >= 0);
+    // set before connect, so the window stays small
+    if (receiveBuffer > 0) setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port + portOffset);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TEST_ASSERT_EQUAL_INT(0, connect(fd, (struct sockaddr*)&addr, sizeof(addr)));
+    static const char request[] = "GET / HTTP/1.1\r\nHost: device\r\nAccept: text/event-stream\r\n\r\n";
+    TEST_ASSERT_EQUAL_INT((int)sizeof(request) - 1, (int)send(fd, request, sizeof(request) - 1, 0));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+// Reads what is there, decodes the complete events
+static void drain(Reader& reader)
+{
+    char buffer[4096];
+    ssize_t n;
+    while ((n = recv(reader.fd, buffer, sizeof(buffer), 0)) > 0) reader.input.append(buffer, (size_t)n);
+    if (n == 0) reader.closed = true;
+
+    size_t end;
+    while ((end = reader.input.find("\n\n")) != std::string::npos)
+    {
+        std::string block = reader.input.substr(0, end);
+        reader.input.erase(0, end + 2);
+        unsigned seq;
+        if (block.compare(0, 9, "HTTP/1.1 ") == 0 || block.compare(0, 6, "retry:") == 0)
+        {
+            reader.headers = true;
+        }
+        else if (sscanf(block.c_str(), "data: {\"seq\":%u", &seq) == 1)
+        {
+            if (seq != reader.lastSeq + 1) reader.inOrder = false;
+            reader.lastSeq = seq;
+            reader.received++;
+        }
+    }
+}
+
+static void serviceAll()
+{
+    livePush.loop();
+    for (int i = 0; i < fastReaders; i++) drain(readers[i]);
+}
+
+static uint32_t counter(const char* name)
+{
+    Counter* c = Counter::find(name);
+    TEST_ASSERT_NOT_NULL(c);
+    return c->value();
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_subscribers_accepted()
+{
+    for (int i = 0; i < LivePushServer::MAX_CLIENTS; i++)
+    {
+        // the stalled readers take 2 KB and never read
+        readers[i].fd = connectReader(i < fastReaders ? 0 : 2048);
+    }
+    for (int round = 0; round < 1000 && livePush.clients() < LivePushServer::MAX_CLIENTS; round++)
+    {
+        serviceAll();
+        usleep(1000);
+    }
+    TEST_ASSERT_EQUAL_UINT8(LivePushServer::MAX_CLIENTS, livePush.clients());
+
+    // one more is turned away
+    Reader extra;
+    extra.fd = connectReader(0);
+    for (int round = 0; round < 1000 && !extra.closed; round++)
+    {
+        serviceAll();
+        drain(extra);
+        usleep(100);
+    }
+    TEST_ASSERT_TRUE(extra.closed);
+    close(extra.fd);
+    TEST_ASSERT_EQUAL_UINT8(LivePushServer::MAX_CLIENTS, livePush.clients());
+
+    for (int round = 0; round < 1000; round++)
+    {
+        bool all = true;
+        serviceAll();
+        for (int i = 0; i < fastReaders; i++) all = all && readers[i].headers;
+        if (all) break;
+        usleep(100);
+    }
+    for (int i = 0; i < fastReaders; i++) TEST_ASSERT_TRUE(readers[i].headers);
+}
+
+void test_fast_readers_get_every_event()
+{
+    uint32_t dropped0 = counter("live_frames_dropped_total");
+    uint32_t exhausted0 = counter("live_pool_exhausted_total");
+    // about 150 bytes per frame, like a sample with a long source name
+    const char* pad = "................................................................................";
+
+    double publishUs = 0;
+    double loopUs = 0;
+    for (uint32_t seq = 1; seq <= events; seq++)
+    {
+        Clock::time_point t0 = Clock::now();
+        TEST_ASSERT_TRUE(livePush.publish(nullptr, "{\"seq\":%u,\"frequency\":%.3f,\"pad\":\"%s\"}", (unsigned)seq,
+                                          50.0 + (seq % 100) * 0.001, pad));
+        Clock::time_point t1 = Clock::now();
+        livePush.loop();
+        Clock::time_point t2 = Clock::now();
+        publishUs += std::chrono::duration<double, std::micro>(t1 - t0).count();
+        loopUs += std::chrono::duration<double, std::micro>(t2 - t1).count();
+        for (int i = 0; i < fastReaders; i++) drain(readers[i]);
+    }
+    for (int round = 0; round < 100; round++)
+    {
+        serviceAll();
+        usleep(100);
+    }
+
+    for (int i = 0; i < fastReaders; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(events, readers[i].received);
+        TEST_ASSERT_TRUE(readers[i].inOrder);
+    }
+    // the stalled readers dropped their oldest frames, the pool never ran out
+    uint32_t dropped = counter("live_frames_dropped_total") - dropped0;
+    TEST_ASSERT_GREATER_THAN(0, dropped);
+    TEST_ASSERT_EQUAL_UINT32(0, counter("live_pool_exhausted_total") - exhausted0);
+
+    char line[160];
+    snprintf(line, sizeof(line), "%u events to %d readers (%d stalled): publish %.2f us, loop %.2f us, %u frames dropped",
+             (unsigned)events, LivePushServer::MAX_CLIENTS, stalledReaders, publishUs / events, loopUs / events,
+             (unsigned)dropped);
+    TEST_MESSAGE(line);
+}
+
+void test_frame_too_long_not_sent()
+{
+    uint32_t frames0 = counter("live_frames_total");
+    std::string text(LivePushServer::FRAME_SIZE, 'x');
+    TEST_ASSERT_FALSE(livePush.publish("stats", "{\"text\":\"%s\"}", text.c_str()));
+    TEST_ASSERT_EQUAL_UINT32(frames0, counter("live_frames_total"));
+
+    // the pool is intact: the next event reaches everyone
+    TEST_ASSERT_TRUE(livePush.publish(nullptr, "{\"seq\":%u}", (unsigned)events + 1));
+    for (int round = 0; round < 100; round++)
+    {
+        serviceAll();
+        usleep(100);
+    }
+    for (int i = 0; i < fastReaders; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(events + 1, readers[i].lastSeq);
+        TEST_ASSERT_TRUE(readers[i].inOrder);
+    }
+}
+
+void test_stalled_readers_closed()
+{
+    host::run(11000000);
+    TEST_ASSERT_TRUE(livePush.publish(nullptr, "{\"seq\":%u}", (unsigned)events + 2));
+    serviceAll();
+    TEST_ASSERT_EQUAL_UINT8(fastReaders, livePush.clients());
+    for (int i = fastReaders; i < LivePushServer::MAX_CLIENTS; i++)
+    {
+        // what was in flight, then the end of the stream
+        for (int round = 0; round < 1000 && !readers[i].closed; round++) drain(readers[i]);
+        TEST_ASSERT_TRUE(readers[i].closed);
+        TEST_ASSERT_LESS_THAN(events, readers[i].received);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    host::useHostSockets(true, portOffset);
+    livePush.begin();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_subscribers_accepted);
+    RUN_TEST(test_fast_readers_get_every_event);
+    RUN_TEST(test_frame_too_long_not_sent);
+    RUN_TEST(test_stalled_readers_closed);
+    for (int i = 0; i < LivePushServer::MAX_CLIENTS; i++) close(readers[i].fd);
+    return UNITY_END();
+}
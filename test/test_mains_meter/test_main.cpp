@@ -0,0 +1,309 @@
+// Local mains measurement (pio test -e native -f test_mains_meter).
+// The estimator is fed synthetic zero crossing streams: exact, with timing
+// noise, with spurious and missing edges. The whole meter is then driven
+// from a comparator on a waveform with harmonics and noise, through the
+// pin interrupt and the edge queue, polled like loop() does, to measure the
+// accuracy and the update latency.
+#include <Arduino.h>
+#include <ArduinoHost.h>
+#include <unity.h>
+#include <math.h>
+#include <random>
+#include <algorithm>
+#include <vector>
+#include "MainsMeter.h"
+#include "Metrics.h"
+
+static const uint16_t nominalHz = 50;
+static const uint8_t cycles = 50;        // main.cpp: a 1 s window
+static const uint8_t sensePin = 20;
+static const uint32_t pollUs = 100000;   // loop() period
+
+static void report(const char* line)
+{
+    TEST_MESSAGE(line);
+}
+
+// Rising zero crossings of a sine at hz, from startUs
+static std::vector<uint32_t> edges(double hz, int count, double startUs = 1000.0)
+{
+    std::vector<uint32_t> out;
+    for (int i = 0; i < count; i++) out.push_back((uint32_t)lround(startUs + i * 1e6 / hz));
+    return out;
+}
+
+// Feeds edges, returns the estimates (mHz)
+static std::vector<uint32_t> feed(MainsFrequencyEstimator& estimator, const std::vector<uint32_t>& times)
+{
+    std::vector<uint32_t> out;
+    for (size_t i = 0; i < times.size(); i++)
+    {
+        if (estimator.addEdge(times[i])) out.push_back(estimator.frequencyMilliHz());
+    }
+    return out;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_clean_edges()
+{
+    const double frequencies[] = { 49.5, 49.8, 50.0, 50.137, 50.5 };
+    for (size_t f = 0; f < sizeof(frequencies) / sizeof(*frequencies); f++)
+    {
+        MainsFrequencyEstimator estimator(nominalHz, cycles);
+        std::vector<uint32_t> estimates = feed(estimator, edges(frequencies[f], 10 * cycles + 1));
+        // one estimate per window, the first when it is full
+        TEST_ASSERT_EQUAL_UINT32(10, estimates.size());
+        for (size_t i = 0; i < estimates.size(); i++)
+        {
+            TEST_ASSERT_INT_WITHIN(1, lround(frequencies[f] * 1000), estimates[i]);
+        }
+        TEST_ASSERT_EQUAL_UINT32(0, estimator.rejectedEdges());
+    }
+}
+
+void test_timer_wrap()
+{
+    // esp_timer_get_time() truncated to 32 bits wraps every 71 minutes
+    MainsFrequencyEstimator estimator(nominalHz, cycles);
+    std::vector<uint32_t> estimates = feed(estimator, edges(50.02, 3 * cycles + 1, 4294967296.0 - 1.5e6));
+    TEST_ASSERT_EQUAL_UINT32(3, estimates.size());
+    for (size_t i = 0; i < estimates.size(); i++) TEST_ASSERT_INT_WITHIN(1, 50020, estimates[i]);
+}
+
+void test_timing_noise()
+{
+    // zero crossing jitter from noise on the sense signal. Up to 50 us every
+    // edge stays in the 2 % lock window (400 us) and the error is that of
+    // the two edges of the window. Beyond, edges fall out of the window and
+    // restart it: fewer estimates, on whichever edges were kept, only
+    // reported.
+    const double sigmasUs[] = { 20, 50, 100, 200 };
+    for (size_t s = 0; s < sizeof(sigmasUs) / sizeof(*sigmasUs); s++)
+    {
+        std::mt19937 rng(31);
+        std::normal_distribution<double> jitter(0.0, sigmasUs[s]);
+        std::vector<uint32_t> times;
+        for (int i = 0; i < 100 * cycles + 1; i++) times.push_back((uint32_t)lround(10000.0 + i * 20000.0 + jitter(rng)));
+
+        MainsFrequencyEstimator estimator(nominalHz, cycles);
+        std::vector<uint32_t> estimates = feed(estimator, times);
+        TEST_ASSERT_GREATER_THAN(0, estimates.size());
+        double sum2 = 0;
+        double worst = 0;
+        for (size_t i = 0; i < estimates.size(); i++)
+        {
+            double err = (double)estimates[i] - 50000.0;
+            sum2 += err * err;
+            worst = fmax(worst, fabs(err));
+        }
+        double rms = sqrt(sum2 / estimates.size());
+        // two edges with sigma jitter over a 1 s span: sqrt(2) * sigma * 50 Hz / 1 s
+        double expected = sqrt(2.0) * sigmasUs[s] * 1e-6 * 50.0 * 1000.0;
+        if (sigmasUs[s] <= 50)
+        {
+            TEST_ASSERT_EQUAL_UINT32(100, estimates.size());
+            TEST_ASSERT_EQUAL_UINT32(0, estimator.resyncs());
+            TEST_ASSERT_LESS_THAN(2 * expected + 1, rms);
+        }
+
+        char line[160];
+        snprintf(line, sizeof(line), "jitter %3.0f us: error %.2f mHz rms, %.0f mHz worst (%.2f expected), "
+                 "%u/100 estimates, %u resyncs, %u edges rejected",
+                 sigmasUs[s], rms, worst, expected, (unsigned)estimates.size(),
+                 (unsigned)estimator.resyncs(), (unsigned)estimator.rejectedEdges());
+        report(line);
+    }
+}
+
+void test_spurious_edges()
+{
+    // extra crossings of a 3rd harmonic and glitches, between the real ones
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> where(0.05, 0.95);
+    std::vector<uint32_t> times;
+    uint32_t inserted = 0;
+    const double periodUs = 1e6 / 49.9;
+    for (int i = 0; i < 20 * cycles + 1; i++)
+    {
+        double t = 1000.0 + i * periodUs;
+        times.push_back((uint32_t)lround(t));
+        if (i == 20 * cycles) break;
+        times.push_back((uint32_t)lround(t + periodUs / 3));
+        times.push_back((uint32_t)lround(t + 2 * periodUs / 3));
+        inserted += 2;
+        if (i % 7 == 0)
+        {
+            times.push_back((uint32_t)lround(t + where(rng) * periodUs));
+            inserted++;
+        }
+    }
+    // the glitches are not in time order with the harmonic crossings
+    std::sort(times.begin(), times.end());
+
+    MainsFrequencyEstimator estimator(nominalHz, cycles);
+    std::vector<uint32_t> estimates = feed(estimator, times);
+    TEST_ASSERT_EQUAL_UINT32(20, estimates.size());
+    for (size_t i = 0; i < estimates.size(); i++) TEST_ASSERT_INT_WITHIN(1, 49900, estimates[i]);
+    TEST_ASSERT_EQUAL_UINT32(inserted, estimator.rejectedEdges());
+    TEST_ASSERT_EQUAL_UINT32(0, estimator.resyncs());
+}
+
+void test_missing_edge()
+{
+    std::vector<uint32_t> times = edges(50.1, 4 * cycles + 1);
+    times.erase(times.begin() + cycles + 10);   // a dropout in the second window
+
+    MainsFrequencyEstimator estimator(nominalHz, cycles);
+    std::vector<uint32_t> estimates = feed(estimator, times);
+    TEST_ASSERT_EQUAL_UINT32(1, estimator.resyncs());
+    // the window starts again after the gap: no estimate spans it
+    TEST_ASSERT_EQUAL_UINT32(3, estimates.size());
+    for (size_t i = 0; i < estimates.size(); i++) TEST_ASSERT_INT_WITHIN(1, 50100, estimates[i]);
+}
+
+// The sense signal through a comparator: fundamental plus 3rd and 5th
+// harmonics and white noise, sampled every stepUs. Rising output edges are
+// driven on the sense pin, which fires the meter's interrupt. The meter is
+// polled every pollUs.
+class SenseSignal
+{
+public:
+    SenseSignal(double third, double fifth, double noise) : _third(third), _fifth(fifth), _noise(0.0, noise), _rng(50) {}
+
+    void setFrequency(double hz) { _hz = hz; }
+
+    // Runs the signal for us from now on. The clock only moves to the
+    // comparator edges and the polls.
+    void run(MainsFrequencyMeter& meter, int64_t us, std::vector<std::pair<int64_t, uint32_t> >& estimates)
+    {
+        const int64_t stepUs = 2;
+        int64_t end = host::now() + us;
+        for (int64_t t = host::now() + stepUs; t <= end; t += stepUs)
+        {
+            _phase += 2 * M_PI * _hz * stepUs * 1e-6;
+            if (_phase > 2 * M_PI) _phase -= 2 * M_PI;
+            double v = sin(_phase) + _third * sin(3 * _phase + 0.5) + _fifth * sin(5 * _phase + 1.0) + _noise(_rng);
+            int level = v > 0 ? HIGH : LOW;
+            if (t >= _nextPoll)
+            {
+                host::run(t - host::now());
+                _nextPoll = t + pollUs;
+                float frequency;
+                if (meter.poll(frequency)) estimates.push_back(std::make_pair(t, (uint32_t)lround(frequency * 1000)));
+            }
+            if (level != _level)
+            {
+                host::run(t - host::now());
+                host::drivePin(sensePin, level);
+                _level = level;
+            }
+        }
+        host::run(end - host::now());
+    }
+
+private:
+    double _third;
+    double _fifth;
+    std::normal_distribution<double> _noise;
+    std::mt19937 _rng;
+    double _hz = 50.0;
+    double _phase = 0;
+    int _level = LOW;
+    int64_t _nextPoll = 0;
+};
+
+void test_waveform_accuracy()
+{
+    // strong enough harmonics for extra crossings per cycle, and chatter at
+    // every crossing from the noise
+    const Counter* edgesCaptured = Counter::find("mains_edges_total");
+    const Counter* edgesRejected = Counter::find("mains_edges_rejected_total");
+    uint32_t captured0 = edgesCaptured->value();
+    uint32_t rejected0 = edgesRejected->value();
+    MainsFrequencyMeter meter(nominalHz, cycles);
+    meter.begin(sensePin);
+    SenseSignal signal(0.45, 0.2, 0.05);
+    signal.setFrequency(49.95);
+    std::vector<std::pair<int64_t, uint32_t> > estimates;
+    signal.run(meter, 30000000, estimates);
+    meter.end();
+
+    TEST_ASSERT_GREATER_OR_EQUAL(28, estimates.size());
+    double sum2 = 0;
+    double worst = 0;
+    for (size_t i = 0; i < estimates.size(); i++)
+    {
+        double err = (double)estimates[i].second - 49950.0;
+        sum2 += err * err;
+        worst = fmax(worst, fabs(err));
+    }
+    double rms = sqrt(sum2 / estimates.size());
+    TEST_ASSERT_LESS_THAN(5.0, worst);
+    // the harmonics cross zero more than once per cycle, past the debounce
+    uint32_t captured = edgesCaptured->value() - captured0;
+    uint32_t rejected = edgesRejected->value() - rejected0;
+    TEST_ASSERT_GREATER_THAN(30 * 50, captured);
+    TEST_ASSERT_GREATER_THAN(0, rejected);
+
+    char line[160];
+    snprintf(line, sizeof(line), "harmonics + noise: %u estimates, error %.2f mHz rms, %.0f mHz worst, "
+             "%u edges captured, %u rejected", (unsigned)estimates.size(), rms, worst, (unsigned)captured, (unsigned)rejected);
+    report(line);
+}
+
+void test_update_latency()
+{
+    // a 100 mHz step: time until the estimate has it, within 5 mHz
+    MainsFrequencyMeter meter(nominalHz, cycles);
+    meter.begin(sensePin);
+    SenseSignal signal(0.1, 0.05, 0.02);
+    std::vector<std::pair<int64_t, uint32_t> > estimates;
+    signal.setFrequency(50.0);
+    signal.run(meter, 5000000, estimates);
+    int64_t stepAt = host::now();
+    signal.setFrequency(50.1);
+    estimates.clear();
+    signal.run(meter, 5000000, estimates);
+    meter.end();
+
+    int64_t settledAt = -1;
+    for (size_t i = 0; i < estimates.size() && settledAt < 0; i++)
+    {
+        if (abs((int)estimates[i].second - 50100) <= 5) settledAt = estimates[i].first;
+    }
+    TEST_ASSERT_TRUE(settledAt > 0);
+    int64_t latencyUs = settledAt - stepAt;
+    // the first window entirely after the step, then the next poll
+    const int64_t windowUs = (int64_t)cycles * 1000000 / nominalHz;
+    TEST_ASSERT_LESS_OR_EQUAL(2 * windowUs + pollUs, latencyUs);
+    // and an estimate every window
+    for (size_t i = 1; i < estimates.size(); i++)
+    {
+        TEST_ASSERT_INT_WITHIN(pollUs + 20000, windowUs, estimates[i].first - estimates[i - 1].first);
+    }
+
+    char line[120];
+    snprintf(line, sizeof(line), "100 mHz step: settled after %.2f s (window %.2f s, poll %.2f s)",
+             latencyUs / 1e6, windowUs / 1e6, pollUs / 1e6);
+    report(line);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_clean_edges);
+    RUN_TEST(test_timer_wrap);
+    RUN_TEST(test_timing_noise);
+    RUN_TEST(test_spurious_edges);
+    RUN_TEST(test_missing_edge);
+    RUN_TEST(test_waveform_accuracy);
+    RUN_TEST(test_update_latency);
+    return UNITY_END();
+}
@@ -0,0 +1,220 @@
+// Power policy (pio test -e native -f test_power_policy).
+// The policy on its own: states, hold time, accounting. Then the firmware,
+// setup() included: a motion started while idle must have raised the
+// clock before its first step and keep it up to its last one, with the
+// first step exactly when the step backend would have made it anyway.
+#include <Arduino.h>
+#include <ArduinoHost.h>
+#include <unity.h>
+#include <vector>
+#include "power_policy.h"
+#include "gauge_freq_meter.h"
+#include "Metrics.h"
+
+// from src/main.cpp
+extern GaugeFreqMeter<ActiveGrid> gaugeFreqMeter;
+void setup();
+void loop();
+
+static const uint32_t holdMs = 2000;   // PowerPolicy of the governor (power_governor.cpp)
+static const uint8_t motion = PowerPolicy::ACTIVITY_MOTION;
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+// Boot counts as an activity at 0
+void test_starts_active()
+{
+    PowerPolicy policy(holdMs);
+    TEST_ASSERT_EQUAL(PowerPolicy::STATE_ACTIVE, policy.state());
+    TEST_ASSERT_EQUAL(PowerPolicy::STATE_ACTIVE, policy.update(0, holdMs - 1));
+    TEST_ASSERT_EQUAL_UINT32(0, policy.transitions());
+}
+
+void test_idle_after_hold()
+{
+    PowerPolicy policy(holdMs);
+    policy.update(motion, 1000);
+    TEST_ASSERT_EQUAL(PowerPolicy::STATE_ACTIVE, policy.update(0, 1000 + holdMs - 1));
+    TEST_ASSERT_EQUAL(PowerPolicy::STATE_IDLE, policy.update(0, 1000 + holdMs));
+    TEST_ASSERT_EQUAL(PowerPolicy::STATE_IDLE, policy.update(0, 60000));
+    TEST_ASSERT_EQUAL_UINT32(1, policy.transitions());
+}
+
+void test_activity_raises_in_the_same_call()
+{
+    PowerPolicy policy(holdMs);
+    policy.update(0, holdMs);
+    TEST_ASSERT_EQUAL(PowerPolicy::STATE_IDLE, policy.state());
+    TEST_ASSERT_EQUAL(PowerPolicy::STATE_ACTIVE, policy.update(motion, holdMs + 1));
+    TEST_ASSERT_EQUAL(PowerPolicy::STATE_ACTIVE, policy.update(PowerPolicy::ACTIVITY_DISPLAY, holdMs + 2));
+    TEST_ASSERT_EQUAL_UINT32(2, policy.transitions());
+}
+
+// The governor raises before setPosition() while loop() polls the needle
+// state: a poll in between, before the step backend has started, must not
+// lower the clock again under the first steps
+void test_raise_before_first_step()
+{
+    PowerPolicy policy(holdMs);
+    policy.update(0, 10000);
+    TEST_ASSERT_EQUAL(PowerPolicy::STATE_IDLE, policy.state());
+
+    TEST_ASSERT_EQUAL(PowerPolicy::STATE_ACTIVE, policy.update(motion, 20000));  // raise()
+    TEST_ASSERT_EQUAL(PowerPolicy::STATE_ACTIVE, policy.update(0, 20000));       // poll, not moving yet
+    TEST_ASSERT_EQUAL(PowerPolicy::STATE_ACTIVE, policy.update(0, 20000 + holdMs - 1));
+    TEST_ASSERT_EQUAL_UINT32(2, policy.transitions());
+}
+
+void test_back_to_back_samples_do_not_toggle()
+{
+    PowerPolicy policy(holdMs);
+    // a short move every second, polled every 100 ms
+    for (uint32_t t = 0; t < 60000; t += 100)
+    {
+        policy.update(t % 1000 < 300 ? motion : 0, t);
+    }
+    TEST_ASSERT_EQUAL(PowerPolicy::STATE_ACTIVE, policy.state());
+    TEST_ASSERT_EQUAL_UINT32(0, policy.transitions());
+}
+
+void test_time_accounting()
+{
+    PowerPolicy policy(holdMs);
+    policy.update(motion, 0);
+    policy.update(0, 500);
+    policy.update(0, 500 + holdMs);         // idle from here
+    policy.update(0, 10000);
+    policy.update(motion, 12000);           // active again
+    policy.update(0, 13000);
+    TEST_ASSERT_EQUAL_UINT32(500 + holdMs + 1000, policy.timeInMs(PowerPolicy::STATE_ACTIVE));
+    TEST_ASSERT_EQUAL_UINT32(12000 - 500 - holdMs, policy.timeInMs(PowerPolicy::STATE_IDLE));
+}
+
+void test_millis_wrap()
+{
+    PowerPolicy policy(holdMs);
+    const uint32_t start = 0xffffffffUL - 500;
+    policy.update(motion, start);
+    TEST_ASSERT_EQUAL(PowerPolicy::STATE_ACTIVE, policy.update(0, start + holdMs - 1));
+    TEST_ASSERT_EQUAL(PowerPolicy::STATE_IDLE, policy.update(0, start + holdMs));
+    TEST_ASSERT_EQUAL_UINT32(holdMs, policy.timeInMs(PowerPolicy::STATE_ACTIVE));
+}
+
+// Steps of the firmware's needle (D4) with the power state at each
+struct Step
+{
+    int64_t atUs;
+    int32_t state;
+};
+
+static std::vector<Step> steps;
+static bool recording = false;
+static Gauge* powerState = nullptr;
+
+static void recordStep(uint8_t pin, int level, int64_t atUs)
+{
+    if (!recording || pin != D4 || level != HIGH) return;
+    steps.push_back({ atUs, powerState->value() });
+}
+
+// The test thread is loopTask: loop() runs here, the other tasks and the
+// timers at its delay()
+static void runLoop(int64_t untilUs)
+{
+    while (host::now() < untilUs) loop();
+}
+
+// Runs the firmware until the needle has stopped and the clock is down
+static bool idle()
+{
+    int64_t end = host::now() + 20000000;
+    while (host::now() < end)
+    {
+        if (gaugeFreqMeter.stopped() && powerState->value() == PowerPolicy::STATE_IDLE) return true;
+        loop();
+    }
+    return false;
+}
+
+static void moveFromIdle(const char* backend, uint32_t firstStepUs)
+{
+    TEST_ASSERT_TRUE(idle());
+    TEST_ASSERT_TRUE(gaugeFreqMeter.setStepTimer(backend));
+
+    static bool high = false;
+    high = !high;
+    steps.clear();
+    recording = true;
+    // a sample in the middle of the loop() delay: no poll of the needle
+    // state before the first steps, only the raise from the motion handler
+    int64_t t0 = host::now() + 50000;
+    float target = ActiveGrid::nominalHz() + (high ? 0.15f : -0.15f);
+    host::at(t0, [target] { gaugeFreqMeter.setPosition(target); });
+    runLoop(t0 + 1000);
+    int64_t end = t0 + 10000000;
+    while (!gaugeFreqMeter.stopped() && host::now() < end) loop();
+    recording = false;
+    TEST_ASSERT_TRUE(gaugeFreqMeter.stopped());
+
+    TEST_ASSERT_GREATER_THAN(100, steps.size());
+    // the clock was up before the first step, and for every step after it
+    for (size_t i = 0; i < steps.size(); i++)
+    {
+        TEST_ASSERT_EQUAL_INT_MESSAGE(PowerPolicy::STATE_ACTIVE, steps[i].state, "step at the idle clock");
+    }
+    // the raise did not hold the first step back
+    TEST_ASSERT_EQUAL_INT64(firstStepUs, steps[0].atUs - t0);
+
+    // down again holdMs after the needle stopped, loop() polls every 100 ms
+    int64_t lastStep = steps.back().atUs;
+    runLoop(lastStep + (holdMs - 200) * 1000LL);
+    TEST_ASSERT_EQUAL_INT32(PowerPolicy::STATE_ACTIVE, powerState->value());
+    runLoop(lastStep + (holdMs + 300) * 1000LL);
+    TEST_ASSERT_EQUAL_INT32(PowerPolicy::STATE_IDLE, powerState->value());
+}
+
+// esp_timer and hardware timer: the first step is one start period
+// (5 ms) after setPosition(), the RMT plays it at once
+void test_firmware_esp_timer_from_idle()
+{
+    moveFromIdle("esp", 5000);
+}
+
+void test_firmware_hw_timer_from_idle()
+{
+    moveFromIdle("hw", 5000);
+}
+
+void test_firmware_rmt_from_idle()
+{
+    moveFromIdle("rmt", 0);
+}
+
+int main(int argc, char** argv)
+{
+    host::setSerialOutput([](const char*, size_t) {});
+    host::addHost("electime", 0x0100007f); // setup() waits for the server to resolve
+    host::onPinChange(recordStep);
+    setup();
+    powerState = Gauge::find("power_state");
+
+    UNITY_BEGIN();
+    RUN_TEST(test_starts_active);
+    RUN_TEST(test_idle_after_hold);
+    RUN_TEST(test_activity_raises_in_the_same_call);
+    RUN_TEST(test_raise_before_first_step);
+    RUN_TEST(test_back_to_back_samples_do_not_toggle);
+    RUN_TEST(test_time_accounting);
+    RUN_TEST(test_millis_wrap);
+    if (powerState == nullptr) return 1;
+    RUN_TEST(test_firmware_esp_timer_from_idle);
+    RUN_TEST(test_firmware_hw_timer_from_idle);
+    RUN_TEST(test_firmware_rmt_from_idle);
+    return UNITY_END();
+}
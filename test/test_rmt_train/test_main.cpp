@@ -0,0 +1,202 @@
+// RMT pulse train against the step timer (pio test -e native -f test_rmt_train).
+// A mock sink records the step pulses each path puts on its pins: the
+// batches played by the RMT must give the same steps, at the same intervals
+// and in the same direction, as the esp_timer backend calling
+// SwitecX12::advance() once per step, also when the target changes in the
+// middle of a batch.
+#include <Arduino.h>
+#include <ArduinoHost.h>
+#include <unity.h>
+#include <vector>
+#include "SwitecX12.h"
+#include "Metrics.h"
+
+uint32_t counterValue(const char* name);
+
+// step, dir and reset pins of the two gauges
+static const uint8_t refPins[3] = { 11, 12, 13 };
+static const uint8_t rmtPins[3] = { 14, 15, 16 };
+
+struct Step
+{
+    int64_t atUs;       // rising edge of the step pin
+    int dir;            // from the dir pin: LOW is clockwise
+};
+
+// The mock sink: every rising edge of a step pin is a step
+static std::vector<Step> refSteps;
+static std::vector<Step> rmtSteps;
+
+static void sink(uint8_t pin, int level, int64_t atUs)
+{
+    if (level != HIGH) return;
+    if (pin == refPins[0]) refSteps.push_back({ atUs, host::pinLevel(refPins[1]) == LOW ? 1 : -1 });
+    if (pin == rmtPins[0]) rmtSteps.push_back({ atUs, host::pinLevel(rmtPins[1]) == LOW ? 1 : -1 });
+}
+
+// Where each test starts. The needle may overshoot a target by a step when
+// it stops, which must not take it below 0.
+static const unsigned int home = 100;
+
+static SwitecX12 refGauge;
+static SwitecX12 rmtGauge;
+static RmtStepTrain train(1);
+
+// Positions below are relative to home
+static int finalPosition(const std::vector<Step>& steps)
+{
+    int position = 0;
+    for (size_t i = 0; i < steps.size(); i++) position += steps[i].dir;
+    return position;
+}
+
+static int furthestPosition(const std::vector<Step>& steps)
+{
+    int position = 0;
+    int furthest = 0;
+    for (size_t i = 0; i < steps.size(); i++)
+    {
+        position += steps[i].dir;
+        if (position > furthest) furthest = position;
+    }
+    return furthest;
+}
+
+// Same steps, directions and intervals; the two paths only differ in when
+// the first step comes after setPosition()
+static void assertSameSteps()
+{
+    TEST_ASSERT_EQUAL_UINT32(refSteps.size(), rmtSteps.size());
+    for (size_t i = 0; i < refSteps.size(); i++)
+    {
+        TEST_ASSERT_EQUAL_INT_MESSAGE(refSteps[i].dir, rmtSteps[i].dir, "direction");
+        if (i == 0) continue;
+        TEST_ASSERT_EQUAL_INT64_MESSAGE(refSteps[i].atUs - refSteps[i - 1].atUs,
+                                        rmtSteps[i].atUs - rmtSteps[i - 1].atUs, "interval");
+    }
+}
+
+// Runs until both needles stop, at most 10 s
+static void settle()
+{
+    for (int i = 0; i < 100 && !(refGauge.Stopped() && rmtGauge.Stopped()); i++) host::run(100000);
+    TEST_ASSERT_TRUE(refGauge.Stopped());
+    TEST_ASSERT_TRUE(rmtGauge.Stopped());
+}
+
+// Both needles back home, sink cleared
+static void rewind()
+{
+    refGauge.setPosition(home);
+    rmtGauge.setPosition(home);
+    settle();
+    refSteps.clear();
+    rmtSteps.clear();
+}
+
+void setUp()
+{
+    rewind();
+}
+
+void tearDown()
+{
+}
+
+void test_full_scale_matches_profile()
+{
+    uint32_t batches0 = counterValue("motor_batches_total");
+    const unsigned int target = rmtGauge.Steps() - 1 - home;
+    refGauge.setPosition(home + target);
+    rmtGauge.setPosition(home + target);
+    settle();
+
+    TEST_ASSERT_EQUAL_UINT32(target, refSteps.size());
+    assertSameSteps();
+    TEST_ASSERT_EQUAL_INT((int)target, finalPosition(rmtSteps));
+    // the ends of the default profile: 4 ms from rest, 450 us at full speed
+    TEST_ASSERT_EQUAL_INT64(4000, rmtSteps[1].atUs - rmtSteps[0].atUs);
+    TEST_ASSERT_EQUAL_INT64(450, rmtSteps[target / 2].atUs - rmtSteps[target / 2 - 1].atUs);
+    // one interrupt per batch of up to 32 steps
+    TEST_ASSERT_EQUAL_UINT32((target + StepBatch::MAX_STEPS - 1) / StepBatch::MAX_STEPS,
+                             counterValue("motor_batches_total") - batches0);
+}
+
+// Steps counted before the last run of retargetAfter()
+static uint32_t stepsBefore = 0;
+
+// Moves to 2000, then to newTarget once step k has been made (half way to
+// step k + 1, in the middle of a batch for the RMT)
+static void retargetAfter(size_t k, unsigned int newTarget)
+{
+    refGauge.setPosition(home + 2000);
+    while (refSteps.size() <= k + 1) host::run(100);
+    int64_t refFirst = refSteps[0].atUs;
+    int64_t offset = (refSteps[k].atUs + refSteps[k + 1].atUs) / 2 - refFirst;
+    settle();
+    refSteps.clear();
+    rewind();
+
+    stepsBefore = counterValue("motor_steps_total");
+    refGauge.setPosition(home + 2000);
+    rmtGauge.setPosition(home + 2000);
+    while (refSteps.empty()) host::run(100);
+    int64_t refAt = refSteps[0].atUs + offset;
+    int64_t rmtAt = rmtSteps[0].atUs + offset;
+    host::at(refAt, [newTarget] { refGauge.setPosition(home + newTarget); });
+    host::at(rmtAt, [newTarget] { rmtGauge.setPosition(home + newTarget); });
+    settle();
+}
+
+void test_reversal_mid_batch()
+{
+    // at full speed, 100 steps in: 10 steps out of the batch in play
+    TEST_ASSERT_NOT_EQUAL(0, 100 % StepBatch::MAX_STEPS);
+    retargetAfter(100, 50);
+
+    assertSameSteps();
+    TEST_ASSERT_EQUAL_INT(50, finalPosition(rmtSteps));
+    // no step past what the per step path does before turning back
+    TEST_ASSERT_EQUAL_INT(furthestPosition(refSteps), furthestPosition(rmtSteps));
+}
+
+void test_closer_target_mid_batch()
+{
+    // the deceleration starts before the end of the batch in play
+    retargetAfter(70, 120);
+
+    assertSameSteps();
+    TEST_ASSERT_EQUAL_INT(120, finalPosition(rmtSteps));
+    TEST_ASSERT_EQUAL_INT(furthestPosition(refSteps), furthestPosition(rmtSteps));
+}
+
+void test_further_target_mid_batch()
+{
+    retargetAfter(40, 3500);
+
+    assertSameSteps();
+    TEST_ASSERT_EQUAL_INT(3500, finalPosition(rmtSteps));
+}
+
+void test_steps_counted_once()
+{
+    retargetAfter(100, 50);
+    // the cut steps are planned twice but only played once
+    TEST_ASSERT_EQUAL_UINT32(refSteps.size() + rmtSteps.size(), counterValue("motor_steps_total") - stepsBefore);
+}
+
+int main(int argc, char** argv)
+{
+    host::onPinChange(sink);
+    refGauge.begin(refPins[0], refPins[1], refPins[2]);
+    rmtGauge.begin(rmtPins[0], rmtPins[1], rmtPins[2]);
+    if (!rmtGauge.setPulseTrain(train)) return 1;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_full_scale_matches_profile);
+    RUN_TEST(test_reversal_mid_batch);
+    RUN_TEST(test_closer_target_mid_batch);
+    RUN_TEST(test_further_target_mid_batch);
+    RUN_TEST(test_steps_counted_once);
+    return UNITY_END();
+}
@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+"""Offline acceleration table tuner for the SwitecX12 needle driver.
+
+Models an X27/X12 gauge stepper (X12.017 driver, 1/12 degree microsteps)
+with its needle as a rotor pulled by the stator field: the magnetic torque
+is T(w) * sin(electrical lag), minus viscous and dry friction. Step times are
+produced by a replica of SwitecX12::advance() driven by a candidate table.
+A step is considered missed when the electrical lag exceeds 90 degrees,
+where the available torque starts to fall.
+
+The search looks for the fastest constant-acceleration profile (delay at
+velocity v proportional to 1/sqrt(v), clamped to a top speed) that never
+misses a step on a standard set of frequency steps, with the motor torque
+derated by the torque margin. It prints the settle time benchmark of the
+current table and of the tuned one, and the tuned table as C.
+
+Usage: tools/accel_tuner.py [--margin 2.0] [--rows 6] [--inertia 1.2e-7] ...
+All model parameters are estimates, check them against the real gauge.
+"""
+
+import argparse
+import math
+
+# SwitecX12 / GaugeFreqMeter constants (SwitecX12.cpp, gauge_freq_meter.cpp)
+DEFAULT_TABLE = [(20, 4000), (50, 2000), (100, 1000), (150, 750), (300, 450)]
+TIMER_INTERVAL_US = 5000
+FREQ_MIN, FREQ_MAX = 49.80, 50.20
+STEP_MIN, STEP_MAX = 207, 3432
+
+DEG_PER_STEP = 1.0 / 12.0
+STEPS_PER_ELECTRICAL_CYCLE = 48  # 4 full steps of 1/3 degree, 12 microsteps each
+
+# Standard benchmark: frequency steps (from, to) in Hz
+FREQUENCY_STEPS = [
+    (50.00, 50.02), (50.00, 50.05), (49.98, 50.03), (50.00, 50.10),
+    (49.90, 50.10), (49.80, 50.20), (50.20, 49.80), (50.05, 49.95),
+]
+
+
+def frequency_to_step(freq):
+    pos = (freq - FREQ_MIN) * (STEP_MAX - STEP_MIN) / (FREQ_MAX - FREQ_MIN) + STEP_MIN
+    return int(min(max(pos, STEP_MIN), STEP_MAX))
+
+
+def step_schedule(table, start, target):
+    """Step times (us) and directions, replicating SwitecX12::advance()."""
+    max_vel = table[-1][0]
+    current, vel, direction = start, 0, 0
+    t = TIMER_INTERVAL_US  # setPosition() starts the timer with this period
+    events = []
+    while True:
+        if current == target and vel == 0:
+            return events
+        if vel == 0:
+            direction = 1 if current < target else -1
+            vel = 1
+        current += direction
+        events.append((t, direction))
+        delta = target - current if direction > 0 else current - target
+        if delta > 0:
+            if delta < vel:
+                vel -= 1
+            elif vel < max_vel:
+                vel += 1
+        else:
+            vel -= 1
+        i = 0
+        while i < len(table) - 1 and table[i][0] < vel:
+            i += 1
+        t += table[i][1]
+
+
+class Motor:
+    def __init__(self, args):
+        self.inertia = args.inertia          # kg m^2, needle + reflected rotor
+        self.torque = args.torque / args.margin  # N m at the shaft, derated
+        self.max_speed = math.radians(args.max_speed)  # rad/s, torque reaches 0
+        self.viscous = args.viscous          # N m s/rad
+        self.friction = args.friction        # N m
+        self.dt = 20e-6
+
+    def simulate(self, events, start):
+        """Returns (missed, settle_time_us)."""
+        rad_per_step = math.radians(DEG_PER_STEP)
+        elec_per_rad = 2 * math.pi / (STEPS_PER_ELECTRICAL_CYCLE * rad_per_step)
+        commanded = start
+        theta = start * rad_per_step
+        omega = 0.0
+        t = 0.0
+        k = 0
+        end = (events[-1][0] * 1e-6 if events else 0.0) + 0.5
+        settle_hold = 0.02  # needle must stay within half a step this long
+        settled_at = None
+        while t < end:
+            while k < len(events) and events[k][0] * 1e-6 <= t:
+                commanded += events[k][1]
+                k += 1
+            lag = (commanded * rad_per_step - theta) * elec_per_rad
+            if abs(lag) > math.pi / 2:
+                return True, None
+            available = self.torque * max(0.0, 1.0 - abs(omega) / self.max_speed)
+            torque = available * math.sin(lag) - self.viscous * omega
+            if omega != 0.0:
+                torque -= math.copysign(self.friction, omega)
+            omega += torque / self.inertia * self.dt
+            theta += omega * self.dt
+            t += self.dt
+            close = abs(commanded * rad_per_step - theta) < rad_per_step / 2 and abs(omega) < math.radians(5)
+            if k == len(events) and close:
+                if settled_at is None:
+                    settled_at = t
+                elif t - settled_at > settle_hold:
+                    break
+            else:
+                settled_at = None
+        return False, (settled_at if settled_at is not None else end) * 1e6
+
+
+def benchmark(table, motor):
+    """Settle time per frequency step, None if a step is missed."""
+    results = []
+    for f0, f1 in FREQUENCY_STEPS:
+        start, target = frequency_to_step(f0), frequency_to_step(f1)
+        events = step_schedule(table, start, target)
+        missed, settle = motor.simulate(events, start)
+        results.append((f0, f1, abs(target - start), None if missed else settle))
+    return results
+
+
+def make_table(accel, min_delay, rows):
+    """Constant acceleration: after v steps the speed is sqrt(2 a v) steps/s."""
+    top_vel = max(2, int(math.ceil((1e6 / min_delay) ** 2 / (2 * accel))))
+    table = []
+    for r in range(1, rows + 1):
+        # breakpoints spread geometrically, denser at low speed where the delay changes fast
+        v = max(1, int(round(top_vel ** (r / rows))))
+        if table and v <= table[-1][0]:
+            v = table[-1][0] + 1
+        # the row applies to the velocities up to v, use the delay of its lowest velocity
+        low = table[-1][0] + 1 if table else 1
+        delay = max(min_delay, int(math.ceil(1e6 / math.sqrt(2 * accel * low))))
+        table.append((v, delay))
+    return table
+
+
+def passes(table, motor):
+    return all(r[3] is not None for r in benchmark(table, motor))
+
+
+def tune(motor, rows):
+    best = None
+    for min_delay in (250, 300, 400, 500):
+        lo, hi = 100.0, 400000.0  # steps/s^2
+        if not passes(make_table(lo, min_delay, rows), motor):
+            continue
+        for _ in range(12):
+            mid = math.sqrt(lo * hi)
+            if passes(make_table(mid, min_delay, rows), motor):
+                lo = mid
+            else:
+                hi = mid
+        table = make_table(lo, min_delay, rows)
+        total = sum(r[3] for r in benchmark(table, motor))
+        if best is None or total < best[0]:
+            best = (total, table, lo)
+    return best
+
+
+def print_benchmark(name, results):
+    print(name)
+    for f0, f1, steps, settle in results:
+        text = "MISSED STEPS" if settle is None else "%8.1f ms" % (settle / 1000)
+        print("  %.2f -> %.2f Hz (%4d steps): %s" % (f0, f1, steps, text))
+    if all(r[3] is not None for r in results):
+        print("  total: %.1f ms" % (sum(r[3] for r in results) / 1000))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--margin", type=float, default=2.0, help="torque safety factor (default 2.0)")
+    parser.add_argument("--rows", type=int, default=6, help="rows of the emitted table")
+    parser.add_argument("--inertia", type=float, default=6e-7, help="needle + rotor inertia at the shaft, kg m^2")
+    parser.add_argument("--torque", type=float, default=1.0e-3, help="holding torque at the shaft, N m")
+    parser.add_argument("--max-speed", type=float, default=600.0, help="shaft speed where torque falls to 0, deg/s")
+    parser.add_argument("--viscous", type=float, default=2.0e-6, help="viscous friction, N m s/rad")
+    parser.add_argument("--friction", type=float, default=5.0e-5, help="dry friction, N m")
+    args = parser.parse_args()
+
+    motor = Motor(args)
+    print_benchmark("Current table %s:" % DEFAULT_TABLE, benchmark(DEFAULT_TABLE, motor))
+
+    best = tune(motor, args.rows)
+    if best is None:
+        print("No profile found without missed steps, lower --margin or check the model")
+        return 1
+    total, table, accel = best
+    print()
+    print_benchmark("Tuned table (%.0f steps/s^2, margin %.1f):" % (accel, args.margin), benchmark(table, motor))
+    print()
+    print("// Generated by tools/accel_tuner.py --margin %.1f" % args.margin)
+    print("static const unsigned short tunedAccelTable[][2] = {")
+    print(",\n".join("  { %4d, %d}" % row for row in table))
+    print("};")
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
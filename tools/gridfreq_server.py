@@ -0,0 +1,646 @@
+#!/usr/bin/env python3
+"""Local stand-in for a GridFreqMonitor server, to test reconnects, backfill
+and the ingest path under faulty traffic.
+
+Serves a WebSocket feed on --port (8765) with one {"time_stamp", "frequency"}
+sample every --period seconds (a random walk around --nominal) and answers
+{"backfill_since": T, "max": N} requests with the samples after T, oldest
+first, in messages of at most N samples:
+    {"backfill": [[time_stamp, frequency], ...], "more": true|false}
+The host name --name (electime) is announced over mDNS so the device finds
+the stand-in like the real server.
+
+--outage DOWN/EVERY closes every connection and refuses new ones for DOWN
+seconds every EVERY seconds. For each outage it reports how long the device
+took to ask for the missed samples after the server came back and how many
+were sent. With --device <ip>, the grid time deviation integrated by the
+device (/metrics grid_time_deviation_ms) is compared every --report seconds
+with the exact integral of the samples served, both counted from the first
+report: they match when no sample was lost.
+
+--profile runs traffic profiles one after the other, --duration seconds each:
+  steady      one sample every --period
+  rate50      50 samples/s (millisecond stamps)
+  duplicates  every sample sent twice, every 5th a third time
+  reorder     every 4th sample followed by the one from 3 periods before
+  malformed   every 3rd sample preceded by a broken or out of range message
+  oversized   every 5th sample preceded by a padded message of 4, 16 or 64 KB
+  stall       20 s of samples, 15 s of silence with the connection open,
+              20 s of samples, then a frame cut in half for 8 s
+With --device, /metrics is read in the background during each profile and a
+table compares them: messages received (and per second), rejected,
+malformed, oversized, duplicate and late samples, the time to handle one
+message on the device (ingest_message_us), the lowest free heap and largest
+block, the JSON arena peak, source failovers and connections to the stand-in.
+Metrics reads load the device a little, --poll sets their interval.
+--backup NAME@ADDRESS serves the same samples from a second stand-in on
+ADDRESS (a second address of this machine, e.g. 127.0.0.2 for the host
+firmware), announced as NAME, for a device built with
+-DBACKUP_SERVER=\"NAME\". --switch DOWN/EVERY then kills the server the
+device is using (source_active_index of /metrics, --device required) every
+EVERY seconds, its connections closed and new ones refused for DOWN
+seconds, and reports how long the device took to be on the other one.
+
+Without a device, the host firmware runs the same ingest path: start
+`.pio/build/sim/program --live 450`, then this with --device 127.0.0.1:8080
+and ELECTIME_TOKEN=sim.
+
+/metrics needs the http.token setting of the device, in ELECTIME_TOKEN.
+
+Usage: tools/gridfreq_server.py [--period 1] [--outage 20/60] [--device <ip>]
+       tools/gridfreq_server.py --profile steady,rate50,malformed --duration 60 --device <ip>
+       tools/gridfreq_server.py --address <ip> --backup electime-b@<ip2> --switch 20/60 --device <ip>
+"""
+
+import argparse
+import base64
+import hashlib
+import json
+import random
+import socket
+import struct
+import threading
+import time
+
+from live_load import metrics
+
+WS_GUID = b"258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+MDNS_GROUP = "224.0.0.251"
+MDNS_PORT = 5353
+
+PROFILES = ("steady", "rate50", "duplicates", "reorder", "malformed", "oversized", "stall")
+STALL_CYCLE = 63.0   # s: samples 0-20, silence 20-35, samples 35-55, split frame at 55
+
+# Broken messages of the malformed profile, by time stamp
+MALFORMED = (
+    lambda t: '{"time_stamp":%d,"frequency":' % t,          # truncated
+    lambda t: 'Connected',                                   # not JSON
+    lambda t: '{"time_stamp":"%d","frequency":50.0}' % t,   # stamp as a string
+    lambda t: '{"frequency":50.0}',                          # no stamp
+    lambda t: '{"time_stamp":%d,"frequency":null}' % t,     # no frequency
+    lambda t: "[" * 64 + "]" * 64,                           # nested too deep
+    lambda t: '{"time_stamp":%d,"frequency":75.0}' % t,     # valid, out of range
+)
+OVERSIZED = (4096, 16384, 65536)
+
+
+# --------------------- WebSocket ---------------------
+
+def recv_exact(sock, n):
+    data = b""
+    while len(data) < n:
+        chunk = sock.recv(n - len(data))
+        if not chunk:
+            raise ConnectionError("closed")
+        data += chunk
+    return data
+
+
+def handshake(sock):
+    request = b""
+    while b"\r\n\r\n" not in request:
+        chunk = sock.recv(1024)
+        if not chunk:
+            raise ConnectionError("closed during handshake")
+        request += chunk
+    key = None
+    for line in request.decode(errors="replace").split("\r\n"):
+        if line.lower().startswith("sec-websocket-key:"):
+            key = line.split(":", 1)[1].strip().encode()
+    if key is None:
+        raise ConnectionError("not a WebSocket request")
+    accept = base64.b64encode(hashlib.sha1(key + WS_GUID).digest())
+    sock.sendall(b"HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                 b"Sec-WebSocket-Accept: " + accept + b"\r\n\r\n")
+
+
+def frame(opcode, payload):
+    header = bytes([0x80 | opcode])
+    if len(payload) < 126:
+        header += bytes([len(payload)])
+    elif len(payload) < 65536:
+        header += bytes([126]) + struct.pack(">H", len(payload))
+    else:
+        header += bytes([127]) + struct.pack(">Q", len(payload))
+    return header + payload
+
+
+def read_frame(sock):
+    b0, b1 = recv_exact(sock, 2)
+    length = b1 & 0x7F
+    if length == 126:
+        length = struct.unpack(">H", recv_exact(sock, 2))[0]
+    elif length == 127:
+        length = struct.unpack(">Q", recv_exact(sock, 8))[0]
+    mask = recv_exact(sock, 4) if b1 & 0x80 else b"\0\0\0\0"
+    payload = bytearray(recv_exact(sock, length))
+    for i in range(length):
+        payload[i] ^= mask[i % 4]
+    return b0 & 0x0F, bytes(payload)
+
+
+class Client:
+    def __init__(self, sock, address):
+        self.sock, self.address = sock, address
+        self.lock = threading.Lock()
+        self.open = True
+
+    def send(self, opcode, payload):
+        try:
+            with self.lock:
+                self.sock.sendall(frame(opcode, payload))
+            return True
+        except OSError:
+            self.close()
+            return False
+
+    def send_text(self, text):
+        return self.send(0x1, text.encode())
+
+    def send_split(self, text, pause):
+        """Sends half of a text frame, waits pause seconds, then the rest."""
+        data = frame(0x1, text.encode())
+        try:
+            with self.lock:
+                self.sock.sendall(data[:len(data) // 2])
+                time.sleep(pause)
+                self.sock.sendall(data[len(data) // 2:])
+            return True
+        except OSError:
+            self.close()
+            return False
+
+    def close(self):
+        if self.open:
+            self.open = False
+            try:
+                self.sock.shutdown(socket.SHUT_RDWR)
+            except OSError:
+                pass
+            self.sock.close()
+
+
+# --------------------- mDNS ---------------------
+
+def encode_name(name):
+    return b"".join(bytes([len(label)]) + label.encode() for label in name.split(".")) + b"\0"
+
+
+def decode_name(packet, offset):
+    labels = []
+    while True:
+        length = packet[offset]
+        if length == 0:
+            return ".".join(labels), offset + 1
+        if length & 0xC0:  # compression pointer, questions of queryHost do not use them
+            return ".".join(labels), offset + 2
+        labels.append(packet[offset + 1:offset + 1 + length].decode(errors="replace"))
+        offset += 1 + length
+
+
+def mdns_responder(hosts, stop):
+    """Answers A queries for <name>.local with its address, hosts is {name: address}."""
+    answers = {(name + ".local").lower(): encode_name(name + ".local") + struct.pack(">HHIH", 1, 0x8001, 120, 4)
+               + socket.inet_aton(address) for name, address in hosts.items()}
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    if hasattr(socket, "SO_REUSEPORT"):
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEPORT, 1)
+    sock.bind(("", MDNS_PORT))
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP,
+                    struct.pack("4s4s", socket.inet_aton(MDNS_GROUP), socket.inet_aton("0.0.0.0")))
+    sock.settimeout(0.5)
+    while not stop.is_set():
+        try:
+            packet, sender = sock.recvfrom(1500)
+        except socket.timeout:
+            continue
+        if len(packet) < 12 or packet[2] & 0x80:
+            continue  # responses
+        try:
+            qname, offset = decode_name(packet, 12)
+            qtype, qclass = struct.unpack(">HH", packet[offset:offset + 4])
+        except (IndexError, struct.error):
+            continue
+        if qname.lower() not in answers or qtype not in (1, 255):
+            continue
+        reply = struct.pack(">HHHHHH", 0, 0x8400, 0, 1, 0, 0) + answers[qname.lower()]
+        if sender[1] != MDNS_PORT or qclass & 0x8000:
+            sock.sendto(struct.pack(">H", struct.unpack(">H", packet[:2])[0]) + reply[2:], sender)
+        else:
+            sock.sendto(reply, (MDNS_GROUP, MDNS_PORT))
+
+
+def local_address():
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    try:
+        sock.connect(("192.0.2.1", 9))  # no packet is sent
+        return sock.getsockname()[0]
+    finally:
+        sock.close()
+
+
+# --------------------- Server ---------------------
+
+class StandIn:
+    def __init__(self, args, name):
+        self.args, self.name = args, name
+        profiles = args.profile.split(",") if args.profile else ()
+        self.ms = args.period < 1.0 or "rate50" in profiles   # sub-second periods need millisecond stamps
+        self.history = []                # (time_stamp, frequency)
+        self.clients = []
+        self.lock = threading.Lock()
+        self.down = False
+        self.outage_end = None           # time the last outage ended, until its backfill request
+        self.frequency = args.nominal
+        self.connects = 0
+        self.split_sent = False
+
+    def stamp(self, t):
+        return int(t * 1000) if self.ms else int(t)
+
+    def next_sample(self):
+        self.frequency += random.gauss(0, 0.004)
+        self.frequency += (self.args.nominal - self.frequency) * 0.02
+        return self.stamp(time.time()), round(self.frequency, 3)
+
+    def accept_loop(self, server):
+        while True:
+            sock, address = server.accept()
+            if self.down:
+                sock.close()
+                continue
+            threading.Thread(target=self.serve, args=(sock, address), daemon=True).start()
+
+    def serve(self, sock, address):
+        try:
+            sock.settimeout(30)
+            handshake(sock)
+        except OSError as e:
+            print("%s: %s handshake failed (%s)" % (self.name, address[0], e))
+            sock.close()
+            return
+        client = Client(sock, address)
+        with self.lock:
+            self.clients.append(client)
+            self.connects += 1
+        print("%s: %s connected" % (self.name, address[0]))
+        try:
+            while client.open:
+                opcode, payload = read_frame(sock)
+                if opcode == 0x9:
+                    client.send(0xA, payload)
+                elif opcode == 0x8:
+                    break
+                elif opcode == 0x1:
+                    self.on_text(client, payload)
+        except (OSError, ConnectionError):
+            pass
+        client.close()
+        with self.lock:
+            self.clients.remove(client)
+        print("%s: %s disconnected" % (self.name, address[0]))
+
+    def on_text(self, client, payload):
+        try:
+            request = json.loads(payload)
+        except ValueError:
+            return  # "Connected" greeting
+        if not isinstance(request, dict) or "backfill_since" not in request:
+            return
+        since = int(request["backfill_since"])
+        chunk = max(1, int(request.get("max", 32)))
+        missed = [s for s in list(self.history) if s[0] > since]
+        delay = "" if self.outage_end is None else ", %.2f s after the server came back" % (time.time() - self.outage_end)
+        self.outage_end = None
+        print("%s: %s backfill since %d: %d samples in %d messages%s"
+              % (self.name, client.address[0], since, len(missed), (len(missed) + chunk - 1) // chunk, delay))
+        for i in range(0, max(len(missed), 1), chunk):
+            part = missed[i:i + chunk]
+            client.send_text(json.dumps({"backfill": [list(s) for s in part], "more": i + chunk < len(missed)},
+                                        separators=(",", ":")))
+
+    def broadcast(self, text):
+        with self.lock:
+            clients = list(self.clients)
+        for client in clients:
+            client.send_text(text)
+
+    def broadcast_split(self, text, pause):
+        with self.lock:
+            clients = list(self.clients)
+        for client in clients:
+            client.send_split(text, pause)
+
+    def messages(self, profile, tick, sample, elapsed):
+        """Messages to send for one tick of a profile: [(text, split pause)]."""
+        text = json.dumps({"time_stamp": sample[0], "frequency": sample[1]})
+        if profile == "duplicates":
+            return [(text, 0)] * (3 if tick % 5 == 4 else 2)
+        if profile == "reorder" and tick % 4 == 3 and len(self.history) > 3:
+            late = self.history[-4]
+            return [(text, 0), (json.dumps({"time_stamp": late[0], "frequency": late[1]}), 0)]
+        if profile == "malformed" and tick % 3 == 2:
+            return [(MALFORMED[(tick // 3) % len(MALFORMED)](sample[0]), 0), (text, 0)]
+        if profile == "oversized" and tick % 5 == 4:
+            size = OVERSIZED[(tick // 5) % len(OVERSIZED)]
+            padded = '{"time_stamp":%d,"frequency":%.3f,"pad":"' % sample
+            return [(padded + "x" * (size - len(padded) - 2) + '"}', 0), (text, 0)]
+        if profile == "stall":
+            phase = elapsed % STALL_CYCLE
+            if 20.0 <= phase < 35.0:
+                return []
+            if phase >= 55.0 and not self.split_sent:
+                self.split_sent = True
+                return [(text, 8.0)]
+            if phase < 55.0:
+                self.split_sent = False
+        return [(text, 0)]
+
+    def drop_all(self):
+        with self.lock:
+            clients = list(self.clients)
+        for client in clients:
+            client.close()
+
+
+def integral(samples, nominal, start, end):
+    """Exact grid time deviation in seconds between two time stamps, frequencies held."""
+    scale = 1000.0 if samples and samples[0][0] > 1e11 else 1.0
+    total = 0.0
+    for (t0, f0), (t1, _) in zip(samples, samples[1:]):
+        if t0 >= start and t1 <= end:
+            total += (f0 / nominal - 1.0) * (t1 - t0) / scale
+    return total
+
+
+def device_deviation(host):
+    deviation = metrics(host).get("grid_time_deviation_ms")
+    return None if deviation is None else deviation / 1000.0
+
+
+class ProfileRun:
+    """Device metrics over one traffic profile, read in the background."""
+
+    def __init__(self, name, servers, device, poll):
+        self.name, self.servers, self.device, self.poll = name, servers, device, poll
+        self.sent = 0
+        self.finished = False
+        self.started = time.time()
+        self.connects = sum(s.connects for s in servers)
+        self.snapshots = []
+        self.stop = threading.Event()
+        self.thread = None
+        if device:
+            self.read()
+            self.thread = threading.Thread(target=self.poll_loop, daemon=True)
+            self.thread.start()
+
+    def read(self):
+        try:
+            self.snapshots.append(metrics(self.device))
+        except OSError as e:
+            print("device: %s" % e)
+
+    def poll_loop(self):
+        while not self.stop.wait(self.poll):
+            self.read()
+
+    def finish(self):
+        self.finished = True
+        self.elapsed = time.time() - self.started
+        self.connects = sum(s.connects for s in self.servers) - self.connects
+        if self.thread:
+            self.stop.set()
+            self.thread.join()
+            self.read()
+
+    def row(self):
+        """Table row, None for the device columns without two metrics reads."""
+        row = [self.name, self.sent, self.connects]
+        if len(self.snapshots) < 2:
+            return row + [None] * 12
+        first, last = self.snapshots[0], self.snapshots[-1]
+
+        def delta(name):
+            return int(last.get(name, 0) - first.get(name, 0))
+
+        def lowest(name):
+            return int(min(s.get(name, 0) for s in self.snapshots))
+
+        received = delta("ingest_messages_total")
+        handled = delta("ingest_message_us_count")
+        return row + [received, received / self.elapsed, delta("ingest_rejected_total"),
+                      delta("ingest_malformed_total"), delta("ingest_oversized_total"),
+                      delta("ingest_deduplicated_total"), delta("ingest_out_of_order_total"),
+                      delta("ingest_message_us_sum") / handled if handled else 0.0,
+                      lowest("heap_free_bytes"), lowest("heap_largest_block_bytes"),
+                      int(max(s.get("json_arena_high_water_bytes", 0) for s in self.snapshots)),
+                      delta("source_failovers_total")]
+
+
+def print_table(runs, device):
+    header = ["profile", "sent", "conn"]
+    if device:
+        header += ["recv", "msg/s", "reject", "malf", "over", "dup", "late", "us/msg", "heap min", "block min", "arena", "failover"]
+    print(" ".join("%10s" % h for h in header))
+    for run in runs:
+        cells = []
+        for value in run.row()[:len(header)]:
+            if value is None:
+                cells.append("%10s" % "-")
+            elif isinstance(value, float):
+                cells.append("%10.1f" % value)
+            elif isinstance(value, str):
+                cells.append("%10s" % value)
+            else:
+                cells.append("%10d" % value)
+        print(" ".join(cells))
+
+
+def active_server(device):
+    """Index of the source the device is using, -1 for none."""
+    return int(metrics(device).get("source_active_index", -1))
+
+
+def switch_loop(servers, device, down, every, switches, stop):
+    """Every `every` seconds, kills the server the device is using for `down` seconds
+    and times the device switching to the other one."""
+    next_kill = time.time() + every
+    while not stop.wait(max(0.0, next_kill - time.time())):
+        next_kill += every
+        try:
+            active = active_server(device)
+        except OSError as e:
+            print("device: %s" % e)
+            continue
+        if active not in (0, 1):
+            print("switch: the device has no active source, skipped")
+            continue
+        killed, other = servers[active], servers[1 - active]
+        print("switch: killing %s" % killed.name)
+        killed.down = True
+        killed.drop_all()
+        killed_at = time.time()
+        switched = None
+        while switched is None and time.time() - killed_at < down and not stop.is_set():
+            try:
+                if active_server(device) == 1 - active:
+                    switched = time.time() - killed_at
+            except OSError:
+                pass
+            time.sleep(0.1)
+        if switched is None:
+            print("switch: the device was not on %s within %.0f s" % (other.name, down))
+        else:
+            print("switch: the device was on %s %.2f s after %s was killed" % (other.name, switched, killed.name))
+            switches.append(switched)
+        stop.wait(max(0.0, killed_at + down - time.time()))
+        killed.down = False
+        print("switch: %s back" % killed.name)
+
+
+def listen(address, port):
+    server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    server.bind((address, port))
+    server.listen(8)
+    return server
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", type=int, default=8765)
+    parser.add_argument("--name", default="electime", help="mDNS host name to announce")
+    parser.add_argument("--address", help="address announced over mDNS (default: the outgoing interface)")
+    parser.add_argument("--period", type=float, default=1.0, help="seconds between samples")
+    parser.add_argument("--nominal", type=float, default=50.0)
+    parser.add_argument("--outage", help="DOWN/EVERY seconds, e.g. 20/60")
+    parser.add_argument("--device", help="device IP to compare the grid time integral with")
+    parser.add_argument("--report", type=float, default=30.0)
+    parser.add_argument("--profile", help="comma separated traffic profiles, see above")
+    parser.add_argument("--duration", type=float, default=60.0, help="seconds per profile")
+    parser.add_argument("--poll", type=float, default=5.0, help="seconds between /metrics reads during a profile")
+    parser.add_argument("--backup", help="NAME@ADDRESS of a second stand-in serving the same samples")
+    parser.add_argument("--switch", help="DOWN/EVERY seconds, kills the server the device uses, e.g. 20/60")
+    args = parser.parse_args()
+    profiles = args.profile.split(",") if args.profile else []
+    for name in profiles:
+        if name not in PROFILES:
+            parser.error("unknown profile %s (%s)" % (name, ", ".join(PROFILES)))
+    if args.backup and "@" not in args.backup:
+        parser.error("--backup takes NAME@ADDRESS")
+    if args.switch and not (args.backup and args.device):
+        parser.error("--switch needs --backup and --device")
+    if args.switch and args.outage:
+        parser.error("--switch and --outage exclude each other")
+
+    # The device uses one port for every source: two stand-ins need two addresses
+    standin = StandIn(args, args.name)
+    address = args.address or local_address()
+    servers = [(standin, address if args.backup else "")]
+    hosts = {args.name: address}
+    if args.backup:
+        name, backup_address = args.backup.split("@", 1)
+        backup = StandIn(args, name)
+        backup.history = standin.history   # same grid, same samples
+        servers.append((backup, backup_address))
+        hosts[name] = backup_address
+    for server, bind in servers:
+        threading.Thread(target=server.accept_loop, args=(listen(bind, args.port),), daemon=True).start()
+        print("serving ws://%s:%d/ as %s.local, one sample every %.3f s"
+              % (bind or address, args.port, server.name, args.period))
+    servers = [server for server, _ in servers]
+    stop = threading.Event()
+    threading.Thread(target=mdns_responder, args=(hosts, stop), daemon=True).start()
+    switches = []
+    if args.switch:
+        switch_down, switch_every = (float(x) for x in args.switch.split("/"))
+        threading.Thread(target=switch_loop, args=(servers, args.device, switch_down, switch_every, switches, stop),
+                         daemon=True).start()
+
+    down, every = (float(x) for x in args.outage.split("/")) if args.outage else (0.0, 0.0)
+    start = time.time()
+    next_sample = start
+    next_report = start + args.report
+    baseline = None   # (time stamp, device deviation) at the first report
+    runs = []
+    run = None
+    tick = 0
+    try:
+        while True:
+            now = time.time()
+            if profiles and (run is None or now - run.started >= args.duration):
+                if run is not None:
+                    run.finish()
+                    print_table([run], args.device)
+                if len(runs) == len(profiles):
+                    break
+                run = ProfileRun(profiles[len(runs)], servers, args.device, args.poll)
+                runs.append(run)
+                print("profile %s for %.0f s" % (run.name, args.duration))
+                tick = 0
+                now = next_sample = time.time()
+            if every:
+                phase = (now - start) % every
+                if phase >= every - down and not standin.down:
+                    print("outage: dropping every connection for %.0f s" % down)
+                    for server in servers:
+                        server.down = True
+                        server.drop_all()
+                elif phase < every - down and standin.down:
+                    print("outage over")
+                    for server in servers:
+                        server.down = False
+                        server.outage_end = now
+
+            sample = standin.next_sample()
+            standin.history.append(sample)
+            up = [server for server in servers if not server.down]
+            if up:
+                profile, elapsed = (run.name, now - run.started) if run else ("steady", now - start)
+                for text, pause in standin.messages(profile, tick, sample, elapsed):
+                    for server in up:
+                        if pause:
+                            server.broadcast_split(text, pause)
+                        else:
+                            server.broadcast(text)
+                    if run:
+                        run.sent += 1
+            tick += 1
+
+            if args.device and not profiles and now >= next_report:
+                next_report += args.report
+                time.sleep(args.period / 2)  # between two samples
+                try:
+                    deviation = device_deviation(args.device)
+                except OSError as e:
+                    print("device: %s" % e)
+                    deviation = None
+                if deviation is not None and baseline is None:
+                    baseline = (sample[0], deviation)
+                elif deviation is not None:
+                    expected = integral(standin.history, args.nominal, baseline[0], sample[0])
+                    measured = deviation - baseline[1]
+                    print("grid time since baseline: served %+.4f s, device %+.4f s, error %+.1f ms"
+                          % (expected, measured, (measured - expected) * 1000.0))
+
+            next_sample += 0.02 if run and run.name == "rate50" else args.period
+            if next_sample < time.time() - args.period:
+                next_sample = time.time()   # after a stall, no burst to catch up
+            time.sleep(max(0.0, next_sample - time.time()))
+    except KeyboardInterrupt:
+        if run is not None and not run.finished:
+            run.finish()
+    stop.set()
+    if switches:
+        print("%d switches, the device on the other server after %.2f s mean, %.2f s max"
+              % (len(switches), sum(switches) / len(switches), max(switches)))
+    if len(runs) > 1:
+        print()
+        print_table(runs, args.device)
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
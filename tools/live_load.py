@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+"""Load test of the live push (Server-Sent Events) endpoint.
+
+Opens --clients connections to http://<host>:81/: most of them read
+everything, --slow of them connect with a tiny receive buffer and never
+read. Over --duration seconds it checks, from the device's /metrics:
+- the fast readers receive every frame the device published,
+- the slow readers only cost dropped frames in their own queues,
+- the ingest path is unaffected (messages keep flowing, parse time).
+
+The device accepts at most LivePushServer::MAX_CLIENTS subscribers and the
+lwIP socket limit of the framework applies, extra connections are closed.
+
+/metrics needs the http.token setting of the device: pass it in the
+ELECTIME_TOKEN environment variable (also read by relay_probe.py and
+gridfreq_server.py).
+
+Usage: ELECTIME_TOKEN=<token> tools/live_load.py <device-ip> [--clients 8] [--slow 3] [--duration 60]
+"""
+
+import argparse
+import os
+import socket
+import threading
+import time
+import urllib.parse
+import urllib.request
+
+
+def metrics_url(host):
+    """/metrics of the device, with the token of ELECTIME_TOKEN."""
+    return "http://%s/metrics?token=%s" % (host, urllib.parse.quote(os.environ.get("ELECTIME_TOKEN", "")))
+
+
+def metrics(host):
+    values = {}
+    with urllib.request.urlopen(metrics_url(host), timeout=5) as response:
+        for line in response.read().decode().splitlines():
+            if line.startswith("#") or " " not in line:
+                continue
+            name, value = line.rsplit(" ", 1)
+            try:
+                values[name] = float(value)
+            except ValueError:
+                pass
+    return values
+
+
+def open_stream(host, port, rcvbuf=None):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    if rcvbuf:
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, rcvbuf)
+    sock.settimeout(10)
+    sock.connect((host, port))
+    sock.sendall(b"GET / HTTP/1.1\r\nHost: %s\r\nAccept: text/event-stream\r\n\r\n" % host.encode())
+    return sock
+
+
+class FastReader(threading.Thread):
+    def __init__(self, host, port, stop):
+        super().__init__(daemon=True)
+        self.host, self.port, self.stop = host, port, stop
+        self.events = 0
+        self.error = None
+
+    def run(self):
+        try:
+            sock = open_stream(self.host, self.port)
+            buffer = b""
+            while not self.stop.is_set():
+                try:
+                    chunk = sock.recv(4096)
+                except socket.timeout:
+                    continue
+                if not chunk:
+                    self.error = "closed by device"
+                    return
+                buffer += chunk
+                while b"\n\n" in buffer:
+                    block, buffer = buffer.split(b"\n\n", 1)
+                    if b"data: " in block:
+                        self.events += 1
+            sock.close()
+        except OSError as e:
+            self.error = str(e)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=81)
+    parser.add_argument("--clients", type=int, default=8, help="total subscribers")
+    parser.add_argument("--slow", type=int, default=3, help="subscribers that never read")
+    parser.add_argument("--duration", type=float, default=60.0)
+    args = parser.parse_args()
+
+    before = metrics(args.host)
+    stop = threading.Event()
+    slow = [open_stream(args.host, args.port, rcvbuf=1024) for _ in range(args.slow)]
+    fast = [FastReader(args.host, args.port, stop) for _ in range(args.clients - args.slow)]
+    for reader in fast:
+        reader.start()
+    time.sleep(1.0)  # let the subscriptions settle before counting
+    start = metrics(args.host)
+    time.sleep(args.duration)
+    end = metrics(args.host)
+    stop.set()
+    for reader in fast:
+        reader.join(timeout=15)
+    for sock in slow:
+        sock.close()
+
+    def delta(name, a=start, b=end):
+        return b.get(name, 0) - a.get(name, 0)
+
+    published = delta("live_frames_total")
+    print("frames published: %d, dropped in slow queues: %d, pool exhausted: %d"
+          % (published, delta("live_frames_dropped_total"), delta("live_pool_exhausted_total")))
+    ok = True
+    for i, reader in enumerate(fast):
+        status = reader.error or "ok"
+        # readers connected before the window, they may count a few more
+        if reader.events < published:
+            status = "MISSED %d frames" % (published - reader.events)
+            ok = False
+        print("  fast reader %d: %d events (%s)" % (i, reader.events, status))
+
+    def parse_mean(a, b):
+        count = b.get("ingest_parse_us_count", 0) - a.get("ingest_parse_us_count", 0)
+        return (b.get("ingest_parse_us_sum", 0) - a.get("ingest_parse_us_sum", 0)) / count if count else 0.0
+
+    messages = delta("ingest_messages_total")
+    print("ingest: %d messages during the test, parse %.0f us on average before vs %.0f us during"
+          % (messages, parse_mean({}, before), parse_mean(start, end)))
+    if messages == 0:
+        print("  no ingest traffic, is the device connected to a GridFreqMonitor server?")
+        ok = False
+    print("PASS" if ok else "FAIL")
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -0,0 +1,269 @@
+#!/usr/bin/env python3
+"""Host replay benchmark of the needle positioning.
+
+Replays a sample series through a model of the ingest path and of the
+needle, once with the direct mapping (the needle is sent to the frequency
+of each sample) and once with the predictive stage of
+src/needle_predictor.h (alpha-beta trend, extrapolated by the sample age
+plus the motor lead). The needle follows SwitecX12::planStep() with the
+default acceleration table, retargeted on every sample like on the device.
+
+Reported, against the frequency the grid really had at each instant:
+  lag        time shift that best aligns the needle with the grid
+  rms        remaining error after the needle, in steps and mHz
+  overshoot  largest excursion of the needle beyond anything the grid did
+             in the preceding 5 s
+
+Samples come either from a trace downloaded from the device
+(http://<device-ip>/trace, the time_stamp and receive time of each sample
+give the network delay) or from a synthetic grid: slow random walk, ramps
+at the quarter hours, measurement noise, 1 s samples and a jittered delay.
+
+Usage: tools/needle_replay.py [--trace trace.bin] [--alpha 0.9] [--beta 0.4]
+                              [--motor-lead 250] [--minutes 30] [--seed 1]
+"""
+
+import argparse
+import bisect
+import math
+import random
+import struct
+
+from accel_tuner import DEFAULT_TABLE, TIMER_INTERVAL_US, frequency_to_step, STEP_MAX, STEP_MIN, FREQ_MAX, FREQ_MIN
+
+STEPS_PER_MHZ = (STEP_MAX - STEP_MIN) / ((FREQ_MAX - FREQ_MIN) * 1000)
+
+# NeedlePredictor constants (src/needle_predictor.h)
+RESET_GAP_MS = 10000
+MAX_TREND_HZ_S = 0.05
+MAX_EXTRAPOLATION_HZ = 0.03
+MAX_AGE_MS = 3000  # main.cpp: older samples are led by the motor lead only
+
+
+def clamp(value, limit):
+    return max(-limit, min(limit, value))
+
+
+class Predictor:
+    """Mirror of NeedlePredictor."""
+
+    def __init__(self, alpha, beta):
+        self.alpha, self.beta = alpha, beta
+        self.last_ms = None
+        self.frequency = 0.0
+        self.trend = 0.0
+
+    def add(self, time_ms, frequency):
+        if self.last_ms is not None and time_ms <= self.last_ms and self.last_ms - time_ms < RESET_GAP_MS:
+            return
+        if self.last_ms is None or time_ms <= self.last_ms or time_ms - self.last_ms > RESET_GAP_MS:
+            self.frequency, self.trend = frequency, 0.0
+        else:
+            dt = (time_ms - self.last_ms) / 1000.0
+            predicted = self.frequency + self.trend * dt
+            residual = frequency - predicted
+            self.frequency = predicted + self.alpha * residual
+            self.trend = clamp(self.trend + self.beta * residual / dt, MAX_TREND_HZ_S)
+        self.last_ms = time_ms
+
+    def predict(self, lead_ms):
+        return self.frequency + clamp(self.trend * lead_ms / 1000.0, MAX_EXTRAPOLATION_HZ)
+
+
+class Needle:
+    """SwitecX12 stepping (planStep) with retargeting, times in us."""
+
+    def __init__(self, step):
+        self.current = self.target = step
+        self.vel, self.dir = 0, 0
+        self.stopped = True
+        self.next_us = 0
+        self.max_vel = DEFAULT_TABLE[-1][0]
+
+    def set_target(self, step, now_us):
+        self.target = step
+        if self.stopped:
+            self.stopped = False
+            self.vel = 0
+            self.next_us = now_us + TIMER_INTERVAL_US
+
+    def run_until(self, end_us, trail):
+        """Steps up to end_us, appending (time_us, step) to trail."""
+        while not self.stopped and self.next_us <= end_us:
+            if self.current == self.target and self.vel == 0:
+                self.stopped, self.dir = True, 0
+                return
+            if self.vel == 0:
+                self.dir = 1 if self.current < self.target else -1
+                self.vel = 1
+            self.current += self.dir
+            trail.append((self.next_us, self.current))
+            delta = self.target - self.current if self.dir > 0 else self.current - self.target
+            if delta > 0:
+                if delta < self.vel:
+                    self.vel -= 1
+                elif self.vel < self.max_vel:
+                    self.vel += 1
+            else:
+                self.vel -= 1
+            i = 0
+            while i < len(DEFAULT_TABLE) - 1 and DEFAULT_TABLE[i][0] < self.vel:
+                i += 1
+            self.next_us += DEFAULT_TABLE[i][1]
+
+
+def synthetic(minutes, seed):
+    """Returns (truth(t_ms), samples [(time_stamp_ms, receive_ms, frequency)])."""
+    rng = random.Random(seed)
+    duration_ms = minutes * 60000
+    # truth on a 100 ms grid: random walk of the trend, ramps at the quarter hours
+    grid = []
+    f, trend, ramp = 50.0, 0.0, 0.0
+    for t in range(0, duration_ms + 1, 100):
+        if t % 900000 == 0:
+            ramp = rng.choice((1, -1)) * 0.001  # Hz/s during the first minute
+        trend = 0.995 * trend + rng.gauss(0, 0.0004)
+        f += (trend + (ramp if t % 900000 < 60000 else 0.0)) * 0.1
+        f += (50.0 - f) * 0.0005
+        f = min(max(f, 49.85), 50.15)
+        grid.append(f)
+
+    def truth(t_ms):
+        i = min(max(int(t_ms // 100), 0), len(grid) - 2)
+        frac = (t_ms - i * 100) / 100.0
+        return grid[i] + (grid[i + 1] - grid[i]) * frac
+
+    samples = []
+    for ts in range(1000, duration_ms, 1000):
+        delay = max(20, rng.gauss(180, 60))
+        samples.append((ts, ts + delay, round(truth(ts) + rng.gauss(0, 0.0015), 3)))
+    return truth, samples
+
+
+def read_varint(data, pos):
+    value = shift = 0
+    while True:
+        b = data[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            return value, pos
+
+
+def unzigzag(v):
+    return (v >> 1) ^ -(v & 1)
+
+
+def read_trace(path):
+    """Samples of a /trace download (see README, Diagnostics)."""
+    data = open(path, "rb").read()
+    samples = []
+    for off in range(0, len(data) - 255, 256):
+        page = data[off:off + 256]
+        if page[0] != 0xE7:
+            continue
+        count = page[1]
+        received, ts, mhz = struct.unpack_from("<QQi", page, 4)
+        records = [(received, ts, mhz)]
+        pos = 24
+        for _ in range(count - 1):
+            deltas = []
+            for _ in range(3):
+                v, pos = read_varint(page, pos)
+                deltas.append(unzigzag(v))
+            received, ts, mhz = received + deltas[0], ts + deltas[1], mhz + deltas[2]
+            records.append((received, ts, mhz))
+        for received, ts, mhz in records:
+            ts_ms = ts * 1000 if ts < 100000000000 else ts
+            samples.append((ts_ms, received, mhz / 1000.0))
+    samples.sort()
+    if not samples:
+        raise SystemExit("no samples in %s" % path)
+    # received times are on the device clock: keep the delays, start at 0
+    base = samples[0][0]
+    samples = [(ts - base, received - base, f) for ts, received, f in samples]
+    times = [s[0] for s in samples]
+    values = [s[2] for s in samples]
+
+    def truth(t_ms):
+        i = bisect.bisect_right(times, t_ms)
+        if i == 0:
+            return values[0]
+        if i == len(times):
+            return values[-1]
+        frac = (t_ms - times[i - 1]) / float(times[i] - times[i - 1])
+        return values[i - 1] + (values[i] - values[i - 1]) * frac
+
+    return truth, samples
+
+
+def replay(samples, predictor, motor_lead_ms):
+    """Needle trail [(time_us, step)] for the samples in arrival order."""
+    arrivals = sorted(samples, key=lambda s: s[1])
+    needle = Needle(frequency_to_step(arrivals[0][2]))
+    trail = [(0, needle.current)]
+    for ts, received, f in arrivals:
+        now_us = int(received * 1000)
+        needle.run_until(now_us, trail)
+        target = f
+        if predictor is not None:
+            predictor.add(ts, f)
+            age = received - ts
+            lead = motor_lead_ms + (age if 0 <= age <= MAX_AGE_MS else 0)
+            target = predictor.predict(lead)
+        needle.set_target(frequency_to_step(target), now_us)
+    needle.run_until(int(arrivals[-1][1] * 1000) + 10000000, trail)
+    return trail
+
+
+def evaluate(trail, truth, start_ms, end_ms):
+    times = [t for t, _ in trail]
+    steps = [s for _, s in trail]
+
+    def needle_at(t_ms):
+        return steps[max(bisect.bisect_right(times, t_ms * 1000) - 1, 0)]
+
+    grid_ms = list(range(int(start_ms), int(end_ms), 50))
+    needle = [needle_at(t) for t in grid_ms]
+
+    def rms(shift_ms):
+        err = [needle[i] - frequency_to_step(truth(t - shift_ms)) for i, t in enumerate(grid_ms)]
+        return math.sqrt(sum(e * e for e in err) / len(err))
+
+    lag = min(range(0, 3001, 50), key=rms)
+
+    window = 5000 // 50
+    truth_steps = [frequency_to_step(truth(t)) for t in grid_ms]
+    overshoot = 0
+    for i in range(window, len(grid_ms)):
+        recent = truth_steps[i - window:i + 1]
+        overshoot = max(overshoot, needle[i] - max(recent), min(recent) - needle[i])
+    return lag, rms(0), overshoot
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--trace", help="trace downloaded from http://<device-ip>/trace (default: synthetic grid)")
+    parser.add_argument("--alpha", type=float, default=0.9, help="alpha of the estimate (main.cpp)")
+    parser.add_argument("--beta", type=float, default=0.4, help="beta of the estimate (main.cpp)")
+    parser.add_argument("--motor-lead", type=int, default=250, help="needle travel time added to the lead, ms")
+    parser.add_argument("--minutes", type=int, default=30, help="length of the synthetic series")
+    parser.add_argument("--seed", type=int, default=1, help="seed of the synthetic series")
+    args = parser.parse_args()
+
+    truth, samples = read_trace(args.trace) if args.trace else synthetic(args.minutes, args.seed)
+    start_ms = samples[0][1] + 10000  # skip the first estimate
+    end_ms = samples[-1][0]
+    delays = sorted(s[1] - s[0] for s in samples)
+    print("%d samples, median delay %.0f ms" % (len(samples), delays[len(delays) // 2]))
+
+    for name, predictor in (("direct", None), ("predictive", Predictor(args.alpha, args.beta))):
+        lag, error, overshoot = evaluate(replay(samples, predictor, args.motor_lead), truth, start_ms, end_ms)
+        print("  %-11s lag %5d ms   rms %6.1f steps (%5.2f mHz)   overshoot %4d steps (%5.2f mHz)"
+              % (name, lag, error, error / STEPS_PER_MHZ, overshoot, overshoot / STEPS_PER_MHZ))
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
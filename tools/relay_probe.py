@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+"""Measures a LAN relay group: server load, relay traffic and sample skew.
+
+Runs one process per device subscribed to its live push stream
+(http://<device>:81/) and one joined to the relay multicast group. Over
+--duration seconds it reports:
+- the role of each device and the upstream load: only relays connect to
+  the GridFreqMonitor servers, so the server sees one subscription per
+  relay instead of one per device,
+- the relay frames on the group (senders, samples, heartbeats, claims),
+- per sample, the spread of the arrival times across the devices
+  (p50 / p95 / max), the time a listener lags behind the relay,
+- sequence gaps and elections counted by the devices.
+
+Power off or disconnect the relay during a run to watch the re-election:
+the role changes and the samples missed while the group had no relay
+show up in the report.
+
+Usage: ELECTIME_TOKEN=<token> tools/relay_probe.py <device-ip> <device-ip> [...] [--duration 60]
+"""
+
+import argparse
+import json
+import multiprocessing
+import queue
+import socket
+import struct
+import time
+
+from live_load import metrics
+
+GROUP = "239.255.50.50"   # LanRelay in src/lan_relay.cpp
+PORT = 5050
+FRAME = struct.Struct("<2sBBIIQI")
+FRAME_TYPES = {1: "sample", 2: "heartbeat", 3: "claim"}
+ROLES = {0: "off", 1: "listener", 2: "candidate", 3: "relay"}
+
+
+def subscriber(host, port, results, deadline):
+    """Puts (host, time_stamp, arrival) for every sample event of a device."""
+    try:
+        sock = socket.create_connection((host, port), timeout=5)
+        sock.sendall(b"GET / HTTP/1.1\r\nHost: %s\r\nAccept: text/event-stream\r\n\r\n" % host.encode())
+        buffer = b""
+        while time.time() < deadline:
+            try:
+                chunk = sock.recv(4096)
+            except socket.timeout:
+                continue
+            if not chunk:
+                break
+            arrival = time.time()
+            buffer += chunk
+            while b"\n\n" in buffer:
+                block, buffer = buffer.split(b"\n\n", 1)
+                if b"event:" in block or b"data: " not in block:
+                    continue  # stats events
+                try:
+                    sample = json.loads(block.split(b"data: ", 1)[1])
+                except ValueError:
+                    continue
+                results.put((host, sample["time_stamp"], arrival))
+        sock.close()
+    except OSError as e:
+        results.put((host, None, str(e)))
+
+
+def sniffer(results, deadline):
+    """Puts (sender, type, seq) for every frame on the relay group."""
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(("", PORT))
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP,
+                    struct.pack("4s4s", socket.inet_aton(GROUP), socket.inet_aton("0.0.0.0")))
+    sock.settimeout(0.5)
+    while time.time() < deadline:
+        try:
+            data = sock.recv(64)
+        except socket.timeout:
+            continue
+        if len(data) != FRAME.size:
+            continue
+        magic, version, kind, sender, seq, _, _ = FRAME.unpack(data)
+        if magic == b"ER" and version == 1:
+            results.put((sender, kind, seq))
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(p * len(values)))] if values else 0.0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("hosts", nargs="+")
+    parser.add_argument("--port", type=int, default=81)
+    parser.add_argument("--duration", type=float, default=60.0)
+    args = parser.parse_args()
+
+    before = {host: metrics(host) for host in args.hosts}
+    deadline = time.time() + args.duration
+    samples = multiprocessing.Queue()
+    frames = multiprocessing.Queue()
+    workers = [multiprocessing.Process(target=subscriber, args=(host, args.port, samples, deadline))
+               for host in args.hosts]
+    workers.append(multiprocessing.Process(target=sniffer, args=(frames, deadline)))
+    for worker in workers:
+        worker.start()
+
+    arrivals = {}   # time_stamp -> {host: arrival}
+    group = {}      # sender -> {frame type: count}
+    while any(worker.is_alive() for worker in workers) or not samples.empty() or not frames.empty():
+        try:
+            host, stamp, arrival = samples.get(timeout=0.2)
+            if stamp is None:
+                print("  %s: %s" % (host, arrival))
+            else:
+                arrivals.setdefault(stamp, {})[host] = arrival
+        except queue.Empty:
+            pass
+        while not frames.empty():
+            sender, kind, _ = frames.get()
+            counts = group.setdefault(sender, {})
+            counts[kind] = counts.get(kind, 0) + 1
+    after = {host: metrics(host) for host in args.hosts}
+
+    def delta(host, name):
+        return after[host].get(name, 0) - before[host].get(name, 0)
+
+    print("devices:")
+    relays = 0
+    for host in args.hosts:
+        role = ROLES.get(int(after[host].get("relay_role", 0)), "?")
+        relays += role in ("relay", "off")
+        print("  %-15s %-9s ingest %4d messages, relayed in %4d, gaps %d, elections %d"
+              % (host, role, delta(host, "ingest_messages_total"), delta(host, "relay_frames_received_total"),
+                 delta(host, "relay_sample_gaps_total"), delta(host, "relay_elections_total")))
+    print("server load: %d upstream subscription(s) for %d devices" % (relays, len(args.hosts)))
+
+    print("relay group %s:%d:" % (GROUP, PORT))
+    for sender, counts in sorted(group.items()):
+        print("  node %08x: %s" % (sender, ", ".join("%d %s" % (n, FRAME_TYPES.get(kind, kind))
+                                                     for kind, n in sorted(counts.items()))))
+
+    complete = [a for a in arrivals.values() if len(a) == len(args.hosts)]
+    spreads = [1000.0 * (max(a.values()) - min(a.values())) for a in complete]
+    print("samples: %d seen, %d by every device" % (len(arrivals), len(complete)))
+    if spreads:
+        print("  skew across devices: p50 %.1f ms, p95 %.1f ms, max %.1f ms"
+              % (percentile(spreads, 0.5), percentile(spreads, 0.95), max(spreads)))
+    for host in args.hosts:
+        missing = sum(1 for a in arrivals.values() if host not in a)
+        if missing:
+            print("  %s missed %d samples" % (host, missing))
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())